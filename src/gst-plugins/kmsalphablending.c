@@ -19,6 +19,7 @@
 #endif
 
 #include "kmsalphablending.h"
+#include "kmscompositor.h"
 #include <commons/kmsagnosticcaps.h>
 #include <commons/kms-core-marshal.h>
 #include <commons/kmshubport.h>
@@ -28,6 +29,9 @@
 
 #define PLUGIN_NAME "alphablending"
 
+#define DEFAULT_FRAME_RATE 15
+#define DEFAULT_PER_PIXEL_ALPHA FALSE
+
 #define KMS_ALPHA_BLENDING_LOCK(mixer) \
   (g_rec_mutex_lock (&( (KmsAlphaBlending *) mixer)->priv->mutex))
 
@@ -88,6 +92,8 @@ enum
 {
   PROP_0,
   PROP_SET_MASTER,
+  PROP_FRAME_RATE,
+  PROP_PER_PIXEL_ALPHA,
   N_PROPERTIES
 };
 
@@ -103,8 +109,6 @@ struct _KmsAlphaBlendingPrivate
 {
   GstElement *videomixer;
   GstElement *audiomixer;
-  GstElement *videotestsrc;
-  GstElement *videotestsrc_capsfilter;
   GHashTable *ports;
   GstElement *mixer_audio_agnostic;
   GstElement *mixer_video_agnostic;
@@ -114,6 +118,8 @@ struct _KmsAlphaBlendingPrivate
   gint output_width, output_height;
   int master_port;
   int z_master;
+  gint frame_rate;
+  gboolean per_pixel_alpha;
 };
 
 /* class initialization */
@@ -123,6 +129,18 @@ G_DEFINE_TYPE_WITH_CODE (KmsAlphaBlending, kms_alpha_blending,
     GST_DEBUG_CATEGORY_INIT (kms_alpha_blending_debug_category, PLUGIN_NAME,
         0, "debug category for alphablending element"));
 
+/* Rectangle of a port on the output, as last set on its mixer pad */
+typedef struct _KmsAlphaBlendingGeometry
+{
+  gboolean valid;
+  gint x;
+  gint y;
+  gint width;
+  gint height;
+  gint z_order;
+  gdouble alpha;
+} KmsAlphaBlendingGeometry;
+
 typedef struct _KmsAlphaBlendingData
 {
   KmsRefStruct parent;
@@ -136,10 +154,7 @@ typedef struct _KmsAlphaBlendingData
   KmsAlphaBlending *mixer;
   GstElement *videoconvert;
   GstElement *capsfilter;
-  GstElement *videoscale;
   GstElement *queue;
-  GstElement *videorate;
-  GstElement *videobox;
   GstPad *video_mixer_pad;
   GstPad *videoconvert_sink_pad;
   gfloat relative_x;
@@ -147,6 +162,7 @@ typedef struct _KmsAlphaBlendingData
   gfloat relative_width;
   gfloat relative_height;
   gint z_order;
+  KmsAlphaBlendingGeometry applied;
 } KmsAlphaBlendingData;
 
 #define KMS_ALPHA_BLENDING_REF(data) \
@@ -178,107 +194,93 @@ compare_port_data (KmsAlphaBlendingData * a, KmsAlphaBlendingData * b)
   return a->id - b->id;
 }
 
+/* Formats the compositor blends without converting them first */
+static GstCaps *
+kms_alpha_blending_create_port_caps (KmsAlphaBlending * self)
+{
+  if (self->priv->per_pixel_alpha) {
+    return gst_caps_from_string ("video/x-raw, format=(string)AYUV");
+  }
+
+  return gst_caps_from_string ("video/x-raw, format=(string){ I420, NV12 }");
+}
+
+/* Sets the geometry on the mixer pad unless it is already there */
 static void
-configure_port (KmsAlphaBlendingData * port_data)
+kms_alpha_blending_apply_geometry (KmsAlphaBlendingData * port_data,
+    gint x, gint y, gint width, gint height, gint z_order, gdouble alpha)
 {
-  KmsAlphaBlending *mixer = port_data->mixer;
-  GstCaps *filtercaps;
+  KmsAlphaBlendingGeometry *applied = &port_data->applied;
 
-  if (port_data->configured) {
-    gint _relative_x, _relative_y, _relative_width, _relative_height;
-
-    _relative_x = port_data->relative_x * mixer->priv->output_width;
-    _relative_y = port_data->relative_y * mixer->priv->output_height;
-    _relative_width = port_data->relative_width * mixer->priv->output_width;
-    _relative_height = port_data->relative_height * mixer->priv->output_height;
-
-    filtercaps =
-        gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "AYUV",
-        "width", G_TYPE_INT, _relative_width, "height",
-        G_TYPE_INT, _relative_height, "framerate", GST_TYPE_FRACTION, 15, 1,
-        NULL);
-
-    if (port_data->videobox != NULL) {
-      int left = 0;
-      int right = 0;
-      int top = 0;
-      int bottom = 0;
-
-      if (_relative_x > 0) {
-        int width_size =
-            (mixer->priv->output_width - (mixer->priv->output_width -
-                _relative_x));
-        if (_relative_width > width_size) {
-          right = (_relative_width - width_size);
-        }
-      } else {
-        left = -1 * _relative_x;
-        if ((_relative_width - left) > mixer->priv->output_width) {
-          right = (_relative_width - left) - mixer->priv->output_width;
-        }
-      }
+  if (port_data->video_mixer_pad == NULL) {
+    return;
+  }
 
-      if (_relative_y > 0) {
-        int height_size =
-            (mixer->priv->output_height - (mixer->priv->output_height -
-                _relative_y));
-        if (_relative_height > height_size) {
-          bottom = (_relative_height - height_size);
-        }
-      } else {
-        top = -1 * _relative_y;
-        if ((_relative_height - top) > mixer->priv->output_height) {
-          bottom = (_relative_height - top) - mixer->priv->output_height;
-        }
-      }
-      g_object_set (port_data->videobox, "right", right, "left", left, "top",
-          top, "bottom", bottom, NULL);
-    }
+  if (applied->valid && applied->x == x && applied->y == y
+      && applied->width == width && applied->height == height
+      && applied->z_order == z_order && applied->alpha == alpha) {
+    GST_LOG ("Port %d geometry unchanged", port_data->id);
+    return;
+  }
 
-    if (port_data->video_mixer_pad != NULL) {
-      int aux_x = _relative_x;
-      int aux_y = _relative_y;
+  GST_DEBUG ("Port %d at %dx%d+%d+%d z %d", port_data->id, width, height, x,
+      y, z_order);
 
-      if (aux_x < 0) {
-        aux_x = 0;
-      }
+  g_object_set (port_data->video_mixer_pad, "xpos", x, "ypos", y,
+      "width", width, "height", height, "zorder", z_order, "alpha", alpha,
+      NULL);
 
-      if (aux_y < 0) {
-        aux_y = 0;
-      }
+  applied->valid = TRUE;
+  applied->x = x;
+  applied->y = y;
+  applied->width = width;
+  applied->height = height;
+  applied->z_order = z_order;
+  applied->alpha = alpha;
+}
 
-      g_object_set (port_data->video_mixer_pad, "xpos", aux_x, "ypos", aux_y,
-          "zorder", port_data->z_order, "alpha", 1.0, NULL);
-    }
+static void
+configure_port (KmsAlphaBlendingData * port_data)
+{
+  KmsAlphaBlending *mixer = port_data->mixer;
+  gint x = 0, y = 0, z_order = 1;
+  gint width = mixer->priv->output_width;
+  gint height = mixer->priv->output_height;
 
-  } else {
-    filtercaps =
-        gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "AYUV",
-        "width", G_TYPE_INT, mixer->priv->output_width, "height",
-        G_TYPE_INT, mixer->priv->output_height,
-        "framerate", GST_TYPE_FRACTION, 15, 1, NULL);
-    if (port_data->video_mixer_pad != NULL) {
-      g_object_set (port_data->video_mixer_pad, "xpos", 0, "ypos", 0, "alpha",
-          1.0, "zorder", 1, NULL);
-    }
+  if (port_data->video_mixer_pad == NULL) {
+    return;
   }
 
-  if (port_data->capsfilter != NULL) {
-    g_object_set (G_OBJECT (port_data->capsfilter), "caps", filtercaps, NULL);
+  if (port_data->configured) {
+    x = port_data->relative_x * mixer->priv->output_width;
+    y = port_data->relative_y * mixer->priv->output_height;
+    width = port_data->relative_width * mixer->priv->output_width;
+    height = port_data->relative_height * mixer->priv->output_height;
+    z_order = port_data->z_order;
   }
 
-  gst_caps_unref (filtercaps);
+  /* the compositor scales the input into this rectangle and clips what */
+  /* falls outside of the output, so no caps are renegotiated */
+  kms_alpha_blending_apply_geometry (port_data, x, y, MAX (width, 1),
+      MAX (height, 1), z_order, 1.0);
 }
 
 static void
 kms_alpha_blending_reconfigure_ports (KmsAlphaBlending * self)
 {
-  GstCaps *filtercaps;
   GList *l;
-  GList *values = g_hash_table_get_values (self->priv->ports);
+  GList *values;
 
+  if (self->priv->videomixer == NULL) {
+    return;
+  }
+
+  values = g_hash_table_get_values (self->priv->ports);
   values = g_list_sort (values, (GCompareFunc) compare_port_data);
 
+  /* every output frame shows either the old layout or the new one */
+  kms_compositor_begin_layout (KMS_COMPOSITOR (self->priv->videomixer));
+
   for (l = values; l != NULL; l = l->next) {
     KmsAlphaBlendingData *port_data = l->data;
 
@@ -287,35 +289,20 @@ kms_alpha_blending_reconfigure_ports (KmsAlphaBlending * self)
     }
 
     if (port_data->id == self->priv->master_port) {
-      filtercaps =
-          gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "AYUV",
-          "width", G_TYPE_INT, self->priv->output_width, "height",
-          G_TYPE_INT, self->priv->output_height, NULL);
-
-      if (port_data->capsfilter != NULL) {
-        g_object_set (G_OBJECT (port_data->capsfilter), "caps", filtercaps,
-            NULL);
-      }
-
-      if (port_data->video_mixer_pad != NULL) {
-        g_object_set (port_data->video_mixer_pad, "xpos", 0, "ypos", 0, "alpha",
-            1.0, "zorder", self->priv->z_master, NULL);
-      }
+      kms_alpha_blending_apply_geometry (port_data, 0, 0,
+          self->priv->output_width, self->priv->output_height,
+          self->priv->z_master, 1.0);
     } else {
       configure_port (port_data);
     }
   }
 
   g_list_free (values);
-  //reconfigure videotestsrc input
-  filtercaps =
-      gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "AYUV",
-      "width", G_TYPE_INT, self->priv->output_width, "height",
-      G_TYPE_INT, self->priv->output_height, "framerate", GST_TYPE_FRACTION, 15,
-      1, NULL);
-  g_object_set (G_OBJECT (self->priv->videotestsrc_capsfilter), "caps",
-      filtercaps, NULL);
-  gst_caps_unref (filtercaps);
+  //reconfigure output size, only renegotiated when it changed
+  g_object_set (G_OBJECT (self->priv->videomixer), "width",
+      self->priv->output_width, "height", self->priv->output_height, NULL);
+
+  kms_compositor_end_layout (KMS_COMPOSITOR (self->priv->videomixer));
 }
 
 static void
@@ -346,6 +333,7 @@ kms_alpha_blending_set_master_port (KmsAlphaBlending * alpha_blending)
         gst_structure_get_int (str, "height", &height)) {
       port_data->mixer->priv->output_height = height;
       port_data->mixer->priv->output_width = width;
+      /* only the ports whose rectangle changed are touched */
       kms_alpha_blending_reconfigure_ports (alpha_blending);
     }
     gst_caps_unref (caps);
@@ -353,6 +341,35 @@ kms_alpha_blending_set_master_port (KmsAlphaBlending * alpha_blending)
   g_object_unref (pad);
 }
 
+/* Only for a format change, the layout never touches the port caps. */
+/* Each capsfilter applies the new caps on its next buffer, so the ports */
+/* switch one at a time. The compositor takes inputs with and without */
+/* alpha side by side meanwhile. */
+static void
+kms_alpha_blending_update_port_caps (KmsAlphaBlending * self)
+{
+  GstCaps *caps;
+  GHashTableIter iter;
+  gpointer value;
+
+  if (self->priv->videomixer == NULL) {
+    return;
+  }
+
+  caps = kms_alpha_blending_create_port_caps (self);
+
+  g_hash_table_iter_init (&iter, self->priv->ports);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    KmsAlphaBlendingData *port_data = value;
+
+    if (port_data->capsfilter != NULL) {
+      g_object_set (G_OBJECT (port_data->capsfilter), "caps", caps, NULL);
+    }
+  }
+
+  gst_caps_unref (caps);
+}
+
 static void
 kms_alpha_blending_set_property (GObject * object, guint property_id,
     const GValue * value, GParamSpec * pspec)
@@ -376,6 +393,22 @@ kms_alpha_blending_set_property (GObject * object, guint property_id,
       gst_structure_free (master);
       break;
     }
+    case PROP_FRAME_RATE:
+      self->priv->frame_rate = g_value_get_int (value);
+      if (self->priv->videomixer != NULL) {
+        g_object_set (self->priv->videomixer, "frame-rate",
+            self->priv->frame_rate, NULL);
+      }
+      break;
+    case PROP_PER_PIXEL_ALPHA:{
+      gboolean per_pixel_alpha = g_value_get_boolean (value);
+
+      if (per_pixel_alpha != self->priv->per_pixel_alpha) {
+        self->priv->per_pixel_alpha = per_pixel_alpha;
+        kms_alpha_blending_update_port_caps (self);
+      }
+      break;
+    }
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -404,6 +437,12 @@ kms_alpha_blending_get_property (GObject * object, guint property_id,
       gst_structure_free (data);
       break;
     }
+    case PROP_FRAME_RATE:
+      g_value_set_int (value, self->priv->frame_rate);
+      break;
+    case PROP_PER_PIXEL_ALPHA:
+      g_value_set_boolean (value, self->priv->per_pixel_alpha);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -416,13 +455,12 @@ static gboolean
 remove_elements_from_pipeline (KmsAlphaBlendingData * port_data)
 {
   KmsAlphaBlending *self = port_data->mixer;
-  GstElement *videoconvert, *videoscale, *videorate, *capsfilter, *queue,
-      *videobox;
+  GstElement *videoconvert, *capsfilter, *queue;
 
   KMS_ALPHA_BLENDING_LOCK (self);
 
-  videobox = port_data->videobox;
-  gst_element_unlink (videobox, self->priv->videomixer);
+  queue = port_data->queue;
+  gst_element_unlink (queue, self->priv->videomixer);
 
   if (port_data->video_mixer_pad != NULL) {
     gst_element_release_request_pad (self->priv->videomixer,
@@ -432,42 +470,29 @@ remove_elements_from_pipeline (KmsAlphaBlendingData * port_data)
   }
 
   videoconvert = g_object_ref (port_data->videoconvert);
-  videorate = g_object_ref (port_data->videorate);
-  queue = g_object_ref (port_data->queue);
-  videoscale = g_object_ref (port_data->videoscale);
   capsfilter = g_object_ref (port_data->capsfilter);
-  g_object_ref (videobox);
+  g_object_ref (queue);
 
   g_object_unref (port_data->videoconvert_sink_pad);
 
   port_data->videoconvert_sink_pad = NULL;
   port_data->videoconvert = NULL;
-  port_data->videorate = NULL;
-  port_data->queue = NULL;
-  port_data->videoscale = NULL;
   port_data->capsfilter = NULL;
-  port_data->videobox = NULL;
+  port_data->queue = NULL;
 
-  gst_bin_remove_many (GST_BIN (self), videoconvert, videoscale, capsfilter,
-      videorate, queue, videobox, NULL);
+  gst_bin_remove_many (GST_BIN (self), videoconvert, capsfilter, queue, NULL);
 
   kms_base_hub_unlink_video_src (KMS_BASE_HUB (self), port_data->id);
 
   KMS_ALPHA_BLENDING_UNLOCK (self);
 
   gst_element_set_state (videoconvert, GST_STATE_NULL);
-  gst_element_set_state (videoscale, GST_STATE_NULL);
-  gst_element_set_state (videorate, GST_STATE_NULL);
   gst_element_set_state (capsfilter, GST_STATE_NULL);
   gst_element_set_state (queue, GST_STATE_NULL);
-  gst_element_set_state (videobox, GST_STATE_NULL);
 
   g_object_unref (videoconvert);
-  g_object_unref (videoscale);
-  g_object_unref (videorate);
   g_object_unref (capsfilter);
   g_object_unref (queue);
-  g_object_unref (videobox);
 
   return G_SOURCE_REMOVE;
 }
@@ -528,12 +553,12 @@ kms_alpha_blending_port_data_destroy (KmsAlphaBlendingData * port_data)
     gboolean result;
     GstPad *pad;
 
-    if (port_data->videorate == NULL) {
+    if (port_data->capsfilter == NULL) {
       KMS_ALPHA_BLENDING_UNLOCK (self);
       return;
     }
 
-    pad = gst_element_get_static_pad (port_data->videorate, "sink");
+    pad = gst_element_get_static_pad (port_data->capsfilter, "sink");
 
     if (pad == NULL) {
       KMS_ALPHA_BLENDING_UNLOCK (self);
@@ -558,7 +583,7 @@ kms_alpha_blending_port_data_destroy (KmsAlphaBlendingData * port_data)
         GST_WARNING ("EOS event did not send");
       }
 
-      gst_element_unlink (port_data->videoconvert, port_data->videorate);
+      gst_element_unlink (port_data->videoconvert, port_data->capsfilter);
       g_object_unref (pad);
 
       KMS_ALPHA_BLENDING_UNLOCK (self);
@@ -569,7 +594,7 @@ kms_alpha_blending_port_data_destroy (KmsAlphaBlendingData * port_data)
       /* so we have to remove elements to avoid memory leaks. */
       remove = port_data->eos_managed;
 
-      gst_element_unlink (port_data->videoconvert, port_data->videorate);
+      gst_element_unlink (port_data->videoconvert, port_data->capsfilter);
       g_object_unref (pad);
 
       KMS_ALPHA_BLENDING_UNLOCK (self);
@@ -620,6 +645,7 @@ link_to_videomixer (GstPad * pad, GstPadProbeInfo * info,
 {
   GstPadTemplate *sink_pad_template;
   KmsAlphaBlending *mixer = data->mixer;
+  GstCaps *port_caps;
 
   if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) != GST_EVENT_CAPS) {
     return GST_PAD_PROBE_PASS;
@@ -663,80 +689,41 @@ link_to_videomixer (GstPad * pad, GstPadProbeInfo * info,
     }
   }
 
-  if (mixer->priv->videotestsrc == NULL) {
-    GstCaps *filtercaps;
-    GstPad *pad;
-
-    mixer->priv->videotestsrc = gst_element_factory_make ("videotestsrc", NULL);
-    mixer->priv->videotestsrc_capsfilter =
-        gst_element_factory_make ("capsfilter", NULL);
-
-    g_object_set (mixer->priv->videotestsrc, "is-live", TRUE, "pattern",
-        /*black */ 2, NULL);
-
-    filtercaps =
-        gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "AYUV",
-        "width", G_TYPE_INT, mixer->priv->output_width,
-        "height", G_TYPE_INT, mixer->priv->output_height,
-        "framerate", GST_TYPE_FRACTION, 15, 1, NULL);
-    g_object_set (G_OBJECT (mixer->priv->videotestsrc_capsfilter), "caps",
-        filtercaps, NULL);
-    gst_caps_unref (filtercaps);
-
-    gst_bin_add_many (GST_BIN (mixer), mixer->priv->videotestsrc,
-        mixer->priv->videotestsrc_capsfilter, NULL);
-
-    gst_element_link (mixer->priv->videotestsrc,
-        mixer->priv->videotestsrc_capsfilter);
-
-    /*link capsfilter -> videomixer */
-    pad = gst_element_request_pad (mixer->priv->videomixer,
-        sink_pad_template, NULL, NULL);
-    gst_element_link_pads (mixer->priv->videotestsrc_capsfilter, NULL,
-        mixer->priv->videomixer, GST_OBJECT_NAME (pad));
-    g_object_set (pad, "xpos", 0, "ypos", 0, "alpha", 0.0, "zorder", 0, NULL);
-    g_object_unref (pad);
-
-    gst_element_sync_state_with_parent (mixer->priv->videotestsrc_capsfilter);
-    gst_element_sync_state_with_parent (mixer->priv->videotestsrc);
-  }
-
-  data->videoscale = gst_element_factory_make ("videoscale", NULL);
+  /* crop, scale and rate adaptation all happen in the compositor, in */
+  /* the same pass that blends the input. videoconvert only works when */
+  /* the input is in a format the compositor does not take. */
   data->capsfilter = gst_element_factory_make ("capsfilter", NULL);
-  data->videorate = gst_element_factory_make ("videorate", NULL);
   data->queue = gst_element_factory_make ("queue", NULL);
-  data->videobox = gst_element_factory_make ("videobox", NULL);
   data->input = TRUE;
 
-  gst_bin_add_many (GST_BIN (mixer), data->queue, data->videorate,
-      data->videoscale, data->capsfilter, data->videobox, NULL);
-
-  g_object_set (data->videorate, "average-period", 200 * GST_MSECOND, NULL);
+  port_caps = kms_alpha_blending_create_port_caps (mixer);
+  g_object_set (G_OBJECT (data->capsfilter), "caps-change-mode",
+      1 /*delayed */ , "caps", port_caps, NULL);
+  gst_caps_unref (port_caps);
   g_object_set (data->queue, "flush-on-eos", TRUE, NULL);
 
-  gst_element_link_many (data->videorate, data->queue, data->videoscale,
-      data->capsfilter, data->videobox, NULL);
+  gst_bin_add_many (GST_BIN (mixer), data->capsfilter, data->queue, NULL);
 
-  /*link capsfilter -> videomixer */
+  gst_element_link (data->capsfilter, data->queue);
+
+  /*link queue -> videomixer */
   data->video_mixer_pad =
       gst_element_request_pad (mixer->priv->videomixer,
       sink_pad_template, NULL, NULL);
 
-  gst_element_link_pads (data->videobox, NULL,
+  gst_element_link_pads (data->queue, NULL,
       mixer->priv->videomixer, GST_OBJECT_NAME (data->video_mixer_pad));
+  data->applied.valid = FALSE;
 
-  gst_element_link (data->videoconvert, data->videorate);
+  gst_element_link (data->videoconvert, data->capsfilter);
 
   data->probe_id = gst_pad_add_probe (data->video_mixer_pad,
       GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
       (GstPadProbeCallback) cb_EOS_received,
       KMS_ALPHA_BLENDING_REF (data), (GDestroyNotify) kms_ref_struct_unref);
 
-  gst_element_sync_state_with_parent (data->videoscale);
   gst_element_sync_state_with_parent (data->capsfilter);
-  gst_element_sync_state_with_parent (data->videorate);
   gst_element_sync_state_with_parent (data->queue);
-  gst_element_sync_state_with_parent (data->videobox);
 
   /* configure videomixer pad */
   mixer->priv->n_elems++;
@@ -871,8 +858,11 @@ kms_alpha_blending_handle_port (KmsBaseHub * mixer,
     GstElement *videorate_mixer;
 
     videorate_mixer = gst_element_factory_make ("videorate", NULL);
-    self->priv->videomixer = gst_element_factory_make ("compositor", NULL);
-    g_object_set (G_OBJECT (self->priv->videomixer), "background", 1, NULL);
+    self->priv->videomixer = gst_element_factory_make ("yuvcompositor", NULL);
+    /* output timed by the compositor itself, even without inputs */
+    g_object_set (G_OBJECT (self->priv->videomixer), "background", 1,
+        "width", self->priv->output_width, "height", self->priv->output_height,
+        "frame-rate", self->priv->frame_rate, "live", TRUE, NULL);
     self->priv->mixer_video_agnostic =
         gst_element_factory_make ("agnosticbin", NULL);
 
@@ -960,7 +950,11 @@ kms_alpha_blending_set_port_properties (KmsAlphaBlending * self,
   port_data->z_order = z_order;
   port_data->configured = TRUE;
 
-  configure_port (port_data);
+  if (self->priv->videomixer != NULL) {
+    kms_compositor_begin_layout (KMS_COMPOSITOR (self->priv->videomixer));
+    configure_port (port_data);
+    kms_compositor_end_layout (KMS_COMPOSITOR (self->priv->videomixer));
+  }
 
   KMS_ALPHA_BLENDING_UNLOCK (self);
 }
@@ -1031,6 +1025,17 @@ kms_alpha_blending_class_init (KmsAlphaBlendingClass * klass)
           "Set the master port",
           GST_TYPE_STRUCTURE, (GParamFlags) G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, PROP_FRAME_RATE,
+      g_param_spec_int ("frame-rate", "Frame rate",
+          "Output frame rate, inputs are sampled at it", 1, G_MAXINT,
+          DEFAULT_FRAME_RATE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PER_PIXEL_ALPHA,
+      g_param_spec_boolean ("per-pixel-alpha", "Per pixel alpha",
+          "Blend inputs with their own alpha channel (AYUV), instead of "
+          "keeping them in I420 or NV12", DEFAULT_PER_PIXEL_ALPHA,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   /* Signals initialization */
   kms_alpha_blending_signals[SIGNAL_SET_PORT_PROPERTIES] =
       g_signal_new ("set-port-properties",
@@ -1057,6 +1062,8 @@ kms_alpha_blending_init (KmsAlphaBlending * self)
   self->priv->z_master = 5;
   self->priv->output_height = 480;
   self->priv->output_width = 640;
+  self->priv->frame_rate = DEFAULT_FRAME_RATE;
+  self->priv->per_pixel_alpha = DEFAULT_PER_PIXEL_ALPHA;
 
   self->priv->loop = kms_loop_new ();
 }
@@ -0,0 +1,232 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsblend.h"
+
+/* SSE2 and AVX2 code is built through function attributes, so the rest */
+/* of the plugin keeps its generic compiler flags */
+#if (defined (__x86_64__) || defined (__i386__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || \
+        (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define KMS_BLEND_X86 1
+#include <immintrin.h>
+#endif
+
+/* exact x / 255 for x in [0, 255 * 255] */
+#define DIV_255(x) (((x) + 128 + (((x) + 128) >> 8)) >> 8)
+
+static inline void
+kms_blend_over_scalar_loop (guint8 * dst, const guint8 * src,
+    const guint8 * alpha, gsize n)
+{
+  gsize i;
+
+  for (i = 0; i < n; i++) {
+    guint v = src[i] + DIV_255 (dst[i] * (255 - alpha[i]));
+
+    dst[i] = MIN (v, 255);
+  }
+}
+
+static void
+kms_blend_over_scalar (guint8 * dst, const guint8 * src, const guint8 * alpha,
+    gsize n)
+{
+  kms_blend_over_scalar_loop (dst, src, alpha, n);
+}
+
+#ifdef KMS_BLEND_X86
+
+__attribute__ ((target ("sse2")))
+static void
+kms_blend_over_sse2 (guint8 * dst, const guint8 * src, const guint8 * alpha,
+    gsize n)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i c255 = _mm_set1_epi16 (255);
+  const __m128i c128 = _mm_set1_epi16 (128);
+  gsize i;
+
+  for (i = 0; i + 16 <= n; i += 16) {
+    __m128i d = _mm_loadu_si128 ((const __m128i *) (dst + i));
+    __m128i s = _mm_loadu_si128 ((const __m128i *) (src + i));
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (alpha + i));
+    __m128i lo, hi;
+
+    lo = _mm_mullo_epi16 (_mm_unpacklo_epi8 (d, zero),
+        _mm_sub_epi16 (c255, _mm_unpacklo_epi8 (a, zero)));
+    hi = _mm_mullo_epi16 (_mm_unpackhi_epi8 (d, zero),
+        _mm_sub_epi16 (c255, _mm_unpackhi_epi8 (a, zero)));
+    lo = _mm_add_epi16 (lo, c128);
+    hi = _mm_add_epi16 (hi, c128);
+    lo = _mm_srli_epi16 (_mm_add_epi16 (lo, _mm_srli_epi16 (lo, 8)), 8);
+    hi = _mm_srli_epi16 (_mm_add_epi16 (hi, _mm_srli_epi16 (hi, 8)), 8);
+
+    _mm_storeu_si128 ((__m128i *) (dst + i), _mm_adds_epu8 (s,
+            _mm_packus_epi16 (lo, hi)));
+  }
+
+  kms_blend_over_scalar_loop (dst + i, src + i, alpha + i, n - i);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+kms_blend_over_avx2 (guint8 * dst, const guint8 * src, const guint8 * alpha,
+    gsize n)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i c255 = _mm256_set1_epi16 (255);
+  const __m256i c128 = _mm256_set1_epi16 (128);
+  gsize i;
+
+  /* unpack and pack work per 128 bits lane, so bytes keep their order */
+  for (i = 0; i + 32 <= n; i += 32) {
+    __m256i d = _mm256_loadu_si256 ((const __m256i *) (dst + i));
+    __m256i s = _mm256_loadu_si256 ((const __m256i *) (src + i));
+    __m256i a = _mm256_loadu_si256 ((const __m256i *) (alpha + i));
+    __m256i lo, hi;
+
+    lo = _mm256_mullo_epi16 (_mm256_unpacklo_epi8 (d, zero),
+        _mm256_sub_epi16 (c255, _mm256_unpacklo_epi8 (a, zero)));
+    hi = _mm256_mullo_epi16 (_mm256_unpackhi_epi8 (d, zero),
+        _mm256_sub_epi16 (c255, _mm256_unpackhi_epi8 (a, zero)));
+    lo = _mm256_add_epi16 (lo, c128);
+    hi = _mm256_add_epi16 (hi, c128);
+    lo = _mm256_srli_epi16 (_mm256_add_epi16 (lo, _mm256_srli_epi16 (lo, 8)),
+        8);
+    hi = _mm256_srli_epi16 (_mm256_add_epi16 (hi, _mm256_srli_epi16 (hi, 8)),
+        8);
+
+    _mm256_storeu_si256 ((__m256i *) (dst + i), _mm256_adds_epu8 (s,
+            _mm256_packus_epi16 (lo, hi)));
+  }
+
+  kms_blend_over_sse2 (dst + i, src + i, alpha + i, n - i);
+}
+
+#endif /* KMS_BLEND_X86 */
+
+static gboolean
+kms_blend_is_supported (KmsBlendImpl impl)
+{
+  switch (impl) {
+    case KMS_BLEND_IMPL_SCALAR:
+      return TRUE;
+#ifdef KMS_BLEND_X86
+    case KMS_BLEND_IMPL_SSE2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("sse2");
+    case KMS_BLEND_IMPL_AVX2:
+      __builtin_cpu_init ();
+      return __builtin_cpu_supports ("avx2");
+#endif
+    default:
+      return FALSE;
+  }
+}
+
+static gpointer
+kms_blend_select_impl (gpointer data)
+{
+  KmsBlendImpl impl;
+
+  if (kms_blend_is_supported (KMS_BLEND_IMPL_AVX2)) {
+    impl = KMS_BLEND_IMPL_AVX2;
+  } else if (kms_blend_is_supported (KMS_BLEND_IMPL_SSE2)) {
+    impl = KMS_BLEND_IMPL_SSE2;
+  } else {
+    impl = KMS_BLEND_IMPL_SCALAR;
+  }
+
+  return GINT_TO_POINTER (impl);
+}
+
+KmsBlendImpl
+kms_blend_get_impl (void)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  g_once (&once, kms_blend_select_impl, NULL);
+
+  return (KmsBlendImpl) GPOINTER_TO_INT (once.retval);
+}
+
+KmsBlendFunc
+kms_blend_get_func (KmsBlendImpl impl)
+{
+  if (impl == KMS_BLEND_IMPL_AUTO)
+    impl = kms_blend_get_impl ();
+
+  if (!kms_blend_is_supported (impl))
+    return NULL;
+
+  switch (impl) {
+#ifdef KMS_BLEND_X86
+    case KMS_BLEND_IMPL_SSE2:
+      return kms_blend_over_sse2;
+    case KMS_BLEND_IMPL_AVX2:
+      return kms_blend_over_avx2;
+#endif
+    default:
+      return kms_blend_over_scalar;
+  }
+}
+
+const gchar *
+kms_blend_impl_to_string (KmsBlendImpl impl)
+{
+  switch (impl) {
+    case KMS_BLEND_IMPL_SCALAR:
+      return "scalar";
+    case KMS_BLEND_IMPL_SSE2:
+      return "sse2";
+    case KMS_BLEND_IMPL_AVX2:
+      return "avx2";
+    default:
+      return "auto";
+  }
+}
+
+void
+kms_blend_over (guint8 * dst, const guint8 * src, const guint8 * alpha,
+    gsize n)
+{
+  static KmsBlendFunc func = NULL;
+
+  if (G_UNLIKELY (func == NULL))
+    func = kms_blend_get_func (KMS_BLEND_IMPL_AUTO);
+
+  func (dst, src, alpha, n);
+}
+
+void
+kms_blend_prepare_bgr (const guint8 * bgra, guint8 * color, guint8 * alpha,
+    gsize n_pixels)
+{
+  gsize i;
+
+  for (i = 0; i < n_pixels; i++) {
+    color[0] = bgra[0];
+    color[1] = bgra[1];
+    color[2] = bgra[2];
+    alpha[0] = alpha[1] = alpha[2] = bgra[3];
+    bgra += 4;
+    color += 3;
+    alpha += 3;
+  }
+}
@@ -0,0 +1,50 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_BLEND_H_
+#define _KMS_BLEND_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  KMS_BLEND_IMPL_AUTO,
+  KMS_BLEND_IMPL_SCALAR,
+  KMS_BLEND_IMPL_SSE2,
+  KMS_BLEND_IMPL_AVX2
+} KmsBlendImpl;
+
+/* dst[i] = src[i] + dst[i] * (255 - alpha[i]) / 255 for n bytes. src holds */
+/* colour values already multiplied by their alpha. */
+typedef void (*KmsBlendFunc) (guint8 * dst, const guint8 * src,
+    const guint8 * alpha, gsize n);
+
+/* Blends with the fastest implementation supported by the running CPU */
+void kms_blend_over (guint8 * dst, const guint8 * src, const guint8 * alpha,
+    gsize n);
+
+/* Returns NULL when impl is not available in this build or CPU */
+KmsBlendFunc kms_blend_get_func (KmsBlendImpl impl);
+KmsBlendImpl kms_blend_get_impl (void);
+const gchar *kms_blend_impl_to_string (KmsBlendImpl impl);
+
+/* Splits premultiplied B G R A pixels into the colour and per byte alpha */
+/* planes that kms_blend_over expects for a packed BGR frame */
+void kms_blend_prepare_bgr (const guint8 * bgra, guint8 * color,
+    guint8 * alpha, gsize n_pixels);
+
+G_END_DECLS
+#endif /* _KMS_BLEND_H_ */
@@ -19,6 +19,9 @@
 #endif
 
 #include "kmscompositemixer.h"
+#include "kmsportbranchpool.h"
+#include "kmsmixerlatency.h"
+#include "kmskeyframecoalescer.h"
 #include <commons/kmsagnosticcaps.h>
 #include <commons/kmshubport.h>
 #include <commons/kmsloop.h>
@@ -26,9 +29,34 @@
 #include <math.h>
 
 #define LATENCY 600             //ms
+#define LATENCY_RECALCULATION_DELAY 500        //ms, joins in between share it
 
 #define PLUGIN_NAME "compositemixer"
 
+#define DEFAULT_PORT_POOL_SIZE 2
+#define DEFAULT_ADAPTIVE_LATENCY FALSE
+#define DEFAULT_LATENCY_PERCENTILE 95
+#define DEFAULT_MIN_LATENCY 40  //ms
+#define DEFAULT_KEYFRAME_REQUEST_INTERVAL 500    //ms
+
+enum
+{
+  PROP_0,
+  PROP_PORT_POOL_SIZE,
+  PROP_PORT_POOL_HITS,
+  PROP_PORT_POOL_MISSES,
+  PROP_ADAPTIVE_LATENCY,
+  PROP_LATENCY_PERCENTILE,
+  PROP_MIN_LATENCY,
+  PROP_MAX_LATENCY,
+  PROP_LATENCY,
+  PROP_LATE_FRAMES,
+  PROP_KEYFRAME_REQUEST_INTERVAL,
+  PROP_KEYFRAME_REQUESTS_RECEIVED,
+  PROP_KEYFRAME_REQUESTS_FORWARDED,
+  N_PROPERTIES
+};
+
 #define KMS_COMPOSITE_MIXER_LOCK(mixer) \
   (g_rec_mutex_lock (&( (KmsCompositeMixer *) mixer)->priv->mutex))
 
@@ -87,7 +115,6 @@ struct _KmsCompositeMixerPrivate
 {
   GstElement *videomixer;
   GstElement *audiomixer;
-  GstElement *videotestsrc;
   GHashTable *ports;
   GstElement *mixer_audio_agnostic;
   GstElement *mixer_video_agnostic;
@@ -95,6 +122,10 @@ struct _KmsCompositeMixerPrivate
   GRecMutex mutex;
   gint n_elems;
   gint output_width, output_height;
+  volatile gint latency_pending;
+  KmsPortBranchPool *pool;
+  KmsMixerLatency *latency;
+  KmsKeyframeCoalescer *coalescer;
 };
 
 /* class initialization */
@@ -109,6 +140,7 @@ typedef struct _KmsCompositeMixerData
   KmsRefStruct parent;
   gint id;
   KmsCompositeMixer *mixer;
+  KmsPortBranch *branch;
   GstElement *capsfilter;
   GstElement *tee;
   GstElement *fakesink;
@@ -154,11 +186,82 @@ compare_port_data (gconstpointer a, gconstpointer b)
   return port_data_a->id - port_data_b->id;
 }
 
+static void
+free_weak_ref (GWeakRef * ref)
+{
+  g_weak_ref_clear (ref);
+  g_slice_free (GWeakRef, ref);
+}
+
+static gboolean
+kms_composite_mixer_recalculate_latency (GWeakRef * ref)
+{
+  KmsCompositeMixer *self = g_weak_ref_get (ref);
+
+  if (self == NULL)
+    return G_SOURCE_REMOVE;
+
+  g_atomic_int_set (&self->priv->latency_pending, FALSE);
+
+  GST_DEBUG_OBJECT (self, "Recalculating latency");
+  gst_bin_recalculate_latency (GST_BIN (self));
+
+  g_object_unref (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+kms_composite_mixer_schedule_latency_recalculation (KmsCompositeMixer * self)
+{
+  GWeakRef *ref;
+
+  if (self->priv->loop == NULL
+      || !g_atomic_int_compare_and_exchange (&self->priv->latency_pending,
+          FALSE, TRUE)) {
+    return;
+  }
+
+  /* a query on the whole bin for each of many joins at once stalls */
+  /* every branch, the ones arriving meanwhile share a single one */
+  ref = g_slice_new (GWeakRef);
+  g_weak_ref_init (ref, self);
+
+  kms_loop_timeout_add_full (self->priv->loop, G_PRIORITY_DEFAULT,
+      LATENCY_RECALCULATION_DELAY,
+      (GSourceFunc) kms_composite_mixer_recalculate_latency, ref,
+      (GDestroyNotify) free_weak_ref);
+}
+
+/* called from a streaming thread when the adaptive latency moves, while */
+/* other threads may hold the mixer lock waiting for it: the new latency */
+/* is applied from the loop */
+static void
+kms_composite_mixer_latency_changed (GWeakRef * ref)
+{
+  KmsCompositeMixer *self = g_weak_ref_get (ref);
+  GWeakRef *idle_ref;
+
+  if (self == NULL)
+    return;
+
+  if (self->priv->loop != NULL
+      && g_atomic_int_compare_and_exchange (&self->priv->latency_pending,
+          FALSE, TRUE)) {
+    idle_ref = g_slice_new (GWeakRef);
+    g_weak_ref_init (idle_ref, self);
+    kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_DEFAULT,
+        (GSourceFunc) kms_composite_mixer_recalculate_latency, idle_ref,
+        (GDestroyNotify) free_weak_ref);
+  }
+
+  g_object_unref (self);
+}
+
 static void
 kms_composite_mixer_recalculate_sizes (gpointer data)
 {
   KmsCompositeMixer *self = KMS_COMPOSITE_MIXER (data);
-  GstCaps *filtercaps;
   gint width, height, top, left, counter, n_columns, n_rows;
   GList *l;
   GList *values = g_hash_table_get_values (self->priv->ports);
@@ -185,18 +288,13 @@ kms_composite_mixer_recalculate_sizes (gpointer data)
       continue;
     }
 
-    filtercaps =
-        gst_caps_new_simple ("video/x-raw",
-        "width", G_TYPE_INT, width, "height", G_TYPE_INT, height,
-        "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1, NULL);
-    g_object_set (port_data->capsfilter, "caps", filtercaps, NULL);
-    gst_caps_unref (filtercaps);
-
     top = ((counter / n_columns) * height);
     left = ((counter % n_columns) * width);
 
+    /* the compositor scales each input into its cell, so the grid */
+    /* changes without renegotiating caps on any input branch */
     g_object_set (port_data->video_mixer_pad, "xpos", left, "ypos", top,
-        "alpha", 1.0, NULL);
+        "width", width, "height", height, "alpha", 1.0, NULL);
     counter++;
 
     GST_DEBUG_OBJECT (self, "counter %d id_port %d ", counter, port_data->id);
@@ -211,6 +309,7 @@ static gboolean
 remove_elements_from_pipeline (KmsCompositeMixerData * port_data)
 {
   KmsCompositeMixer *self = port_data->mixer;
+  KmsPortBranch *branch;
 
   KMS_COMPOSITE_MIXER_LOCK (self);
 
@@ -229,28 +328,21 @@ remove_elements_from_pipeline (KmsCompositeMixerData * port_data)
     port_data->video_mixer_pad = NULL;
   }
 
-  gst_bin_remove_many (GST_BIN (self),
-      g_object_ref (port_data->capsfilter),
-      g_object_ref (port_data->tee), g_object_ref (port_data->fakesink), NULL);
-
   kms_base_hub_unlink_video_src (KMS_BASE_HUB (self), port_data->id);
 
-  KMS_COMPOSITE_MIXER_UNLOCK (self);
-
-  gst_element_set_state (port_data->capsfilter, GST_STATE_NULL);
-  gst_element_set_state (port_data->tee, GST_STATE_NULL);
-  gst_element_set_state (port_data->fakesink, GST_STATE_NULL);
-
-  g_object_unref (port_data->capsfilter);
-  g_object_unref (port_data->tee);
-  g_object_unref (port_data->fakesink);
-  g_object_unref (port_data->tee_sink_pad);
-
+  branch = port_data->branch;
+  port_data->branch = NULL;
   port_data->tee_sink_pad = NULL;
   port_data->capsfilter = NULL;
   port_data->tee = NULL;
   port_data->fakesink = NULL;
 
+  KMS_COMPOSITE_MIXER_UNLOCK (self);
+
+  if (branch != NULL) {
+    kms_port_branch_pool_release (self->priv->pool, branch);
+  }
+
   return G_SOURCE_REMOVE;
 }
 
@@ -291,27 +383,12 @@ cb_EOS_received (GstPad * pad, GstPadProbeInfo * info, gpointer data)
   return GST_PAD_PROBE_OK;
 }
 
-static GstPadProbeReturn
-cb_latency (GstPad * pad, GstPadProbeInfo * info, gpointer data)
-{
-  if (GST_QUERY_TYPE (GST_PAD_PROBE_INFO_QUERY (info)) != GST_QUERY_LATENCY) {
-    return GST_PAD_PROBE_OK;
-  }
-
-  GST_LOG_OBJECT (pad, "Modifing latency query. New latency %ld",
-      LATENCY * GST_MSECOND);
-
-  gst_query_set_latency (GST_PAD_PROBE_INFO_QUERY (info),
-      TRUE, LATENCY * GST_MSECOND, LATENCY * GST_MSECOND);
-
-  return GST_PAD_PROBE_OK;
-}
-
 static void
 kms_composite_mixer_port_data_destroy (gpointer data)
 {
   KmsCompositeMixerData *port_data = (KmsCompositeMixerData *) data;
   KmsCompositeMixer *self = port_data->mixer;
+  KmsPortBranch *branch;
   GstPad *audiosink;
   gchar *padname;
 
@@ -374,7 +451,7 @@ kms_composite_mixer_port_data_destroy (gpointer data)
             (GDestroyNotify) kms_ref_struct_unref);
       }
     }
-    gst_element_unlink (port_data->capsfilter, port_data->tee);
+    /* the branch stays linked, it goes back to the pool once drained */
     g_object_unref (pad);
   } else {
     if (port_data->probe_id > 0) {
@@ -388,26 +465,21 @@ kms_composite_mixer_port_data_destroy (gpointer data)
 
     if (port_data->link_probe_id > 0) {
       gst_pad_remove_probe (port_data->tee_sink_pad, port_data->link_probe_id);
+      port_data->link_probe_id = 0;
     }
-    KMS_COMPOSITE_MIXER_UNLOCK (self);
 
-    gst_element_unlink (port_data->capsfilter, port_data->tee);
-    gst_element_unlink (port_data->tee, port_data->fakesink);
-
-    gst_bin_remove (GST_BIN (self), g_object_ref (port_data->capsfilter));
-    gst_element_set_state (port_data->capsfilter, GST_STATE_NULL);
-    g_object_unref (port_data->capsfilter);
+    branch = port_data->branch;
+    port_data->branch = NULL;
+    port_data->tee_sink_pad = NULL;
     port_data->capsfilter = NULL;
-
-    gst_bin_remove (GST_BIN (self), g_object_ref (port_data->tee));
-    gst_element_set_state (port_data->tee, GST_STATE_NULL);
-    g_object_unref (port_data->tee);
     port_data->tee = NULL;
-
-    gst_bin_remove (GST_BIN (self), g_object_ref (port_data->fakesink));
-    gst_element_set_state (port_data->fakesink, GST_STATE_NULL);
-    g_object_unref (port_data->fakesink);
     port_data->fakesink = NULL;
+    KMS_COMPOSITE_MIXER_UNLOCK (self);
+
+    /* never used, back to the pool as it is */
+    if (branch != NULL) {
+      kms_port_branch_pool_release (self->priv->pool, branch);
+    }
   }
 
   padname = g_strdup_printf (AUDIO_SINK_PAD, port_data->id);
@@ -465,16 +537,16 @@ link_to_videomixer (GstPad * pad, GstPadProbeInfo * info,
       (GstPadProbeCallback) cb_EOS_received,
       KMS_COMPOSITE_MIXER_REF (data), (GDestroyNotify) kms_ref_struct_unref);
 
-  data->latency_probe_id = gst_pad_add_probe (data->video_mixer_pad,
-      GST_PAD_PROBE_TYPE_QUERY_UPSTREAM,
-      (GstPadProbeCallback) cb_latency, NULL, NULL);
+  /* answers the latency queries and measures how late buffers arrive */
+  data->latency_probe_id = kms_mixer_latency_add_probe (mixer->priv->latency,
+      data->video_mixer_pad);
 
   /*recalculate the output sizes */
   mixer->priv->n_elems++;
   kms_composite_mixer_recalculate_sizes (mixer);
 
   //Recalculate latency to avoid video freezes when an element stops to send media.
-  gst_bin_recalculate_latency (GST_BIN (mixer));
+  kms_composite_mixer_schedule_latency_recalculation (mixer);
 
   KMS_COMPOSITE_MIXER_UNLOCK (mixer);
 
@@ -518,8 +590,6 @@ kms_composite_mixer_port_data_create (KmsCompositeMixer * mixer, gint id)
 {
   KmsCompositeMixerData *data;
   gchar *padname;
-  GstPad *tee_src;
-  GstCaps *filtercaps;
 
   data = kms_create_composite_mixer_data ();
   data->mixer = mixer;
@@ -528,43 +598,23 @@ kms_composite_mixer_port_data_create (KmsCompositeMixer * mixer, gint id)
   data->removing = FALSE;
   data->eos_managed = FALSE;
 
-  data->tee = gst_element_factory_make ("tee", NULL);
-  data->fakesink = gst_element_factory_make ("fakesink", NULL);
-  data->capsfilter = gst_element_factory_make ("capsfilter", NULL);
-
-  g_object_set (G_OBJECT (data->capsfilter), "caps-change-mode",
-      1 /*delayed */ , NULL);
-
-  g_object_set (G_OBJECT (data->fakesink), "async", FALSE, "sync", FALSE, NULL);
-
-  gst_bin_add_many (GST_BIN (mixer), data->capsfilter, data->tee,
-      data->fakesink, NULL);
-
-  gst_element_sync_state_with_parent (data->capsfilter);
-  gst_element_sync_state_with_parent (data->tee);
-  gst_element_sync_state_with_parent (data->fakesink);
-
-  filtercaps =
-      gst_caps_new_simple ("video/x-raw",
-      "width", G_TYPE_INT, mixer->priv->output_width,
-      "height", G_TYPE_INT, mixer->priv->output_height,
-      "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1, NULL);
-  g_object_set (data->capsfilter, "caps", filtercaps, NULL);
-  gst_caps_unref (filtercaps);
+  /* capsfilter -> tee -> fakesink, already built and running */
+  data->branch = kms_port_branch_pool_acquire (mixer->priv->pool);
+  if (data->branch == NULL) {
+    /* the pool is cleared on dispose */
+    GST_DEBUG_OBJECT (mixer, "No branch pooled for port %d", id);
+    data->branch = kms_port_branch_pool_build (mixer->priv->pool,
+        GST_BIN (mixer));
+  }
+  data->capsfilter = data->branch->capsfilter;
+  data->tee = data->branch->tee;
+  data->fakesink = data->branch->fakesink;
+  data->tee_sink_pad = data->branch->tee_sink_pad;
 
   /*link basemixer -> video_agnostic */
   kms_base_hub_link_video_sink (KMS_BASE_HUB (mixer), data->id,
       data->capsfilter, "sink", FALSE);
 
-  data->tee_sink_pad = gst_element_get_static_pad (data->tee, "sink");
-  gst_element_link_pads (data->capsfilter, NULL, data->tee,
-      GST_OBJECT_NAME (data->tee_sink_pad));
-
-  tee_src = gst_element_get_request_pad (data->tee, "src_%u");
-  gst_element_link_pads (data->tee, GST_OBJECT_NAME (tee_src), data->fakesink,
-      "sink");
-  g_object_unref (tee_src);
-
   padname = g_strdup_printf (AUDIO_SINK_PAD, id);
   kms_base_hub_link_audio_sink (KMS_BASE_HUB (mixer), id,
       mixer->priv->audiomixer, padname, FALSE);
@@ -632,6 +682,7 @@ kms_composite_mixer_handle_port (KmsBaseHub * mixer,
   KmsCompositeMixer *self = KMS_COMPOSITE_MIXER (mixer);
   KmsCompositeMixerData *port_data;
   gint port_id;
+  GstPad *sink;
 
 #ifdef NEED_FILTER
   GstElement *filter;
@@ -653,9 +704,10 @@ kms_composite_mixer_handle_port (KmsBaseHub * mixer,
   KMS_COMPOSITE_MIXER_LOCK (self);
 
   if (self->priv->videomixer == NULL) {
-    self->priv->videomixer = gst_element_factory_make ("compositor", NULL);
+    self->priv->videomixer = gst_element_factory_make ("yuvcompositor", NULL);
     g_object_set (G_OBJECT (self->priv->videomixer), "background",
-        1 /*black */ , "start-time-selection", 1 /*first */ , NULL);
+        1 /*black */ , "width", self->priv->output_width, "height",
+        self->priv->output_height, "frame-rate", 15, "live", TRUE, NULL);
     self->priv->mixer_video_agnostic =
         gst_element_factory_make ("agnosticbin", NULL);
 
@@ -680,56 +732,15 @@ kms_composite_mixer_handle_port (KmsBaseHub * mixer,
         self->priv->mixer_video_agnostic, NULL);
 #endif
 
-    if (self->priv->videotestsrc == NULL) {
-      GstElement *capsfilter;
-      GstCaps *filtercaps;
-      GstPad *pad;
-      GstPadTemplate *sink_pad_template;
-
-      sink_pad_template =
-          gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS
-          (self->priv->videomixer), "sink_%u");
-
-      if (G_UNLIKELY (sink_pad_template == NULL)) {
-        GST_ERROR_OBJECT (self, "Error taking a new pad from videomixer");
-      }
-
-      self->priv->videotestsrc =
-          gst_element_factory_make ("videotestsrc", NULL);
-      capsfilter = gst_element_factory_make ("capsfilter", NULL);
-      g_object_set (G_OBJECT (capsfilter), "caps-change-mode", 1, NULL);
-
-      g_object_set (self->priv->videotestsrc, "is-live", TRUE, "pattern",
-          /*black */ 2, NULL);
-
-      filtercaps =
-          gst_caps_new_simple ("video/x-raw",
-          "width", G_TYPE_INT, self->priv->output_width,
-          "height", G_TYPE_INT, self->priv->output_height,
-          "framerate", GST_TYPE_FRACTION, 15, 1, NULL);
-      g_object_set (G_OBJECT (capsfilter), "caps", filtercaps, NULL);
-      gst_caps_unref (filtercaps);
-
-      gst_bin_add_many (GST_BIN (self), self->priv->videotestsrc,
-          capsfilter, NULL);
-
-      gst_element_link (self->priv->videotestsrc, capsfilter);
-
-      /*link capsfilter -> videomixer */
-      pad = gst_element_request_pad (self->priv->videomixer, sink_pad_template,
-          NULL, NULL);
-
-      gst_element_link_pads (capsfilter, NULL,
-          self->priv->videomixer, GST_OBJECT_NAME (pad));
-      g_object_set (pad, "xpos", 0, "ypos", 0, "alpha", 0.0, NULL);
-      g_object_unref (pad);
-
-      gst_element_sync_state_with_parent (capsfilter);
-      gst_element_sync_state_with_parent (self->priv->videotestsrc);
-    }
     gst_element_sync_state_with_parent (self->priv->videomixer);
     gst_element_sync_state_with_parent (self->priv->mixer_video_agnostic);
 
+    /* new outputs ask the mixer, and so every input, for a keyframe */
+    sink = gst_element_get_static_pad (self->priv->mixer_video_agnostic,
+        "sink");
+    kms_keyframe_coalescer_add_probe (self->priv->coalescer, sink);
+    g_object_unref (sink);
+
 #ifdef NEED_FILTER
     gst_element_sync_state_with_parent (filter);
 //    gst_element_sync_state_with_parent (capsfilter_0);
@@ -770,6 +781,11 @@ kms_composite_mixer_dispose (GObject * object)
   KMS_COMPOSITE_MIXER_LOCK (self);
   g_hash_table_remove_all (self->priv->ports);
   KMS_COMPOSITE_MIXER_UNLOCK (self);
+
+  if (self->priv->pool != NULL) {
+    kms_port_branch_pool_clear (self->priv->pool);
+  }
+
   g_clear_object (&self->priv->loop);
 
   G_OBJECT_CLASS (kms_composite_mixer_parent_class)->dispose (object);
@@ -787,9 +803,128 @@ kms_composite_mixer_finalize (GObject * object)
     self->priv->ports = NULL;
   }
 
+  if (self->priv->pool != NULL) {
+    kms_port_branch_pool_unref (self->priv->pool);
+    self->priv->pool = NULL;
+  }
+
+  if (self->priv->latency != NULL) {
+    kms_mixer_latency_unref (self->priv->latency);
+    self->priv->latency = NULL;
+  }
+
+  if (self->priv->coalescer != NULL) {
+    kms_keyframe_coalescer_unref (self->priv->coalescer);
+    self->priv->coalescer = NULL;
+  }
+
   G_OBJECT_CLASS (kms_composite_mixer_parent_class)->finalize (object);
 }
 
+static void
+kms_composite_mixer_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsCompositeMixer *self = KMS_COMPOSITE_MIXER (object);
+  GstClockTime min, max;
+  guint64 hits, misses;
+
+  switch (property_id) {
+    case PROP_PORT_POOL_SIZE:
+      g_value_set_uint (value,
+          kms_port_branch_pool_get_size (self->priv->pool));
+      break;
+    case PROP_PORT_POOL_HITS:
+      kms_port_branch_pool_get_stats (self->priv->pool, &hits, NULL);
+      g_value_set_uint64 (value, hits);
+      break;
+    case PROP_PORT_POOL_MISSES:
+      kms_port_branch_pool_get_stats (self->priv->pool, NULL, &misses);
+      g_value_set_uint64 (value, misses);
+      break;
+    case PROP_ADAPTIVE_LATENCY:
+      g_value_set_boolean (value,
+          kms_mixer_latency_get_adaptive (self->priv->latency));
+      break;
+    case PROP_LATENCY_PERCENTILE:
+      g_value_set_uint (value,
+          kms_mixer_latency_get_percentile (self->priv->latency));
+      break;
+    case PROP_MIN_LATENCY:
+      kms_mixer_latency_get_range (self->priv->latency, &min, NULL);
+      g_value_set_uint (value, min / GST_MSECOND);
+      break;
+    case PROP_MAX_LATENCY:
+      kms_mixer_latency_get_range (self->priv->latency, NULL, &max);
+      g_value_set_uint (value, max / GST_MSECOND);
+      break;
+    case PROP_LATENCY:
+      g_value_set_uint (value,
+          kms_mixer_latency_get_current (self->priv->latency) / GST_MSECOND);
+      break;
+    case PROP_LATE_FRAMES:
+      g_value_set_uint64 (value,
+          kms_mixer_latency_get_late_frames (self->priv->latency));
+      break;
+    case PROP_KEYFRAME_REQUEST_INTERVAL:
+      g_value_set_uint (value,
+          kms_keyframe_coalescer_get_interval (self->priv->coalescer) /
+          GST_MSECOND);
+      break;
+    case PROP_KEYFRAME_REQUESTS_RECEIVED:
+      g_value_set_uint64 (value,
+          kms_keyframe_coalescer_get_received (self->priv->coalescer));
+      break;
+    case PROP_KEYFRAME_REQUESTS_FORWARDED:
+      g_value_set_uint64 (value,
+          kms_keyframe_coalescer_get_forwarded (self->priv->coalescer));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+kms_composite_mixer_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsCompositeMixer *self = KMS_COMPOSITE_MIXER (object);
+  GstClockTime min, max;
+
+  switch (property_id) {
+    case PROP_PORT_POOL_SIZE:
+      kms_port_branch_pool_set_size (self->priv->pool,
+          g_value_get_uint (value));
+      break;
+    case PROP_ADAPTIVE_LATENCY:
+      kms_mixer_latency_set_adaptive (self->priv->latency,
+          g_value_get_boolean (value));
+      break;
+    case PROP_LATENCY_PERCENTILE:
+      kms_mixer_latency_set_percentile (self->priv->latency,
+          g_value_get_uint (value));
+      break;
+    case PROP_MIN_LATENCY:
+      kms_mixer_latency_get_range (self->priv->latency, NULL, &max);
+      kms_mixer_latency_set_range (self->priv->latency,
+          g_value_get_uint (value) * GST_MSECOND, max);
+      break;
+    case PROP_MAX_LATENCY:
+      kms_mixer_latency_get_range (self->priv->latency, &min, NULL);
+      kms_mixer_latency_set_range (self->priv->latency, min,
+          g_value_get_uint (value) * GST_MSECOND);
+      break;
+    case PROP_KEYFRAME_REQUEST_INTERVAL:
+      kms_keyframe_coalescer_set_interval (self->priv->coalescer,
+          g_value_get_uint (value) * GST_MSECOND);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
 static void
 kms_composite_mixer_class_init (KmsCompositeMixerClass * klass)
 {
@@ -802,6 +937,8 @@ kms_composite_mixer_class_init (KmsCompositeMixerClass * klass)
       " in one output flow", "David Fernandez <d.fernandezlop@gmail.com>");
 
   gobject_class->dispose = GST_DEBUG_FUNCPTR (kms_composite_mixer_dispose);
+  gobject_class->set_property = kms_composite_mixer_set_property;
+  gobject_class->get_property = kms_composite_mixer_get_property;
   gobject_class->finalize = GST_DEBUG_FUNCPTR (kms_composite_mixer_finalize);
 
   base_hub_class->handle_port =
@@ -818,6 +955,79 @@ kms_composite_mixer_class_init (KmsCompositeMixerClass * klass)
   gst_element_class_add_pad_template (gstelement_class,
       gst_static_pad_template_get (&video_sink_factory));
 
+  g_object_class_install_property (gobject_class, PROP_PORT_POOL_SIZE,
+      g_param_spec_uint ("port-pool-size", "Port pool size",
+          "Port video branches kept built and running for new ports",
+          0, G_MAXUINT, DEFAULT_PORT_POOL_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PORT_POOL_HITS,
+      g_param_spec_uint64 ("port-pool-hits", "Port pool hits",
+          "New ports that took a branch from the pool",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PORT_POOL_MISSES,
+      g_param_spec_uint64 ("port-pool-misses", "Port pool misses",
+          "New ports that had to build their branch",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADAPTIVE_LATENCY,
+      g_param_spec_boolean ("adaptive-latency", "Adaptive latency",
+          "Follow the measured skew between inputs instead of a fixed latency",
+          DEFAULT_ADAPTIVE_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY_PERCENTILE,
+      g_param_spec_uint ("latency-percentile", "Latency percentile",
+          "Percentile of the input skews covered by the adaptive latency",
+          1, 100, DEFAULT_LATENCY_PERCENTILE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MIN_LATENCY,
+      g_param_spec_uint ("min-latency", "Minimum latency",
+          "Lower bound of the adaptive latency (ms)",
+          0, G_MAXUINT, DEFAULT_MIN_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_LATENCY,
+      g_param_spec_uint ("max-latency", "Maximum latency",
+          "Upper bound of the adaptive latency (ms)",
+          0, G_MAXUINT, LATENCY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY,
+      g_param_spec_uint ("latency", "Latency",
+          "Latency in use to wait for the inputs (ms)",
+          0, G_MAXUINT, LATENCY, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATE_FRAMES,
+      g_param_spec_uint64 ("late-frames", "Late frames",
+          "Input buffers whose skew behind the earliest input exceeded the "
+          "latency in use, not the ones the compositor actually dropped",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_REQUEST_INTERVAL,
+      g_param_spec_uint ("keyframe-request-interval",
+          "Keyframe request interval",
+          "Minimum time (ms) between two keyframe requests sent to the "
+          "inputs, the ones received in between are merged",
+          0, G_MAXUINT, DEFAULT_KEYFRAME_REQUEST_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_REQUESTS_RECEIVED,
+      g_param_spec_uint64 ("keyframe-requests-received",
+          "Keyframe requests received",
+          "Keyframe requests received from the outputs",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_REQUESTS_FORWARDED,
+      g_param_spec_uint64 ("keyframe-requests-forwarded",
+          "Keyframe requests forwarded",
+          "Keyframe requests sent to the inputs",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   /* Registers a private structure for the instantiatable type */
   g_type_class_add_private (klass, sizeof (KmsCompositeMixerPrivate));
 }
@@ -825,6 +1035,9 @@ kms_composite_mixer_class_init (KmsCompositeMixerClass * klass)
 static void
 kms_composite_mixer_init (KmsCompositeMixer * self)
 {
+  GstCaps *caps;
+  GWeakRef *ref;
+
   self->priv = KMS_COMPOSITE_MIXER_GET_PRIVATE (self);
 
   g_rec_mutex_init (&self->priv->mutex);
@@ -837,6 +1050,24 @@ kms_composite_mixer_init (KmsCompositeMixer * self)
   self->priv->n_elems = 0;
 
   self->priv->loop = kms_loop_new ();
+
+  /* inputs keep their own size, the grid cell is set on the mixer pad */
+  caps = gst_caps_new_simple ("video/x-raw",
+      "pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1, NULL);
+  self->priv->pool = kms_port_branch_pool_new (GST_BIN (self),
+      self->priv->loop, caps, DEFAULT_PORT_POOL_SIZE);
+  gst_caps_unref (caps);
+
+  ref = g_slice_new (GWeakRef);
+  g_weak_ref_init (ref, self);
+  self->priv->latency = kms_mixer_latency_new (LATENCY * GST_MSECOND,
+      (KmsMixerLatencyFunc) kms_composite_mixer_latency_changed, ref,
+      (GDestroyNotify) free_weak_ref);
+  kms_mixer_latency_set_range (self->priv->latency,
+      DEFAULT_MIN_LATENCY * GST_MSECOND, LATENCY * GST_MSECOND);
+
+  self->priv->coalescer = kms_keyframe_coalescer_new (self->priv->loop,
+      DEFAULT_KEYFRAME_REQUEST_INTERVAL * GST_MSECOND);
 }
 
 gboolean
@@ -0,0 +1,1213 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmscompositor.h"
+#include "kmscompositorblit.h"
+
+#include <string.h>
+#include <opencv/cv.h>
+#include <opencv/highgui.h>
+
+#define PLUGIN_NAME "yuvcompositor"
+
+GST_DEBUG_CATEGORY_STATIC (kms_compositor_debug_category);
+#define GST_CAT_DEFAULT kms_compositor_debug_category
+
+#define KMS_COMPOSITOR_GET_PRIVATE(obj) ( \
+  G_TYPE_INSTANCE_GET_PRIVATE (           \
+    (obj),                                \
+    KMS_TYPE_COMPOSITOR,                  \
+    KmsCompositorPrivate                  \
+  )                                       \
+)
+
+#define SRC_FORMATS " { I420, NV12 } "
+#define SINK_FORMATS " { I420, NV12, AYUV } "
+
+/* output rows are shared among the workers from this size on */
+#define PARALLEL_MIN_PIXELS (1920 * 1080)
+#define MAX_BANDS 4
+#define CHECKER_SIZE 8
+
+#define DEFAULT_BACKGROUND KMS_COMPOSITOR_BACKGROUND_CHECKER
+#define DEFAULT_PAD_XPOS 0
+#define DEFAULT_PAD_YPOS 0
+#define DEFAULT_PAD_WIDTH 0
+#define DEFAULT_PAD_HEIGHT 0
+#define DEFAULT_PAD_ALPHA 1.0
+
+enum
+{
+  PROP_0,
+  PROP_BACKGROUND,
+  PROP_BACKGROUND_IMAGE,
+  PROP_WIDTH,
+  PROP_HEIGHT,
+  PROP_FRAME_RATE,
+  PROP_LIVE
+};
+
+enum
+{
+  PROP_PAD_0,
+  PROP_PAD_XPOS,
+  PROP_PAD_YPOS,
+  PROP_PAD_WIDTH,
+  PROP_PAD_HEIGHT,
+  PROP_PAD_ALPHA
+};
+
+struct _KmsCompositorPrivate
+{
+  KmsCompositorBackground background;
+  gchar *background_image;
+  GstBuffer *background_buffer; /* I420 copy of the background image */
+  GstVideoInfo background_info;
+  gint width, height, frame_rate;
+
+  /* the clock pad makes the aggregator time out on its own clock */
+  gboolean live;
+  GstPad *clock_src;
+  GstPad *clock_sink;
+
+  KmsCompositorScratch *scratch[MAX_BANDS];
+
+  /* held by the pad geometry batches and while frames read it */
+  GMutex layout_lock;
+};
+
+typedef struct _KmsCompositorEntry
+{
+  GstVideoFrame *frame;
+  gint x, y, width, height;     /* in output pixels */
+  guint8 alpha;
+  gboolean opaque;
+  gboolean skip;
+} KmsCompositorEntry;
+
+typedef struct _KmsCompositorRender
+{
+  GstVideoFrame *out;
+  KmsCompositorBackground background;
+  gboolean fill;
+  KmsCompositorEntry *entries;  /* bottom to top */
+  guint n_entries;
+
+  GMutex mutex;
+  GCond cond;
+  guint pending;
+} KmsCompositorRender;
+
+typedef struct _KmsCompositorBand
+{
+  KmsCompositorRender *render;
+  gint row_start;
+  gint row_end;
+  KmsCompositorScratch *scratch;
+} KmsCompositorBand;
+
+static GstStaticPadTemplate src_factory = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (SRC_FORMATS))
+    );
+
+static GstStaticPadTemplate sink_factory = GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (SINK_FORMATS))
+    );
+
+#define KMS_TYPE_COMPOSITOR_BACKGROUND (kms_compositor_background_get_type ())
+
+static GType
+kms_compositor_background_get_type (void)
+{
+  static GType type = 0;
+
+  static const GEnumValue values[] = {
+    {KMS_COMPOSITOR_BACKGROUND_CHECKER, "Checker pattern", "checker"},
+    {KMS_COMPOSITOR_BACKGROUND_BLACK, "Black", "black"},
+    {KMS_COMPOSITOR_BACKGROUND_WHITE, "White", "white"},
+    {KMS_COMPOSITOR_BACKGROUND_TRANSPARENT,
+        "Black, output formats have no alpha channel", "transparent"},
+    {0, NULL, NULL},
+  };
+
+  if (!type) {
+    type = g_enum_register_static ("KmsCompositorBackground", values);
+  }
+
+  return type;
+}
+
+/* pad */
+
+G_DEFINE_TYPE (KmsCompositorPad, kms_compositor_pad,
+    GST_TYPE_VIDEO_AGGREGATOR_PAD);
+
+static void
+kms_compositor_pad_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsCompositorPad *pad = KMS_COMPOSITOR_PAD (object);
+
+  GST_OBJECT_LOCK (pad);
+
+  switch (prop_id) {
+    case PROP_PAD_XPOS:
+      g_value_set_int (value, pad->xpos);
+      break;
+    case PROP_PAD_YPOS:
+      g_value_set_int (value, pad->ypos);
+      break;
+    case PROP_PAD_WIDTH:
+      g_value_set_int (value, pad->width);
+      break;
+    case PROP_PAD_HEIGHT:
+      g_value_set_int (value, pad->height);
+      break;
+    case PROP_PAD_ALPHA:
+      g_value_set_double (value, pad->alpha);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (pad);
+}
+
+static void
+kms_compositor_pad_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsCompositorPad *pad = KMS_COMPOSITOR_PAD (object);
+
+  /* geometry changes apply from the next output frame, they never need */
+  /* a renegotiation of the input */
+  GST_OBJECT_LOCK (pad);
+
+  switch (prop_id) {
+    case PROP_PAD_XPOS:
+      pad->xpos = g_value_get_int (value);
+      break;
+    case PROP_PAD_YPOS:
+      pad->ypos = g_value_get_int (value);
+      break;
+    case PROP_PAD_WIDTH:
+      pad->width = g_value_get_int (value);
+      break;
+    case PROP_PAD_HEIGHT:
+      pad->height = g_value_get_int (value);
+      break;
+    case PROP_PAD_ALPHA:
+      pad->alpha = g_value_get_double (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (pad);
+}
+
+static gboolean
+kms_compositor_pad_set_info (GstVideoAggregatorPad * pad,
+    GstVideoAggregator * vagg, GstVideoInfo * current_info,
+    GstVideoInfo * wanted_info)
+{
+  /* every input format is scaled and blended as it is, no conversion */
+  return TRUE;
+}
+
+static gboolean
+kms_compositor_pad_prepare_frame (GstVideoAggregatorPad * pad,
+    GstVideoAggregator * vagg)
+{
+  GstVideoFrame *frame;
+  gdouble alpha;
+
+  if (pad->buffer == NULL)
+    return TRUE;
+
+  GST_OBJECT_LOCK (pad);
+  alpha = KMS_COMPOSITOR_PAD (pad)->alpha;
+  GST_OBJECT_UNLOCK (pad);
+
+  if (alpha <= 0.0) {
+    GST_LOG_OBJECT (pad, "Pad has alpha 0.0, not mapping frame");
+    return TRUE;
+  }
+
+  frame = g_slice_new0 (GstVideoFrame);
+
+  if (!gst_video_frame_map (frame, &pad->buffer_vinfo, pad->buffer,
+          GST_MAP_READ)) {
+    GST_WARNING_OBJECT (vagg, "Could not map input buffer");
+    g_slice_free (GstVideoFrame, frame);
+    return FALSE;
+  }
+
+  pad->aggregated_frame = frame;
+
+  return TRUE;
+}
+
+static void
+kms_compositor_pad_clean_frame (GstVideoAggregatorPad * pad,
+    GstVideoAggregator * vagg)
+{
+  if (pad->aggregated_frame == NULL)
+    return;
+
+  gst_video_frame_unmap (pad->aggregated_frame);
+  g_slice_free (GstVideoFrame, pad->aggregated_frame);
+  pad->aggregated_frame = NULL;
+}
+
+static void
+kms_compositor_pad_class_init (KmsCompositorPadClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstVideoAggregatorPadClass *vaggpad_class =
+      GST_VIDEO_AGGREGATOR_PAD_CLASS (klass);
+
+  gobject_class->set_property = kms_compositor_pad_set_property;
+  gobject_class->get_property = kms_compositor_pad_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_PAD_XPOS,
+      g_param_spec_int ("xpos", "X Position", "X Position of the picture",
+          G_MININT, G_MAXINT, DEFAULT_PAD_XPOS,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_YPOS,
+      g_param_spec_int ("ypos", "Y Position", "Y Position of the picture",
+          G_MININT, G_MAXINT, DEFAULT_PAD_YPOS,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_WIDTH,
+      g_param_spec_int ("width", "Width",
+          "Width of the picture (0 = width of the input)", 0, G_MAXINT,
+          DEFAULT_PAD_WIDTH,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_HEIGHT,
+      g_param_spec_int ("height", "Height",
+          "Height of the picture (0 = height of the input)", 0, G_MAXINT,
+          DEFAULT_PAD_HEIGHT,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_PAD_ALPHA,
+      g_param_spec_double ("alpha", "Alpha", "Alpha of the picture", 0.0, 1.0,
+          DEFAULT_PAD_ALPHA,
+          G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+
+  vaggpad_class->set_info = GST_DEBUG_FUNCPTR (kms_compositor_pad_set_info);
+  vaggpad_class->prepare_frame =
+      GST_DEBUG_FUNCPTR (kms_compositor_pad_prepare_frame);
+  vaggpad_class->clean_frame =
+      GST_DEBUG_FUNCPTR (kms_compositor_pad_clean_frame);
+}
+
+static void
+kms_compositor_pad_init (KmsCompositorPad * pad)
+{
+  pad->xpos = DEFAULT_PAD_XPOS;
+  pad->ypos = DEFAULT_PAD_YPOS;
+  pad->width = DEFAULT_PAD_WIDTH;
+  pad->height = DEFAULT_PAD_HEIGHT;
+  pad->alpha = DEFAULT_PAD_ALPHA;
+}
+
+/* element */
+
+G_DEFINE_TYPE_WITH_CODE (KmsCompositor, kms_compositor,
+    GST_TYPE_VIDEO_AGGREGATOR,
+    GST_DEBUG_CATEGORY_INIT (kms_compositor_debug_category, PLUGIN_NAME, 0,
+        "debug category for yuvcompositor element"));
+
+/* Loads a BGR image and converts it to I420 (BT.601), cropped to even */
+/* dimensions */
+static GstBuffer *
+kms_compositor_load_image (const gchar * path, GstVideoInfo * info)
+{
+  GstVideoFrame frame;
+  GstBuffer *buffer;
+  IplImage *image;
+  gint width, height, x, y;
+
+  image = cvLoadImage (path, CV_LOAD_IMAGE_COLOR);
+  if (image == NULL)
+    return NULL;
+
+  width = image->width & ~1;
+  height = image->height & ~1;
+
+  if (width == 0 || height == 0) {
+    cvReleaseImage (&image);
+    return NULL;
+  }
+
+  gst_video_info_set_format (info, GST_VIDEO_FORMAT_I420, width, height);
+  buffer = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (info), NULL);
+
+  if (!gst_video_frame_map (&frame, info, buffer, GST_MAP_WRITE)) {
+    gst_buffer_unref (buffer);
+    cvReleaseImage (&image);
+    return NULL;
+  }
+
+  for (y = 0; y < height; y += 2) {
+    guint8 *py = GST_VIDEO_FRAME_COMP_DATA (&frame, 0) +
+        y * GST_VIDEO_FRAME_COMP_STRIDE (&frame, 0);
+    guint8 *pu = GST_VIDEO_FRAME_COMP_DATA (&frame, 1) +
+        (y / 2) * GST_VIDEO_FRAME_COMP_STRIDE (&frame, 1);
+    guint8 *pv = GST_VIDEO_FRAME_COMP_DATA (&frame, 2) +
+        (y / 2) * GST_VIDEO_FRAME_COMP_STRIDE (&frame, 2);
+
+    for (x = 0; x < width; x += 2) {
+      gint r = 0, g = 0, b = 0, dx, dy;
+
+      for (dy = 0; dy < 2; dy++) {
+        const guint8 *bgr = (const guint8 *) image->imageData +
+            (y + dy) * image->widthStep + x * 3;
+
+        for (dx = 0; dx < 2; dx++, bgr += 3) {
+          py[dy * GST_VIDEO_FRAME_COMP_STRIDE (&frame, 0) + x + dx] =
+              ((66 * bgr[2] + 129 * bgr[1] + 25 * bgr[0] + 128) >> 8) + 16;
+          b += bgr[0];
+          g += bgr[1];
+          r += bgr[2];
+        }
+      }
+
+      r = (r + 2) / 4;
+      g = (g + 2) / 4;
+      b = (b + 2) / 4;
+      pu[x / 2] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+      pv[x / 2] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+  }
+
+  gst_video_frame_unmap (&frame);
+  cvReleaseImage (&image);
+
+  return buffer;
+}
+
+static void
+kms_compositor_set_background_image (KmsCompositor * self, const gchar * path)
+{
+  GstBuffer *buffer = NULL, *old;
+  GstVideoInfo info;
+
+  /* decoded out of the object lock, streaming goes on meanwhile */
+  if (path != NULL && path[0] != '\0') {
+    buffer = kms_compositor_load_image (path, &info);
+    if (buffer == NULL) {
+      GST_WARNING_OBJECT (self, "Cannot load background image %s", path);
+    } else {
+      GST_INFO_OBJECT (self, "Background image %s, %dx%d", path,
+          GST_VIDEO_INFO_WIDTH (&info), GST_VIDEO_INFO_HEIGHT (&info));
+    }
+  }
+
+  GST_OBJECT_LOCK (self);
+  g_free (self->priv->background_image);
+  self->priv->background_image = g_strdup (path);
+  old = self->priv->background_buffer;
+  self->priv->background_buffer = buffer;
+  if (buffer != NULL)
+    self->priv->background_info = info;
+  GST_OBJECT_UNLOCK (self);
+
+  if (old != NULL)
+    gst_buffer_unref (old);
+}
+
+static gboolean
+kms_compositor_clock_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  if (GST_QUERY_TYPE (query) != GST_QUERY_LATENCY)
+    return FALSE;
+
+  /* a live source without latency of its own, so the aggregator produces */
+  /* a frame per period even when no input has data, or there is none */
+  gst_query_set_latency (query, TRUE, 0, GST_CLOCK_TIME_NONE);
+
+  return TRUE;
+}
+
+/* the clock input starts a stream as any other, so that it can be ended */
+static void
+kms_compositor_start_clock (KmsCompositor * self, GstPad * clock_src)
+{
+  GstSegment segment;
+  gchar *stream_id;
+
+  /* kept on the pad until the compositor pad is active */
+  stream_id = gst_pad_create_stream_id (clock_src, GST_ELEMENT (self),
+      "clock");
+  gst_pad_push_event (clock_src, gst_event_new_stream_start (stream_id));
+  g_free (stream_id);
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (clock_src, gst_event_new_segment (&segment));
+}
+
+/* on teardown the aggregator does not wait for the clock input anymore */
+static void
+kms_compositor_stop_clock (KmsCompositor * self, GstPad * clock_src)
+{
+  if (!gst_pad_push_event (clock_src, gst_event_new_eos ())) {
+    GST_DEBUG_OBJECT (self, "Clock pad EOS not delivered");
+  }
+}
+
+static void
+kms_compositor_set_live (KmsCompositor * self, gboolean live)
+{
+  GstPad *clock_src = NULL, *clock_sink = NULL;
+
+  GST_OBJECT_LOCK (self);
+
+  if (self->priv->live == live) {
+    GST_OBJECT_UNLOCK (self);
+    return;
+  }
+
+  self->priv->live = live;
+  if (!live) {
+    clock_src = self->priv->clock_src;
+    clock_sink = self->priv->clock_sink;
+    self->priv->clock_src = NULL;
+    self->priv->clock_sink = NULL;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+
+  if (!live) {
+    if (clock_sink != NULL) {
+      kms_compositor_stop_clock (self, clock_src);
+      gst_pad_unlink (clock_src, clock_sink);
+      gst_element_release_request_pad (GST_ELEMENT (self), clock_sink);
+      g_object_unref (clock_sink);
+    }
+    g_clear_object (&clock_src);
+    return;
+  }
+
+  /* never carries data, it only answers the latency query */
+  clock_src = gst_pad_new ("clock_src", GST_PAD_SRC);
+  gst_pad_set_query_function (clock_src, kms_compositor_clock_query);
+
+  clock_sink = gst_element_get_request_pad (GST_ELEMENT (self), "sink_%u");
+  if (clock_sink == NULL || gst_pad_link (clock_src, clock_sink) !=
+      GST_PAD_LINK_OK) {
+    GST_ERROR_OBJECT (self, "Cannot link clock pad");
+    if (clock_sink != NULL) {
+      gst_element_release_request_pad (GST_ELEMENT (self), clock_sink);
+      g_object_unref (clock_sink);
+    }
+    g_object_unref (clock_src);
+    return;
+  }
+
+  gst_pad_set_active (clock_src, TRUE);
+  kms_compositor_start_clock (self, clock_src);
+
+  GST_OBJECT_LOCK (self);
+  self->priv->clock_src = clock_src;
+  self->priv->clock_sink = clock_sink;
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+kms_compositor_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsCompositor *self = KMS_COMPOSITOR (object);
+
+  GST_OBJECT_LOCK (self);
+
+  switch (prop_id) {
+    case PROP_BACKGROUND:
+      g_value_set_enum (value, self->priv->background);
+      break;
+    case PROP_BACKGROUND_IMAGE:
+      g_value_set_string (value, self->priv->background_image);
+      break;
+    case PROP_WIDTH:
+      g_value_set_int (value, self->priv->width);
+      break;
+    case PROP_HEIGHT:
+      g_value_set_int (value, self->priv->height);
+      break;
+    case PROP_FRAME_RATE:
+      g_value_set_int (value, self->priv->frame_rate);
+      break;
+    case PROP_LIVE:
+      g_value_set_boolean (value, self->priv->live);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+kms_compositor_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsCompositor *self = KMS_COMPOSITOR (object);
+  gboolean changed = FALSE;
+  gint val;
+
+  if (prop_id == PROP_BACKGROUND_IMAGE) {
+    kms_compositor_set_background_image (self, g_value_get_string (value));
+    return;
+  }
+
+  if (prop_id == PROP_LIVE) {
+    kms_compositor_set_live (self, g_value_get_boolean (value));
+    return;
+  }
+
+  GST_OBJECT_LOCK (self);
+
+  switch (prop_id) {
+    case PROP_BACKGROUND:
+      self->priv->background = g_value_get_enum (value);
+      break;
+    case PROP_WIDTH:
+      val = g_value_get_int (value);
+      changed = val != self->priv->width;
+      self->priv->width = val;
+      break;
+    case PROP_HEIGHT:
+      val = g_value_get_int (value);
+      changed = val != self->priv->height;
+      self->priv->height = val;
+      break;
+    case PROP_FRAME_RATE:
+      val = g_value_get_int (value);
+      changed = val != self->priv->frame_rate;
+      self->priv->frame_rate = val;
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+
+  GST_OBJECT_UNLOCK (self);
+
+  if (changed) {
+    /* new output caps from the next frame on */
+    gst_pad_mark_reconfigure (GST_AGGREGATOR (self)->srcpad);
+  }
+}
+
+static GstCaps *
+kms_compositor_update_caps (GstVideoAggregator * vagg, GstCaps * caps)
+{
+  KmsCompositor *self = KMS_COMPOSITOR (vagg);
+  gint best_width = 0, best_height = 0, best_fps_n = 0, best_fps_d = 1;
+  gdouble best_fps = 0.0;
+  GstCaps *ret;
+  GList *l;
+  guint i;
+
+  GST_OBJECT_LOCK (vagg);
+
+  for (l = GST_ELEMENT (vagg)->sinkpads; l != NULL; l = l->next) {
+    GstVideoAggregatorPad *vpad = l->data;
+    KmsCompositorPad *cpad = l->data;
+    gint fps_n, fps_d, width, height;
+
+    if (GST_VIDEO_INFO_FORMAT (&vpad->info) == GST_VIDEO_FORMAT_UNKNOWN)
+      continue;
+
+    GST_OBJECT_LOCK (cpad);
+    width = cpad->width > 0 ? cpad->width : GST_VIDEO_INFO_WIDTH (&vpad->info);
+    height = cpad->height > 0 ? cpad->height :
+        GST_VIDEO_INFO_HEIGHT (&vpad->info);
+    best_width = MAX (best_width, cpad->xpos + width);
+    best_height = MAX (best_height, cpad->ypos + height);
+    GST_OBJECT_UNLOCK (cpad);
+
+    fps_n = GST_VIDEO_INFO_FPS_N (&vpad->info);
+    fps_d = GST_VIDEO_INFO_FPS_D (&vpad->info);
+    if (fps_n > 0 && fps_d > 0 && (gdouble) fps_n / fps_d > best_fps) {
+      best_fps = (gdouble) fps_n / fps_d;
+      best_fps_n = fps_n;
+      best_fps_d = fps_d;
+    }
+  }
+
+  /* fixed output geometry, when configured */
+  if (self->priv->width > 0)
+    best_width = self->priv->width;
+  if (self->priv->height > 0)
+    best_height = self->priv->height;
+  if (self->priv->frame_rate > 0) {
+    best_fps_n = self->priv->frame_rate;
+    best_fps_d = 1;
+  } else if (best_fps_n <= 0) {
+    best_fps_n = 25;
+    best_fps_d = 1;
+  }
+
+  GST_OBJECT_UNLOCK (vagg);
+
+  ret = gst_caps_make_writable (gst_caps_ref (caps));
+
+  for (i = 0; i < gst_caps_get_size (ret); i++) {
+    GstStructure *s = gst_caps_get_structure (ret, i);
+    const gchar *format = gst_structure_get_string (s, "format");
+
+    /* inputs with alpha are blended, the output never has it */
+    if (g_strcmp0 (format, "I420") != 0 && g_strcmp0 (format, "NV12") != 0) {
+      gst_structure_set (s, "format", G_TYPE_STRING, "I420", NULL);
+    }
+
+    if (best_width > 0 && best_height > 0) {
+      gst_structure_set (s, "width", G_TYPE_INT, best_width, "height",
+          G_TYPE_INT, best_height, NULL);
+    }
+
+    gst_structure_set (s, "framerate", GST_TYPE_FRACTION, best_fps_n,
+        best_fps_d, NULL);
+  }
+
+  return ret;
+}
+
+static gboolean
+kms_compositor_rect_contains (const KmsCompositorEntry * outer,
+    const KmsCompositorEntry * inner)
+{
+  return outer->x <= inner->x && outer->y <= inner->y &&
+      outer->x + outer->width >= inner->x + inner->width &&
+      outer->y + outer->height >= inner->y + inner->height;
+}
+
+/* Marks the inputs hidden below opaque ones, returns TRUE when the */
+/* whole output is covered by an opaque input */
+static gboolean
+kms_compositor_cull (KmsCompositorEntry * entries, guint n, gint width,
+    gint height)
+{
+  KmsCompositorEntry output = { NULL, 0, 0, width, height, 255, TRUE, FALSE };
+  gboolean covered = FALSE;
+  gint i, j;
+
+  for (i = n - 1; i >= 0; i--) {
+    KmsCompositorEntry clipped = entries[i];
+
+    /* only the visible part matters */
+    clipped.x = MAX (entries[i].x, 0);
+    clipped.y = MAX (entries[i].y, 0);
+    clipped.width = MIN (entries[i].x + entries[i].width, width) - clipped.x;
+    clipped.height =
+        MIN (entries[i].y + entries[i].height, height) - clipped.y;
+
+    if (clipped.width <= 0 || clipped.height <= 0 || covered) {
+      entries[i].skip = TRUE;
+      continue;
+    }
+
+    for (j = i + 1; j < (gint) n && !entries[i].skip; j++) {
+      if (entries[j].opaque && !entries[j].skip
+          && kms_compositor_rect_contains (&entries[j], &clipped)) {
+        entries[i].skip = TRUE;
+      }
+    }
+
+    if (!entries[i].skip && entries[i].opaque
+        && kms_compositor_rect_contains (&entries[i], &output)) {
+      covered = TRUE;
+    }
+  }
+
+  return covered;
+}
+
+static void
+kms_compositor_fill_background (KmsCompositorRender * render,
+    KmsCompositorPlane * plane, guint first_comp, gint row_start,
+    gint row_end)
+{
+  guint8 value[2];
+
+  if (first_comp == 0) {
+    switch (render->background) {
+      case KMS_COMPOSITOR_BACKGROUND_CHECKER:
+        kms_compositor_fill_checker (plane, CHECKER_SIZE, 80, 160, row_start,
+            row_end);
+        return;
+      case KMS_COMPOSITOR_BACKGROUND_WHITE:
+        value[0] = 235;
+        break;
+      default:
+        value[0] = 16;
+        break;
+    }
+  } else {
+    value[0] = value[1] = 128;
+  }
+
+  kms_compositor_fill (plane, value, row_start, row_end);
+}
+
+static void
+kms_compositor_render_band (KmsCompositorBand * band)
+{
+  KmsCompositorRender *render = band->render;
+  GstVideoFrame *out = render->out;
+  const GstVideoFormatInfo *finfo = out->info.finfo;
+  guint p, c, e;
+
+  for (p = 0; p < GST_VIDEO_FRAME_N_PLANES (out); p++) {
+    KmsCompositorComponent src[GST_VIDEO_MAX_COMPONENTS];
+    guint comps[GST_VIDEO_MAX_COMPONENTS];
+    KmsCompositorPlane plane;
+    gint row_start, row_end, wsub, hsub;
+    guint n = 0;
+
+    for (c = 0; c < GST_VIDEO_FRAME_N_COMPONENTS (out); c++) {
+      if (GST_VIDEO_FORMAT_INFO_PLANE (finfo, c) == p)
+        comps[n++] = c;
+    }
+
+    plane.data = GST_VIDEO_FRAME_COMP_DATA (out, comps[0]);
+    plane.stride = GST_VIDEO_FRAME_COMP_STRIDE (out, comps[0]);
+    plane.width = GST_VIDEO_FRAME_COMP_WIDTH (out, comps[0]);
+    plane.height = GST_VIDEO_FRAME_COMP_HEIGHT (out, comps[0]);
+    plane.n_channels = n;
+
+    wsub = GST_VIDEO_FORMAT_INFO_W_SUB (finfo, comps[0]);
+    hsub = GST_VIDEO_FORMAT_INFO_H_SUB (finfo, comps[0]);
+
+    /* bands start at even rows, so they split subsampled planes exactly */
+    row_start = band->row_start >> hsub;
+    row_end = band->row_end >= GST_VIDEO_FRAME_HEIGHT (out) ?
+        plane.height : band->row_end >> hsub;
+
+    if (render->fill) {
+      kms_compositor_fill_background (render, &plane, comps[0], row_start,
+          row_end);
+    }
+
+    for (e = 0; e < render->n_entries; e++) {
+      KmsCompositorEntry *entry = &render->entries[e];
+      KmsCompositorComponent alpha, *src_alpha = NULL;
+      GstVideoFrame *frame = entry->frame;
+      gint x0, y0, x1, y1;
+
+      if (entry->skip)
+        continue;
+
+      for (c = 0; c < n; c++) {
+        src[c].data = GST_VIDEO_FRAME_COMP_DATA (frame, comps[c]);
+        src[c].stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, comps[c]);
+        src[c].pixel_stride = GST_VIDEO_FRAME_COMP_PSTRIDE (frame, comps[c]);
+        src[c].width = GST_VIDEO_FRAME_COMP_WIDTH (frame, comps[c]);
+        src[c].height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, comps[c]);
+      }
+
+      if (GST_VIDEO_INFO_HAS_ALPHA (&frame->info)) {
+        alpha.data = GST_VIDEO_FRAME_COMP_DATA (frame, GST_VIDEO_COMP_A);
+        alpha.stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, GST_VIDEO_COMP_A);
+        alpha.pixel_stride =
+            GST_VIDEO_FRAME_COMP_PSTRIDE (frame, GST_VIDEO_COMP_A);
+        alpha.width = GST_VIDEO_FRAME_COMP_WIDTH (frame, GST_VIDEO_COMP_A);
+        alpha.height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, GST_VIDEO_COMP_A);
+        src_alpha = &alpha;
+      }
+
+      /* rectangle in plane units, rounded outwards */
+      x0 = entry->x >> wsub;
+      y0 = entry->y >> hsub;
+      x1 = -((-(entry->x + entry->width)) >> wsub);
+      y1 = -((-(entry->y + entry->height)) >> hsub);
+
+      kms_compositor_blit (&plane, src, src_alpha, x0, y0, x1 - x0, y1 - y0,
+          entry->alpha, row_start, row_end, band->scratch);
+    }
+  }
+}
+
+static void
+kms_compositor_band_run (KmsCompositorBand * band, gpointer unused)
+{
+  KmsCompositorRender *render = band->render;
+
+  kms_compositor_render_band (band);
+
+  g_mutex_lock (&render->mutex);
+  if (--render->pending == 0)
+    g_cond_signal (&render->cond);
+  g_mutex_unlock (&render->mutex);
+}
+
+static gpointer
+kms_compositor_create_pool (gpointer data)
+{
+  return g_thread_pool_new ((GFunc) kms_compositor_band_run, NULL,
+      g_get_num_processors (), FALSE, NULL);
+}
+
+static GThreadPool *
+kms_compositor_get_pool (void)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  g_once (&once, kms_compositor_create_pool, NULL);
+
+  return once.retval;
+}
+
+static void
+kms_compositor_render (KmsCompositor * self, KmsCompositorRender * render)
+{
+  KmsCompositorBand bands[MAX_BANDS];
+  gint height = GST_VIDEO_FRAME_HEIGHT (render->out);
+  gint n_bands = 1, rows, i;
+
+  if (GST_VIDEO_FRAME_WIDTH (render->out) * height >= PARALLEL_MIN_PIXELS) {
+    n_bands = CLAMP (g_get_num_processors (), 1, MAX_BANDS);
+  }
+
+  /* even number of rows per band */
+  rows = ((height + n_bands - 1) / n_bands + 1) & ~1;
+
+  for (i = 0; i < n_bands; i++) {
+    if (self->priv->scratch[i] == NULL)
+      self->priv->scratch[i] = kms_compositor_scratch_new ();
+
+    bands[i].render = render;
+    bands[i].row_start = MIN (i * rows, height);
+    bands[i].row_end = MIN ((i + 1) * rows, height);
+    bands[i].scratch = self->priv->scratch[i];
+  }
+
+  if (n_bands == 1) {
+    kms_compositor_render_band (&bands[0]);
+    return;
+  }
+
+  g_mutex_init (&render->mutex);
+  g_cond_init (&render->cond);
+  render->pending = n_bands - 1;
+
+  for (i = 1; i < n_bands; i++) {
+    g_thread_pool_push (kms_compositor_get_pool (), &bands[i], NULL);
+  }
+
+  kms_compositor_render_band (&bands[0]);
+
+  g_mutex_lock (&render->mutex);
+  while (render->pending > 0)
+    g_cond_wait (&render->cond, &render->mutex);
+  g_mutex_unlock (&render->mutex);
+
+  g_cond_clear (&render->cond);
+  g_mutex_clear (&render->mutex);
+}
+
+static GstFlowReturn
+kms_compositor_aggregate_frames (GstVideoAggregator * vagg, GstBuffer * outbuf)
+{
+  KmsCompositor *self = KMS_COMPOSITOR (vagg);
+  GstVideoFrame out_frame, bg_frame;
+  KmsCompositorRender render;
+  GstBuffer *bg_buffer = NULL;
+  gboolean covered;
+  GList *l;
+  guint n = 0;
+
+  if (!gst_video_frame_map (&out_frame, &vagg->info, outbuf, GST_MAP_WRITE)) {
+    GST_WARNING_OBJECT (vagg, "Could not map output buffer");
+    return GST_FLOW_ERROR;
+  }
+
+  memset (&render, 0, sizeof (render));
+  render.out = &out_frame;
+
+  g_mutex_lock (&self->priv->layout_lock);
+  GST_OBJECT_LOCK (vagg);
+
+  render.background = self->priv->background;
+  render.entries = g_newa (KmsCompositorEntry,
+      g_list_length (GST_ELEMENT (vagg)->sinkpads) + 1);
+
+  /* the background image is the bottom input, stretched to the output */
+  if (self->priv->background_buffer != NULL
+      && gst_video_frame_map (&bg_frame, &self->priv->background_info,
+          self->priv->background_buffer, GST_MAP_READ)) {
+    bg_buffer = gst_buffer_ref (self->priv->background_buffer);
+    render.entries[n].frame = &bg_frame;
+    render.entries[n].x = render.entries[n].y = 0;
+    render.entries[n].width = GST_VIDEO_FRAME_WIDTH (&out_frame);
+    render.entries[n].height = GST_VIDEO_FRAME_HEIGHT (&out_frame);
+    render.entries[n].alpha = 255;
+    render.entries[n].opaque = TRUE;
+    render.entries[n].skip = FALSE;
+    n++;
+  }
+
+  /* sink pads are sorted by zorder */
+  for (l = GST_ELEMENT (vagg)->sinkpads; l != NULL; l = l->next) {
+    GstVideoAggregatorPad *pad = l->data;
+    KmsCompositorPad *cpad = l->data;
+    KmsCompositorEntry *entry = &render.entries[n];
+    GstVideoFrame *frame = pad->aggregated_frame;
+    gdouble alpha;
+
+    if (frame == NULL)
+      continue;
+
+    GST_OBJECT_LOCK (cpad);
+    entry->x = cpad->xpos;
+    entry->y = cpad->ypos;
+    entry->width = cpad->width > 0 ? cpad->width :
+        GST_VIDEO_FRAME_WIDTH (frame);
+    entry->height = cpad->height > 0 ? cpad->height :
+        GST_VIDEO_FRAME_HEIGHT (frame);
+    alpha = cpad->alpha;
+    GST_OBJECT_UNLOCK (cpad);
+
+    entry->frame = frame;
+    entry->alpha = CLAMP ((gint) (alpha * 255.0 + 0.5), 0, 255);
+    entry->opaque = entry->alpha == 255
+        && !GST_VIDEO_INFO_HAS_ALPHA (&frame->info);
+    entry->skip = entry->alpha == 0;
+    n++;
+  }
+
+  /* geometry taken, a pending batch may go on */
+  g_mutex_unlock (&self->priv->layout_lock);
+
+  render.n_entries = n;
+  covered = kms_compositor_cull (render.entries, n,
+      GST_VIDEO_FRAME_WIDTH (&out_frame), GST_VIDEO_FRAME_HEIGHT (&out_frame));
+  render.fill = !covered;
+
+  kms_compositor_render (self, &render);
+
+  GST_OBJECT_UNLOCK (vagg);
+
+  if (bg_buffer != NULL) {
+    gst_video_frame_unmap (&bg_frame);
+    gst_buffer_unref (bg_buffer);
+  }
+
+  gst_video_frame_unmap (&out_frame);
+
+  return GST_FLOW_OK;
+}
+
+/* A live compositor is usually added to a pipeline that is already */
+/* playing. Starting its output at zero would make it produce the frames */
+/* of the whole elapsed running time at once before catching up. */
+static void
+kms_compositor_set_live_start_time (KmsCompositor * self)
+{
+  GstClockTime base_time, now, running_time;
+  GstClock *clock;
+
+  clock = gst_element_get_clock (GST_ELEMENT (self));
+  if (clock == NULL) {
+    GST_WARNING_OBJECT (self, "No clock to start the output at");
+    return;
+  }
+
+  now = gst_clock_get_time (clock);
+  base_time = gst_element_get_base_time (GST_ELEMENT (self));
+  gst_object_unref (clock);
+
+  running_time = now > base_time ? now - base_time : 0;
+
+  GST_DEBUG_OBJECT (self, "Output starts at %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (running_time));
+
+  g_object_set (self, "start-time-selection", 2 /*set */ , "start-time",
+      running_time, NULL);
+}
+
+static GstStateChangeReturn
+kms_compositor_change_state (GstElement * element, GstStateChange transition)
+{
+  KmsCompositor *self = KMS_COMPOSITOR (element);
+  GstStateChangeReturn ret;
+  GstPad *clock_src = NULL;
+  gboolean live;
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_PLAYING) {
+    GST_OBJECT_LOCK (self);
+    live = self->priv->live;
+    GST_OBJECT_UNLOCK (self);
+
+    if (live) {
+      kms_compositor_set_live_start_time (self);
+    }
+  }
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    GST_OBJECT_LOCK (self);
+    if (self->priv->clock_src != NULL)
+      clock_src = g_object_ref (self->priv->clock_src);
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  if (clock_src != NULL) {
+    kms_compositor_stop_clock (self, clock_src);
+  }
+
+  ret = GST_ELEMENT_CLASS (kms_compositor_parent_class)->change_state (element,
+      transition);
+
+  if (clock_src != NULL) {
+    /* drops the EOS, the next run starts the clock stream again */
+    gst_pad_set_active (clock_src, FALSE);
+    gst_pad_set_active (clock_src, TRUE);
+    kms_compositor_start_clock (self, clock_src);
+    g_object_unref (clock_src);
+  }
+
+  return ret;
+}
+
+static void
+kms_compositor_finalize (GObject * object)
+{
+  KmsCompositor *self = KMS_COMPOSITOR (object);
+  guint i;
+
+  for (i = 0; i < MAX_BANDS; i++)
+    kms_compositor_scratch_free (self->priv->scratch[i]);
+
+  g_clear_object (&self->priv->clock_sink);
+  g_clear_object (&self->priv->clock_src);
+
+  if (self->priv->background_buffer != NULL)
+    gst_buffer_unref (self->priv->background_buffer);
+
+  g_free (self->priv->background_image);
+  g_mutex_clear (&self->priv->layout_lock);
+
+  G_OBJECT_CLASS (kms_compositor_parent_class)->finalize (object);
+}
+
+static void
+kms_compositor_class_init (KmsCompositorClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *gstelement_class = GST_ELEMENT_CLASS (klass);
+  GstAggregatorClass *agg_class = GST_AGGREGATOR_CLASS (klass);
+  GstVideoAggregatorClass *vagg_class = GST_VIDEO_AGGREGATOR_CLASS (klass);
+
+  gobject_class->set_property = kms_compositor_set_property;
+  gobject_class->get_property = kms_compositor_get_property;
+  gobject_class->finalize = kms_compositor_finalize;
+
+  gstelement_class->change_state =
+      GST_DEBUG_FUNCPTR (kms_compositor_change_state);
+
+  agg_class->sinkpads_type = KMS_TYPE_COMPOSITOR_PAD;
+  vagg_class->update_caps = GST_DEBUG_FUNCPTR (kms_compositor_update_caps);
+  vagg_class->aggregate_frames =
+      GST_DEBUG_FUNCPTR (kms_compositor_aggregate_frames);
+
+  g_object_class_install_property (gobject_class, PROP_BACKGROUND,
+      g_param_spec_enum ("background", "Background", "Background type",
+          KMS_TYPE_COMPOSITOR_BACKGROUND, DEFAULT_BACKGROUND,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_BACKGROUND_IMAGE,
+      g_param_spec_string ("background-image", "Background image",
+          "Background Image local file path, shown below every input",
+          NULL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_WIDTH,
+      g_param_spec_int ("width", "Width",
+          "Fixed width of output screen (0 = expandable by the content)",
+          0, G_MAXINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_HEIGHT,
+      g_param_spec_int ("height", "Height",
+          "Fixed height of output screen (0 = expandable by the content)",
+          0, G_MAXINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FRAME_RATE,
+      g_param_spec_int ("frame-rate", "Frame rate",
+          "Fixed frame rate of output screen (0 = expandable by the content)",
+          0, G_MAXINT, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LIVE,
+      g_param_spec_boolean ("live", "Live",
+          "Produce frames at the output frame rate on the pipeline clock, "
+          "even without inputs, starting at the running time the element "
+          "goes to PLAYING at", FALSE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&src_factory));
+  gst_element_class_add_pad_template (gstelement_class,
+      gst_static_pad_template_get (&sink_factory));
+
+  gst_element_class_set_static_metadata (gstelement_class,
+      "YUV compositor", "Filter/Editor/Video/Compositor",
+      "Scales and blends I420, NV12 and AYUV inputs into an I420 or NV12 "
+      "output without format conversions",
+      "Tao Ren <tao@swarmnyc.com> <tour.ren.gz@gmail.com>");
+
+  g_type_class_add_private (klass, sizeof (KmsCompositorPrivate));
+}
+
+static void
+kms_compositor_init (KmsCompositor * self)
+{
+  self->priv = KMS_COMPOSITOR_GET_PRIVATE (self);
+
+  self->priv->background = DEFAULT_BACKGROUND;
+  g_mutex_init (&self->priv->layout_lock);
+}
+
+void
+kms_compositor_begin_layout (KmsCompositor * self)
+{
+  g_return_if_fail (KMS_IS_COMPOSITOR (self));
+
+  g_mutex_lock (&self->priv->layout_lock);
+}
+
+void
+kms_compositor_end_layout (KmsCompositor * self)
+{
+  g_return_if_fail (KMS_IS_COMPOSITOR (self));
+
+  g_mutex_unlock (&self->priv->layout_lock);
+}
+
+gboolean
+kms_compositor_plugin_init (GstPlugin * plugin)
+{
+  return gst_element_register (plugin, PLUGIN_NAME, GST_RANK_NONE,
+      KMS_TYPE_COMPOSITOR);
+}
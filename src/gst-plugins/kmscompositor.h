@@ -0,0 +1,91 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_COMPOSITOR_H_
+#define _KMS_COMPOSITOR_H_
+
+#ifndef GST_USE_UNSTABLE_API
+#define GST_USE_UNSTABLE_API
+#endif
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <gst/video/gstvideoaggregator.h>
+
+G_BEGIN_DECLS
+
+#define KMS_TYPE_COMPOSITOR   (kms_compositor_get_type())
+#define KMS_COMPOSITOR(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),KMS_TYPE_COMPOSITOR,KmsCompositor))
+#define KMS_COMPOSITOR_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),KMS_TYPE_COMPOSITOR,KmsCompositorClass))
+#define KMS_IS_COMPOSITOR(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),KMS_TYPE_COMPOSITOR))
+#define KMS_IS_COMPOSITOR_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE((klass),KMS_TYPE_COMPOSITOR))
+
+#define KMS_TYPE_COMPOSITOR_PAD   (kms_compositor_pad_get_type())
+#define KMS_COMPOSITOR_PAD(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),KMS_TYPE_COMPOSITOR_PAD,KmsCompositorPad))
+#define KMS_COMPOSITOR_PAD_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),KMS_TYPE_COMPOSITOR_PAD,KmsCompositorPadClass))
+#define KMS_IS_COMPOSITOR_PAD(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),KMS_TYPE_COMPOSITOR_PAD))
+#define KMS_IS_COMPOSITOR_PAD_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE((klass),KMS_TYPE_COMPOSITOR_PAD))
+
+typedef struct _KmsCompositor KmsCompositor;
+typedef struct _KmsCompositorClass KmsCompositorClass;
+typedef struct _KmsCompositorPrivate KmsCompositorPrivate;
+typedef struct _KmsCompositorPad KmsCompositorPad;
+typedef struct _KmsCompositorPadClass KmsCompositorPadClass;
+
+typedef enum
+{
+  KMS_COMPOSITOR_BACKGROUND_CHECKER,
+  KMS_COMPOSITOR_BACKGROUND_BLACK,
+  KMS_COMPOSITOR_BACKGROUND_WHITE,
+  KMS_COMPOSITOR_BACKGROUND_TRANSPARENT
+} KmsCompositorBackground;
+
+struct _KmsCompositor
+{
+  GstVideoAggregator parent;
+  KmsCompositorPrivate *priv;
+};
+
+struct _KmsCompositorClass
+{
+  GstVideoAggregatorClass parent_class;
+};
+
+struct _KmsCompositorPad
+{
+  GstVideoAggregatorPad parent;
+
+  /* < private > */
+  gint xpos, ypos;
+  gint width, height;
+  gdouble alpha;
+};
+
+struct _KmsCompositorPadClass
+{
+  GstVideoAggregatorPadClass parent_class;
+};
+
+GType kms_compositor_get_type (void);
+GType kms_compositor_pad_get_type (void);
+
+/* Pad properties set between these calls reach the same output frame, */
+/* none is composed with only part of them applied. Do not nest them. */
+void kms_compositor_begin_layout (KmsCompositor * self);
+void kms_compositor_end_layout (KmsCompositor * self);
+
+gboolean kms_compositor_plugin_init (GstPlugin * plugin);
+
+G_END_DECLS
+#endif /* _KMS_COMPOSITOR_H_ */
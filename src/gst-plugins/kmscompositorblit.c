@@ -0,0 +1,713 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmscompositorblit.h"
+
+#include <string.h>
+
+#if (defined (__x86_64__) || defined (__i386__)) && \
+    (defined (__clang__) || __GNUC__ > 4 || \
+        (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define KMS_COMPOSITOR_X86 1
+#include <immintrin.h>
+#endif
+
+/* exact x / 255 for x in [0, 255 * 255] */
+#define DIV_255(x) (((x) + 128 + (((x) + 128) >> 8)) >> 8)
+
+/* weights are in 1/256 units */
+#define LERP(a, b, w) (((a) * (256 - (w)) + (b) * (w) + 128) >> 8)
+
+typedef struct _KmsCompositorTap
+{
+  gint x0;
+  gint x1;
+  guint weight;
+} KmsCompositorTap;
+
+typedef struct _KmsCompositorRowCache
+{
+  guint8 *rows[2];
+  gint index[2];
+} KmsCompositorRowCache;
+
+struct _KmsCompositorScratch
+{
+  KmsCompositorTap *taps;
+  gsize size;
+  guint8 *line;                 /* vertically interpolated source row */
+  gsize line_size;
+  KmsCompositorRowCache color;
+  KmsCompositorRowCache alpha;
+};
+
+/* dst = lerp (row0, row1, weight) blended over dst with a constant alpha */
+typedef void (*KmsCompositorRowFunc) (guint8 * dst, const guint8 * row0,
+    const guint8 * row1, guint weight, guint alpha, gsize n);
+
+/* the same, also weighted by the interpolated per pixel alpha */
+typedef void (*KmsCompositorRowAlphaFunc) (guint8 * dst, const guint8 * row0,
+    const guint8 * row1, const guint8 * alpha0, const guint8 * alpha1,
+    guint weight, guint alpha, gsize n);
+
+typedef struct _KmsCompositorKernels
+{
+  KmsBlendImpl impl;
+  KmsCompositorRowFunc row;
+  KmsCompositorRowAlphaFunc row_alpha;
+} KmsCompositorKernels;
+
+static inline void
+kms_compositor_row_scalar_loop (guint8 * dst, const guint8 * row0,
+    const guint8 * row1, guint weight, guint alpha, gsize n)
+{
+  gsize i;
+
+  if (alpha == 255) {
+    for (i = 0; i < n; i++)
+      dst[i] = LERP (row0[i], row1[i], weight);
+    return;
+  }
+
+  for (i = 0; i < n; i++) {
+    guint v = LERP (row0[i], row1[i], weight);
+
+    dst[i] = DIV_255 (v * alpha + dst[i] * (255 - alpha));
+  }
+}
+
+static void
+kms_compositor_row_scalar (guint8 * dst, const guint8 * row0,
+    const guint8 * row1, guint weight, guint alpha, gsize n)
+{
+  if (weight == 0 && alpha == 255) {
+    memcpy (dst, row0, n);
+    return;
+  }
+
+  kms_compositor_row_scalar_loop (dst, row0, row1, weight, alpha, n);
+}
+
+static inline void
+kms_compositor_row_alpha_scalar_loop (guint8 * dst, const guint8 * row0,
+    const guint8 * row1, const guint8 * alpha0, const guint8 * alpha1,
+    guint weight, guint alpha, gsize n)
+{
+  gsize i;
+
+  for (i = 0; i < n; i++) {
+    guint v = LERP (row0[i], row1[i], weight);
+    guint a = DIV_255 (LERP (alpha0[i], alpha1[i], weight) * alpha);
+
+    dst[i] = DIV_255 (v * a + dst[i] * (255 - a));
+  }
+}
+
+static void
+kms_compositor_row_alpha_scalar (guint8 * dst, const guint8 * row0,
+    const guint8 * row1, const guint8 * alpha0, const guint8 * alpha1,
+    guint weight, guint alpha, gsize n)
+{
+  kms_compositor_row_alpha_scalar_loop (dst, row0, row1, alpha0, alpha1,
+      weight, alpha, n);
+}
+
+#ifdef KMS_COMPOSITOR_X86
+
+/* all the intermediate values fit in unsigned 16 bits */
+
+__attribute__ ((target ("sse2")))
+static inline __m128i
+kms_compositor_lerp_sse2 (__m128i a, __m128i b, __m128i w0, __m128i w1)
+{
+  const __m128i c128 = _mm_set1_epi16 (128);
+
+  return _mm_srli_epi16 (_mm_add_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (a,
+                  w0), _mm_mullo_epi16 (b, w1)), c128), 8);
+}
+
+__attribute__ ((target ("sse2")))
+static inline __m128i
+kms_compositor_mix_sse2 (__m128i v, __m128i d, __m128i a)
+{
+  const __m128i c128 = _mm_set1_epi16 (128);
+  const __m128i c255 = _mm_set1_epi16 (255);
+  __m128i x;
+
+  x = _mm_add_epi16 (_mm_add_epi16 (_mm_mullo_epi16 (v, a),
+          _mm_mullo_epi16 (d, _mm_sub_epi16 (c255, a))), c128);
+
+  return _mm_srli_epi16 (_mm_add_epi16 (x, _mm_srli_epi16 (x, 8)), 8);
+}
+
+__attribute__ ((target ("sse2")))
+static void
+kms_compositor_row_sse2 (guint8 * dst, const guint8 * row0,
+    const guint8 * row1, guint weight, guint alpha, gsize n)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i w0 = _mm_set1_epi16 (256 - weight);
+  const __m128i w1 = _mm_set1_epi16 (weight);
+  const __m128i a = _mm_set1_epi16 (alpha);
+  gsize i;
+
+  if (weight == 0 && alpha == 255) {
+    memcpy (dst, row0, n);
+    return;
+  }
+
+  for (i = 0; i + 16 <= n; i += 16) {
+    __m128i r0 = _mm_loadu_si128 ((const __m128i *) (row0 + i));
+    __m128i r1 = _mm_loadu_si128 ((const __m128i *) (row1 + i));
+    __m128i lo, hi;
+
+    lo = kms_compositor_lerp_sse2 (_mm_unpacklo_epi8 (r0, zero),
+        _mm_unpacklo_epi8 (r1, zero), w0, w1);
+    hi = kms_compositor_lerp_sse2 (_mm_unpackhi_epi8 (r0, zero),
+        _mm_unpackhi_epi8 (r1, zero), w0, w1);
+
+    if (alpha != 255) {
+      __m128i d = _mm_loadu_si128 ((const __m128i *) (dst + i));
+
+      lo = kms_compositor_mix_sse2 (lo, _mm_unpacklo_epi8 (d, zero), a);
+      hi = kms_compositor_mix_sse2 (hi, _mm_unpackhi_epi8 (d, zero), a);
+    }
+
+    _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packus_epi16 (lo, hi));
+  }
+
+  kms_compositor_row_scalar_loop (dst + i, row0 + i, row1 + i, weight, alpha,
+      n - i);
+}
+
+__attribute__ ((target ("sse2")))
+static void
+kms_compositor_row_alpha_sse2 (guint8 * dst, const guint8 * row0,
+    const guint8 * row1, const guint8 * alpha0, const guint8 * alpha1,
+    guint weight, guint alpha, gsize n)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i c128 = _mm_set1_epi16 (128);
+  const __m128i w0 = _mm_set1_epi16 (256 - weight);
+  const __m128i w1 = _mm_set1_epi16 (weight);
+  const __m128i ca = _mm_set1_epi16 (alpha);
+  gsize i;
+
+  for (i = 0; i + 16 <= n; i += 16) {
+    __m128i r0 = _mm_loadu_si128 ((const __m128i *) (row0 + i));
+    __m128i r1 = _mm_loadu_si128 ((const __m128i *) (row1 + i));
+    __m128i a0 = _mm_loadu_si128 ((const __m128i *) (alpha0 + i));
+    __m128i a1 = _mm_loadu_si128 ((const __m128i *) (alpha1 + i));
+    __m128i d = _mm_loadu_si128 ((const __m128i *) (dst + i));
+    __m128i lo, hi, alo, ahi;
+
+    lo = kms_compositor_lerp_sse2 (_mm_unpacklo_epi8 (r0, zero),
+        _mm_unpacklo_epi8 (r1, zero), w0, w1);
+    hi = kms_compositor_lerp_sse2 (_mm_unpackhi_epi8 (r0, zero),
+        _mm_unpackhi_epi8 (r1, zero), w0, w1);
+    alo = kms_compositor_lerp_sse2 (_mm_unpacklo_epi8 (a0, zero),
+        _mm_unpacklo_epi8 (a1, zero), w0, w1);
+    ahi = kms_compositor_lerp_sse2 (_mm_unpackhi_epi8 (a0, zero),
+        _mm_unpackhi_epi8 (a1, zero), w0, w1);
+
+    /* alpha * constant alpha / 255 */
+    alo = _mm_add_epi16 (_mm_mullo_epi16 (alo, ca), c128);
+    alo = _mm_srli_epi16 (_mm_add_epi16 (alo, _mm_srli_epi16 (alo, 8)), 8);
+    ahi = _mm_add_epi16 (_mm_mullo_epi16 (ahi, ca), c128);
+    ahi = _mm_srli_epi16 (_mm_add_epi16 (ahi, _mm_srli_epi16 (ahi, 8)), 8);
+
+    lo = kms_compositor_mix_sse2 (lo, _mm_unpacklo_epi8 (d, zero), alo);
+    hi = kms_compositor_mix_sse2 (hi, _mm_unpackhi_epi8 (d, zero), ahi);
+
+    _mm_storeu_si128 ((__m128i *) (dst + i), _mm_packus_epi16 (lo, hi));
+  }
+
+  kms_compositor_row_alpha_scalar_loop (dst + i, row0 + i, row1 + i,
+      alpha0 + i, alpha1 + i, weight, alpha, n - i);
+}
+
+__attribute__ ((target ("avx2")))
+static inline __m256i
+kms_compositor_lerp_avx2 (__m256i a, __m256i b, __m256i w0, __m256i w1)
+{
+  const __m256i c128 = _mm256_set1_epi16 (128);
+
+  return _mm256_srli_epi16 (_mm256_add_epi16 (_mm256_add_epi16
+          (_mm256_mullo_epi16 (a, w0), _mm256_mullo_epi16 (b, w1)), c128), 8);
+}
+
+__attribute__ ((target ("avx2")))
+static inline __m256i
+kms_compositor_mix_avx2 (__m256i v, __m256i d, __m256i a)
+{
+  const __m256i c128 = _mm256_set1_epi16 (128);
+  const __m256i c255 = _mm256_set1_epi16 (255);
+  __m256i x;
+
+  x = _mm256_add_epi16 (_mm256_add_epi16 (_mm256_mullo_epi16 (v, a),
+          _mm256_mullo_epi16 (d, _mm256_sub_epi16 (c255, a))), c128);
+
+  return _mm256_srli_epi16 (_mm256_add_epi16 (x, _mm256_srli_epi16 (x, 8)),
+      8);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+kms_compositor_row_avx2 (guint8 * dst, const guint8 * row0,
+    const guint8 * row1, guint weight, guint alpha, gsize n)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i w0 = _mm256_set1_epi16 (256 - weight);
+  const __m256i w1 = _mm256_set1_epi16 (weight);
+  const __m256i a = _mm256_set1_epi16 (alpha);
+  gsize i;
+
+  if (weight == 0 && alpha == 255) {
+    memcpy (dst, row0, n);
+    return;
+  }
+
+  /* unpack and pack work per 128 bits lane, so bytes keep their order */
+  for (i = 0; i + 32 <= n; i += 32) {
+    __m256i r0 = _mm256_loadu_si256 ((const __m256i *) (row0 + i));
+    __m256i r1 = _mm256_loadu_si256 ((const __m256i *) (row1 + i));
+    __m256i lo, hi;
+
+    lo = kms_compositor_lerp_avx2 (_mm256_unpacklo_epi8 (r0, zero),
+        _mm256_unpacklo_epi8 (r1, zero), w0, w1);
+    hi = kms_compositor_lerp_avx2 (_mm256_unpackhi_epi8 (r0, zero),
+        _mm256_unpackhi_epi8 (r1, zero), w0, w1);
+
+    if (alpha != 255) {
+      __m256i d = _mm256_loadu_si256 ((const __m256i *) (dst + i));
+
+      lo = kms_compositor_mix_avx2 (lo, _mm256_unpacklo_epi8 (d, zero), a);
+      hi = kms_compositor_mix_avx2 (hi, _mm256_unpackhi_epi8 (d, zero), a);
+    }
+
+    _mm256_storeu_si256 ((__m256i *) (dst + i), _mm256_packus_epi16 (lo, hi));
+  }
+
+  kms_compositor_row_sse2 (dst + i, row0 + i, row1 + i, weight, alpha, n - i);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+kms_compositor_row_alpha_avx2 (guint8 * dst, const guint8 * row0,
+    const guint8 * row1, const guint8 * alpha0, const guint8 * alpha1,
+    guint weight, guint alpha, gsize n)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i c128 = _mm256_set1_epi16 (128);
+  const __m256i w0 = _mm256_set1_epi16 (256 - weight);
+  const __m256i w1 = _mm256_set1_epi16 (weight);
+  const __m256i ca = _mm256_set1_epi16 (alpha);
+  gsize i;
+
+  for (i = 0; i + 32 <= n; i += 32) {
+    __m256i r0 = _mm256_loadu_si256 ((const __m256i *) (row0 + i));
+    __m256i r1 = _mm256_loadu_si256 ((const __m256i *) (row1 + i));
+    __m256i a0 = _mm256_loadu_si256 ((const __m256i *) (alpha0 + i));
+    __m256i a1 = _mm256_loadu_si256 ((const __m256i *) (alpha1 + i));
+    __m256i d = _mm256_loadu_si256 ((const __m256i *) (dst + i));
+    __m256i lo, hi, alo, ahi;
+
+    lo = kms_compositor_lerp_avx2 (_mm256_unpacklo_epi8 (r0, zero),
+        _mm256_unpacklo_epi8 (r1, zero), w0, w1);
+    hi = kms_compositor_lerp_avx2 (_mm256_unpackhi_epi8 (r0, zero),
+        _mm256_unpackhi_epi8 (r1, zero), w0, w1);
+    alo = kms_compositor_lerp_avx2 (_mm256_unpacklo_epi8 (a0, zero),
+        _mm256_unpacklo_epi8 (a1, zero), w0, w1);
+    ahi = kms_compositor_lerp_avx2 (_mm256_unpackhi_epi8 (a0, zero),
+        _mm256_unpackhi_epi8 (a1, zero), w0, w1);
+
+    /* alpha * constant alpha / 255 */
+    alo = _mm256_add_epi16 (_mm256_mullo_epi16 (alo, ca), c128);
+    alo = _mm256_srli_epi16 (_mm256_add_epi16 (alo, _mm256_srli_epi16 (alo,
+                8)), 8);
+    ahi = _mm256_add_epi16 (_mm256_mullo_epi16 (ahi, ca), c128);
+    ahi = _mm256_srli_epi16 (_mm256_add_epi16 (ahi, _mm256_srli_epi16 (ahi,
+                8)), 8);
+
+    lo = kms_compositor_mix_avx2 (lo, _mm256_unpacklo_epi8 (d, zero), alo);
+    hi = kms_compositor_mix_avx2 (hi, _mm256_unpackhi_epi8 (d, zero), ahi);
+
+    _mm256_storeu_si256 ((__m256i *) (dst + i), _mm256_packus_epi16 (lo, hi));
+  }
+
+  kms_compositor_row_alpha_sse2 (dst + i, row0 + i, row1 + i, alpha0 + i,
+      alpha1 + i, weight, alpha, n - i);
+}
+
+#endif /* KMS_COMPOSITOR_X86 */
+
+static KmsCompositorKernels kernels = { KMS_BLEND_IMPL_AUTO, NULL, NULL };
+
+static const KmsCompositorKernels *
+kms_compositor_get_kernels (void)
+{
+  if (G_UNLIKELY (kernels.row == NULL))
+    kms_compositor_blit_set_impl (KMS_BLEND_IMPL_AUTO);
+
+  return &kernels;
+}
+
+gboolean
+kms_compositor_blit_set_impl (KmsBlendImpl impl)
+{
+  if (impl == KMS_BLEND_IMPL_AUTO)
+    impl = kms_blend_get_impl ();
+
+  /* same instruction sets as the overlay blend kernels */
+  if (kms_blend_get_func (impl) == NULL)
+    return FALSE;
+
+  switch (impl) {
+#ifdef KMS_COMPOSITOR_X86
+    case KMS_BLEND_IMPL_SSE2:
+      kernels.row_alpha = kms_compositor_row_alpha_sse2;
+      kernels.row = kms_compositor_row_sse2;
+      break;
+    case KMS_BLEND_IMPL_AVX2:
+      kernels.row_alpha = kms_compositor_row_alpha_avx2;
+      kernels.row = kms_compositor_row_avx2;
+      break;
+#endif
+    default:
+      impl = KMS_BLEND_IMPL_SCALAR;
+      kernels.row_alpha = kms_compositor_row_alpha_scalar;
+      kernels.row = kms_compositor_row_scalar;
+      break;
+  }
+
+  kernels.impl = impl;
+
+  return TRUE;
+}
+
+KmsBlendImpl
+kms_compositor_blit_get_impl (void)
+{
+  return kms_compositor_get_kernels ()->impl;
+}
+
+KmsCompositorScratch *
+kms_compositor_scratch_new (void)
+{
+  return g_slice_new0 (KmsCompositorScratch);
+}
+
+void
+kms_compositor_scratch_free (KmsCompositorScratch * scratch)
+{
+  if (scratch == NULL)
+    return;
+
+  g_free (scratch->taps);
+  g_free (scratch->line);
+  g_free (scratch->color.rows[0]);
+  g_free (scratch->color.rows[1]);
+  g_free (scratch->alpha.rows[0]);
+  g_free (scratch->alpha.rows[1]);
+  g_slice_free (KmsCompositorScratch, scratch);
+}
+
+static void
+kms_compositor_scratch_reserve (KmsCompositorScratch * scratch, gsize n_pixels,
+    guint n_channels)
+{
+  gsize size = n_pixels * n_channels;
+  guint i;
+
+  if (size <= scratch->size)
+    return;
+
+  scratch->taps = g_renew (KmsCompositorTap, scratch->taps, size);
+  for (i = 0; i < 2; i++) {
+    scratch->color.rows[i] = g_realloc (scratch->color.rows[i], size);
+    scratch->alpha.rows[i] = g_realloc (scratch->alpha.rows[i], size);
+  }
+  scratch->size = size;
+}
+
+static void
+kms_compositor_scratch_reserve_line (KmsCompositorScratch * scratch,
+    gsize size)
+{
+  if (size <= scratch->line_size)
+    return;
+
+  scratch->line = g_realloc (scratch->line, size);
+  scratch->line_size = size;
+}
+
+/* Maps destination position pos of size dst_size to source coordinates */
+/* keeping pixel centres aligned */
+static inline void
+kms_compositor_map (gint pos, gint dst_size, gint src_size, gint * i0,
+    gint * i1, guint * weight)
+{
+  gint64 p = ((gint64) (2 * pos + 1) * src_size * 128) / dst_size - 128;
+  gint i;
+
+  if (p < 0)
+    p = 0;
+
+  i = p >> 8;
+  if (i >= src_size - 1) {
+    *i0 = *i1 = src_size - 1;
+    *weight = 0;
+  } else {
+    *i0 = i;
+    *weight = p & 255;
+    *i1 = *weight != 0 ? i + 1 : i;
+  }
+}
+
+static void
+kms_compositor_scale_row (guint8 * dst, guint step, const guint8 * src,
+    gint pixel_stride, const KmsCompositorTap * taps, gsize n)
+{
+  gsize i;
+
+  if (step == 1 && pixel_stride == 1) {
+    for (i = 0; i < n; i++) {
+      dst[i] = LERP (src[taps[i].x0], src[taps[i].x1], taps[i].weight);
+    }
+    return;
+  }
+
+  for (i = 0; i < n; i++) {
+    const KmsCompositorTap *tap = &taps[i];
+
+    dst[i * step] = LERP (src[tap->x0 * pixel_stride],
+        src[tap->x1 * pixel_stride], tap->weight);
+  }
+}
+
+static const guint8 *
+kms_compositor_get_row (KmsCompositorRowCache * cache,
+    const KmsCompositorComponent * src, guint n_src, guint n_channels,
+    const KmsCompositorTap * taps, gsize n, gint index)
+{
+  guint8 *row;
+  guint slot, c;
+  gsize i;
+
+  if (cache->index[0] == index)
+    return cache->rows[0];
+  if (cache->index[1] == index)
+    return cache->rows[1];
+
+  /* rows are requested in increasing order, the oldest one goes */
+  slot = cache->index[0] < cache->index[1] ? 0 : 1;
+  row = cache->rows[slot];
+  cache->index[slot] = index;
+
+  for (c = 0; c < n_src; c++) {
+    kms_compositor_scale_row (row + c, n_channels,
+        src[c].data + index * src[c].stride, src[c].pixel_stride, taps, n);
+  }
+
+  /* a single source component (alpha) applies to every channel */
+  for (c = n_src; c < n_channels; c++) {
+    for (i = 0; i < n; i++)
+      row[i * n_channels + c] = row[i * n_channels];
+  }
+
+  return row;
+}
+
+/* the components are already laid out as the destination channels */
+static gboolean
+kms_compositor_is_packed (const KmsCompositorComponent * src, guint n)
+{
+  guint c;
+
+  for (c = 0; c < n; c++) {
+    if (src[c].pixel_stride != (gint) n || src[c].data != src[0].data + c
+        || src[c].stride != src[0].stride)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+kms_compositor_blit_row_vertical_first (guint8 * out,
+    const KmsCompositorComponent * src, guint n_channels, gint i0, gint i1,
+    guint weight, guint alpha, gsize n, KmsCompositorScratch * scratch)
+{
+  const KmsCompositorKernels *k = kms_compositor_get_kernels ();
+  gboolean packed = kms_compositor_is_packed (src, n_channels);
+  guint8 *row = alpha == 255 ? out : scratch->color.rows[0];
+  const guint8 *line = NULL;
+  guint c;
+
+  for (c = 0; c < n_channels; c++) {
+    /* interleaved channels share one source row */
+    if (c == 0 || !packed) {
+      if (weight == 0) {
+        line = src[c].data + i0 * src[c].stride;
+      } else {
+        gsize size = (src[c].width - 1) * src[c].pixel_stride + 1;
+
+        if (packed)
+          size += n_channels - 1;
+
+        kms_compositor_scratch_reserve_line (scratch, size);
+        k->row (scratch->line, src[c].data + i0 * src[c].stride,
+            src[c].data + i1 * src[c].stride, weight, 255, size);
+        line = scratch->line;
+      }
+    }
+
+    kms_compositor_scale_row (row + c, n_channels, packed ? line + c : line,
+        src[c].pixel_stride, scratch->taps, n);
+  }
+
+  if (alpha != 255)
+    k->row (out, row, row, 0, alpha, n * n_channels);
+}
+
+void
+kms_compositor_fill (KmsCompositorPlane * dst, const guint8 * value,
+    gint row_start, gint row_end)
+{
+  gsize size = dst->width * dst->n_channels;
+  guint8 *first;
+  gint y;
+  gsize i;
+
+  row_start = MAX (row_start, 0);
+  row_end = MIN (row_end, dst->height);
+
+  if (row_start >= row_end)
+    return;
+
+  first = dst->data + row_start * dst->stride;
+
+  if (dst->n_channels == 1) {
+    for (y = row_start; y < row_end; y++)
+      memset (dst->data + y * dst->stride, value[0], size);
+    return;
+  }
+
+  for (i = 0; i < size; i++)
+    first[i] = value[i % dst->n_channels];
+
+  for (y = row_start + 1; y < row_end; y++)
+    memcpy (dst->data + y * dst->stride, first, size);
+}
+
+void
+kms_compositor_fill_checker (KmsCompositorPlane * dst, gint size,
+    guint8 even, guint8 odd, gint row_start, gint row_end)
+{
+  gint x, y;
+
+  row_start = MAX (row_start, 0);
+  row_end = MIN (row_end, dst->height);
+
+  for (y = row_start; y < row_end; y++) {
+    guint8 *row = dst->data + y * dst->stride;
+
+    for (x = 0; x < dst->width; x++)
+      row[x] = ((x / size + y / size) & 1) ? odd : even;
+  }
+}
+
+void
+kms_compositor_blit (KmsCompositorPlane * dst,
+    const KmsCompositorComponent * src, const KmsCompositorComponent *
+    src_alpha, gint x, gint y, gint width, gint height, guint8 alpha,
+    gint row_start, gint row_end, KmsCompositorScratch * scratch)
+{
+  const KmsCompositorKernels *k = kms_compositor_get_kernels ();
+  guint n_channels = dst->n_channels;
+  gint sw = src[0].width, sh = src[0].height;
+  gint x0, x1, y0, y1, row, i0, i1;
+  gboolean direct, vertical_first;
+  guint weight;
+  gsize n, i;
+
+  if (width <= 0 || height <= 0 || sw <= 0 || sh <= 0 || alpha == 0)
+    return;
+
+  x0 = MAX (x, 0);
+  x1 = MIN (x + width, dst->width);
+  y0 = MAX (MAX (y, 0), row_start);
+  y1 = MIN (MIN (y + height, dst->height), row_end);
+
+  if (x0 >= x1 || y0 >= y1)
+    return;
+
+  n = x1 - x0;
+
+  /* same width and layout, source rows are used in place */
+  direct = sw == width && src_alpha == NULL
+      && kms_compositor_is_packed (src, n_channels);
+
+  /* when shrinking, every output row needs new source rows: interpolate */
+  /* them first so only one row per output row is scaled horizontally */
+  vertical_first = !direct && src_alpha == NULL && sh >= height;
+
+  kms_compositor_scratch_reserve (scratch, n, n_channels);
+  scratch->color.index[0] = scratch->color.index[1] = -1;
+  scratch->alpha.index[0] = scratch->alpha.index[1] = -1;
+
+  if (!direct) {
+    for (i = 0; i < n; i++) {
+      kms_compositor_map ((gint) (x0 - x + i), width, sw, &scratch->taps[i].x0,
+          &scratch->taps[i].x1, &scratch->taps[i].weight);
+    }
+  }
+
+  for (row = y0; row < y1; row++) {
+    guint8 *out = dst->data + row * dst->stride + x0 * n_channels;
+    const guint8 *r0, *r1;
+
+    kms_compositor_map (row - y, height, sh, &i0, &i1, &weight);
+
+    if (direct) {
+      r0 = src[0].data + i0 * src[0].stride + (x0 - x) * n_channels;
+      r1 = src[0].data + i1 * src[0].stride + (x0 - x) * n_channels;
+      k->row (out, r0, r1, weight, alpha, n * n_channels);
+    } else if (vertical_first) {
+      kms_compositor_blit_row_vertical_first (out, src, n_channels, i0, i1,
+          weight, alpha, n, scratch);
+    } else {
+      r0 = kms_compositor_get_row (&scratch->color, src, n_channels,
+          n_channels, scratch->taps, n, i0);
+      r1 = kms_compositor_get_row (&scratch->color, src, n_channels,
+          n_channels, scratch->taps, n, i1);
+
+      if (src_alpha == NULL) {
+        k->row (out, r0, r1, weight, alpha, n * n_channels);
+      } else {
+        const guint8 *a0, *a1;
+
+        a0 = kms_compositor_get_row (&scratch->alpha, src_alpha, 1,
+            n_channels, scratch->taps, n, i0);
+        a1 = kms_compositor_get_row (&scratch->alpha, src_alpha, 1,
+            n_channels, scratch->taps, n, i1);
+        k->row_alpha (out, r0, r1, a0, a1, weight, alpha, n * n_channels);
+      }
+    }
+  }
+}
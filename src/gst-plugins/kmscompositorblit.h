@@ -0,0 +1,74 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_COMPOSITOR_BLIT_H_
+#define _KMS_COMPOSITOR_BLIT_H_
+
+#include <glib.h>
+#include "kmsblend.h"
+
+G_BEGIN_DECLS
+
+/* One colour component of a picture. Interleaved components (NV12 */
+/* chroma, AYUV) point to their first byte and have pixel_stride > 1. */
+typedef struct _KmsCompositorComponent
+{
+  const guint8 *data;
+  gint stride;
+  gint pixel_stride;
+  gint width;
+  gint height;
+} KmsCompositorComponent;
+
+/* A destination plane holding n_channels interleaved components */
+typedef struct _KmsCompositorPlane
+{
+  guint8 *data;
+  gint stride;
+  gint width;                   /* in pixels */
+  gint height;
+  guint n_channels;
+} KmsCompositorPlane;
+
+typedef struct _KmsCompositorScratch KmsCompositorScratch;
+
+/* Per thread working memory of kms_compositor_blit */
+KmsCompositorScratch *kms_compositor_scratch_new (void);
+void kms_compositor_scratch_free (KmsCompositorScratch * scratch);
+
+/* Selects the kernels used by the next blits, for tests and benchmarks */
+gboolean kms_compositor_blit_set_impl (KmsBlendImpl impl);
+KmsBlendImpl kms_compositor_blit_get_impl (void);
+
+/* Fills rows [row_start, row_end) of dst with one value per channel */
+void kms_compositor_fill (KmsCompositorPlane * dst, const guint8 * value,
+    gint row_start, gint row_end);
+
+/* Fills rows [row_start, row_end) of a one channel plane with squares of */
+/* size pixels alternating between two values */
+void kms_compositor_fill_checker (KmsCompositorPlane * dst, gint size,
+    guint8 even, guint8 odd, gint row_start, gint row_end);
+
+/* Scales src (dst->n_channels components) into the x, y, width x height */
+/* rectangle of dst, which may lie partly outside of it, and blends it */
+/* with the constant alpha and, when src_alpha is not NULL, with that */
+/* per pixel alpha. Only rows [row_start, row_end) of dst are written, so */
+/* several threads may share a destination using different row ranges. */
+void kms_compositor_blit (KmsCompositorPlane * dst,
+    const KmsCompositorComponent * src, const KmsCompositorComponent *
+    src_alpha, gint x, gint y, gint width, gint height, guint8 alpha,
+    gint row_start, gint row_end, KmsCompositorScratch * scratch);
+
+G_END_DECLS
+#endif /* _KMS_COMPOSITOR_BLIT_H_ */
@@ -22,6 +22,8 @@
 #include <commons/kms-core-marshal.h>
 #include "kmsdispatcher.h"
 #include <commons/kmshubport.h>
+#include <commons/kmsloop.h>
+#include "kmskeyframecoalescer.h"
 
 #define PLUGIN_NAME "dispatcher"
 
@@ -42,10 +44,14 @@ GST_DEBUG_CATEGORY_STATIC (kms_dispatcher_debug_category);
   )                                             \
 )
 
+#define DEFAULT_KEYFRAME_REQUEST_INTERVAL 500   /* ms */
+
 struct _KmsDispatcherPrivate
 {
   GRecMutex mutex;
   GHashTable *ports;
+  KmsLoop *loop;
+  KmsKeyframeCoalescer *coalescer;
 };
 
 typedef struct _KmsDispatcherPortData KmsDispatcherPortData;
@@ -73,6 +79,14 @@ enum
 
 static guint obj_signals[LAST_SIGNAL] = { 0 };
 
+enum
+{
+  PROP_0,
+  PROP_KEYFRAME_REQUEST_INTERVAL,
+  PROP_KEYFRAME_REQUESTS_RECEIVED,
+  PROP_KEYFRAME_REQUESTS_FORWARDED
+};
+
 static void
 destroy_gint (gpointer data)
 {
@@ -112,6 +126,7 @@ static KmsDispatcherPortData *
 kms_dispatcher_port_data_create (KmsDispatcher * self, gint id)
 {
   KmsDispatcherPortData *data = g_slice_new0 (KmsDispatcherPortData);
+  GstPad *sink;
 
   data->dispatcher = self;
   data->audio_agnostic = gst_element_factory_make ("agnosticbin", NULL);
@@ -128,6 +143,10 @@ kms_dispatcher_port_data_create (KmsDispatcher * self, gint id)
   kms_base_hub_link_audio_sink (KMS_BASE_HUB (self), id,
       data->audio_agnostic, "sink", FALSE);
 
+  sink = gst_element_get_static_pad (data->video_agnostic, "sink");
+  kms_keyframe_coalescer_add_probe (self->priv->coalescer, sink);
+  g_object_unref (sink);
+
   return data;
 }
 
@@ -146,6 +165,8 @@ kms_dispatcher_dispose (GObject * object)
   }
   KMS_DISPATCHER_UNLOCK (self);
 
+  g_clear_object (&self->priv->loop);
+
   G_OBJECT_CLASS (kms_dispatcher_parent_class)->dispose (object);
 }
 
@@ -157,10 +178,54 @@ kms_dispatcher_finalize (GObject * object)
   GST_DEBUG_OBJECT (self, "finalize");
 
   g_rec_mutex_clear (&self->priv->mutex);
+  kms_keyframe_coalescer_unref (self->priv->coalescer);
 
   G_OBJECT_CLASS (kms_dispatcher_parent_class)->finalize (object);
 }
 
+static void
+kms_dispatcher_set_property (GObject * object, guint property_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  KmsDispatcher *self = KMS_DISPATCHER (object);
+
+  switch (property_id) {
+    case PROP_KEYFRAME_REQUEST_INTERVAL:
+      kms_keyframe_coalescer_set_interval (self->priv->coalescer,
+          g_value_get_uint (value) * GST_MSECOND);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
+static void
+kms_dispatcher_get_property (GObject * object, guint property_id,
+    GValue * value, GParamSpec * pspec)
+{
+  KmsDispatcher *self = KMS_DISPATCHER (object);
+
+  switch (property_id) {
+    case PROP_KEYFRAME_REQUEST_INTERVAL:
+      g_value_set_uint (value,
+          kms_keyframe_coalescer_get_interval (self->priv->coalescer) /
+          GST_MSECOND);
+      break;
+    case PROP_KEYFRAME_REQUESTS_RECEIVED:
+      g_value_set_uint64 (value,
+          kms_keyframe_coalescer_get_received (self->priv->coalescer));
+      break;
+    case PROP_KEYFRAME_REQUESTS_FORWARDED:
+      g_value_set_uint64 (value,
+          kms_keyframe_coalescer_get_forwarded (self->priv->coalescer));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+      break;
+  }
+}
+
 static void
 kms_dispatcher_unhandle_port (KmsBaseHub * hub, gint id)
 {
@@ -254,6 +319,8 @@ kms_dispatcher_class_init (KmsDispatcherClass * klass)
 
   gobject_class->dispose = GST_DEBUG_FUNCPTR (kms_dispatcher_dispose);
   gobject_class->finalize = GST_DEBUG_FUNCPTR (kms_dispatcher_finalize);
+  gobject_class->set_property = kms_dispatcher_set_property;
+  gobject_class->get_property = kms_dispatcher_get_property;
 
   base_hub_class->handle_port = GST_DEBUG_FUNCPTR (kms_dispatcher_handle_port);
   base_hub_class->unhandle_port =
@@ -268,6 +335,29 @@ kms_dispatcher_class_init (KmsDispatcherClass * klass)
       __kms_core_marshal_BOOLEAN__UINT_UINT, G_TYPE_BOOLEAN, 2, G_TYPE_UINT,
       G_TYPE_UINT);
 
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_REQUEST_INTERVAL,
+      g_param_spec_uint ("keyframe-request-interval",
+          "Keyframe request interval",
+          "Minimum time (ms) between two keyframe requests sent to a source, "
+          "the ones received in between are merged", 0, G_MAXUINT,
+          DEFAULT_KEYFRAME_REQUEST_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_REQUESTS_RECEIVED,
+      g_param_spec_uint64 ("keyframe-requests-received",
+          "Keyframe requests received",
+          "Keyframe requests received from the outputs", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_REQUESTS_FORWARDED,
+      g_param_spec_uint64 ("keyframe-requests-forwarded",
+          "Keyframe requests forwarded",
+          "Keyframe requests sent to the sources", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   /* Registers a private structure for the instantiatable type */
   g_type_class_add_private (klass, sizeof (KmsDispatcherPrivate));
 }
@@ -280,6 +370,9 @@ kms_dispatcher_init (KmsDispatcher * self)
       destroy_gint, kms_dispatcher_port_data_destroy);
 
   g_rec_mutex_init (&self->priv->mutex);
+  self->priv->loop = kms_loop_new ();
+  self->priv->coalescer = kms_keyframe_coalescer_new (self->priv->loop,
+      DEFAULT_KEYFRAME_REQUEST_INTERVAL * GST_MSECOND);
 }
 
 gboolean
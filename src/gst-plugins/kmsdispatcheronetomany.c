@@ -21,6 +21,9 @@
 #include "kmsdispatcheronetomany.h"
 #include <commons/kmsagnosticcaps.h>
 #include <commons/kmshubport.h>
+#include <commons/kmsloop.h>
+#include <gst/video/video.h>
+#include "kmskeyframecoalescer.h"
 
 #define PLUGIN_NAME "dispatcheronetomany"
 
@@ -43,12 +46,18 @@ GST_DEBUG_CATEGORY_STATIC (kms_dispatcher_one_to_many_debug_category);
 
 #define MAIN_PORT_NONE (-1)
 
+#define DEFAULT_GOP_CACHE_SIZE 120      /* buffers, 0 disables the cache */
+#define DEFAULT_KEYFRAME_REQUEST_INTERVAL 500   /* ms */
+
 struct _KmsDispatcherOneToManyPrivate
 {
   GRecMutex mutex;
   GHashTable *ports;
 
   gint main_port;
+  guint gop_cache_size;
+  KmsLoop *loop;
+  KmsKeyframeCoalescer *coalescer;
 };
 
 typedef struct _KmsDispatcherOneToManyPortData KmsDispatcherOneToManyPortData;
@@ -59,12 +68,28 @@ struct _KmsDispatcherOneToManyPortData
   gint id;
   GstElement *audio_agnostic;
   GstElement *video_agnostic;
+
+  /* encoded video of the port, as it enters video_agnostic */
+  GstPad *video_sink;
+  gulong video_probe_id;
+
+  /* last keyframe and the buffers after it, replayed to the viewers */
+  /* when this port becomes the main one */
+  GMutex gop_mutex;
+  GQueue gop;
+  gboolean gop_valid;
+  gboolean replay_pending;
+  gboolean replaying;           /* only used from the streaming thread */
 };
 
 enum
 {
   PROP_0,
-  PROP_MAIN_PORT
+  PROP_MAIN_PORT,
+  PROP_GOP_CACHE_SIZE,
+  PROP_KEYFRAME_REQUEST_INTERVAL,
+  PROP_KEYFRAME_REQUESTS_RECEIVED,
+  PROP_KEYFRAME_REQUESTS_FORWARDED
 };
 
 /* class initialization */
@@ -74,6 +99,101 @@ G_DEFINE_TYPE_WITH_CODE (KmsDispatcherOneToMany, kms_dispatcher_one_to_many,
     GST_DEBUG_CATEGORY_INIT (kms_dispatcher_one_to_many_debug_category,
         PLUGIN_NAME, 0, "debug category for dispatcheronetomany element"));
 
+/* must be called with the gop mutex held */
+static void
+kms_dispatcher_one_to_many_port_clear_gop (KmsDispatcherOneToManyPortData *
+    port_data)
+{
+  GstBuffer *buffer;
+
+  while ((buffer = g_queue_pop_head (&port_data->gop)) != NULL) {
+    gst_buffer_unref (buffer);
+  }
+
+  port_data->gop_valid = FALSE;
+}
+
+static GstPadProbeReturn
+kms_dispatcher_one_to_many_video_buffer (GstPad * pad, GstBuffer * buffer,
+    KmsDispatcherOneToManyPortData * port_data)
+{
+  guint max_size = port_data->mixer->priv->gop_cache_size;
+  GList *replay = NULL, *l;
+
+  if (port_data->replaying) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  g_mutex_lock (&port_data->gop_mutex);
+
+  if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    /* the new viewers start with this one */
+    kms_dispatcher_one_to_many_port_clear_gop (port_data);
+    port_data->gop_valid = TRUE;
+    port_data->replay_pending = FALSE;
+  }
+
+  if (port_data->replay_pending) {
+    port_data->replay_pending = FALSE;
+    for (l = port_data->gop.head; l != NULL; l = l->next) {
+      replay = g_list_prepend (replay, gst_buffer_ref (l->data));
+    }
+    replay = g_list_reverse (replay);
+  }
+
+  if (port_data->gop_valid) {
+    if (port_data->gop.length < max_size) {
+      g_queue_push_tail (&port_data->gop, gst_buffer_ref (buffer));
+    } else {
+      /* too long to be worth replaying, wait for the next keyframe */
+      kms_dispatcher_one_to_many_port_clear_gop (port_data);
+    }
+  }
+
+  g_mutex_unlock (&port_data->gop_mutex);
+
+  if (replay == NULL) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  GST_DEBUG_OBJECT (port_data->mixer, "Port %d replays %u cached buffers",
+      port_data->id, g_list_length (replay));
+
+  /* pushed ahead of the current buffer, in this same streaming thread */
+  port_data->replaying = TRUE;
+  for (l = replay; l != NULL; l = l->next) {
+    gst_pad_chain (pad, l->data);
+  }
+  port_data->replaying = FALSE;
+  g_list_free (replay);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+kms_dispatcher_one_to_many_video_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsDispatcherOneToManyPortData * port_data)
+{
+  GstEvent *event;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    return kms_dispatcher_one_to_many_video_buffer (pad,
+        GST_PAD_PROBE_INFO_BUFFER (info), port_data);
+  }
+
+  event = GST_PAD_PROBE_INFO_EVENT (info);
+
+  /* a new stream or codec, the cached buffers are useless */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS
+      || GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP) {
+    g_mutex_lock (&port_data->gop_mutex);
+    kms_dispatcher_one_to_many_port_clear_gop (port_data);
+    g_mutex_unlock (&port_data->gop_mutex);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
 static KmsDispatcherOneToManyPortData *
 kms_dispatcher_one_to_many_port_data_create (KmsDispatcherOneToMany * mixer,
     gint id)
@@ -96,6 +216,16 @@ kms_dispatcher_one_to_many_port_data_create (KmsDispatcherOneToMany * mixer,
   kms_base_hub_link_audio_sink (KMS_BASE_HUB (mixer), id,
       data->audio_agnostic, "sink", FALSE);
 
+  g_mutex_init (&data->gop_mutex);
+  g_queue_init (&data->gop);
+  data->video_sink = gst_element_get_static_pad (data->video_agnostic, "sink");
+  data->video_probe_id = gst_pad_add_probe (data->video_sink,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      (GstPadProbeCallback) kms_dispatcher_one_to_many_video_probe, data,
+      NULL);
+  /* the relinked viewers of a switch all ask for a keyframe */
+  kms_keyframe_coalescer_add_probe (mixer->priv->coalescer, data->video_sink);
+
   return data;
 }
 
@@ -114,6 +244,12 @@ kms_dispatcher_one_to_many_port_data_destroy (gpointer data)
   gst_element_set_state (port_data->audio_agnostic, GST_STATE_NULL);
   gst_element_set_state (port_data->video_agnostic, GST_STATE_NULL);
 
+  /* not streaming any more, the probe cannot be running */
+  gst_pad_remove_probe (port_data->video_sink, port_data->video_probe_id);
+  g_clear_object (&port_data->video_sink);
+  kms_dispatcher_one_to_many_port_clear_gop (port_data);
+  g_mutex_clear (&port_data->gop_mutex);
+
   g_clear_object (&port_data->audio_agnostic);
   g_clear_object (&port_data->video_agnostic);
 
@@ -135,42 +271,69 @@ create_gint (gint value)
   return p;
 }
 
+/* must be called with the mutex held */
 static void
-kms_dispatcher_one_to_many_link_port (KmsDispatcherOneToMany * self, gint to)
+kms_dispatcher_one_to_many_link_port (KmsDispatcherOneToMany * self, gint to,
+    KmsDispatcherOneToManyPortData * main_data)
 {
-  KmsDispatcherOneToManyPortData *port_data;
-
-  KMS_DISPATCHER_ONE_TO_MANY_LOCK (self);
-  if (self->priv->main_port < 0) {
+  if (main_data == NULL) {
     kms_base_hub_unlink_audio_src (KMS_BASE_HUB (self), to);
     kms_base_hub_unlink_video_src (KMS_BASE_HUB (self), to);
   } else {
-    port_data = g_hash_table_lookup (self->priv->ports, &self->priv->main_port);
     kms_base_hub_link_audio_src (KMS_BASE_HUB (self), to,
-        port_data->audio_agnostic, "src_%u", TRUE);
+        main_data->audio_agnostic, "src_%u", TRUE);
     kms_base_hub_link_video_src (KMS_BASE_HUB (self), to,
-        port_data->video_agnostic, "src_%u", TRUE);
+        main_data->video_agnostic, "src_%u", TRUE);
   }
+}
 
-  KMS_DISPATCHER_ONE_TO_MANY_UNLOCK (self);
+static KmsDispatcherOneToManyPortData *
+kms_dispatcher_one_to_many_get_main_data (KmsDispatcherOneToMany * self)
+{
+  if (self->priv->main_port < 0) {
+    return NULL;
+  }
+
+  return g_hash_table_lookup (self->priv->ports, &self->priv->main_port);
 }
 
+/* The new viewers get the cached GOP of the main port on its next buffer */
+/* and the source a keyframe request, merged with theirs by the coalescer */
 static void
-kms_dispatcher_one_to_many_change_main_port_it (gpointer key, gpointer value,
-    gpointer data)
+kms_dispatcher_one_to_many_prepare_switch (KmsDispatcherOneToMany * self,
+    KmsDispatcherOneToManyPortData * main_data)
 {
-  KmsDispatcherOneToManyPortData *port_data = value;
-
-  kms_dispatcher_one_to_many_link_port (port_data->mixer, port_data->id);
+  g_mutex_lock (&main_data->gop_mutex);
+  main_data->replay_pending = main_data->gop_valid;
+  GST_DEBUG_OBJECT (self, "Switching to port %d, %u cached buffers",
+      main_data->id, main_data->gop.length);
+  g_mutex_unlock (&main_data->gop_mutex);
+
+  gst_pad_push_event (main_data->video_sink,
+      gst_video_event_new_upstream_force_key_unit (GST_CLOCK_TIME_NONE, TRUE,
+          0));
 }
 
 static void
 kms_dispatcher_one_to_many_change_main_port (KmsDispatcherOneToMany * self)
 {
+  KmsDispatcherOneToManyPortData *main_data;
+  GHashTableIter iter;
+  gpointer key;
+
   KMS_DISPATCHER_ONE_TO_MANY_LOCK (self);
 
-  g_hash_table_foreach (self->priv->ports,
-      kms_dispatcher_one_to_many_change_main_port_it, NULL);
+  main_data = kms_dispatcher_one_to_many_get_main_data (self);
+
+  if (main_data != NULL) {
+    kms_dispatcher_one_to_many_prepare_switch (self, main_data);
+  }
+
+  /* every viewer in one pass, under a single lock */
+  g_hash_table_iter_init (&iter, self->priv->ports);
+  while (g_hash_table_iter_next (&iter, &key, NULL)) {
+    kms_dispatcher_one_to_many_link_port (self, *(gint *) key, main_data);
+  }
 
   KMS_DISPATCHER_ONE_TO_MANY_UNLOCK (self);
 }
@@ -215,7 +378,8 @@ kms_dispatcher_one_to_many_handle_port (KmsBaseHub * mixer,
   KMS_DISPATCHER_ONE_TO_MANY_LOCK (self);
   g_hash_table_insert (self->priv->ports, create_gint (port_id), port_data);
 
-  kms_dispatcher_one_to_many_link_port (self, port_id);
+  kms_dispatcher_one_to_many_link_port (self, port_id,
+      kms_dispatcher_one_to_many_get_main_data (self));
 
   KMS_DISPATCHER_ONE_TO_MANY_UNLOCK (self);
 
@@ -230,10 +394,22 @@ kms_dispatcher_one_to_many_set_property (GObject * object, guint property_id,
 
   KMS_DISPATCHER_ONE_TO_MANY_LOCK (self);
   switch (property_id) {
-    case PROP_MAIN_PORT:
-      self->priv->main_port = g_value_get_int (value);
-      kms_dispatcher_one_to_many_change_main_port (self);
-
+    case PROP_MAIN_PORT:{
+      gint main_port = g_value_get_int (value);
+
+      /* viewers already on it would only lose their decoder state */
+      if (main_port != self->priv->main_port) {
+        self->priv->main_port = main_port;
+        kms_dispatcher_one_to_many_change_main_port (self);
+      }
+      break;
+    }
+    case PROP_GOP_CACHE_SIZE:
+      self->priv->gop_cache_size = g_value_get_uint (value);
+      break;
+    case PROP_KEYFRAME_REQUEST_INTERVAL:
+      kms_keyframe_coalescer_set_interval (self->priv->coalescer,
+          g_value_get_uint (value) * GST_MSECOND);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -253,6 +429,22 @@ kms_dispatcher_one_to_many_get_property (GObject * object, guint property_id,
     case PROP_MAIN_PORT:
       g_value_set_int (value, self->priv->main_port);
       break;
+    case PROP_GOP_CACHE_SIZE:
+      g_value_set_uint (value, self->priv->gop_cache_size);
+      break;
+    case PROP_KEYFRAME_REQUEST_INTERVAL:
+      g_value_set_uint (value,
+          kms_keyframe_coalescer_get_interval (self->priv->coalescer) /
+          GST_MSECOND);
+      break;
+    case PROP_KEYFRAME_REQUESTS_RECEIVED:
+      g_value_set_uint64 (value,
+          kms_keyframe_coalescer_get_received (self->priv->coalescer));
+      break;
+    case PROP_KEYFRAME_REQUESTS_FORWARDED:
+      g_value_set_uint64 (value,
+          kms_keyframe_coalescer_get_forwarded (self->priv->coalescer));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -269,6 +461,8 @@ kms_dispatcher_one_to_many_dispose (GObject * object)
   g_hash_table_remove_all (self->priv->ports);
   KMS_DISPATCHER_ONE_TO_MANY_UNLOCK (self);
 
+  g_clear_object (&self->priv->loop);
+
   G_OBJECT_CLASS (kms_dispatcher_one_to_many_parent_class)->dispose (object);
 }
 
@@ -284,6 +478,8 @@ kms_dispatcher_one_to_many_finalize (GObject * object)
     self->priv->ports = NULL;
   }
 
+  kms_keyframe_coalescer_unref (self->priv->coalescer);
+
   G_OBJECT_CLASS (kms_dispatcher_one_to_many_parent_class)->finalize (object);
 }
 
@@ -318,6 +514,36 @@ kms_dispatcher_one_to_many_class_init (KmsDispatcherOneToManyClass * klass)
           "The selected main port, -1 indicates none.", -1, G_MAXINT,
           MAIN_PORT_NONE, G_PARAM_READWRITE));
 
+  g_object_class_install_property (gobject_class, PROP_GOP_CACHE_SIZE,
+      g_param_spec_uint ("gop-cache-size",
+          "GOP cache size",
+          "Buffers from the last keyframe kept per port for the viewers of "
+          "a new main port, 0 disables it", 0, G_MAXUINT,
+          DEFAULT_GOP_CACHE_SIZE, G_PARAM_READWRITE));
+
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_REQUEST_INTERVAL,
+      g_param_spec_uint ("keyframe-request-interval",
+          "Keyframe request interval",
+          "Minimum time (ms) between two keyframe requests sent to a source, "
+          "the ones received in between are merged", 0, G_MAXUINT,
+          DEFAULT_KEYFRAME_REQUEST_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_REQUESTS_RECEIVED,
+      g_param_spec_uint64 ("keyframe-requests-received",
+          "Keyframe requests received",
+          "Keyframe requests received from the viewers", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_REQUESTS_FORWARDED,
+      g_param_spec_uint64 ("keyframe-requests-forwarded",
+          "Keyframe requests forwarded",
+          "Keyframe requests sent to the sources", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   /* Registers a private structure for the instantiatable type */
   g_type_class_add_private (klass, sizeof (KmsDispatcherOneToManyPrivate));
 }
@@ -332,6 +558,10 @@ kms_dispatcher_one_to_many_init (KmsDispatcherOneToMany * self)
       release_gint, kms_dispatcher_one_to_many_port_data_destroy);
 
   self->priv->main_port = MAIN_PORT_NONE;
+  self->priv->gop_cache_size = DEFAULT_GOP_CACHE_SIZE;
+  self->priv->loop = kms_loop_new ();
+  self->priv->coalescer = kms_keyframe_coalescer_new (self->priv->loop,
+      DEFAULT_KEYFRAME_REQUEST_INTERVAL * GST_MSECOND);
 }
 
 gboolean
@@ -28,6 +28,7 @@
 #include "kmsstylecompositemixer.h"
 #include "kmstextoverlay.h"
 #include "kmsepisodeoverlay.h"
+#include "kmscompositor.h"
 
 static gboolean
 kurento_init (GstPlugin * kurento)
@@ -75,6 +76,9 @@ kurento_init (GstPlugin * kurento)
   if (!kms_alpha_blending_plugin_init (kurento))
     return FALSE;
 
+  if (!kms_compositor_plugin_init (kurento))
+    return FALSE;
+
   return TRUE;
 }
 
@@ -13,36 +13,33 @@
  *
  * Create by Tao Ren <tao@swarmnyc.com> <tour.ren.gz@gmail.com>
  */
-#define _XOPEN_SOURCE 500
-
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
 #include "kmsepisodeoverlay.h"
+#include "kmsimagecache.h"
+#include "kmsoverlaysprite.h"
+#include "kmssnapshot.h"
+#include "kmstextlabel.h"
+#include "kmsstylescene.h"
 
 #include <gst/gst.h>
 #include <gst/video/video.h>
 #include <gst/video/gstvideofilter.h>
-#include <glib/gstdio.h>
-#include <ftw.h>
 #include <string.h>
-#include <errno.h>
 
 #include <opencv/cv.h>
 
 #include <opencv/highgui.h>
-#include <libsoup/soup.h>
 
 #include <stdlib.h>
 #include <glib-object.h>
 #include <json-glib/json-glib.h>
-#include <pango/pangocairo.h>
+#include <cairo.h>
 
-#define TEMP_PATH "/tmp/XXXXXX"
 #define BLUE_COLOR (cvScalar (255, 0, 0, 0))
 #define SRC_OVERLAY ((double)1)
-#define MINIMUM_OUTLINE_OFFSET 1.0
 
 #define PLUGIN_NAME "episodeoverlay"
 
@@ -64,6 +61,7 @@ GST_DEBUG_CATEGORY_STATIC (kms_episode_overlay_debug_category);
 )
 
 #define DEFAULT_STYLE NULL
+#define DEFAULT_FONT_DESC "sans bold 16"
 
 #if G_BYTE_ORDER == G_LITTLE_ENDIAN
 # define CAIRO_ARGB_A 3
@@ -86,57 +84,60 @@ GST_DEBUG_CATEGORY_STATIC (kms_episode_overlay_debug_category);
 enum
 {
   PROP_0,
-  PROP_STYLE
+  PROP_STYLE,
+  PROP_SCENE
 };
 
-#define MAX_VIEW_COUNT 4
-#define MAX_TEXT_LENGTH 128
 #define MSG_BAR_HEIGHT 30
-#define MSG_BAR_BGCOLOR CV_RGB (73, 73, 73)
-#define HOST_BAR_COLOR CV_RGB (255, 91, 0)
-#define GUEST_BAR_COLOR CV_RGB (0, 103, 157)
+#define MSG_BAR_BGCOLOR 73, 73, 73
+#define HOST_BAR_COLOR 255, 91, 0
+#define GUEST_BAR_COLOR 0, 103, 157
+#define BORDER_COLOR 255, 255, 255
 #define MSG_BAR_ALPHA 0.85
+#define MSG_BAR_TAB_WIDTH 4
+#define MSG_TEXT_OFFSET_X 10
 typedef struct _KmsTextViewPrivate
 {
   int x;
   int y;
   int width;
   int height;
-  gchar text[MAX_TEXT_LENGTH];
-  cairo_surface_t *textImage;
+  KmsTextLabel *label;          /* rendered by the label worker */
+  KmsOverlaySprite *sprite;     /* all decorations, built on first use */
+  KmsTextLabel *sprite_label;   /* label drawn in sprite */
 } KmsTextViewPrivate;
 
 struct _KmsEpisodeOverlayPrivate
 {
   GRecMutex mutex;
-  IplImage *cvImage, *costume, *background, *background_image;
+  IplImage *costume, *background;
+  KmsImage *background_image;
+  gchar *background_uri;
   GstStructure *image_to_overlay;
 
   gint output_width, output_height;
   gdouble offsetXPercent, offsetYPercent, widthPercent, heightPercent;
-  gboolean show_debug_info, dir_created;
-  gchar *dir;
+  gboolean show_debug_info;
   GstClockTime dts, pts;
 
   GQueue *events_queue;
   gchar *style;
-  KmsTextViewPrivate views[MAX_VIEW_COUNT];
+  GArray *views;
   gint enable;
+  guint scene_version;
 
   // for text font.
-  PangoContext *pango_context;
-  PangoLayout *layout;
-  gdouble shadow_offset;
-  gdouble outline_offset;
+  gchar *font_desc;
 };
 
 /* pad templates */
 
+/* planar formats first, so the compositor keeps the encoder's format */
 #define VIDEO_SRC_CAPS \
-    GST_VIDEO_CAPS_MAKE("{ BGR }")
+    GST_VIDEO_CAPS_MAKE("{ I420, NV12, BGR }")
 
 #define VIDEO_SINK_CAPS \
-    GST_VIDEO_CAPS_MAKE("{ BGR }")
+    GST_VIDEO_CAPS_MAKE("{ I420, NV12, BGR }")
 
 /* class initialization */
 
@@ -145,106 +146,223 @@ G_DEFINE_TYPE_WITH_CODE (KmsEpisodeOverlay, kms_episode_overlay,
     GST_DEBUG_CATEGORY_INIT (kms_episode_overlay_debug_category, PLUGIN_NAME,
         0, "debug category for episodeoverlay element"));
 
-static gboolean
-kms_episode_overlay_is_valid_uri (const gchar * url)
+typedef struct _KmsBackgroundRequest
 {
-  gboolean ret;
-  GRegex *regex;
+  GWeakRef ref;
+  gchar *uri;
+} KmsBackgroundRequest;
 
-  regex = g_regex_new ("^(?:((?:https?):)\\/\\/)([^:\\/\\s]+)(?::(\\d*))?(?:\\/"
-      "([^\\s?#]+)?([?][^?#]*)?(#.*)?)?$", 0, 0, NULL);
-  ret = g_regex_match (regex, url, G_REGEX_MATCH_ANCHORED, NULL);
-  g_regex_unref (regex);
-
-  return ret;
+static void
+kms_background_request_free (KmsBackgroundRequest * req)
+{
+  g_weak_ref_clear (&req->ref);
+  g_free (req->uri);
+  g_slice_free (KmsBackgroundRequest, req);
 }
 
 static void
-load_from_url (gchar * file_name, const gchar * url)
+kms_episode_overlay_background_loaded (KmsImage * image,
+    KmsBackgroundRequest * req)
 {
-  SoupSession *session;
-  SoupMessage *msg;
-  FILE *dst;
+  KmsEpisodeOverlay *self = g_weak_ref_get (&req->ref);
 
-  session = soup_session_sync_new ();
-  msg = soup_message_new ("GET", url);
-  soup_session_send_message (session, msg);
+  if (self == NULL)
+    return;
 
-  dst = fopen (file_name, "w+");
+  KMS_EPISODE_OVERLAY_LOCK (self);
 
-  if (dst == NULL) {
-    GST_ERROR ("It is not possible to create the file");
-    goto end;
+  /* a newer background may have been requested while this one was loading */
+  if (g_strcmp0 (self->priv->background_uri, req->uri) != 0) {
+    GST_DEBUG_OBJECT (self, "Discarding outdated background image");
+  } else if (image == NULL) {
+    GST_WARNING_OBJECT (self, "Image not loaded from URL: %s", req->uri);
+    /* forget it so that setting the same URL again retries the load */
+    g_free (self->priv->background_uri);
+    self->priv->background_uri = NULL;
+  } else {
+    GST_INFO ("@rentao Image loaded from URL: %s", image->uri);
+    if (self->priv->background_image != NULL)
+      kms_image_unref (self->priv->background_image);
+    self->priv->background_image = kms_image_ref (image);
+    if (self->priv->background != NULL) {
+      cvReleaseImage (&self->priv->background);
+      self->priv->background = NULL;
+      GST_INFO ("@rentao reset background");
+    }
   }
-  fwrite (msg->response_body->data, 1, msg->response_body->length, dst);
-  fclose (dst);
 
-end:
-  g_object_unref (msg);
-  g_object_unref (session);
+  KMS_EPISODE_OVERLAY_UNLOCK (self);
+
+  g_object_unref (self);
 }
 
 static void
-kms_episode_overlay_adjust_values_with_fontdesc (KmsEpisodeOverlay * self,
-    PangoFontDescription * desc)
+kms_episode_overlay_set_view_label (KmsTextViewPrivate * view,
+    KmsTextLabel * label)
 {
-  gint font_size = pango_font_description_get_size (desc) / PANGO_SCALE;
+  if (view->label != NULL)
+    kms_text_label_unref (view->label);
 
-  self->priv->shadow_offset = (double) (font_size) / 13.0;
-  self->priv->outline_offset = (double) (font_size) / 15.0;
-  if (self->priv->outline_offset < MINIMUM_OUTLINE_OFFSET)
-    self->priv->outline_offset = MINIMUM_OUTLINE_OFFSET;
+  view->label = label;
 }
 
+/* Labels are rendered on a worker, the frame path picks them up when */
+/* they are ready */
 static void
 kms_episode_overlay_rebuild_text_images (KmsEpisodeOverlay * self)
 {
-  int i;
-  KmsTextViewPrivate *data;
+  KmsTextViewPrivate *view;
+  guint i;
 
-  for (i = 0; i < MAX_VIEW_COUNT; i++) {
-    data = &self->priv->views[i];
-    if (data->width > 0) {
-      PangoRectangle ink_rect, logical_rect;
-      gint width, height;
-      cairo_t *cr;
+  for (i = 0; i < self->priv->views->len; i++) {
+    view = &g_array_index (self->priv->views, KmsTextViewPrivate, i);
+    if (view->label == NULL)
+      continue;
 
-      if (data->textImage != NULL) {
-        cairo_surface_destroy (data->textImage);
-        data->textImage = NULL;
-      }
-      if (strlen (data->text) == 0)
-        continue;
-      // draw text on pango layout.
-      pango_layout_set_markup (self->priv->layout, data->text, -1);
-      // calculate the size of text.
-      pango_layout_get_pixel_extents (self->priv->layout, &ink_rect,
-          &logical_rect);
-      width = logical_rect.width + self->priv->shadow_offset;
-      height = logical_rect.height + logical_rect.y + self->priv->shadow_offset;
-      GST_INFO ("@rentao i=%d, text=%s width=%d height=%d", i, data->text,
-          width, height);
-
-      // draw on the cairo surface.
-      data->textImage =
-          cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
-      cr = cairo_create (data->textImage);
-      cairo_set_source_rgb (cr, 1.0, 1.0, 1.0); // white color to draw text.
-      cairo_move_to (cr, 0.0, 0.0);
-      pango_cairo_show_layout (cr, self->priv->layout);
-      cairo_destroy (cr);
+    kms_episode_overlay_set_view_label (view,
+        kms_text_label_new (self->priv->font_desc, view->label->markup));
+  }
+}
+
+static void
+kms_episode_overlay_set_view_geometry (KmsTextViewPrivate * view, gint x,
+    gint y, gint width, gint height)
+{
+  if (view->x == x && view->y == y && view->width == width
+      && view->height == height)
+    return;
+
+  view->x = x;
+  view->y = y;
+  view->width = width;
+  view->height = height;
+
+  kms_overlay_sprite_free (view->sprite);
+  view->sprite = NULL;
+}
+
+/* Only labels whose text really changed are rendered again */
+static void
+kms_episode_overlay_set_view_text (KmsEpisodeOverlay * self,
+    KmsTextViewPrivate * view, const gchar * text)
+{
+  if (view->label != NULL && g_strcmp0 (view->label->markup, text) == 0)
+    return;
+
+  kms_episode_overlay_set_view_label (view,
+      kms_text_label_new (self->priv->font_desc, text));
+}
+
+/* Returns TRUE when the font changed and every label must be rendered again */
+static gboolean
+kms_episode_overlay_set_font_desc (KmsEpisodeOverlay * self,
+    const gchar * fontdesc_str)
+{
+  if (fontdesc_str == NULL
+      || g_strcmp0 (fontdesc_str, self->priv->font_desc) == 0)
+    return FALSE;
+
+  GST_LOG_OBJECT (self, "font description set: %s", fontdesc_str);
+  g_free (self->priv->font_desc);
+  self->priv->font_desc = g_strdup (fontdesc_str);
+
+  return TRUE;
+}
+
+/* Returns TRUE when a view that was shown has been hidden */
+static gboolean
+kms_episode_overlay_set_n_views (KmsEpisodeOverlay * self, guint count)
+{
+  KmsTextViewPrivate *view;
+  gboolean hidden = FALSE;
+  guint i;
+
+  /* new views start unset, like the ones hidden below */
+  while (self->priv->views->len < count) {
+    KmsTextViewPrivate unset = { 0 };
+
+    unset.width = -1;
+    unset.height = -1;
+    g_array_append_val (self->priv->views, unset);
+  }
+
+  // views not used any more are hidden, their labels are kept.
+  for (i = 0; i < self->priv->views->len; i++) {
+    view = &g_array_index (self->priv->views, KmsTextViewPrivate, i);
+    if (i >= count) {
+      hidden |= view->width > 0;
+      kms_episode_overlay_set_view_geometry (view, view->x, view->y, -1, -1);
     }
   }
+
+  return hidden;
+}
+
+static void
+kms_episode_overlay_apply_scene (KmsEpisodeOverlay * self,
+    const KmsStyleScene * scene)
+{
+  KmsTextViewPrivate *view;
+  gboolean moved = FALSE;
+  guint i;
+
+  if (scene == NULL)
+    return;
+
+  KMS_EPISODE_OVERLAY_LOCK (self);
+
+  /* scenes may be published from several threads, keep the newest one */
+  if (scene->version <= self->priv->scene_version) {
+    GST_DEBUG_OBJECT (self, "Ignoring outdated scene %u", scene->version);
+    goto end;
+  }
+  self->priv->scene_version = scene->version;
+
+  if (scene->width > 0)
+    self->priv->output_width = scene->width;
+  if (scene->height > 0)
+    self->priv->output_height = scene->height;
+
+  if (kms_episode_overlay_set_font_desc (self, scene->font_desc))
+    kms_episode_overlay_rebuild_text_images (self);
+
+  moved = kms_episode_overlay_set_n_views (self, scene->n_views);
+
+  for (i = 0; i < scene->n_views; i++) {
+    const KmsStyleSceneView *src = &scene->views[i];
+
+    view = &g_array_index (self->priv->views, KmsTextViewPrivate, i);
+    if (view->x != src->x || view->y != src->y || view->width != src->width
+        || view->height != src->height) {
+      kms_episode_overlay_set_view_geometry (view, src->x, src->y,
+          src->width, src->height);
+      moved = TRUE;
+    }
+    kms_episode_overlay_set_view_text (self, view, src->text);
+  }
+
+  if (moved && self->priv->background != NULL) {
+    cvReleaseImage (&self->priv->background);
+    self->priv->background = NULL;
+    GST_INFO ("@rentao reset background");
+  }
+
+  self->priv->enable = scene->enable;
+  GST_TRACE_OBJECT (self, "@rentao scene %u applied, views=%u, enable=%d",
+      scene->version, scene->n_views, scene->enable);
+
+end:
+  KMS_EPISODE_OVERLAY_UNLOCK (self);
 }
 
 static gboolean
 kms_episode_overlay_parse_style (KmsEpisodeOverlay * self)
 {
-  IplImage *backgroundImg = NULL;
   JsonParser *parser;
   GError *error;
   JsonReader *reader;
   gint width = 0, height = 0, x, y, count, i, disable;
+  KmsTextViewPrivate *view;
   const gchar *text, *url;
   const gchar *fontdesc_str;
 
@@ -294,76 +412,37 @@ kms_episode_overlay_parse_style (KmsEpisodeOverlay * self)
   // handle background image.
   if (json_reader_read_member (reader, "background_image")) {
     url = json_reader_get_string_value (reader);
-    if (!self->priv->dir_created) {
-      gchar *d = g_strdup (TEMP_PATH);
-
-      self->priv->dir = g_mkdtemp (d);
-      self->priv->dir_created = TRUE;
-      GST_INFO ("@rentao create tmp folder fot download image. %s", d);
-    }
-
-    backgroundImg =
-        cvLoadImage (url, CV_LOAD_IMAGE_COLOR /*ignore alpha channel */ );
-
-    if (backgroundImg != NULL) {
-      GST_DEBUG ("Image loaded from file");
-    } else {
-      // load from url.
-      if (kms_episode_overlay_is_valid_uri (url)) {
-        gchar *file_name = g_strconcat (self->priv->dir, "/image.png", NULL);
-
-        load_from_url (file_name, url);
-        backgroundImg =
-            cvLoadImage (file_name,
-            CV_LOAD_IMAGE_COLOR /*ignore alpha channel */ );
-        g_remove (file_name);
-        g_free (file_name);
-      }
-    }
-
-    if (self->priv->background_image != NULL) {
-      cvReleaseImage (&self->priv->background_image);
-      self->priv->background_image = NULL;
-      // also reset the backgroud image.
-    }
-    if (backgroundImg == NULL) {
-      GST_INFO ("@rentao Image not loaded from URL: %s", url);
-    } else {
-      GST_INFO ("@rentao Image loaded from URL: %s", url);
-      self->priv->background_image = backgroundImg;
-      if (self->priv->background != NULL) {
-        cvReleaseImage (&self->priv->background);
-        self->priv->background = NULL;
-        GST_INFO ("@rentao reset background");
-      }
+    if (url != NULL && g_strcmp0 (url, self->priv->background_uri) != 0) {
+      KmsBackgroundRequest *req = g_slice_new (KmsBackgroundRequest);
+
+      g_free (self->priv->background_uri);
+      self->priv->background_uri = g_strdup (url);
+
+      /* the current image is kept until the new one is ready */
+      g_weak_ref_init (&req->ref, self);
+      req->uri = g_strdup (url);
+      kms_image_cache_load_async (url, self->priv->output_width,
+          self->priv->output_height,
+          (KmsImageCacheFunc) kms_episode_overlay_background_loaded, req,
+          (GDestroyNotify) kms_background_request_free);
     }
   }
   json_reader_end_element (reader);
 
   // handle font description
   if (json_reader_read_member (reader, "font-desc")) {
-    PangoFontDescription *desc;
-
     fontdesc_str = json_reader_get_string_value (reader);
-    desc = pango_font_description_from_string (fontdesc_str);
-    if (desc) {
-      GST_LOG_OBJECT (self, "font description set: %s", fontdesc_str);
-      pango_layout_set_font_description (self->priv->layout, desc);
-      kms_episode_overlay_adjust_values_with_fontdesc (self, desc);
-      pango_font_description_free (desc);
-    } else {
-      GST_WARNING_OBJECT (self, "font description parse failed: %s",
-          fontdesc_str);
-    }
+    if (kms_episode_overlay_set_font_desc (self, fontdesc_str))
+      kms_episode_overlay_rebuild_text_images (self);
   }
   json_reader_end_element (reader);
 
   // handle views.
   if (json_reader_read_member (reader, "views")) {
     // got views, reset the original first,
-    for (i = 0; i < MAX_VIEW_COUNT; i++) {
-      self->priv->views[i].width = -1;
-      self->priv->views[i].height = -1;
+    for (i = 0; i < self->priv->views->len; i++) {
+      view = &g_array_index (self->priv->views, KmsTextViewPrivate, i);
+      kms_episode_overlay_set_view_geometry (view, view->x, view->y, -1, -1);
     }
     // also reset the backgroud image.
     if (self->priv->background != NULL) {
@@ -372,52 +451,49 @@ kms_episode_overlay_parse_style (KmsEpisodeOverlay * self)
       GST_INFO ("@rentao reset background");
     }
     count = json_reader_count_elements (reader);
-    count = (count < MAX_VIEW_COUNT) ? count : MAX_VIEW_COUNT;
+    kms_episode_overlay_set_n_views (self, MAX (count, 0));
     for (i = 0; i < count; i++) {
       json_reader_read_element (reader, i);
+      view = &g_array_index (self->priv->views, KmsTextViewPrivate, i);
 
       if (json_reader_read_member (reader, "width")) {
         width = json_reader_get_int_value (reader);
-        self->priv->views[i].width = width;
-        GST_INFO ("@rentao set view[%d] width=%d", i,
-            self->priv->views[i].width);
+        view->width = width;
+        GST_INFO ("@rentao set view[%d] width=%d", i, view->width);
         json_reader_end_member (reader);
       }
 
       if (json_reader_read_member (reader, "height")) {
         height = json_reader_get_int_value (reader);
-        self->priv->views[i].height = height;
-        GST_INFO ("@rentao set view[%d] height=%d", i,
-            self->priv->views[i].height);
+        view->height = height;
+        GST_INFO ("@rentao set view[%d] height=%d", i, view->height);
         json_reader_end_member (reader);
       }
 
       if (json_reader_read_member (reader, "text")) {
         text = json_reader_get_string_value (reader);
         if (text != NULL) {
-          g_strlcpy (self->priv->views[i].text, text, MAX_TEXT_LENGTH);
-          GST_INFO ("@rentao set view[%d] text=%s", i,
-              self->priv->views[i].text);
+          kms_episode_overlay_set_view_text (self, view, text);
+          GST_INFO ("@rentao set view[%d] text=%s", i, text);
         }
         json_reader_end_member (reader);
       }
 
       if (json_reader_read_member (reader, "x")) {
         x = json_reader_get_int_value (reader);
-        self->priv->views[i].x = x;
-        GST_INFO ("@rentao set view[%d] left=%d", i, self->priv->views[i].x);
+        view->x = x;
+        GST_INFO ("@rentao set view[%d] left=%d", i, view->x);
         json_reader_end_member (reader);
       }
 
       if (json_reader_read_member (reader, "y")) {
         y = json_reader_get_int_value (reader);
-        self->priv->views[i].y = y;
-        GST_INFO ("@rentao set view[%d] top=%d", i, self->priv->views[i].y);
+        view->y = y;
+        GST_INFO ("@rentao set view[%d] top=%d", i, view->y);
         json_reader_end_member (reader);
       }
 
       json_reader_end_element (reader);
-      kms_episode_overlay_rebuild_text_images (self);
     }
     GST_INFO ("@rentao set views' count=%d", count);
     json_reader_end_member (reader);
@@ -446,6 +522,9 @@ kms_episode_overlay_set_property (GObject * object, guint property_id,
       self->priv->style = g_value_dup_string (value);
       kms_episode_overlay_parse_style (self);
       break;
+    case PROP_SCENE:
+      kms_episode_overlay_apply_scene (self, g_value_get_boxed (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -475,68 +554,144 @@ kms_episode_overlay_get_property (GObject * object, guint property_id,
 }
 
 static void
-kms_episode_overlay_initialize_images (KmsEpisodeOverlay * episodeoverlay,
-    GstVideoFrame * frame)
+kms_episode_overlay_set_source_rgb8 (cairo_t * cr, gint r, gint g, gint b,
+    gdouble alpha)
 {
-  if (episodeoverlay->priv->cvImage == NULL) {
-    episodeoverlay->priv->cvImage =
-        cvCreateImage (cvSize (frame->info.width, frame->info.height),
-        IPL_DEPTH_8U, 3);
-
-  } else if ((episodeoverlay->priv->cvImage->width != frame->info.width)
-      || (episodeoverlay->priv->cvImage->height != frame->info.height)) {
-
-    cvReleaseImage (&episodeoverlay->priv->cvImage);
-    episodeoverlay->priv->cvImage =
-        cvCreateImage (cvSize (frame->info.width, frame->info.height),
-        IPL_DEPTH_8U, 3);
-  }
+  cairo_set_source_rgba (cr, r / 255.0, g / 255.0, b / 255.0, alpha);
 }
 
-static int
-delete_file (const char *fpath, const struct stat *sb, int typeflag,
-    struct FTW *ftwbuf)
+/* Renders the message bar, its colour tab, the text and the double */
+/* border of a view, in coordinates starting one pixel above and left of */
+/* the view */
+static void
+kms_episode_overlay_draw_decoration (cairo_t * cr, KmsTextViewPrivate * data,
+    guint index, cairo_surface_t * text)
 {
-  int rv = g_remove (fpath);
-
-  if (rv) {
-    GST_WARNING ("Error deleting file: %s. %s", fpath, strerror (errno));
+  gint width = data->width + 3, height = data->height + 3;
+  gint bar_top = 1 + data->height - MSG_BAR_HEIGHT;
+
+  cairo_set_antialias (cr, CAIRO_ANTIALIAS_NONE);
+
+  // draw background block and leading small color block.
+  cairo_push_group (cr);
+  kms_episode_overlay_set_source_rgb8 (cr, MSG_BAR_BGCOLOR, 1.0);
+  cairo_rectangle (cr, 1, bar_top, data->width, MSG_BAR_HEIGHT);
+  cairo_fill (cr);
+  if (index == 0)
+    kms_episode_overlay_set_source_rgb8 (cr, HOST_BAR_COLOR, 1.0);
+  else
+    kms_episode_overlay_set_source_rgb8 (cr, GUEST_BAR_COLOR, 1.0);
+  cairo_rectangle (cr, 1, bar_top, MIN (MSG_BAR_TAB_WIDTH, data->width),
+      MSG_BAR_HEIGHT);
+  cairo_fill (cr);
+  cairo_pop_group_to_source (cr);
+  cairo_paint_with_alpha (cr, MSG_BAR_ALPHA);
+
+  // draw msg text, left-most and center aligned.
+  if (text != NULL) {
+    gint offset_y = (MSG_BAR_HEIGHT -
+        cairo_image_surface_get_height (text) + 1) / 2;
+
+    cairo_save (cr);
+    cairo_rectangle (cr, 1, bar_top, data->width, MSG_BAR_HEIGHT);
+    cairo_clip (cr);
+    cairo_set_source_surface (cr, text, 1 + MSG_TEXT_OFFSET_X,
+        bar_top + offset_y);
+    cairo_paint (cr);
+    cairo_restore (cr);
   }
 
-  return rv;
+  // draw boundary, two pixels wide around the view.
+  kms_episode_overlay_set_source_rgb8 (cr, BORDER_COLOR, 1.0);
+  cairo_set_fill_rule (cr, CAIRO_FILL_RULE_EVEN_ODD);
+  cairo_rectangle (cr, 0, 0, width, height);
+  cairo_rectangle (cr, 2, 2, data->width - 1, data->height - 1);
+  cairo_fill (cr);
 }
 
+/* Renders the part of the decoration inside the given rectangle */
 static void
-remove_recursive (const gchar * path)
+kms_episode_overlay_add_sprite_part (KmsOverlaySprite * sprite,
+    KmsTextViewPrivate * data, guint index, cairo_surface_t * text, gint x,
+    gint y, gint width, gint height)
+{
+  cairo_surface_t *surface;
+  cairo_t *cr;
+
+  if (width <= 0 || height <= 0)
+    return;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+  cr = cairo_create (surface);
+  cairo_translate (cr, -x, -y);
+  kms_episode_overlay_draw_decoration (cr, data, index, text);
+  cairo_destroy (cr);
+  cairo_surface_flush (surface);
+
+  kms_overlay_sprite_add_argb32 (sprite, cairo_image_surface_get_data
+      (surface), width, height, cairo_image_surface_get_stride (surface),
+      data->x - 1 + x, data->y - 1 + y);
+  cairo_surface_destroy (surface);
+}
+
+/* The view interior is transparent, so only the top border, the side */
+/* borders and the message bar with the bottom border are kept. Parts meet */
+/* at even frame coordinates, so no chroma sample is shared by two parts. */
+static KmsOverlaySprite *
+kms_episode_overlay_build_sprite (KmsTextViewPrivate * data, guint index,
+    cairo_surface_t * text)
 {
-  nftw (path, delete_file, 64, FTW_DEPTH | FTW_PHYS);
+  KmsOverlaySprite *sprite;
+  gint width = data->width + 3, height = data->height + 3;
+  gint ox = data->x - 1, oy = data->y - 1;
+  gint top_end, bottom_start, left_end, right_start;
+
+  top_end = MIN (2 + ((oy + 2) & 1), height);
+  bottom_start = 1 + data->height - MSG_BAR_HEIGHT;
+  bottom_start -= (oy + bottom_start) & 1;
+  bottom_start = CLAMP (bottom_start, top_end, height);
+  left_end = MIN (2 + ((ox + 2) & 1), width);
+  right_start = width - 2;
+  right_start -= (ox + right_start) & 1;
+  right_start = MAX (right_start, left_end);
+
+  sprite = kms_overlay_sprite_new ();
+  kms_episode_overlay_add_sprite_part (sprite, data, index, text, 0, 0,
+      width, top_end);
+  kms_episode_overlay_add_sprite_part (sprite, data, index, text, 0,
+      top_end, left_end, bottom_start - top_end);
+  kms_episode_overlay_add_sprite_part (sprite, data, index, text,
+      right_start, top_end, width - right_start, bottom_start - top_end);
+  kms_episode_overlay_add_sprite_part (sprite, data, index, text, 0,
+      bottom_start, width, height - bottom_start);
+
+  GST_DEBUG ("@rentao built sprite for view %u (%dx%d, %u parts)", index,
+      width, height, sprite->parts->len);
+
+  return sprite;
 }
 
+/* Builds the sprite again when the view changed or a newer label is ready. */
+/* While a label is still being rendered the previous one is kept. */
 static void
-kms_episode_overlay_renderer_image_to_cvimage (cairo_surface_t * text_surface,
-    IplImage * curFrameImage, int xpos, int ypos)
+kms_episode_overlay_update_sprite (KmsTextViewPrivate * data, guint index)
 {
-  int i, j, width, height;
-  CvSize frameSize;
-  guchar *p, *bitp, *text_image, *pixbuf;
-
-  text_image = cairo_image_surface_get_data (text_surface);
-  width = cairo_image_surface_get_width (text_surface);
-  height = cairo_image_surface_get_height (text_surface);
-  frameSize = cvGetSize (curFrameImage);
-  pixbuf = (guchar *) curFrameImage->imageData;
-
-  for (i = 0; i < height && ypos + i < frameSize.height; i++) {
-    p = pixbuf + (ypos + i) * frameSize.width * 3 + xpos * 3;
-    bitp = text_image + i * width * 4;
-    for (j = 0; j < width && j < frameSize.width; j++) {
-      p[0] |= bitp[CAIRO_ARGB_B];
-      p[1] |= bitp[CAIRO_ARGB_G];
-      p[2] |= bitp[CAIRO_ARGB_R];
-
-      bitp += 4;
-      p += 3;
-    }
+  KmsTextLabel *label = data->sprite_label;
+
+  if (data->label != NULL && kms_text_label_is_ready (data->label))
+    label = data->label;
+
+  if (data->sprite != NULL && label == data->sprite_label)
+    return;
+
+  kms_overlay_sprite_free (data->sprite);
+  data->sprite = kms_episode_overlay_build_sprite (data, index,
+      label != NULL ? kms_text_label_get_surface (label) : NULL);
+
+  if (label != data->sprite_label) {
+    if (data->sprite_label != NULL)
+      kms_text_label_unref (data->sprite_label);
+    data->sprite_label = label != NULL ? kms_text_label_ref (label) : NULL;
   }
 }
 
@@ -545,12 +700,9 @@ kms_episode_overlay_transform_frame_ip (GstVideoFilter * filter,
     GstVideoFrame * frame)
 {
   KmsEpisodeOverlay *self = KMS_EPISODE_OVERLAY (filter);
-  GstMapInfo info;
-  int i;
-  IplImage *curImg, *styleZone;
+  guint i;
 
   //CvFont font;
-  int left, right, top, bottom;
   KmsTextViewPrivate *data;
 
   // plug-in now is disabled.
@@ -576,37 +728,30 @@ kms_episode_overlay_transform_frame_ip (GstVideoFilter * filter,
 //
 //  gst_text_render_check_argb (render);
 
-  gst_buffer_map (frame->buffer, &info, GST_MAP_READ);
-
   // Check the current frame's resolution just in case.
   if (frame->info.width != self->priv->output_width
       || frame->info.height != self->priv->output_height) {
-    static int id = 0;
-    char filename[256];
+    GstCaps *caps = gst_video_info_to_caps (&frame->info);
+    gchar *path;
+
+    // save the frame to file for further checking, at most every 30s.
+    path = kms_snapshot_take (GST_OBJECT_NAME (self),
+        KMS_SNAPSHOT_AUTOMATIC_INTERVAL, frame->buffer, caps);
+    gst_caps_unref (caps);
 
-    // save the frame to file for further checking.
-    g_snprintf (filename, 256, "/var/log/kurento-media-server/snapshot%03d.jpg",
-        id++);
     GST_ERROR
-        ("@rentao wront resolution, output=(%d,%d), current frame=(%d,%d), save this frame to %s.",
-        frame->info.width, frame->info.height, self->priv->output_width,
-        self->priv->output_height, filename);
-
-    kms_episode_overlay_initialize_images (self, frame);
-    self->priv->cvImage->imageData = (char *) info.data;
-    curImg = self->priv->cvImage;
-    cvSaveImage (filename, curImg, 0);
-    gst_buffer_unmap (frame->buffer, &info);
+        ("@rentao wrong resolution, output=(%d,%d), current frame=(%d,%d), snapshot=%s.",
+        self->priv->output_width, self->priv->output_height,
+        frame->info.width, frame->info.height, path ? path : "none");
+    g_free (path);
+
     return GST_FLOW_OK;
   }
 
   KMS_EPISODE_OVERLAY_LOCK (self);
 
-  kms_episode_overlay_initialize_images (self, frame);
-  self->priv->cvImage->imageData = (char *) info.data;
-  curImg = self->priv->cvImage;
   GST_TRACE ("@rentao transform_frame_ip. width=%d, height=%d",
-      cvGetSize (curImg).width, cvGetSize (curImg).height);
+      frame->info.width, frame->info.height);
 
   //cvInitFont (&font, CV_FONT_HERSHEY_SIMPLEX, 0.75f, 0.75f, 0, 2, 8);   //rate of width
 //
@@ -614,7 +759,7 @@ kms_episode_overlay_transform_frame_ip (GstVideoFilter * filter,
 //  if (self->priv->enable == 2) {
 //    KMS_EPISODE_OVERLAY_UNLOCK (self);
 //    if (self->priv->background_image != NULL) {
-//      cvResize (self->priv->background_image, curImg, CV_INTER_LINEAR);
+//      cvResize (self->priv->background_image->image, curImg, CV_INTER_LINEAR);
 //    }
 //    gst_buffer_unmap (frame->buffer, &info);
 //    return GST_FLOW_OK;
@@ -623,10 +768,10 @@ kms_episode_overlay_transform_frame_ip (GstVideoFilter * filter,
 //  if (self->priv->background == NULL && self->priv->background_image != NULL) {
 //    styleZone =
 //        cvCreateImage (cvGetSize (curImg), curImg->depth, curImg->nChannels);
-//    cvResize (self->priv->background_image, styleZone, CV_INTER_LINEAR);
-////    cvCopy (self->priv->background_image, styleZone, NULL);
-//    for (i = 0; i < MAX_VIEW_COUNT; i++) {
-//      data = &self->priv->views[i];
+//    cvResize (self->priv->background_image->image, styleZone, CV_INTER_LINEAR);
+////    cvCopy (self->priv->background_image->image, styleZone, NULL);
+//    for (i = 0; i < self->priv->views->len; i++) {
+//      data = &g_array_index (self->priv->views, KmsTextViewPrivate, i);
 //      if (data->width > 0) {
 //        cvRectangle (styleZone, cvPoint (data->x, data->y),
 //            cvPoint (data->x + data->width, data->y + data->height), CV_RGB (0,
@@ -639,63 +784,21 @@ kms_episode_overlay_transform_frame_ip (GstVideoFilter * filter,
 //  }
 //  // draw the background to source frame first.
 //  if (self->priv->background != NULL) {
-////    cvCopy(self->priv->background_image, curImg, NULL);
+////    cvCopy(self->priv->background_image->image, curImg, NULL);
 ////    cvAdd (curImg, self->priv->background, curImg, NULL);
 //    GST_INFO("@rentao NOT add background to source frame");
 //  }
 
-  for (i = 0; i < MAX_VIEW_COUNT; i++) {
-    data = &self->priv->views[i];
-    if (data->width > 0) {
-      styleZone =
-          cvCreateImage (cvSize (data->width, MSG_BAR_HEIGHT), curImg->depth,
-          curImg->nChannels);
-      // draw background block.
-      cvRectangle (styleZone, cvPoint (0, 0), cvPoint (data->width,
-              MSG_BAR_HEIGHT), MSG_BAR_BGCOLOR, CV_FILLED, 8, 0);
-      // draw leading small color block.
-      if (i == 0)
-        cvRectangle (styleZone, cvPoint (0, 0), cvPoint (3, MSG_BAR_HEIGHT),
-            HOST_BAR_COLOR, CV_FILLED, 8, 0);
-      else
-        cvRectangle (styleZone, cvPoint (0, 0), cvPoint (3, MSG_BAR_HEIGHT),
-            GUEST_BAR_COLOR, CV_FILLED, 8, 0);
-
-      // set ROI
-      left = data->x;           // left
-      bottom = data->y + data->height;  // bottom
-      right = left + data->width;       // right
-      top = bottom - MSG_BAR_HEIGHT;    //top
-      cvSetImageROI (curImg, cvRect (left, top, right - left, bottom - top));
-
-      // draw style bar alpha transparency to source frame.
-      cvAddWeighted (curImg, 1 - MSG_BAR_ALPHA, styleZone, MSG_BAR_ALPHA, 0,
-          curImg);
-
-      // draw msg text.
-//      cvPutText (curImg, data->text, cvPoint (10, 20), &font, CV_RGB (255, 255,
-//              255));
-      // release ROI
-      cvResetImageROI (curImg);
-
-      // draw msg text.
-      if (data->textImage != NULL) {
-        int offsetX = 10;       // left-most align.
-        int offsetY = (MSG_BAR_HEIGHT - cairo_image_surface_get_height (data->textImage) + 1) / 2;      // center align.
-
-        kms_episode_overlay_renderer_image_to_cvimage (data->textImage, curImg,
-            left + offsetX, top + offsetY);
-      }
-      // draw boundary
-      cvRectangle (curImg, cvPoint (data->x, data->y),
-          cvPoint (data->x + data->width, data->y + data->height), CV_RGB (255,
-              255, 255), 1, 8, 0);
-      cvRectangle (curImg, cvPoint (data->x - 1, data->y - 1),
-          cvPoint (data->x + data->width + 1, data->y + data->height + 1),
-          CV_RGB (255, 255, 255), 1, 8, 0);
-
-      cvReleaseImage (&styleZone);
-    }
+  /* decorations only change with the style, they are rendered once and */
+  /* just blended here */
+  for (i = 0; i < self->priv->views->len; i++) {
+    data = &g_array_index (self->priv->views, KmsTextViewPrivate, i);
+    if (data->width <= 0 || data->height <= 0)
+      continue;
+
+    kms_episode_overlay_update_sprite (data, i);
+
+    kms_overlay_sprite_blend (data->sprite, frame);
   }
 //
 //  // draw text using pango
@@ -746,8 +849,6 @@ kms_episode_overlay_transform_frame_ip (GstVideoFilter * filter,
 
   KMS_EPISODE_OVERLAY_UNLOCK (self);
 
-  gst_buffer_unmap (frame->buffer, &info);
-
   return GST_FLOW_OK;
 }
 
@@ -768,18 +869,17 @@ kms_episode_overlay_dispose (GObject * object)
 static void
 kms_episode_overlay_finalize (GObject * object)
 {
-  int i;
+  guint i;
 
   KmsEpisodeOverlay *episodeoverlay = KMS_EPISODE_OVERLAY (object);
 
-  if (episodeoverlay->priv->cvImage != NULL)
-    cvReleaseImage (&episodeoverlay->priv->cvImage);
-
   if (episodeoverlay->priv->costume != NULL)
     cvReleaseImage (&episodeoverlay->priv->costume);
 
   if (episodeoverlay->priv->background_image != NULL)
-    cvReleaseImage (&episodeoverlay->priv->background_image);
+    kms_image_unref (episodeoverlay->priv->background_image);
+
+  g_free (episodeoverlay->priv->background_uri);
 
   if (episodeoverlay->priv->background != NULL)
     cvReleaseImage (&episodeoverlay->priv->background);
@@ -787,18 +887,22 @@ kms_episode_overlay_finalize (GObject * object)
   if (episodeoverlay->priv->image_to_overlay != NULL)
     gst_structure_free (episodeoverlay->priv->image_to_overlay);
 
-  if (episodeoverlay->priv->dir_created) {
-    remove_recursive (episodeoverlay->priv->dir);
-    g_free (episodeoverlay->priv->dir);
-  }
-
   if (episodeoverlay->priv->style != NULL)
     g_free (episodeoverlay->priv->style);
 
-  for (i = 0; i < MAX_VIEW_COUNT; i++) {
-    if (episodeoverlay->priv->views[i].textImage != NULL)
-      cairo_surface_destroy (episodeoverlay->priv->views[i].textImage);
+  for (i = 0; i < episodeoverlay->priv->views->len; i++) {
+    KmsTextViewPrivate *view = &g_array_index (episodeoverlay->priv->views,
+        KmsTextViewPrivate, i);
+
+    kms_overlay_sprite_free (view->sprite);
+    if (view->sprite_label != NULL)
+      kms_text_label_unref (view->sprite_label);
+    if (view->label != NULL)
+      kms_text_label_unref (view->label);
   }
+  g_array_free (episodeoverlay->priv->views, TRUE);
+
+  g_free (episodeoverlay->priv->font_desc);
 
   g_rec_mutex_clear (&episodeoverlay->priv->mutex);
 
@@ -811,49 +915,24 @@ kms_episode_overlay_finalize (GObject * object)
 static void
 kms_episode_overlay_init (KmsEpisodeOverlay * self)
 {
-  int i;
-  PangoFontMap *fontmap;
-  PangoFontDescription *desc;
-
   self->priv = KMS_EPISODE_OVERLAY_GET_PRIVATE (self);
   g_rec_mutex_init (&self->priv->mutex);
 
   self->priv->show_debug_info = FALSE;
-  self->priv->cvImage = NULL;
   self->priv->costume = NULL;
   self->priv->background_image = NULL;
   self->priv->background = NULL;
-  self->priv->dir_created = FALSE;
+  self->priv->background_uri = NULL;
   self->priv->style = NULL;
   self->priv->enable = 0;
+  self->priv->scene_version = 0;
 
   self->priv->events_queue = g_queue_new ();
 
-  for (i = 0; i < MAX_VIEW_COUNT; i++) {
-    self->priv->views[i].width = -1;
-    self->priv->views[i].height = -1;
-    self->priv->views[i].textImage = NULL;
-  }
-
-  // init pango context
-  self->priv->shadow_offset = 0;
-  self->priv->outline_offset = 0;
-  fontmap = pango_cairo_font_map_get_default ();
-  self->priv->pango_context =
-      pango_font_map_create_context (PANGO_FONT_MAP (fontmap));
-  pango_context_set_base_gravity (self->priv->pango_context,
-      PANGO_GRAVITY_SOUTH);
-  // init pango layout
-  self->priv->layout = pango_layout_new (self->priv->pango_context);
-//  desc = pango_context_get_font_description (self->priv->pango_context);
-  desc = pango_font_description_from_string ("sans bold 16");
-  if (desc != NULL) {
-    GST_INFO ("@rentao pango_font_description_from_string");
-  }
-  pango_layout_set_font_description (self->priv->layout, desc);
-//  GST_INFO ("@rentao font description sans bold 64. %" GST_PTR_FORMAT, desc);
-  kms_episode_overlay_adjust_values_with_fontdesc (self, desc);
+  self->priv->views = g_array_new (FALSE, TRUE, sizeof (KmsTextViewPrivate));
 
+  // labels are rendered by the shared text worker.
+  self->priv->font_desc = g_strdup (DEFAULT_FONT_DESC);
 }
 
 static void
@@ -895,6 +974,11 @@ kms_episode_overlay_class_init (KmsEpisodeOverlayClass * klass)
           "Style description(schema like ice candidate)",
           DEFAULT_STYLE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_SCENE,
+      g_param_spec_boxed ("scene", "Scene",
+          "Layout of the views, shared by the composite mixer",
+          KMS_TYPE_STYLE_SCENE, G_PARAM_WRITABLE | G_PARAM_STATIC_STRINGS));
+
   g_type_class_add_private (klass, sizeof (KmsEpisodeOverlayPrivate));
 }
 
@@ -38,6 +38,9 @@ G_DEFINE_QUARK (BASE_TIME_DATA, base_time_data);
 
 #define POST_PIPELINE "post-pipeline"
 
+#define DEFAULT_HIGH_WATER_MARK (2 * 1024 * 1024)
+#define DEFAULT_LOW_WATER_MARK (512 * 1024)
+
 GST_DEBUG_CATEGORY_STATIC (kms_http_post_endpoint_debug_category);
 #define GST_CAT_DEFAULT kms_http_post_endpoint_debug_category
 
@@ -55,6 +58,13 @@ struct _KmsHttpPostEndpointPrivate
   gboolean use_encoded_media;
   int handler_id;
   GstBus *bus;
+
+  /* upload flow control */
+  guint64 high_water_mark;
+  guint64 low_water_mark;
+  gboolean throttled;
+  gint64 throttled_since;
+  GstClockTime throttled_time;
 };
 
 /* Object properties */
@@ -62,6 +72,10 @@ enum
 {
   PROP_0,
   PROP_USE_ENCODED_MEDIA,
+  PROP_HIGH_WATER_MARK,
+  PROP_LOW_WATER_MARK,
+  PROP_THROTTLED,
+  PROP_THROTTLED_TIME,
   N_PROPERTIES
 };
 
@@ -72,7 +86,10 @@ enum
 {
   /* actions */
   SIGNAL_PUSH_BUFFER,
+  SIGNAL_PUSH_BUFFER_LIST,
   SIGNAL_END_OF_STREAM,
+  /* signals */
+  SIGNAL_THROTTLE,
   LAST_SIGNAL
 };
 
@@ -315,6 +332,70 @@ post_decodebin_pad_removed_handler (GstElement * decodebin, GstPad * pad,
   }
 }
 
+/* Called with the element lock held */
+static void
+kms_http_post_endpoint_configure_appsrc (KmsHttpPostEndpoint * self)
+{
+  guint min_percent = 0;
+
+  if (self->priv->appsrc == NULL)
+    return;
+
+  if (self->priv->high_water_mark > 0) {
+    min_percent = MIN (self->priv->low_water_mark,
+        self->priv->high_water_mark) * 100 / self->priv->high_water_mark;
+  }
+
+  /* appsrc does not block, it signals enough-data and need-data instead */
+  g_object_set (G_OBJECT (self->priv->appsrc), "max-bytes",
+      self->priv->high_water_mark, "min-percent", min_percent, NULL);
+}
+
+static void
+appsrc_enough_data (GstElement * appsrc, KmsHttpPostEndpoint * self)
+{
+  KMS_ELEMENT_LOCK (self);
+
+  if (self->priv->throttled) {
+    KMS_ELEMENT_UNLOCK (self);
+    return;
+  }
+
+  self->priv->throttled = TRUE;
+  self->priv->throttled_since = g_get_monotonic_time ();
+
+  KMS_ELEMENT_UNLOCK (self);
+
+  GST_DEBUG_OBJECT (self, "Upload queue is full, throttling");
+  g_signal_emit (G_OBJECT (self), http_post_ep_signals[SIGNAL_THROTTLE], 0,
+      TRUE);
+}
+
+static void
+appsrc_need_data (GstElement * appsrc, guint length,
+    KmsHttpPostEndpoint * self)
+{
+  gint64 elapsed;
+
+  KMS_ELEMENT_LOCK (self);
+
+  if (!self->priv->throttled) {
+    KMS_ELEMENT_UNLOCK (self);
+    return;
+  }
+
+  elapsed = g_get_monotonic_time () - self->priv->throttled_since;
+  self->priv->throttled_time += elapsed * GST_USECOND;
+  self->priv->throttled = FALSE;
+
+  KMS_ELEMENT_UNLOCK (self);
+
+  GST_DEBUG_OBJECT (self, "Upload queue drained after %" G_GINT64_FORMAT
+      " us, resuming", elapsed);
+  g_signal_emit (G_OBJECT (self), http_post_ep_signals[SIGNAL_THROTTLE], 0,
+      FALSE);
+}
+
 static void
 kms_http_post_endpoint_init_pipeline (KmsHttpPostEndpoint * self)
 {
@@ -329,6 +410,12 @@ kms_http_post_endpoint_init_pipeline (KmsHttpPostEndpoint * self)
   g_object_set (G_OBJECT (self->priv->appsrc), "is-live", TRUE,
       "do-timestamp", TRUE, "min-latency", G_GUINT64_CONSTANT (0),
       "max-latency", G_GUINT64_CONSTANT (0), "format", GST_FORMAT_TIME, NULL);
+  kms_http_post_endpoint_configure_appsrc (self);
+
+  g_signal_connect (self->priv->appsrc, "enough-data",
+      G_CALLBACK (appsrc_enough_data), self);
+  g_signal_connect (self->priv->appsrc, "need-data",
+      G_CALLBACK (appsrc_need_data), self);
 
   /* configure decodebin */
   if (self->priv->use_encoded_media) {
@@ -377,6 +464,30 @@ kms_http_post_endpoint_push_buffer_action (KmsHttpPostEndpoint * self,
   return ret;
 }
 
+static GstFlowReturn
+kms_http_post_endpoint_push_buffer_list_action (KmsHttpPostEndpoint * self,
+    GstBufferList * list)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint i, len;
+
+  KMS_ELEMENT_LOCK (self);
+
+  if (KMS_HTTP_ENDPOINT (self)->pipeline == NULL)
+    kms_http_post_endpoint_init_pipeline (self);
+
+  KMS_ELEMENT_UNLOCK (self);
+
+  /* appsrc takes single buffers, the wrapped data is not copied anyway */
+  len = gst_buffer_list_length (list);
+  for (i = 0; i < len && ret == GST_FLOW_OK; i++) {
+    g_signal_emit_by_name (self->priv->appsrc, "push-buffer",
+        gst_buffer_list_get (list, i), &ret);
+  }
+
+  return ret;
+}
+
 static GstFlowReturn
 kms_http_post_endpoint_end_of_stream_action (KmsHttpPostEndpoint * self)
 {
@@ -409,6 +520,14 @@ kms_http_post_endpoint_set_property (GObject * object, guint property_id,
     case PROP_USE_ENCODED_MEDIA:
       self->priv->use_encoded_media = g_value_get_boolean (value);
       break;
+    case PROP_HIGH_WATER_MARK:
+      self->priv->high_water_mark = g_value_get_uint64 (value);
+      kms_http_post_endpoint_configure_appsrc (self);
+      break;
+    case PROP_LOW_WATER_MARK:
+      self->priv->low_water_mark = g_value_get_uint64 (value);
+      kms_http_post_endpoint_configure_appsrc (self);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -427,6 +546,25 @@ kms_http_post_endpoint_get_property (GObject * object, guint property_id,
     case PROP_USE_ENCODED_MEDIA:
       g_value_set_boolean (value, self->priv->use_encoded_media);
       break;
+    case PROP_HIGH_WATER_MARK:
+      g_value_set_uint64 (value, self->priv->high_water_mark);
+      break;
+    case PROP_LOW_WATER_MARK:
+      g_value_set_uint64 (value, self->priv->low_water_mark);
+      break;
+    case PROP_THROTTLED:
+      g_value_set_boolean (value, self->priv->throttled);
+      break;
+    case PROP_THROTTLED_TIME:{
+      GstClockTime throttled_time = self->priv->throttled_time;
+
+      if (self->priv->throttled) {
+        throttled_time += (g_get_monotonic_time () -
+            self->priv->throttled_since) * GST_USECOND;
+      }
+      g_value_set_uint64 (value, throttled_time);
+      break;
+    }
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -466,6 +604,27 @@ kms_http_post_endpoint_class_init (KmsHttpPostEndpointClass * klass)
       "could have an unexpected behaviour if key frames are lost",
       FALSE, G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY);
 
+  obj_properties[PROP_HIGH_WATER_MARK] = g_param_spec_uint64
+      ("high-water-mark", "High water mark",
+      "Upload bytes waiting to be decoded that throttle the upload "
+      "(0 = unlimited)", 0, G_MAXUINT64, DEFAULT_HIGH_WATER_MARK,
+      G_PARAM_READWRITE);
+
+  obj_properties[PROP_LOW_WATER_MARK] = g_param_spec_uint64
+      ("low-water-mark", "Low water mark",
+      "Upload bytes waiting to be decoded below which a throttled upload "
+      "is resumed", 0, G_MAXUINT64, DEFAULT_LOW_WATER_MARK,
+      G_PARAM_READWRITE);
+
+  obj_properties[PROP_THROTTLED] = g_param_spec_boolean ("throttled",
+      "Throttled", "Whether the upload is currently throttled", FALSE,
+      G_PARAM_READABLE);
+
+  obj_properties[PROP_THROTTLED_TIME] = g_param_spec_uint64
+      ("throttled-time", "Throttled time",
+      "Total time (ns) the upload has been throttled", 0, G_MAXUINT64, 0,
+      G_PARAM_READABLE);
+
   g_object_class_install_properties (gobject_class,
       N_PROPERTIES, obj_properties);
 
@@ -477,6 +636,13 @@ kms_http_post_endpoint_class_init (KmsHttpPostEndpointClass * klass)
       NULL, NULL, __kms_core_marshal_ENUM__BOXED,
       GST_TYPE_FLOW_RETURN, 1, GST_TYPE_BUFFER);
 
+  http_post_ep_signals[SIGNAL_PUSH_BUFFER_LIST] =
+      g_signal_new ("push-buffer-list", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (KmsHttpPostEndpointClass, push_buffer_list),
+      NULL, NULL, __kms_core_marshal_ENUM__BOXED,
+      GST_TYPE_FLOW_RETURN, 1, GST_TYPE_BUFFER_LIST);
+
   http_post_ep_signals[SIGNAL_END_OF_STREAM] =
       g_signal_new ("end-of-stream", G_TYPE_FROM_CLASS (klass),
       G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
@@ -484,7 +650,13 @@ kms_http_post_endpoint_class_init (KmsHttpPostEndpointClass * klass)
       NULL, NULL, __kms_core_marshal_ENUM__VOID,
       GST_TYPE_FLOW_RETURN, 0, G_TYPE_NONE);
 
+  http_post_ep_signals[SIGNAL_THROTTLE] =
+      g_signal_new ("throttle", G_TYPE_FROM_CLASS (klass), G_SIGNAL_RUN_LAST,
+      0, NULL, NULL, g_cclosure_marshal_VOID__BOOLEAN, G_TYPE_NONE, 1,
+      G_TYPE_BOOLEAN);
+
   klass->push_buffer = kms_http_post_endpoint_push_buffer_action;
+  klass->push_buffer_list = kms_http_post_endpoint_push_buffer_list_action;
   klass->end_of_stream = kms_http_post_endpoint_end_of_stream_action;
 
   g_type_class_add_private (klass, sizeof (KmsHttpPostEndpointPrivate));
@@ -495,6 +667,8 @@ kms_http_post_endpoint_init (KmsHttpPostEndpoint * self)
 {
   self->priv = KMS_HTTP_POST_ENDPOINT_GET_PRIVATE (self);
   KMS_HTTP_ENDPOINT (self)->method = KMS_HTTP_ENDPOINT_METHOD_POST;
+  self->priv->high_water_mark = DEFAULT_HIGH_WATER_MARK;
+  self->priv->low_water_mark = DEFAULT_LOW_WATER_MARK;
 }
 
 gboolean
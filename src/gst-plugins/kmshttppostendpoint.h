@@ -66,6 +66,8 @@ struct _KmsHttpPostEndpointClass
 
   /* actions */
   GstFlowReturn (*push_buffer) (KmsHttpPostEndpoint * self, GstBuffer * buffer);
+  GstFlowReturn (*push_buffer_list) (KmsHttpPostEndpoint * self,
+      GstBufferList * list);
   GstFlowReturn (*end_of_stream) (KmsHttpPostEndpoint * self);
 };
 
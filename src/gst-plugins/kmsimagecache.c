@@ -0,0 +1,451 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsimagecache.h"
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <libsoup/soup.h>
+#include <opencv/highgui.h>
+
+#define GST_CAT_DEFAULT kms_image_cache_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmsimagecache"
+
+#define CACHE_DIR_NAME "kms-image-cache"
+#define MAX_MEMORY_BYTES (32 * 1024 * 1024)
+#define MAX_LOADER_THREADS 2
+#define DOWNLOAD_TIMEOUT 10     /* seconds */
+#define DISK_ENTRY_TTL (60 * 60)        /* seconds */
+#define MAX_DISK_BYTES (256 * 1024 * 1024)
+#define DISK_PRUNE_INTERVAL (10 * 60)   /* seconds */
+
+typedef struct _KmsImageCacheWaiter
+{
+  KmsImageCacheFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+} KmsImageCacheWaiter;
+
+typedef struct _KmsImageCacheRequest
+{
+  gchar *key;
+  gchar *uri;
+  gint width;
+  gint height;
+  GSList *waiters;
+} KmsImageCacheRequest;
+
+typedef struct _KmsImageCache
+{
+  GMutex mutex;
+  GHashTable *images;           /* key -> KmsImage, most recent at lru head */
+  GQueue lru;
+  gsize bytes;
+  GHashTable *pending;          /* key -> KmsImageCacheRequest */
+  GThreadPool *pool;
+  SoupSession *session;
+  gchar *dir;
+  gint64 last_prune;            /* monotonic seconds */
+} KmsImageCache;
+
+typedef struct _KmsImageCacheFile
+{
+  gchar *path;
+  gint64 mtime;
+  gint64 size;
+} KmsImageCacheFile;
+
+static KmsImageCache *cache = NULL;
+
+static void
+kms_image_destroy (KmsImage * image)
+{
+  if (image->image != NULL)
+    cvReleaseImage (&image->image);
+
+  g_free (image->uri);
+  g_free (image->path);
+  g_free (image->key);
+
+  g_slice_free (KmsImage, image);
+}
+
+static void
+kms_image_cache_waiter_call (KmsImageCacheWaiter * waiter, KmsImage * image)
+{
+  waiter->func (image, waiter->user_data);
+
+  if (waiter->notify != NULL)
+    waiter->notify (waiter->user_data);
+
+  g_slice_free (KmsImageCacheWaiter, waiter);
+}
+
+static gboolean
+kms_image_cache_is_remote (const gchar * uri)
+{
+  return g_str_has_prefix (uri, "http://") || g_str_has_prefix (uri,
+      "https://");
+}
+
+static gboolean
+kms_image_cache_is_fresh (const gchar * path)
+{
+  GStatBuf st;
+
+  if (g_stat (path, &st) != 0)
+    return FALSE;
+
+  return (g_get_real_time () / G_USEC_PER_SEC) - st.st_mtime < DISK_ENTRY_TTL;
+}
+
+/* Returns the path of the original image, downloading it when needed */
+static gchar *
+kms_image_cache_fetch (const gchar * uri, const gchar * raw_path)
+{
+  SoupMessage *msg;
+  GError *err = NULL;
+  gboolean ok;
+
+  if (!kms_image_cache_is_remote (uri))
+    return g_strdup (uri);
+
+  if (kms_image_cache_is_fresh (raw_path))
+    return g_strdup (raw_path);
+
+  msg = soup_message_new ("GET", uri);
+  if (msg == NULL) {
+    GST_WARNING ("Invalid image URL %s", uri);
+    return NULL;
+  }
+
+  soup_session_send_message (cache->session, msg);
+
+  if (!SOUP_STATUS_IS_SUCCESSFUL (msg->status_code)) {
+    GST_WARNING ("Cannot download %s: %d %s", uri, msg->status_code,
+        msg->reason_phrase);
+    g_object_unref (msg);
+    return NULL;
+  }
+
+  /* written to a temporary file and renamed, readers never see half files */
+  ok = g_file_set_contents (raw_path, msg->response_body->data,
+      msg->response_body->length, &err);
+  g_object_unref (msg);
+
+  if (!ok) {
+    GST_WARNING ("Cannot store %s: %s", uri, err->message);
+    g_error_free (err);
+    return NULL;
+  }
+
+  return g_strdup (raw_path);
+}
+
+static KmsImage *
+kms_image_cache_decode (KmsImageCacheRequest * req)
+{
+  gchar *base, *raw_path, *scaled_path, *src_path = NULL;
+  IplImage *src, *scaled = NULL;
+  KmsImage *image = NULL;
+  gboolean scale = req->width > 0 && req->height > 0;
+
+  base = g_compute_checksum_for_string (G_CHECKSUM_SHA1, req->uri, -1);
+  raw_path = g_build_filename (cache->dir, base, NULL);
+  scaled_path = g_strdup_printf ("%s-%dx%d.png", raw_path, req->width,
+      req->height);
+  g_free (base);
+
+  if (scale && kms_image_cache_is_fresh (scaled_path)) {
+    scaled = cvLoadImage (scaled_path, CV_LOAD_IMAGE_COLOR);
+  }
+
+  if (scaled == NULL) {
+    src_path = kms_image_cache_fetch (req->uri, raw_path);
+    if (src_path == NULL)
+      goto end;
+
+    /* ignore alpha channel */
+    src = cvLoadImage (src_path, CV_LOAD_IMAGE_COLOR);
+    if (src == NULL) {
+      GST_WARNING ("Cannot decode image %s", req->uri);
+      /* do not serve the broken download again until it expires */
+      if (kms_image_cache_is_remote (req->uri))
+        g_unlink (raw_path);
+      goto end;
+    }
+
+    if (scale && (src->width != req->width || src->height != req->height)) {
+      scaled = cvCreateImage (cvSize (req->width, req->height), src->depth,
+          src->nChannels);
+      cvResize (src, scaled, CV_INTER_AREA);
+      cvReleaseImage (&src);
+    } else {
+      scaled = src;
+    }
+
+    if (scale && !cvSaveImage (scaled_path, scaled, 0)) {
+      GST_WARNING ("Cannot store scaled image %s", scaled_path);
+    }
+  }
+
+  image = g_slice_new0 (KmsImage);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (image),
+      (GDestroyNotify) kms_image_destroy);
+  image->key = g_strdup (req->key);
+  image->uri = g_strdup (req->uri);
+  image->width = scaled->width;
+  image->height = scaled->height;
+  image->image = scaled;
+  image->size = scaled->imageSize;
+  image->path = scale ? g_strdup (scaled_path) : g_strdup (src_path);
+
+end:
+  g_free (src_path);
+  g_free (scaled_path);
+  g_free (raw_path);
+
+  return image;
+}
+
+/* must be called with the cache mutex held */
+static void
+kms_image_cache_store (KmsImage * image)
+{
+  kms_image_ref (image);
+  g_queue_push_head (&cache->lru, image);
+  image->lru_link = g_queue_peek_head_link (&cache->lru);
+  g_hash_table_insert (cache->images, image->key, image);
+  cache->bytes += image->size;
+
+  /* images still in use keep living until their users release them */
+  while (cache->bytes > MAX_MEMORY_BYTES && cache->lru.length > 1) {
+    KmsImage *old = g_queue_pop_tail (&cache->lru);
+
+    GST_DEBUG ("Evicting %s (%" G_GSIZE_FORMAT " bytes)", old->key,
+        old->size);
+    cache->bytes -= old->size;
+    old->lru_link = NULL;
+    g_hash_table_remove (cache->images, old->key);
+    kms_image_unref (old);
+  }
+}
+
+static gint
+compare_file_mtime (gconstpointer a, gconstpointer b)
+{
+  const KmsImageCacheFile *file_a = a;
+  const KmsImageCacheFile *file_b = b;
+
+  return (file_a->mtime > file_b->mtime) - (file_a->mtime < file_b->mtime);
+}
+
+static void
+kms_image_cache_file_free (KmsImageCacheFile * file)
+{
+  g_free (file->path);
+  g_slice_free (KmsImageCacheFile, file);
+}
+
+/* Removes expired files and then the oldest ones until the directory */
+/* fits in MAX_DISK_BYTES. Files being read stay valid until closed. */
+static void
+kms_image_cache_prune_disk (void)
+{
+  gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+  GSList *files = NULL, *l;
+  gint64 total = 0;
+  const gchar *name;
+  GDir *dir;
+
+  dir = g_dir_open (cache->dir, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL) {
+    KmsImageCacheFile *file;
+    GStatBuf st;
+    gchar *path;
+
+    path = g_build_filename (cache->dir, name, NULL);
+    if (g_stat (path, &st) != 0 || !S_ISREG (st.st_mode)) {
+      g_free (path);
+      continue;
+    }
+
+    if (now - st.st_mtime >= DISK_ENTRY_TTL) {
+      GST_DEBUG ("Removing expired %s", path);
+      g_unlink (path);
+      g_free (path);
+      continue;
+    }
+
+    file = g_slice_new (KmsImageCacheFile);
+    file->path = path;
+    file->mtime = st.st_mtime;
+    file->size = st.st_size;
+    total += st.st_size;
+    files = g_slist_prepend (files, file);
+  }
+  g_dir_close (dir);
+
+  files = g_slist_sort (files, compare_file_mtime);
+  for (l = files; l != NULL && total > MAX_DISK_BYTES; l = l->next) {
+    KmsImageCacheFile *file = l->data;
+
+    GST_DEBUG ("Removing %s (%" G_GINT64_FORMAT " bytes)", file->path,
+        file->size);
+    g_unlink (file->path);
+    total -= file->size;
+  }
+
+  g_slist_free_full (files, (GDestroyNotify) kms_image_cache_file_free);
+}
+
+static void
+kms_image_cache_request_free (KmsImageCacheRequest * req)
+{
+  g_free (req->key);
+  g_free (req->uri);
+  g_slice_free (KmsImageCacheRequest, req);
+}
+
+static void
+kms_image_cache_process (KmsImageCacheRequest * req, gpointer unused)
+{
+  gint64 now = g_get_monotonic_time () / G_USEC_PER_SEC;
+  gboolean prune = FALSE;
+  KmsImage *image;
+  GSList *waiters, *l;
+
+  GST_DEBUG ("Loading %s", req->key);
+  image = kms_image_cache_decode (req);
+
+  g_mutex_lock (&cache->mutex);
+  g_hash_table_steal (cache->pending, req->key);
+  if (image != NULL) {
+    kms_image_cache_store (image);
+  }
+  waiters = g_slist_reverse (req->waiters);
+  req->waiters = NULL;
+  if (now - cache->last_prune >= DISK_PRUNE_INTERVAL) {
+    cache->last_prune = now;
+    prune = TRUE;
+  }
+  g_mutex_unlock (&cache->mutex);
+
+  if (prune)
+    kms_image_cache_prune_disk ();
+
+  for (l = waiters; l != NULL; l = l->next) {
+    kms_image_cache_waiter_call (l->data, image);
+  }
+  g_slist_free (waiters);
+
+  if (image != NULL)
+    kms_image_unref (image);
+
+  kms_image_cache_request_free (req);
+}
+
+static gpointer
+kms_image_cache_init (gpointer data)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+
+  cache = g_slice_new0 (KmsImageCache);
+  g_mutex_init (&cache->mutex);
+  g_queue_init (&cache->lru);
+  cache->images = g_hash_table_new (g_str_hash, g_str_equal);
+  cache->pending = g_hash_table_new (g_str_hash, g_str_equal);
+  cache->pool =
+      g_thread_pool_new ((GFunc) kms_image_cache_process, NULL,
+      MAX_LOADER_THREADS, FALSE, NULL);
+  cache->session = soup_session_sync_new_with_options (SOUP_SESSION_TIMEOUT,
+      DOWNLOAD_TIMEOUT, NULL);
+  cache->dir = g_build_filename (g_get_tmp_dir (), CACHE_DIR_NAME, NULL);
+
+  if (g_mkdir_with_parents (cache->dir, 0700) != 0) {
+    GST_WARNING ("Cannot create image cache directory %s", cache->dir);
+  }
+
+  /* files left by previous runs are pruned by the first load */
+  cache->last_prune = G_MININT64 / 2;
+
+  return NULL;
+}
+
+void
+kms_image_cache_load_async (const gchar * uri, gint width, gint height,
+    KmsImageCacheFunc func, gpointer user_data, GDestroyNotify notify)
+{
+  static GOnce once = G_ONCE_INIT;
+  KmsImageCacheWaiter *waiter;
+  KmsImageCacheRequest *req;
+  KmsImage *image;
+  gchar *key;
+
+  g_return_if_fail (uri != NULL && func != NULL);
+
+  g_once (&once, kms_image_cache_init, NULL);
+
+  key = g_strdup_printf ("%s@%dx%d", uri, MAX (width, 0), MAX (height, 0));
+
+  waiter = g_slice_new (KmsImageCacheWaiter);
+  waiter->func = func;
+  waiter->user_data = user_data;
+  waiter->notify = notify;
+
+  g_mutex_lock (&cache->mutex);
+
+  image = g_hash_table_lookup (cache->images, key);
+  if (image != NULL) {
+    g_queue_unlink (&cache->lru, image->lru_link);
+    g_queue_push_head_link (&cache->lru, image->lru_link);
+    kms_image_ref (image);
+    g_mutex_unlock (&cache->mutex);
+    g_free (key);
+
+    kms_image_cache_waiter_call (waiter, image);
+    kms_image_unref (image);
+    return;
+  }
+
+  /* the same image is already being loaded, just wait for it */
+  req = g_hash_table_lookup (cache->pending, key);
+  if (req != NULL) {
+    req->waiters = g_slist_prepend (req->waiters, waiter);
+    g_mutex_unlock (&cache->mutex);
+    g_free (key);
+    return;
+  }
+
+  req = g_slice_new0 (KmsImageCacheRequest);
+  req->key = key;
+  req->uri = g_strdup (uri);
+  req->width = width;
+  req->height = height;
+  req->waiters = g_slist_prepend (NULL, waiter);
+  g_hash_table_insert (cache->pending, req->key, req);
+
+  g_thread_pool_push (cache->pool, req, NULL);
+
+  g_mutex_unlock (&cache->mutex);
+}
@@ -0,0 +1,57 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_IMAGE_CACHE_H_
+#define _KMS_IMAGE_CACHE_H_
+
+#include <glib.h>
+#include <commons/kmsrefstruct.h>
+#include <opencv/cv.h>
+
+G_BEGIN_DECLS
+
+typedef struct _KmsImage
+{
+  KmsRefStruct ref;
+
+  gchar *uri;
+  gint width;
+  gint height;
+  gchar *path;                  /* decoded and scaled copy on disk */
+  IplImage *image;              /* BGR pixels, read only */
+
+  /*< private > */
+  gchar *key;
+  gsize size;
+  GList *lru_link;
+} KmsImage;
+
+#define kms_image_ref(image) \
+  ((KmsImage *) kms_ref_struct_ref (KMS_REF_STRUCT_CAST (image)))
+#define kms_image_unref(image) \
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (image))
+
+/* image is NULL when it could not be loaded, failures are not cached and */
+/* the next request tries again. It is only valid during the call, take a */
+/* reference to keep it. */
+typedef void (*KmsImageCacheFunc) (KmsImage * image, gpointer user_data);
+
+/* Loads uri (http(s) URL or local file) scaled to width x height, or with */
+/* its own size if any of them is not positive. func is called right away */
+/* if the image is in memory, otherwise from a loader thread. */
+void kms_image_cache_load_async (const gchar * uri, gint width, gint height,
+    KmsImageCacheFunc func, gpointer user_data, GDestroyNotify notify);
+
+G_END_DECLS
+#endif /* _KMS_IMAGE_CACHE_H_ */
@@ -0,0 +1,395 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmskeyframecoalescer.h"
+
+#include <gst/video/video.h>
+
+#define GST_CAT_DEFAULT kms_keyframe_coalescer_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmskeyframecoalescer"
+
+struct _KmsKeyframeCoalescer
+{
+  KmsRefStruct ref;
+
+  KmsLoop *loop;
+
+  GMutex mutex;
+  GstClockTime interval;
+  guint64 received;
+  guint64 forwarded;
+};
+
+typedef struct _KmsKeyframeCoalescerSource
+{
+  KmsRefStruct ref;
+
+  KmsKeyframeCoalescer *coalescer;
+  GWeakRef pad;
+
+  /* protected by the coalescer mutex */
+  gint64 last_forwarded;        /* monotonic time, 0 if none yet */
+  gboolean pending;
+  gboolean all_headers;
+  gboolean encoded;             /* only then buffers tell the keyframes */
+  guint timer;                  /* loop source sending the merged request */
+} KmsKeyframeCoalescerSource;
+
+/* marks the requests sent by the coalescer itself */
+#define MERGED_REQUEST_FIELD "kms-merged"
+
+#define KMS_KEYFRAME_COALESCER_SOURCE_REF(source) \
+  kms_ref_struct_ref (KMS_REF_STRUCT_CAST (source))
+#define KMS_KEYFRAME_COALESCER_SOURCE_UNREF(source) \
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (source))
+
+static void
+kms_keyframe_coalescer_destroy (KmsKeyframeCoalescer * self)
+{
+  g_mutex_clear (&self->mutex);
+  g_object_unref (self->loop);
+
+  g_slice_free (KmsKeyframeCoalescer, self);
+}
+
+KmsKeyframeCoalescer *
+kms_keyframe_coalescer_new (KmsLoop * loop, GstClockTime interval)
+{
+  static gsize init = 0;
+  KmsKeyframeCoalescer *self;
+
+  if (g_once_init_enter (&init)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+        GST_DEFAULT_NAME);
+    g_once_init_leave (&init, 1);
+  }
+
+  self = g_slice_new0 (KmsKeyframeCoalescer);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (self),
+      (GDestroyNotify) kms_keyframe_coalescer_destroy);
+
+  g_mutex_init (&self->mutex);
+  self->loop = g_object_ref (loop);
+  self->interval = interval;
+
+  return self;
+}
+
+static void
+kms_keyframe_coalescer_source_destroy (KmsKeyframeCoalescerSource * source)
+{
+  g_weak_ref_clear (&source->pad);
+  kms_keyframe_coalescer_unref (source->coalescer);
+  g_slice_free (KmsKeyframeCoalescerSource, source);
+}
+
+/* must be called with the mutex held */
+static void
+kms_keyframe_coalescer_source_cancel_timer (KmsKeyframeCoalescerSource *
+    source)
+{
+  if (source->timer == 0) {
+    return;
+  }
+
+  kms_loop_remove (source->coalescer->loop, source->timer);
+  source->timer = 0;
+}
+
+/* Called when the probe is removed */
+static void
+kms_keyframe_coalescer_source_remove (KmsKeyframeCoalescerSource * source)
+{
+  g_mutex_lock (&source->coalescer->mutex);
+  kms_keyframe_coalescer_source_cancel_timer (source);
+  g_mutex_unlock (&source->coalescer->mutex);
+
+  KMS_KEYFRAME_COALESCER_SOURCE_UNREF (source);
+}
+
+/* must be called with the mutex held */
+static gint64
+kms_keyframe_coalescer_source_wait (KmsKeyframeCoalescerSource * source,
+    gint64 now)
+{
+  gint64 interval = source->coalescer->interval / GST_USECOND;
+
+  if (source->last_forwarded == 0) {
+    return 0;
+  }
+
+  return MAX (source->last_forwarded + interval - now, 0);
+}
+
+/* must be called with the mutex held, returns the event to send */
+static GstEvent *
+kms_keyframe_coalescer_source_forward_merged (KmsKeyframeCoalescerSource *
+    source, gint64 now)
+{
+  GstEvent *event;
+
+  event = gst_video_event_new_upstream_force_key_unit (GST_CLOCK_TIME_NONE,
+      source->all_headers, 0);
+  gst_structure_set (gst_event_writable_structure (event),
+      MERGED_REQUEST_FIELD, G_TYPE_BOOLEAN, TRUE, NULL);
+
+  source->last_forwarded = now;
+  source->pending = FALSE;
+  source->all_headers = FALSE;
+  source->coalescer->forwarded++;
+
+  return event;
+}
+
+static void
+kms_keyframe_coalescer_source_send (KmsKeyframeCoalescerSource * source,
+    GstEvent * event)
+{
+  GstPad *pad = g_weak_ref_get (&source->pad);
+
+  if (pad != NULL) {
+    GST_DEBUG_OBJECT (pad, "Sending merged keyframe request");
+    gst_pad_push_event (pad, event);
+    g_object_unref (pad);
+  } else {
+    gst_event_unref (event);
+  }
+}
+
+static gboolean
+kms_keyframe_coalescer_timeout (KmsKeyframeCoalescerSource * source)
+{
+  guint id = g_source_get_id (g_main_current_source ());
+  GstEvent *event = NULL;
+
+  g_mutex_lock (&source->coalescer->mutex);
+
+  if (source->timer != id) {
+    /* cancelled while it was being dispatched */
+    g_mutex_unlock (&source->coalescer->mutex);
+    return G_SOURCE_REMOVE;
+  }
+
+  source->timer = 0;
+
+  if (source->pending) {
+    event = kms_keyframe_coalescer_source_forward_merged (source,
+        g_get_monotonic_time ());
+  }
+
+  g_mutex_unlock (&source->coalescer->mutex);
+
+  if (event != NULL) {
+    kms_keyframe_coalescer_source_send (source, event);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* must be called with the mutex held */
+static void
+kms_keyframe_coalescer_source_schedule (KmsKeyframeCoalescerSource * source,
+    gint64 wait)
+{
+  if (source->timer != 0) {
+    return;
+  }
+
+  /* rounded up, it must not fire before the interval ends */
+  source->timer = kms_loop_timeout_add_full (source->coalescer->loop,
+      G_PRIORITY_DEFAULT, (wait + 999) / 1000,
+      (GSourceFunc) kms_keyframe_coalescer_timeout,
+      KMS_KEYFRAME_COALESCER_SOURCE_REF (source),
+      (GDestroyNotify) kms_ref_struct_unref);
+}
+
+static GstPadProbeReturn
+kms_keyframe_coalescer_request (KmsKeyframeCoalescerSource * source,
+    GstPad * pad, GstEvent * event)
+{
+  KmsKeyframeCoalescer *self = source->coalescer;
+  GstPadProbeReturn ret = GST_PAD_PROBE_OK;
+  gint64 now = g_get_monotonic_time ();
+  gboolean all_headers = FALSE;
+  gint64 wait;
+
+  if (gst_structure_has_field (gst_event_get_structure (event),
+          MERGED_REQUEST_FIELD)) {
+    /* already counted */
+    return GST_PAD_PROBE_OK;
+  }
+
+  gst_video_event_parse_upstream_force_key_unit (event, NULL, &all_headers,
+      NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  self->received++;
+  wait = kms_keyframe_coalescer_source_wait (source, now);
+
+  if (wait == 0) {
+    source->last_forwarded = now;
+    source->pending = FALSE;
+    source->all_headers = FALSE;
+    kms_keyframe_coalescer_source_cancel_timer (source);
+    self->forwarded++;
+  } else {
+    /* sent when the interval ends, unless a keyframe comes first */
+    source->pending = TRUE;
+    source->all_headers |= all_headers;
+    kms_keyframe_coalescer_source_schedule (source, wait);
+    ret = GST_PAD_PROBE_DROP;
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  if (ret == GST_PAD_PROBE_DROP) {
+    GST_LOG_OBJECT (pad, "Keyframe request merged");
+  }
+
+  return ret;
+}
+
+static void
+kms_keyframe_coalescer_caps (KmsKeyframeCoalescerSource * source,
+    GstEvent * event)
+{
+  GstStructure *st;
+  GstCaps *caps;
+
+  gst_event_parse_caps (event, &caps);
+  st = gst_caps_get_structure (caps, 0);
+
+  g_mutex_lock (&source->coalescer->mutex);
+  source->encoded = !gst_structure_has_name (st, "video/x-raw");
+  g_mutex_unlock (&source->coalescer->mutex);
+}
+
+static void
+kms_keyframe_coalescer_buffer (KmsKeyframeCoalescerSource * source,
+    GstPad * pad, GstBuffer * buffer)
+{
+  KmsKeyframeCoalescer *self = source->coalescer;
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    return;
+  }
+
+  g_mutex_lock (&self->mutex);
+
+  /* raw buffers are never delta units, they do not serve any request */
+  if (source->pending && source->encoded) {
+    GST_LOG_OBJECT (pad, "Merged keyframe requests served by a keyframe");
+    source->pending = FALSE;
+    source->all_headers = FALSE;
+    kms_keyframe_coalescer_source_cancel_timer (source);
+  }
+
+  g_mutex_unlock (&self->mutex);
+}
+
+static GstPadProbeReturn
+kms_keyframe_coalescer_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsKeyframeCoalescerSource * source)
+{
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    kms_keyframe_coalescer_buffer (source, pad,
+        GST_PAD_PROBE_INFO_BUFFER (info));
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) &
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+      kms_keyframe_coalescer_caps (source, event);
+    }
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) &
+      GST_PAD_PROBE_TYPE_EVENT_UPSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (gst_video_event_is_force_key_unit (event)) {
+      return kms_keyframe_coalescer_request (source, pad, event);
+    }
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+gulong
+kms_keyframe_coalescer_add_probe (KmsKeyframeCoalescer * self, GstPad * pad)
+{
+  KmsKeyframeCoalescerSource *source;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  source = g_slice_new0 (KmsKeyframeCoalescerSource);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (source),
+      (GDestroyNotify) kms_keyframe_coalescer_source_destroy);
+  source->coalescer = kms_keyframe_coalescer_ref (self);
+  g_weak_ref_init (&source->pad, pad);
+
+  return gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_UPSTREAM,
+      (GstPadProbeCallback) kms_keyframe_coalescer_probe, source,
+      (GDestroyNotify) kms_keyframe_coalescer_source_remove);
+}
+
+void
+kms_keyframe_coalescer_set_interval (KmsKeyframeCoalescer * self,
+    GstClockTime interval)
+{
+  g_mutex_lock (&self->mutex);
+  self->interval = interval;
+  g_mutex_unlock (&self->mutex);
+}
+
+GstClockTime
+kms_keyframe_coalescer_get_interval (KmsKeyframeCoalescer * self)
+{
+  GstClockTime interval;
+
+  g_mutex_lock (&self->mutex);
+  interval = self->interval;
+  g_mutex_unlock (&self->mutex);
+
+  return interval;
+}
+
+guint64
+kms_keyframe_coalescer_get_received (KmsKeyframeCoalescer * self)
+{
+  guint64 received;
+
+  g_mutex_lock (&self->mutex);
+  received = self->received;
+  g_mutex_unlock (&self->mutex);
+
+  return received;
+}
+
+guint64
+kms_keyframe_coalescer_get_forwarded (KmsKeyframeCoalescer * self)
+{
+  guint64 forwarded;
+
+  g_mutex_lock (&self->mutex);
+  forwarded = self->forwarded;
+  g_mutex_unlock (&self->mutex);
+
+  return forwarded;
+}
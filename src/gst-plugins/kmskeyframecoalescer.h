@@ -0,0 +1,56 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_KEYFRAME_COALESCER_H_
+#define _KMS_KEYFRAME_COALESCER_H_
+
+#include <gst/gst.h>
+#include <commons/kmsloop.h>
+#include <commons/kmsrefstruct.h>
+
+G_BEGIN_DECLS
+
+typedef struct _KmsKeyframeCoalescer KmsKeyframeCoalescer;
+
+/* Merges the keyframe requests that the branches of a hub send to the */
+/* same source, so a mass join does not flood the publisher. Merged */
+/* requests are sent from loop, usually the one of the hub. */
+KmsKeyframeCoalescer *kms_keyframe_coalescer_new (KmsLoop * loop,
+    GstClockTime interval);
+
+#define kms_keyframe_coalescer_ref(coalescer) \
+  ((KmsKeyframeCoalescer *) kms_ref_struct_ref (KMS_REF_STRUCT_CAST (coalescer)))
+#define kms_keyframe_coalescer_unref(coalescer) \
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (coalescer))
+
+/* Adds a probe on the pad a source enters the hub through. At most one */
+/* request per interval goes upstream from it, the ones received in */
+/* between are merged into a single request sent when the interval ends, */
+/* unless a keyframe of the encoded stream serves them first. */
+gulong kms_keyframe_coalescer_add_probe (KmsKeyframeCoalescer * coalescer,
+    GstPad * pad);
+
+void kms_keyframe_coalescer_set_interval (KmsKeyframeCoalescer * coalescer,
+    GstClockTime interval);
+GstClockTime kms_keyframe_coalescer_get_interval (KmsKeyframeCoalescer *
+    coalescer);
+
+/* Counters over all the sources of the coalescer */
+guint64 kms_keyframe_coalescer_get_received (KmsKeyframeCoalescer *
+    coalescer);
+guint64 kms_keyframe_coalescer_get_forwarded (KmsKeyframeCoalescer *
+    coalescer);
+
+G_END_DECLS
+#endif /* _KMS_KEYFRAME_COALESCER_H_ */
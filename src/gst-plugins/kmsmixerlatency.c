@@ -0,0 +1,422 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsmixerlatency.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define GST_CAT_DEFAULT kms_mixer_latency_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmsmixerlatency"
+
+#define WINDOW_SIZE 128         /* arrival offsets kept per input */
+#define UPDATE_INTERVAL 30      /* buffers between two estimations */
+#define HYSTERESIS (10 * GST_MSECOND)   /* smaller changes are ignored */
+
+#define DEFAULT_PERCENTILE 95
+#define DEFAULT_MIN_LATENCY (40 * GST_MSECOND)
+
+struct _KmsMixerLatency
+{
+  KmsRefStruct ref;
+
+  GMutex mutex;
+  GList *ports;
+
+  GstClockTime fixed;
+  gboolean adaptive;
+  guint percentile;
+  GstClockTime min;
+  GstClockTime max;
+  GstClockTime current;
+  guint64 late_frames;
+  /* earliest arrival offset among the inputs, the skews are relative to it */
+  GstClockTimeDiff floor;
+  gboolean floor_valid;
+
+  KmsMixerLatencyFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+};
+
+typedef struct _KmsMixerLatencyPort
+{
+  KmsMixerLatency *latency;
+  GstSegment segment;
+  /* arrival clock time minus running time of the last buffers */
+  GstClockTimeDiff offsets[WINDOW_SIZE];
+  guint n_offsets;
+  guint next;
+  guint pending;
+  gboolean estimated;
+  GstClockTimeDiff floor;
+  GstClockTimeDiff estimation;
+} KmsMixerLatencyPort;
+
+static void
+kms_mixer_latency_destroy (KmsMixerLatency * self)
+{
+  if (self->notify != NULL)
+    self->notify (self->user_data);
+
+  g_list_free (self->ports);
+  g_mutex_clear (&self->mutex);
+
+  g_slice_free (KmsMixerLatency, self);
+}
+
+KmsMixerLatency *
+kms_mixer_latency_new (GstClockTime fixed, KmsMixerLatencyFunc func,
+    gpointer user_data, GDestroyNotify notify)
+{
+  static gsize init = 0;
+  KmsMixerLatency *self;
+
+  if (g_once_init_enter (&init)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+        GST_DEFAULT_NAME);
+    g_once_init_leave (&init, 1);
+  }
+
+  self = g_slice_new0 (KmsMixerLatency);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (self),
+      (GDestroyNotify) kms_mixer_latency_destroy);
+
+  g_mutex_init (&self->mutex);
+  self->fixed = fixed;
+  self->current = fixed;
+  self->percentile = DEFAULT_PERCENTILE;
+  self->min = MIN (DEFAULT_MIN_LATENCY, fixed);
+  self->max = fixed;
+  self->func = func;
+  self->user_data = user_data;
+  self->notify = notify;
+
+  return self;
+}
+
+static gint
+compare_clock_time_diff (gconstpointer a, gconstpointer b)
+{
+  GstClockTimeDiff ta = *(const GstClockTimeDiff *) a;
+  GstClockTimeDiff tb = *(const GstClockTimeDiff *) b;
+
+  return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
+
+/* keeps the earliest offset of the window and the percentile one */
+static void
+kms_mixer_latency_port_estimate (KmsMixerLatencyPort * port, guint percentile)
+{
+  GstClockTimeDiff sorted[WINDOW_SIZE];
+
+  if (port->n_offsets == 0)
+    return;
+
+  memcpy (sorted, port->offsets, port->n_offsets * sizeof (GstClockTimeDiff));
+  qsort (sorted, port->n_offsets, sizeof (GstClockTimeDiff),
+      compare_clock_time_diff);
+
+  port->floor = sorted[0];
+  port->estimation = sorted[(port->n_offsets - 1) * percentile / 100];
+  port->estimated = TRUE;
+}
+
+/* must be called with the mutex held, returns TRUE if current changed */
+static gboolean
+kms_mixer_latency_update (KmsMixerLatency * self, gboolean force)
+{
+  GstClockTime target = 0, diff;
+  GList *l;
+
+  self->floor_valid = FALSE;
+  for (l = self->ports; l != NULL; l = l->next) {
+    KmsMixerLatencyPort *port = l->data;
+
+    if (!port->estimated)
+      continue;
+
+    if (!self->floor_valid || port->floor < self->floor) {
+      self->floor = port->floor;
+      self->floor_valid = TRUE;
+    }
+  }
+
+  if (!self->adaptive) {
+    target = self->fixed;
+  } else {
+    /* the mixer waits for its slowest input, measured against the earliest */
+    /* arrival of any of them: the clock offset they all share cancels out */
+    for (l = self->ports; l != NULL; l = l->next) {
+      KmsMixerLatencyPort *port = l->data;
+
+      if (port->estimated && port->estimation > self->floor)
+        target = MAX (target, (GstClockTime) (port->estimation - self->floor));
+    }
+
+    target = CLAMP (target, self->min, self->max);
+  }
+
+  diff = target > self->current ? target - self->current :
+      self->current - target;
+
+  if (diff == 0 || (!force && diff < HYSTERESIS))
+    return FALSE;
+
+  GST_DEBUG ("Latency %" GST_TIME_FORMAT " -> %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (self->current), GST_TIME_ARGS (target));
+  self->current = target;
+
+  return TRUE;
+}
+
+static void
+kms_mixer_latency_changed (KmsMixerLatency * self)
+{
+  if (self->func != NULL)
+    self->func (self->user_data);
+}
+
+static void
+kms_mixer_latency_port_free (KmsMixerLatencyPort * port)
+{
+  KmsMixerLatency *self = port->latency;
+  gboolean changed;
+
+  g_mutex_lock (&self->mutex);
+  self->ports = g_list_remove (self->ports, port);
+  changed = kms_mixer_latency_update (self, FALSE);
+  g_mutex_unlock (&self->mutex);
+
+  if (changed)
+    kms_mixer_latency_changed (self);
+
+  kms_mixer_latency_unref (self);
+  g_slice_free (KmsMixerLatencyPort, port);
+}
+
+static void
+kms_mixer_latency_port_sample (KmsMixerLatencyPort * port, GstPad * pad,
+    GstBuffer * buffer)
+{
+  KmsMixerLatency *self = port->latency;
+  GstClockTime running_time, now;
+  GstClockTimeDiff offset;
+  GstElement *element;
+  GstClock *clock;
+  gboolean changed = FALSE;
+
+  if (!GST_BUFFER_PTS_IS_VALID (buffer))
+    return;
+
+  running_time = gst_segment_to_running_time (&port->segment, GST_FORMAT_TIME,
+      GST_BUFFER_PTS (buffer));
+  if (!GST_CLOCK_TIME_IS_VALID (running_time))
+    return;
+
+  element = GST_PAD_PARENT (pad);
+  if (element == NULL)
+    return;
+
+  clock = gst_element_get_clock (element);
+  if (clock == NULL)
+    return;
+
+  now = gst_clock_get_time (clock) - gst_element_get_base_time (element);
+  g_object_unref (clock);
+
+  offset = GST_CLOCK_DIFF (running_time, now);
+
+  g_mutex_lock (&self->mutex);
+
+  if (self->floor_valid && offset - self->floor > (GstClockTimeDiff)
+      self->current) {
+    self->late_frames++;
+    GST_LOG_OBJECT (pad, "Late buffer, skew %" GST_TIME_FORMAT,
+        GST_TIME_ARGS ((GstClockTime) (offset - self->floor)));
+  }
+
+  port->offsets[port->next] = offset;
+  port->next = (port->next + 1) % WINDOW_SIZE;
+  port->n_offsets = MIN (port->n_offsets + 1, WINDOW_SIZE);
+
+  if (++port->pending >= UPDATE_INTERVAL) {
+    port->pending = 0;
+    kms_mixer_latency_port_estimate (port, self->percentile);
+    changed = kms_mixer_latency_update (self, FALSE);
+  }
+
+  g_mutex_unlock (&self->mutex);
+
+  if (changed)
+    kms_mixer_latency_changed (self);
+}
+
+static GstPadProbeReturn
+kms_mixer_latency_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsMixerLatencyPort * port)
+{
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    kms_mixer_latency_port_sample (port, pad,
+        GST_PAD_PROBE_INFO_BUFFER (info));
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_BOTH) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT) {
+      gst_event_copy_segment (event, &port->segment);
+    }
+  } else if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_QUERY_BOTH) {
+    GstQuery *query = GST_PAD_PROBE_INFO_QUERY (info);
+    GstClockTime current;
+
+    if (GST_QUERY_TYPE (query) != GST_QUERY_LATENCY)
+      return GST_PAD_PROBE_OK;
+
+    current = kms_mixer_latency_get_current (port->latency);
+
+    GST_LOG_OBJECT (pad, "Modifing latency query. New latency %"
+        GST_TIME_FORMAT, GST_TIME_ARGS (current));
+
+    gst_query_set_latency (query, TRUE, current, current);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+gulong
+kms_mixer_latency_add_probe (KmsMixerLatency * self, GstPad * pad)
+{
+  KmsMixerLatencyPort *port;
+
+  g_return_val_if_fail (self != NULL, 0);
+
+  port = g_slice_new0 (KmsMixerLatencyPort);
+  port->latency = kms_mixer_latency_ref (self);
+  gst_segment_init (&port->segment, GST_FORMAT_TIME);
+
+  g_mutex_lock (&self->mutex);
+  self->ports = g_list_prepend (self->ports, port);
+  g_mutex_unlock (&self->mutex);
+
+  return gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_QUERY_UPSTREAM,
+      (GstPadProbeCallback) kms_mixer_latency_probe, port,
+      (GDestroyNotify) kms_mixer_latency_port_free);
+}
+
+void
+kms_mixer_latency_set_adaptive (KmsMixerLatency * self, gboolean adaptive)
+{
+  gboolean changed;
+
+  g_mutex_lock (&self->mutex);
+  self->adaptive = adaptive;
+  /* start safe, the measures bring it down */
+  if (adaptive)
+    self->current = self->max;
+  changed = kms_mixer_latency_update (self, TRUE);
+  g_mutex_unlock (&self->mutex);
+
+  if (changed)
+    kms_mixer_latency_changed (self);
+}
+
+gboolean
+kms_mixer_latency_get_adaptive (KmsMixerLatency * self)
+{
+  gboolean adaptive;
+
+  g_mutex_lock (&self->mutex);
+  adaptive = self->adaptive;
+  g_mutex_unlock (&self->mutex);
+
+  return adaptive;
+}
+
+void
+kms_mixer_latency_set_percentile (KmsMixerLatency * self, guint percentile)
+{
+  g_mutex_lock (&self->mutex);
+  self->percentile = CLAMP (percentile, 1, 100);
+  g_mutex_unlock (&self->mutex);
+}
+
+guint
+kms_mixer_latency_get_percentile (KmsMixerLatency * self)
+{
+  guint percentile;
+
+  g_mutex_lock (&self->mutex);
+  percentile = self->percentile;
+  g_mutex_unlock (&self->mutex);
+
+  return percentile;
+}
+
+void
+kms_mixer_latency_set_range (KmsMixerLatency * self, GstClockTime min,
+    GstClockTime max)
+{
+  gboolean changed;
+
+  g_mutex_lock (&self->mutex);
+  self->min = MIN (min, max);
+  self->max = MAX (min, max);
+  changed = kms_mixer_latency_update (self, TRUE);
+  g_mutex_unlock (&self->mutex);
+
+  if (changed)
+    kms_mixer_latency_changed (self);
+}
+
+void
+kms_mixer_latency_get_range (KmsMixerLatency * self, GstClockTime * min,
+    GstClockTime * max)
+{
+  g_mutex_lock (&self->mutex);
+  if (min != NULL)
+    *min = self->min;
+  if (max != NULL)
+    *max = self->max;
+  g_mutex_unlock (&self->mutex);
+}
+
+GstClockTime
+kms_mixer_latency_get_current (KmsMixerLatency * self)
+{
+  GstClockTime current;
+
+  g_mutex_lock (&self->mutex);
+  current = self->current;
+  g_mutex_unlock (&self->mutex);
+
+  return current;
+}
+
+guint64
+kms_mixer_latency_get_late_frames (KmsMixerLatency * self)
+{
+  guint64 late_frames;
+
+  g_mutex_lock (&self->mutex);
+  late_frames = self->late_frames;
+  g_mutex_unlock (&self->mutex);
+
+  return late_frames;
+}
@@ -0,0 +1,66 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_MIXER_LATENCY_H_
+#define _KMS_MIXER_LATENCY_H_
+
+#include <gst/gst.h>
+#include <commons/kmsrefstruct.h>
+
+G_BEGIN_DECLS
+
+typedef struct _KmsMixerLatency KmsMixerLatency;
+
+/* Called from a streaming thread when the chosen latency changes, it must */
+/* not take locks the streaming threads of the mixer may be waiting for */
+typedef void (*KmsMixerLatencyFunc) (gpointer user_data);
+
+/* Answers the latency queries of the mixer inputs, with fixed until the */
+/* adaptive mode is enabled. */
+KmsMixerLatency *kms_mixer_latency_new (GstClockTime fixed,
+    KmsMixerLatencyFunc func, gpointer user_data, GDestroyNotify notify);
+
+#define kms_mixer_latency_ref(latency) \
+  ((KmsMixerLatency *) kms_ref_struct_ref (KMS_REF_STRUCT_CAST (latency)))
+#define kms_mixer_latency_unref(latency) \
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (latency))
+
+/* Adds a probe on the aggregator sink pad of an input. It measures how */
+/* much later than the earliest input its buffers arrive, and answers its */
+/* upstream latency queries. */
+gulong kms_mixer_latency_add_probe (KmsMixerLatency * latency, GstPad * pad);
+
+void kms_mixer_latency_set_adaptive (KmsMixerLatency * latency,
+    gboolean adaptive);
+gboolean kms_mixer_latency_get_adaptive (KmsMixerLatency * latency);
+
+/* Percentile of the arrival skews of each input that must be covered */
+void kms_mixer_latency_set_percentile (KmsMixerLatency * latency,
+    guint percentile);
+guint kms_mixer_latency_get_percentile (KmsMixerLatency * latency);
+
+void kms_mixer_latency_set_range (KmsMixerLatency * latency, GstClockTime min,
+    GstClockTime max);
+void kms_mixer_latency_get_range (KmsMixerLatency * latency,
+    GstClockTime * min, GstClockTime * max);
+
+GstClockTime kms_mixer_latency_get_current (KmsMixerLatency * latency);
+
+/* Buffers whose skew behind the earliest input exceeded the latency in */
+/* use. They may miss their output frame, but they are not counted as */
+/* dropped by the compositor. */
+guint64 kms_mixer_latency_get_late_frames (KmsMixerLatency * latency);
+
+G_END_DECLS
+#endif /* _KMS_MIXER_LATENCY_H_ */
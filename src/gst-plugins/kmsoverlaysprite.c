@@ -0,0 +1,495 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsoverlaysprite.h"
+#include "kmsblend.h"
+
+#include <string.h>
+
+#if G_BYTE_ORDER == G_LITTLE_ENDIAN
+# define ARGB32_A 3
+# define ARGB32_R 2
+# define ARGB32_G 1
+# define ARGB32_B 0
+#else
+# define ARGB32_A 0
+# define ARGB32_R 1
+# define ARGB32_G 2
+# define ARGB32_B 3
+#endif
+
+/* exact x / 255 for x in [0, 255 * 255] */
+#define DIV_255(x) (((x) + 128 + (((x) + 128) >> 8)) >> 8)
+
+/* limited range RGB to YUV coefficients, scaled by 256 */
+typedef struct _KmsOverlaySpriteMatrix
+{
+  gint y[3];
+  gint u[3];
+  gint v[3];
+} KmsOverlaySpriteMatrix;
+
+static const KmsOverlaySpriteMatrix bt601 = {
+  {66, 129, 25}, {-38, -74, 112}, {112, -94, -18}
+};
+
+static const KmsOverlaySpriteMatrix bt709 = {
+  {47, 157, 16}, {-26, -87, 112}, {112, -102, -10}
+};
+
+/* premultiplied B G R A to premultiplied Y U V, the conversion is affine */
+/* so the offsets are just scaled by alpha */
+static void
+kms_overlay_sprite_pixel_to_yuv (const KmsOverlaySpriteMatrix * m,
+    const guint8 * p, gint * y, gint * u, gint * v)
+{
+  gint b = p[0], g = p[1], r = p[2], a = p[3];
+
+  *y = ((m->y[0] * r + m->y[1] * g + m->y[2] * b + 128) >> 8) +
+      DIV_255 (16 * a);
+  *u = ((m->u[0] * r + m->u[1] * g + m->u[2] * b + 128) >> 8) +
+      DIV_255 (128 * a);
+  *v = ((m->v[0] * r + m->v[1] * g + m->v[2] * b + 128) >> 8) +
+      DIV_255 (128 * a);
+
+  *y = CLAMP (*y, 0, 255);
+  *u = CLAMP (*u, 0, 255);
+  *v = CLAMP (*v, 0, 255);
+}
+
+static KmsOverlaySpriteLayer *
+kms_overlay_sprite_layer_new (guint plane, guint component, gint x, gint y,
+    gint width, gint height, gint pixel_stride)
+{
+  KmsOverlaySpriteLayer *layer = g_slice_new0 (KmsOverlaySpriteLayer);
+  gsize size = width * height * pixel_stride;
+
+  layer->plane = plane;
+  layer->component = component;
+  layer->x = x;
+  layer->y = y;
+  layer->width = width;
+  layer->height = height;
+  layer->pixel_stride = pixel_stride;
+  layer->color = g_malloc0 (size);
+  layer->alpha = g_malloc0 (size);
+  layer->runs = g_array_new (FALSE, FALSE, sizeof (KmsOverlaySpriteRun));
+
+  return layer;
+}
+
+static void
+kms_overlay_sprite_layer_free (KmsOverlaySpriteLayer * layer)
+{
+  g_array_free (layer->runs, TRUE);
+  g_free (layer->color);
+  g_free (layer->alpha);
+  g_slice_free (KmsOverlaySpriteLayer, layer);
+}
+
+/* must be called once color and alpha are filled */
+static void
+kms_overlay_sprite_layer_add_runs (KmsOverlaySpriteLayer * layer)
+{
+  KmsOverlaySpriteRun run;
+  gint row, i;
+
+  for (row = 0; row < layer->height; row++) {
+    const guint8 *a = layer->alpha + row * layer->width * layer->pixel_stride;
+
+    run.row = row;
+    i = 0;
+
+    while (i < layer->width) {
+      while (i < layer->width && a[i * layer->pixel_stride] == 0)
+        i++;
+
+      if (i == layer->width)
+        break;
+
+      run.start = i;
+      while (i < layer->width && a[i * layer->pixel_stride] != 0)
+        i++;
+      run.length = i - run.start;
+
+      g_array_append_val (layer->runs, run);
+    }
+  }
+}
+
+static void
+kms_overlay_sprite_layer_blend (KmsOverlaySpriteLayer * layer, guint8 * data,
+    gint stride, gint width, gint height)
+{
+  gint ps = layer->pixel_stride;
+  guint i;
+
+  for (i = 0; i < layer->runs->len; i++) {
+    const KmsOverlaySpriteRun *run =
+        &g_array_index (layer->runs, KmsOverlaySpriteRun, i);
+    gint y = layer->y + run->row;
+    gint x = layer->x + run->start;
+    gint start = run->start, end = run->start + run->length;
+    gsize offset;
+
+    if (y < 0 || y >= height)
+      continue;
+
+    /* clip the run to the plane */
+    if (x < 0) {
+      start -= x;
+      x = 0;
+    }
+    if (layer->x + end > width)
+      end = width - layer->x;
+
+    if (end <= start)
+      continue;
+
+    offset = (run->row * layer->width + start) * ps;
+    kms_blend_over (data + y * stride + x * ps, layer->color + offset,
+        layer->alpha + offset, (end - start) * ps);
+  }
+}
+
+static KmsOverlaySpriteLayer *
+kms_overlay_sprite_build_bgr (KmsOverlaySpritePart * part)
+{
+  KmsOverlaySpriteLayer *layer;
+  gint row;
+
+  layer = kms_overlay_sprite_layer_new (0, 0, part->x, part->y,
+      part->width, part->height, 3);
+
+  for (row = 0; row < part->height; row++) {
+    gsize offset = row * part->width * 3;
+
+    kms_blend_prepare_bgr (part->pixels + row * part->stride,
+        layer->color + offset, layer->alpha + offset, part->width);
+  }
+
+  return layer;
+}
+
+static KmsOverlaySpriteLayer *
+kms_overlay_sprite_build_luma (KmsOverlaySpritePart * part,
+    const KmsOverlaySpriteMatrix * m)
+{
+  KmsOverlaySpriteLayer *layer;
+  gint row, col, y, u, v;
+
+  layer = kms_overlay_sprite_layer_new (0, 0, part->x, part->y,
+      part->width, part->height, 1);
+
+  for (row = 0; row < part->height; row++) {
+    const guint8 *p = part->pixels + row * part->stride;
+    gint idx = row * part->width;
+
+    for (col = 0; col < part->width; col++) {
+      kms_overlay_sprite_pixel_to_yuv (m, p + col * 4, &y, &u, &v);
+      layer->color[idx + col] = y;
+      layer->alpha[idx + col] = p[col * 4 + 3];
+    }
+  }
+
+  return layer;
+}
+
+/* Chroma layers are aligned to the 2x2 chroma grid of the frame. Each */
+/* chroma sample takes the mean of the premultiplied values and alphas of */
+/* the part pixels it covers, missing pixels being transparent. With */
+/* interleaved set, U and V share one NV12 layer. */
+static void
+kms_overlay_sprite_build_chroma (KmsOverlaySpritePart * part,
+    const KmsOverlaySpriteMatrix * m, gboolean interleaved)
+{
+  KmsOverlaySpriteLayer *u_layer, *v_layer;
+  gint cx0, cy0, cw, ch, cx, cy, dx, dy;
+  gint ps = interleaved ? 2 : 1;
+
+  /* floor division, the part may start at -1 */
+  cx0 = (part->x - (part->x < 0)) / 2;
+  cy0 = (part->y - (part->y < 0)) / 2;
+  cw = (part->x + part->width + 1) / 2 - cx0;
+  ch = (part->y + part->height + 1) / 2 - cy0;
+
+  u_layer = kms_overlay_sprite_layer_new (1, 1, cx0, cy0, cw, ch, ps);
+  v_layer = interleaved ? u_layer :
+      kms_overlay_sprite_layer_new (2, 2, cx0, cy0, cw, ch, 1);
+
+  for (cy = 0; cy < ch; cy++) {
+    for (cx = 0; cx < cw; cx++) {
+      gint sum_a = 0, sum_u = 0, sum_v = 0, y, u, v;
+      gint idx = cy * cw + cx;
+
+      for (dy = 0; dy < 2; dy++) {
+        gint sy = (cy0 + cy) * 2 + dy - part->y;
+
+        if (sy < 0 || sy >= part->height)
+          continue;
+
+        for (dx = 0; dx < 2; dx++) {
+          gint sx = (cx0 + cx) * 2 + dx - part->x;
+          const guint8 *p;
+
+          if (sx < 0 || sx >= part->width)
+            continue;
+
+          p = part->pixels + sy * part->stride + sx * 4;
+          kms_overlay_sprite_pixel_to_yuv (m, p, &y, &u, &v);
+          sum_a += p[3];
+          sum_u += u;
+          sum_v += v;
+        }
+      }
+
+      if (interleaved) {
+        u_layer->color[idx * 2] = (sum_u + 2) / 4;
+        u_layer->color[idx * 2 + 1] = (sum_v + 2) / 4;
+        u_layer->alpha[idx * 2] = u_layer->alpha[idx * 2 + 1] =
+            (sum_a + 2) / 4;
+      } else {
+        u_layer->color[idx] = (sum_u + 2) / 4;
+        v_layer->color[idx] = (sum_v + 2) / 4;
+        u_layer->alpha[idx] = v_layer->alpha[idx] = (sum_a + 2) / 4;
+      }
+    }
+  }
+
+  part->layers[part->n_layers++] = u_layer;
+  if (!interleaved)
+    part->layers[part->n_layers++] = v_layer;
+}
+
+static void
+kms_overlay_sprite_part_clear_layers (KmsOverlaySpritePart * part)
+{
+  guint i;
+
+  for (i = 0; i < part->n_layers; i++) {
+    kms_overlay_sprite_layer_free (part->layers[i]);
+    part->layers[i] = NULL;
+  }
+
+  part->n_layers = 0;
+}
+
+static void
+kms_overlay_sprite_part_build_layers (KmsOverlaySpritePart * part,
+    GstVideoFormat format, const KmsOverlaySpriteMatrix * m)
+{
+  guint i;
+
+  kms_overlay_sprite_part_clear_layers (part);
+
+  switch (format) {
+    case GST_VIDEO_FORMAT_BGR:
+      part->layers[part->n_layers++] = kms_overlay_sprite_build_bgr (part);
+      break;
+    case GST_VIDEO_FORMAT_I420:
+      part->layers[part->n_layers++] = kms_overlay_sprite_build_luma (part, m);
+      kms_overlay_sprite_build_chroma (part, m, FALSE);
+      break;
+    case GST_VIDEO_FORMAT_NV12:
+      part->layers[part->n_layers++] = kms_overlay_sprite_build_luma (part, m);
+      kms_overlay_sprite_build_chroma (part, m, TRUE);
+      break;
+    default:
+      return;
+  }
+
+  for (i = 0; i < part->n_layers; i++) {
+    kms_overlay_sprite_layer_add_runs (part->layers[i]);
+  }
+}
+
+static void
+kms_overlay_sprite_part_free (KmsOverlaySpritePart * part)
+{
+  kms_overlay_sprite_part_clear_layers (part);
+  g_free (part->pixels);
+  g_slice_free (KmsOverlaySpritePart, part);
+}
+
+static void
+kms_overlay_sprite_build_layers (KmsOverlaySprite * sprite,
+    GstVideoFormat format, GstVideoColorMatrix matrix)
+{
+  const KmsOverlaySpriteMatrix *m;
+  guint i;
+
+  m = (matrix == GST_VIDEO_COLOR_MATRIX_BT709) ? &bt709 : &bt601;
+
+  for (i = 0; i < sprite->parts->len; i++) {
+    kms_overlay_sprite_part_build_layers (g_ptr_array_index (sprite->parts,
+            i), format, m);
+  }
+
+  sprite->format = format;
+  sprite->matrix = matrix;
+}
+
+KmsOverlaySprite *
+kms_overlay_sprite_new (void)
+{
+  KmsOverlaySprite *sprite = g_slice_new0 (KmsOverlaySprite);
+
+  sprite->parts =
+      g_ptr_array_new_with_free_func ((GDestroyNotify)
+      kms_overlay_sprite_part_free);
+  sprite->format = GST_VIDEO_FORMAT_UNKNOWN;
+
+  return sprite;
+}
+
+void
+kms_overlay_sprite_add_argb32 (KmsOverlaySprite * sprite, const guint8 * data,
+    gint width, gint height, gint stride, gint x, gint y)
+{
+  KmsOverlaySpritePart *part;
+  gint left = width, right = 0, top = height, bottom = 0;
+  gint i, j;
+
+  g_return_if_fail (sprite != NULL && data != NULL);
+
+  /* bounding box of the pixels that are not fully transparent */
+  for (i = 0; i < height; i++) {
+    const guint8 *src = data + i * stride;
+
+    for (j = 0; j < width; j++) {
+      if (src[j * 4 + ARGB32_A] == 0)
+        continue;
+
+      left = MIN (left, j);
+      right = MAX (right, j + 1);
+      top = MIN (top, i);
+      bottom = i + 1;
+    }
+  }
+
+  if (left >= right || top >= bottom)
+    return;
+
+  part = g_slice_new0 (KmsOverlaySpritePart);
+  part->x = x + left;
+  part->y = y + top;
+  part->width = right - left;
+  part->height = bottom - top;
+  part->stride = part->width * 4;
+  part->pixels = g_malloc (part->stride * part->height);
+
+  for (i = 0; i < part->height; i++) {
+    const guint8 *src = data + (top + i) * stride + left * 4;
+    guint8 *dst = part->pixels + i * part->stride;
+
+    for (j = 0; j < part->width; j++) {
+      dst[0] = src[ARGB32_B];
+      dst[1] = src[ARGB32_G];
+      dst[2] = src[ARGB32_R];
+      dst[3] = src[ARGB32_A];
+      src += 4;
+      dst += 4;
+    }
+  }
+
+  g_ptr_array_add (sprite->parts, part);
+
+  /* layers of the new part are built with the next blend */
+  sprite->format = GST_VIDEO_FORMAT_UNKNOWN;
+}
+
+KmsOverlaySprite *
+kms_overlay_sprite_new_from_argb32 (const guint8 * data, gint width,
+    gint height, gint stride, gint x, gint y)
+{
+  KmsOverlaySprite *sprite;
+
+  g_return_val_if_fail (data != NULL && width > 0 && height > 0, NULL);
+
+  sprite = kms_overlay_sprite_new ();
+  kms_overlay_sprite_add_argb32 (sprite, data, width, height, stride, x, y);
+
+  return sprite;
+}
+
+void
+kms_overlay_sprite_free (KmsOverlaySprite * sprite)
+{
+  if (sprite == NULL)
+    return;
+
+  g_ptr_array_free (sprite->parts, TRUE);
+  g_slice_free (KmsOverlaySprite, sprite);
+}
+
+gsize
+kms_overlay_sprite_get_size (KmsOverlaySprite * sprite)
+{
+  gsize size = 0;
+  guint i, l;
+
+  for (i = 0; i < sprite->parts->len; i++) {
+    KmsOverlaySpritePart *part = g_ptr_array_index (sprite->parts, i);
+
+    size += part->stride * part->height;
+    for (l = 0; l < part->n_layers; l++) {
+      KmsOverlaySpriteLayer *layer = part->layers[l];
+
+      size += 2 * layer->width * layer->height * layer->pixel_stride;
+    }
+  }
+
+  return size;
+}
+
+gboolean
+kms_overlay_sprite_supports_format (GstVideoFormat format)
+{
+  return format == GST_VIDEO_FORMAT_BGR || format == GST_VIDEO_FORMAT_I420
+      || format == GST_VIDEO_FORMAT_NV12;
+}
+
+gboolean
+kms_overlay_sprite_blend (KmsOverlaySprite * sprite, GstVideoFrame * frame)
+{
+  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT (frame);
+  GstVideoColorMatrix matrix = frame->info.colorimetry.matrix;
+  guint i, l;
+
+  if (!kms_overlay_sprite_supports_format (format))
+    return FALSE;
+
+  if (sprite->format != format || sprite->matrix != matrix)
+    kms_overlay_sprite_build_layers (sprite, format, matrix);
+
+  for (i = 0; i < sprite->parts->len; i++) {
+    KmsOverlaySpritePart *part = g_ptr_array_index (sprite->parts, i);
+
+    for (l = 0; l < part->n_layers; l++) {
+      KmsOverlaySpriteLayer *layer = part->layers[l];
+
+      kms_overlay_sprite_layer_blend (layer,
+          GST_VIDEO_FRAME_PLANE_DATA (frame, layer->plane),
+          GST_VIDEO_FRAME_PLANE_STRIDE (frame, layer->plane),
+          GST_VIDEO_FRAME_COMP_WIDTH (frame, layer->component),
+          GST_VIDEO_FRAME_COMP_HEIGHT (frame, layer->component));
+    }
+  }
+
+  return TRUE;
+}
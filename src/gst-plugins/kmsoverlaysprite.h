@@ -0,0 +1,97 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_OVERLAY_SPRITE_H_
+#define _KMS_OVERLAY_SPRITE_H_
+
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+#define KMS_OVERLAY_SPRITE_MAX_LAYERS 3
+
+/* Horizontal span of layer pixels that are not fully transparent */
+typedef struct _KmsOverlaySpriteRun
+{
+  gint row;
+  gint start;
+  gint length;
+} KmsOverlaySpriteRun;
+
+/* The sprite converted to one plane of a video format, ready to be */
+/* blended with kms_blend_over */
+typedef struct _KmsOverlaySpriteLayer
+{
+  guint plane;
+  guint component;
+  gint x;                       /* position in plane pixels */
+  gint y;
+  gint width;
+  gint height;
+  gint pixel_stride;            /* bytes per plane pixel */
+  guint8 *color;                /* premultiplied values */
+  guint8 *alpha;                /* alpha of every byte in color */
+  GArray *runs;                 /* KmsOverlaySpriteRun, row ordered */
+} KmsOverlaySpriteLayer;
+
+/* Rectangle of the sprite holding pixels, fully transparent areas of the */
+/* decoration are not stored */
+typedef struct _KmsOverlaySpritePart
+{
+  gint x;                       /* position in the frame */
+  gint y;
+  gint width;
+  gint height;
+  gint stride;
+  guint8 *pixels;               /* premultiplied alpha, B G R A bytes */
+
+  /*< private > */
+  KmsOverlaySpriteLayer *layers[KMS_OVERLAY_SPRITE_MAX_LAYERS];
+  guint n_layers;
+} KmsOverlaySpritePart;
+
+/* Pre-rendered decoration, blended as is on every frame */
+typedef struct _KmsOverlaySprite
+{
+  GPtrArray *parts;             /* KmsOverlaySpritePart, not overlapping */
+
+  /*< private > */
+  GstVideoFormat format;
+  GstVideoColorMatrix matrix;
+} KmsOverlaySprite;
+
+KmsOverlaySprite *kms_overlay_sprite_new (void);
+
+/* Copies a cairo ARGB32 image (native endian, premultiplied) placed at */
+/* x, y. Its transparent margins are trimmed, parts must not overlap. */
+void kms_overlay_sprite_add_argb32 (KmsOverlaySprite * sprite,
+    const guint8 * data, gint width, gint height, gint stride, gint x, gint y);
+
+/* Sprite made of a single image */
+KmsOverlaySprite *kms_overlay_sprite_new_from_argb32 (const guint8 * data,
+    gint width, gint height, gint stride, gint x, gint y);
+void kms_overlay_sprite_free (KmsOverlaySprite * sprite);
+
+/* Bytes held by the sprite pixels and its built layers */
+gsize kms_overlay_sprite_get_size (KmsOverlaySprite * sprite);
+
+gboolean kms_overlay_sprite_supports_format (GstVideoFormat format);
+
+/* Blends the sprite over a BGR, I420 or NV12 frame, clipped to its size. */
+/* Layers for the frame format are built on first use. */
+gboolean kms_overlay_sprite_blend (KmsOverlaySprite * sprite,
+    GstVideoFrame * frame);
+
+G_END_DECLS
+#endif /* _KMS_OVERLAY_SPRITE_H_ */
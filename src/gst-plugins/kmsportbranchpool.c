@@ -0,0 +1,367 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsportbranchpool.h"
+
+#define GST_CAT_DEFAULT kms_port_branch_pool_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmsportbranchpool"
+
+struct _KmsPortBranchPool
+{
+  KmsRefStruct ref;
+
+  GMutex mutex;
+  GstBin *bin;                  /* not owned, NULL once cleared */
+  KmsLoop *loop;                /* not owned, NULL once cleared */
+  GstCaps *caps;
+  guint size;
+  GQueue idle;
+  gboolean refill_pending;
+
+  guint64 hits;
+  guint64 misses;
+};
+
+static KmsPortBranch *
+kms_port_branch_new (GstBin * bin, GstCaps * caps)
+{
+  KmsPortBranch *branch = g_slice_new0 (KmsPortBranch);
+
+  branch->capsfilter = gst_element_factory_make ("capsfilter", NULL);
+  branch->tee = gst_element_factory_make ("tee", NULL);
+  branch->fakesink = gst_element_factory_make ("fakesink", NULL);
+
+  g_object_set (G_OBJECT (branch->capsfilter), "caps-change-mode",
+      1 /*delayed */ , "caps", caps, NULL);
+  g_object_set (G_OBJECT (branch->fakesink), "async", FALSE, "sync", FALSE,
+      NULL);
+
+  /* the bin keeps its own references */
+  gst_bin_add_many (bin, g_object_ref (branch->capsfilter),
+      g_object_ref (branch->tee), g_object_ref (branch->fakesink), NULL);
+
+  branch->tee_sink_pad = gst_element_get_static_pad (branch->tee, "sink");
+  gst_element_link_pads (branch->capsfilter, NULL, branch->tee,
+      GST_OBJECT_NAME (branch->tee_sink_pad));
+
+  branch->fakesink_tee_pad = gst_element_get_request_pad (branch->tee,
+      "src_%u");
+  gst_element_link_pads (branch->tee, GST_OBJECT_NAME
+      (branch->fakesink_tee_pad), branch->fakesink, "sink");
+
+  gst_element_sync_state_with_parent (branch->capsfilter);
+  gst_element_sync_state_with_parent (branch->tee);
+  gst_element_sync_state_with_parent (branch->fakesink);
+
+  return branch;
+}
+
+static void
+kms_port_branch_destroy (KmsPortBranch * branch)
+{
+  GstObject *bin = gst_object_get_parent (GST_OBJECT (branch->capsfilter));
+
+  if (bin != NULL) {
+    gst_bin_remove_many (GST_BIN (bin), branch->capsfilter, branch->tee,
+        branch->fakesink, NULL);
+    gst_object_unref (bin);
+  }
+
+  gst_element_set_state (branch->capsfilter, GST_STATE_NULL);
+  gst_element_set_state (branch->tee, GST_STATE_NULL);
+  gst_element_set_state (branch->fakesink, GST_STATE_NULL);
+
+  g_object_unref (branch->fakesink_tee_pad);
+  g_object_unref (branch->tee_sink_pad);
+  g_object_unref (branch->capsfilter);
+  g_object_unref (branch->tee);
+  g_object_unref (branch->fakesink);
+
+  g_slice_free (KmsPortBranch, branch);
+}
+
+/* Leaves the branch as kms_port_branch_new built it */
+static void
+kms_port_branch_reset (KmsPortBranch * branch, GstCaps * caps)
+{
+  GSList *pads = NULL, *l;
+  GstPad *sink;
+  GList *p;
+
+  sink = gst_element_get_static_pad (branch->capsfilter, "sink");
+  if (gst_pad_is_linked (sink)) {
+    GstPad *peer = gst_pad_get_peer (sink);
+
+    gst_pad_unlink (peer, sink);
+    g_object_unref (peer);
+  }
+  g_object_unref (sink);
+
+  if (!gst_pad_is_linked (branch->tee_sink_pad)) {
+    gst_element_link_pads (branch->capsfilter, NULL, branch->tee,
+        GST_OBJECT_NAME (branch->tee_sink_pad));
+  }
+
+  /* tee pads requested by the mixer while the branch was in use */
+  GST_OBJECT_LOCK (branch->tee);
+  for (p = GST_ELEMENT (branch->tee)->srcpads; p != NULL; p = p->next) {
+    if (p->data != branch->fakesink_tee_pad)
+      pads = g_slist_prepend (pads, g_object_ref (p->data));
+  }
+  GST_OBJECT_UNLOCK (branch->tee);
+
+  for (l = pads; l != NULL; l = l->next) {
+    gst_element_release_request_pad (branch->tee, l->data);
+  }
+  g_slist_free_full (pads, g_object_unref);
+
+  g_object_set (G_OBJECT (branch->capsfilter), "caps", caps, NULL);
+
+  /* going through READY deactivates the pads, dropping EOS and sticky */
+  /* events left by the previous stream */
+  gst_element_set_state (branch->capsfilter, GST_STATE_READY);
+  gst_element_set_state (branch->tee, GST_STATE_READY);
+  gst_element_set_state (branch->fakesink, GST_STATE_READY);
+
+  gst_element_sync_state_with_parent (branch->fakesink);
+  gst_element_sync_state_with_parent (branch->tee);
+  gst_element_sync_state_with_parent (branch->capsfilter);
+}
+
+static gboolean
+kms_port_branch_pool_refill (KmsPortBranchPool * pool)
+{
+  g_mutex_lock (&pool->mutex);
+  pool->refill_pending = FALSE;
+
+  while (pool->bin != NULL && pool->idle.length < pool->size) {
+    GstBin *bin = g_object_ref (pool->bin);
+    KmsPortBranch *branch;
+
+    g_mutex_unlock (&pool->mutex);
+    branch = kms_port_branch_new (bin, pool->caps);
+    g_object_unref (bin);
+    g_mutex_lock (&pool->mutex);
+
+    if (pool->bin == NULL || pool->idle.length >= pool->size) {
+      g_mutex_unlock (&pool->mutex);
+      kms_port_branch_destroy (branch);
+      g_mutex_lock (&pool->mutex);
+      break;
+    }
+
+    g_queue_push_tail (&pool->idle, branch);
+  }
+
+  GST_DEBUG ("Pool has %u idle branches", pool->idle.length);
+
+  g_mutex_unlock (&pool->mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* must be called with the pool mutex held */
+static void
+kms_port_branch_pool_schedule_refill (KmsPortBranchPool * pool)
+{
+  if (pool->loop == NULL || pool->refill_pending
+      || pool->idle.length >= pool->size) {
+    return;
+  }
+
+  pool->refill_pending = TRUE;
+  kms_loop_idle_add_full (pool->loop, G_PRIORITY_LOW,
+      (GSourceFunc) kms_port_branch_pool_refill,
+      kms_port_branch_pool_ref (pool), (GDestroyNotify) kms_ref_struct_unref);
+}
+
+static void
+kms_port_branch_pool_destroy (KmsPortBranchPool * pool)
+{
+  g_queue_free_full (&pool->idle, (GDestroyNotify) kms_port_branch_destroy);
+
+  if (pool->caps != NULL)
+    gst_caps_unref (pool->caps);
+
+  g_mutex_clear (&pool->mutex);
+
+  g_slice_free (KmsPortBranchPool, pool);
+}
+
+KmsPortBranchPool *
+kms_port_branch_pool_new (GstBin * bin, KmsLoop * loop, GstCaps * caps,
+    guint size)
+{
+  static gsize init = 0;
+  KmsPortBranchPool *pool;
+
+  if (g_once_init_enter (&init)) {
+    GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+        GST_DEFAULT_NAME);
+    g_once_init_leave (&init, 1);
+  }
+
+  pool = g_slice_new0 (KmsPortBranchPool);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (pool),
+      (GDestroyNotify) kms_port_branch_pool_destroy);
+
+  g_mutex_init (&pool->mutex);
+  g_queue_init (&pool->idle);
+  pool->bin = bin;
+  pool->loop = loop;
+  pool->caps = caps != NULL ? gst_caps_ref (caps) : NULL;
+  pool->size = size;
+
+  /* ready for the first ports */
+  kms_port_branch_pool_refill (pool);
+
+  return pool;
+}
+
+void
+kms_port_branch_pool_clear (KmsPortBranchPool * pool)
+{
+  GQueue idle;
+
+  g_mutex_lock (&pool->mutex);
+  pool->bin = NULL;
+  pool->loop = NULL;
+  idle = pool->idle;
+  g_queue_init (&pool->idle);
+  g_mutex_unlock (&pool->mutex);
+
+  g_list_free_full (idle.head, (GDestroyNotify) kms_port_branch_destroy);
+}
+
+void
+kms_port_branch_pool_set_size (KmsPortBranchPool * pool, guint size)
+{
+  GSList *excess = NULL;
+
+  g_mutex_lock (&pool->mutex);
+
+  pool->size = size;
+
+  while (pool->idle.length > size) {
+    excess = g_slist_prepend (excess, g_queue_pop_tail (&pool->idle));
+  }
+
+  kms_port_branch_pool_schedule_refill (pool);
+
+  g_mutex_unlock (&pool->mutex);
+
+  g_slist_free_full (excess, (GDestroyNotify) kms_port_branch_destroy);
+}
+
+guint
+kms_port_branch_pool_get_size (KmsPortBranchPool * pool)
+{
+  guint size;
+
+  g_mutex_lock (&pool->mutex);
+  size = pool->size;
+  g_mutex_unlock (&pool->mutex);
+
+  return size;
+}
+
+KmsPortBranch *
+kms_port_branch_pool_acquire (KmsPortBranchPool * pool)
+{
+  KmsPortBranch *branch;
+  GstBin *bin;
+
+  g_mutex_lock (&pool->mutex);
+
+  branch = g_queue_pop_head (&pool->idle);
+  if (branch != NULL) {
+    pool->hits++;
+  } else {
+    pool->misses++;
+  }
+
+  GST_DEBUG ("Branch %s (%" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT
+      " misses)", branch != NULL ? "hit" : "miss", pool->hits, pool->misses);
+
+  kms_port_branch_pool_schedule_refill (pool);
+  bin = pool->bin != NULL ? g_object_ref (pool->bin) : NULL;
+
+  g_mutex_unlock (&pool->mutex);
+
+  if (branch == NULL && bin != NULL) {
+    branch = kms_port_branch_new (bin, pool->caps);
+  }
+
+  if (bin != NULL)
+    g_object_unref (bin);
+
+  return branch;
+}
+
+KmsPortBranch *
+kms_port_branch_pool_build (KmsPortBranchPool * pool, GstBin * bin)
+{
+  g_return_val_if_fail (GST_IS_BIN (bin), NULL);
+
+  return kms_port_branch_new (bin, pool->caps);
+}
+
+void
+kms_port_branch_pool_release (KmsPortBranchPool * pool,
+    KmsPortBranch * branch)
+{
+  gboolean keep;
+
+  g_return_if_fail (branch != NULL);
+
+  g_mutex_lock (&pool->mutex);
+  keep = pool->bin != NULL && pool->idle.length < pool->size;
+  g_mutex_unlock (&pool->mutex);
+
+  if (!keep) {
+    kms_port_branch_destroy (branch);
+    return;
+  }
+
+  kms_port_branch_reset (branch, pool->caps);
+
+  g_mutex_lock (&pool->mutex);
+  keep = pool->bin != NULL && pool->idle.length < pool->size;
+  if (keep)
+    g_queue_push_tail (&pool->idle, branch);
+  g_mutex_unlock (&pool->mutex);
+
+  if (!keep)
+    kms_port_branch_destroy (branch);
+}
+
+void
+kms_port_branch_pool_get_stats (KmsPortBranchPool * pool, guint64 * hits,
+    guint64 * misses)
+{
+  g_mutex_lock (&pool->mutex);
+
+  if (hits != NULL)
+    *hits = pool->hits;
+
+  if (misses != NULL)
+    *misses = pool->misses;
+
+  g_mutex_unlock (&pool->mutex);
+}
@@ -0,0 +1,73 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_PORT_BRANCH_POOL_H_
+#define _KMS_PORT_BRANCH_POOL_H_
+
+#include <gst/gst.h>
+#include <commons/kmsloop.h>
+#include <commons/kmsrefstruct.h>
+
+G_BEGIN_DECLS
+
+/* capsfilter -> tee -> fakesink, the video branch of a mixer hub port */
+typedef struct _KmsPortBranch
+{
+  GstElement *capsfilter;
+  GstElement *tee;
+  GstElement *fakesink;
+  GstPad *tee_sink_pad;
+
+  /*< private > */
+  GstPad *fakesink_tee_pad;
+} KmsPortBranch;
+
+typedef struct _KmsPortBranchPool KmsPortBranchPool;
+
+/* Keeps up to size branches built, linked and running inside bin. Branch */
+/* capsfilters get caps, which may be NULL. Refills run on loop. */
+KmsPortBranchPool *kms_port_branch_pool_new (GstBin * bin, KmsLoop * loop,
+    GstCaps * caps, guint size);
+
+#define kms_port_branch_pool_ref(pool) \
+  ((KmsPortBranchPool *) kms_ref_struct_ref (KMS_REF_STRUCT_CAST (pool)))
+#define kms_port_branch_pool_unref(pool) \
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (pool))
+
+/* Destroys the idle branches and stops refilling, for the bin dispose */
+void kms_port_branch_pool_clear (KmsPortBranchPool * pool);
+
+void kms_port_branch_pool_set_size (KmsPortBranchPool * pool, guint size);
+guint kms_port_branch_pool_get_size (KmsPortBranchPool * pool);
+
+/* Returns an idle branch, or a new one when the pool is empty. Returns */
+/* NULL once the pool is cleared. */
+KmsPortBranch *kms_port_branch_pool_acquire (KmsPortBranchPool * pool);
+
+/* Builds a new branch inside bin with the pool caps, skipping the idle */
+/* ones. For callers that still need a branch after the pool is cleared. */
+KmsPortBranch *kms_port_branch_pool_build (KmsPortBranchPool * pool,
+    GstBin * bin);
+
+/* Takes back a branch whose capsfilter and extra tee pads are not linked */
+/* anymore and which has no probes left. It is reset and kept for the next */
+/* acquire, or destroyed when the pool is full. */
+void kms_port_branch_pool_release (KmsPortBranchPool * pool,
+    KmsPortBranch * branch);
+
+void kms_port_branch_pool_get_stats (KmsPortBranchPool * pool, guint64 * hits,
+    guint64 * misses);
+
+G_END_DECLS
+#endif /* _KMS_PORT_BRANCH_POOL_H_ */
@@ -0,0 +1,359 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmssnapshot.h"
+
+#include <gst/video/video.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define GST_CAT_DEFAULT kms_snapshot_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmssnapshot"
+
+#define SNAPSHOT_DIR "/var/log/kurento-media-server/snapshots"
+#define SNAPSHOT_PREFIX "snapshot-"
+#define MAX_QUEUED_FRAMES 4
+#define MAX_RETAINED_FILES 200
+#define ENCODE_TIMEOUT (5 * GST_SECOND)
+#define WORKER_NICE 19
+#define MAX_TRACKED_OWNERS 1024
+#define OWNER_VALID_CHARS G_CSET_A_2_Z G_CSET_a_2_z G_CSET_DIGITS "-_."
+
+typedef struct _KmsSnapshotJob
+{
+  gchar *path;
+  GstSample *sample;
+  KmsSnapshotDoneFunc func;
+  gpointer user_data;
+  GDestroyNotify notify;
+} KmsSnapshotJob;
+
+typedef struct _KmsSnapshotService
+{
+  GMutex mutex;
+  GHashTable *last_taken;       /* owner -> GstClockTime * */
+  GQueue files;                 /* written paths, oldest first */
+  guint queued;
+  guint64 sequence;
+  guint64 dropped;
+  GThreadPool *pool;
+  gchar *dir;
+} KmsSnapshotService;
+
+static KmsSnapshotService *service = NULL;
+
+static gint
+kms_snapshot_compare_names (gconstpointer a, gconstpointer b)
+{
+  return g_strcmp0 (a, b);
+}
+
+/* previous runs count against the retention cap too */
+static void
+kms_snapshot_load_existing_files (void)
+{
+  GDir *dir;
+  const gchar *name;
+  GList *names = NULL, *l;
+
+  dir = g_dir_open (service->dir, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL) {
+    if (g_str_has_prefix (name, SNAPSHOT_PREFIX))
+      names = g_list_prepend (names, g_strdup (name));
+  }
+  g_dir_close (dir);
+
+  /* names start with the date, so they sort by age */
+  names = g_list_sort (names, kms_snapshot_compare_names);
+  for (l = names; l != NULL; l = l->next) {
+    g_queue_push_tail (&service->files, g_build_filename (service->dir,
+            l->data, NULL));
+  }
+  g_list_free_full (names, g_free);
+}
+
+/* must be called with the mutex held */
+static void
+kms_snapshot_enforce_retention (void)
+{
+  while (service->files.length > MAX_RETAINED_FILES) {
+    gchar *old = g_queue_pop_head (&service->files);
+
+    GST_DEBUG ("Removing old snapshot %s", old);
+    g_unlink (old);
+    g_free (old);
+  }
+}
+
+static void
+kms_snapshot_lower_priority (void)
+{
+#ifdef __linux__
+  static GPrivate lowered = G_PRIVATE_INIT (NULL);
+
+  /* on linux nice values apply to single threads */
+  if (g_private_get (&lowered) == NULL) {
+    if (setpriority (PRIO_PROCESS, syscall (SYS_gettid), WORKER_NICE) != 0) {
+      GST_WARNING ("Cannot lower snapshot worker priority");
+    }
+    g_private_set (&lowered, GINT_TO_POINTER (TRUE));
+  }
+#endif
+}
+
+static void
+kms_snapshot_job_free (KmsSnapshotJob * job)
+{
+  if (job->notify != NULL)
+    job->notify (job->user_data);
+
+  g_free (job->path);
+  gst_sample_unref (job->sample);
+  g_slice_free (KmsSnapshotJob, job);
+}
+
+static void
+kms_snapshot_encode (KmsSnapshotJob * job, gpointer unused)
+{
+  GstCaps *jpeg_caps;
+  GstSample *jpeg;
+  GError *err = NULL;
+  GstMapInfo info;
+  gboolean written = FALSE;
+
+  kms_snapshot_lower_priority ();
+
+  jpeg_caps = gst_caps_new_empty_simple ("image/jpeg");
+  jpeg = gst_video_convert_sample (job->sample, jpeg_caps, ENCODE_TIMEOUT,
+      &err);
+  gst_caps_unref (jpeg_caps);
+
+  if (jpeg == NULL) {
+    GST_WARNING ("Cannot encode snapshot %s: %s", job->path,
+        err ? err->message : "unknown error");
+    g_clear_error (&err);
+  } else {
+    GstBuffer *buffer = gst_sample_get_buffer (jpeg);
+
+    if (gst_buffer_map (buffer, &info, GST_MAP_READ)) {
+      written = g_file_set_contents (job->path, (const gchar *) info.data,
+          info.size, &err);
+      gst_buffer_unmap (buffer, &info);
+    }
+
+    if (!written) {
+      GST_WARNING ("Cannot write snapshot %s: %s", job->path,
+          err ? err->message : "unknown error");
+      g_clear_error (&err);
+    }
+
+    gst_sample_unref (jpeg);
+  }
+
+  g_mutex_lock (&service->mutex);
+  service->queued--;
+  if (written) {
+    GST_INFO ("Snapshot written to %s", job->path);
+    g_queue_push_tail (&service->files, g_strdup (job->path));
+    kms_snapshot_enforce_retention ();
+  }
+  g_mutex_unlock (&service->mutex);
+
+  if (job->func != NULL)
+    job->func (job->path, written, job->user_data);
+
+  kms_snapshot_job_free (job);
+}
+
+static gpointer
+kms_snapshot_init (gpointer data)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+
+  service = g_slice_new0 (KmsSnapshotService);
+  g_mutex_init (&service->mutex);
+  g_queue_init (&service->files);
+  service->last_taken = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_free);
+  service->pool = g_thread_pool_new ((GFunc) kms_snapshot_encode, NULL, 1,
+      FALSE, NULL);
+
+  service->dir = g_strdup (SNAPSHOT_DIR);
+  if (g_mkdir_with_parents (service->dir, 0755) != 0) {
+    g_free (service->dir);
+    service->dir = g_build_filename (g_get_tmp_dir (), "kms-snapshots", NULL);
+    g_mkdir_with_parents (service->dir, 0755);
+  }
+
+  kms_snapshot_load_existing_files ();
+  g_mutex_lock (&service->mutex);
+  kms_snapshot_enforce_retention ();
+  g_mutex_unlock (&service->mutex);
+
+  GST_INFO ("Snapshots stored in %s", service->dir);
+
+  return NULL;
+}
+
+static void
+kms_snapshot_ensure_service (void)
+{
+  static GOnce once = G_ONCE_INIT;
+
+  g_once (&once, kms_snapshot_init, NULL);
+}
+
+static gboolean
+kms_snapshot_is_stale (gpointer owner, GstClockTime * last, GstClockTime * now)
+{
+  return *now - *last > KMS_SNAPSHOT_AUTOMATIC_INTERVAL;
+}
+
+gchar *
+kms_snapshot_reserve (const gchar * owner, GstClockTime min_interval)
+{
+  GstClockTime now = g_get_monotonic_time () * GST_USECOND;
+  GstClockTime *last;
+  GDateTime *date;
+  gchar *stamp, *name, *path, *safe_owner;
+
+  g_return_val_if_fail (owner != NULL, NULL);
+
+  kms_snapshot_ensure_service ();
+
+  g_mutex_lock (&service->mutex);
+
+  last = g_hash_table_lookup (service->last_taken, owner);
+  if (last != NULL && now - *last < min_interval) {
+    g_mutex_unlock (&service->mutex);
+    GST_DEBUG ("Snapshot of %s rate limited", owner);
+    return NULL;
+  }
+
+  /* owners are elements that come and go, forget the idle ones */
+  if (last == NULL
+      && g_hash_table_size (service->last_taken) >= MAX_TRACKED_OWNERS) {
+    g_hash_table_foreach_remove (service->last_taken,
+        (GHRFunc) kms_snapshot_is_stale, &now);
+  }
+
+  last = g_new (GstClockTime, 1);
+  *last = now;
+  g_hash_table_insert (service->last_taken, g_strdup (owner), last);
+
+  /* owner ends up in a file name, it must not leave the directory */
+  safe_owner = g_strcanon (g_strdup (owner), OWNER_VALID_CHARS, '_');
+
+  date = g_date_time_new_now_utc ();
+  stamp = g_date_time_format (date, "%Y%m%d-%H%M%S");
+  name = g_strdup_printf (SNAPSHOT_PREFIX "%s-%06" G_GUINT64_FORMAT "-%s.jpg",
+      stamp, service->sequence++ % 1000000, safe_owner);
+  path = g_build_filename (service->dir, name, NULL);
+  g_date_time_unref (date);
+  g_free (safe_owner);
+  g_free (stamp);
+  g_free (name);
+
+  g_mutex_unlock (&service->mutex);
+
+  return path;
+}
+
+gboolean
+kms_snapshot_submit (const gchar * path, GstBuffer * buffer, GstCaps * caps)
+{
+  return kms_snapshot_submit_full (path, buffer, caps, NULL, NULL, NULL);
+}
+
+gboolean
+kms_snapshot_submit_full (const gchar * path, GstBuffer * buffer,
+    GstCaps * caps, KmsSnapshotDoneFunc func, gpointer user_data,
+    GDestroyNotify notify)
+{
+  KmsSnapshotJob *job;
+  GstBuffer *copy;
+  guint64 dropped;
+
+  g_return_val_if_fail (path != NULL, FALSE);
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), FALSE);
+  g_return_val_if_fail (GST_IS_CAPS (caps), FALSE);
+
+  kms_snapshot_ensure_service ();
+
+  g_mutex_lock (&service->mutex);
+  if (service->queued >= MAX_QUEUED_FRAMES) {
+    dropped = ++service->dropped;
+    g_mutex_unlock (&service->mutex);
+    GST_WARNING ("Snapshot queue full, dropping %s (%" G_GUINT64_FORMAT
+        " dropped)", path, dropped);
+    goto error;
+  }
+  service->queued++;
+  g_mutex_unlock (&service->mutex);
+
+  /* the frame keeps flowing, the worker gets its own copy */
+  copy = gst_buffer_copy_region (buffer, GST_BUFFER_COPY_ALL |
+      GST_BUFFER_COPY_DEEP, 0, -1);
+
+  job = g_slice_new0 (KmsSnapshotJob);
+  job->path = g_strdup (path);
+  job->sample = gst_sample_new (copy, caps, NULL, NULL);
+  job->func = func;
+  job->user_data = user_data;
+  job->notify = notify;
+  gst_buffer_unref (copy);
+
+  g_thread_pool_push (service->pool, job, NULL);
+
+  return TRUE;
+
+error:
+  if (notify != NULL)
+    notify (user_data);
+
+  return FALSE;
+}
+
+gchar *
+kms_snapshot_take (const gchar * owner, GstClockTime min_interval,
+    GstBuffer * buffer, GstCaps * caps)
+{
+  gchar *path;
+
+  path = kms_snapshot_reserve (owner, min_interval);
+  if (path == NULL)
+    return NULL;
+
+  if (!kms_snapshot_submit (path, buffer, caps)) {
+    g_free (path);
+    return NULL;
+  }
+
+  return path;
+}
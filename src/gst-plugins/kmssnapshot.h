@@ -0,0 +1,53 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_SNAPSHOT_H_
+#define _KMS_SNAPSHOT_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* Minimum time between two snapshots of the same owner */
+#define KMS_SNAPSHOT_AUTOMATIC_INTERVAL (30 * GST_SECOND)
+#define KMS_SNAPSHOT_ON_DEMAND_INTERVAL (1 * GST_SECOND)
+
+/* Called from the worker once the snapshot has been written, or not */
+typedef void (*KmsSnapshotDoneFunc) (const gchar * path, gboolean written,
+    gpointer user_data);
+
+/* Returns the path the next snapshot of owner will be written to, or */
+/* NULL when owner took its previous one less than min_interval ago. */
+/* Characters of owner not valid in file names are replaced. */
+gchar *kms_snapshot_reserve (const gchar * owner, GstClockTime min_interval);
+
+/* Queues a copy of the raw video frame to be encoded as JPEG into path, */
+/* as returned by kms_snapshot_reserve, from a low priority worker. Frames */
+/* are dropped when the queue is full. */
+gboolean kms_snapshot_submit (const gchar * path, GstBuffer * buffer,
+    GstCaps * caps);
+
+/* Like kms_snapshot_submit, func is only called when TRUE is returned. */
+/* notify is called when user_data is not needed any more in both cases, */
+/* but not for invalid arguments. */
+gboolean kms_snapshot_submit_full (const gchar * path, GstBuffer * buffer,
+    GstCaps * caps, KmsSnapshotDoneFunc func, gpointer user_data,
+    GDestroyNotify notify);
+
+/* reserve + submit, returns the path or NULL when nothing was queued */
+gchar *kms_snapshot_take (const gchar * owner, GstClockTime min_interval,
+    GstBuffer * buffer, GstCaps * caps);
+
+G_END_DECLS
+#endif /* _KMS_SNAPSHOT_H_ */
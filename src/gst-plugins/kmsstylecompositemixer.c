@@ -15,24 +15,27 @@
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
-#define _XOPEN_SOURCE 500
-
 #include "kmsstylecompositemixer.h"
+#include "kmsimagecache.h"
+#include "kmsstylelayout.h"
+#include "kmsstylescene.h"
+#include "kmssnapshot.h"
+#include "kmsportbranchpool.h"
+#include "kmsmixerlatency.h"
+#include "kmskeyframecoalescer.h"
 #include <commons/kmsagnosticcaps.h>
 #include <commons/kmshubport.h>
 #include <commons/kmsloop.h>
 #include <commons/kmsrefstruct.h>
+#include <gst/video/video.h>
 #include <math.h>
-#include <ftw.h>
 #include <stdlib.h>
 #include <glib-object.h>
 #include <json-glib/json-glib.h>
-#include <libsoup/soup.h>
-#include <glib/gstdio.h>
 #include <string.h>
 
 #define LATENCY 600             //ms
-#define TEMP_PATH "/tmp/XXXXXX"
+#define PARK_DELAY 1000         //ms, hidden inputs are detached after it
 
 #define PLUGIN_NAME "stylecompositemixer"
 
@@ -64,15 +67,56 @@ GST_DEBUG_CATEGORY_STATIC (kms_style_composite_mixer_debug_category);
 
 #define DEFAULT_BACKGROUND_IMAGE NULL
 #define DEFAULT_STYLE NULL
+#define DEFAULT_PORT_POOL_SIZE 2
+#define DEFAULT_ADAPTIVE_LATENCY FALSE
+#define DEFAULT_LATENCY_PERCENTILE 95
+#define DEFAULT_MIN_LATENCY 40  //ms
+#define DEFAULT_KEYFRAME_REQUEST_INTERVAL 500    //ms
 
 enum
 {
   PROP_0,
   PROP_BACKGROUND_IMAGE,
   PROP_STYLE,
+  PROP_PORT_POOL_SIZE,
+  PROP_PORT_POOL_HITS,
+  PROP_PORT_POOL_MISSES,
+  PROP_ADAPTIVE_LATENCY,
+  PROP_LATENCY_PERCENTILE,
+  PROP_MIN_LATENCY,
+  PROP_MAX_LATENCY,
+  PROP_LATENCY,
+  PROP_LATE_FRAMES,
+  PROP_KEYFRAME_REQUEST_INTERVAL,
+  PROP_KEYFRAME_REQUESTS_RECEIVED,
+  PROP_KEYFRAME_REQUESTS_FORWARDED,
   N_PROPERTIES
 };
 
+enum
+{
+  SIGNAL_SNAPSHOT_DONE,
+  LAST_SIGNAL
+};
+
+static guint obj_signals[LAST_SIGNAL] = { 0 };
+
+typedef enum
+{
+  SNAPSHOT_PENDING,
+  SNAPSHOT_TAKEN,
+  SNAPSHOT_CANCELLED
+} KmsSnapshotState;
+
+/* A snapshot waiting for the next composed frame */
+typedef struct _KmsStyleCompositeMixerSnapshot
+{
+  KmsRefStruct parent;
+  GWeakRef mixer;
+  gchar *path;
+  volatile gint state;
+} KmsStyleCompositeMixerSnapshot;
+
 static GstStaticPadTemplate audio_sink_factory =
 GST_STATIC_PAD_TEMPLATE (AUDIO_SINK_PAD_NAME_COMP,
     GST_PAD_SINK,
@@ -84,7 +128,7 @@ static GstStaticPadTemplate video_sink_factory =
 GST_STATIC_PAD_TEMPLATE (VIDEO_SINK_PAD_NAME_COMP,
     GST_PAD_SINK,
     GST_PAD_SOMETIMES,
-    GST_STATIC_CAPS (KMS_AGNOSTIC_RAW_VIDEO_CAPS)
+    GST_STATIC_CAPS (KMS_AGNOSTIC_VIDEO_CAPS)
     );
 
 static GstStaticPadTemplate audio_src_factory =
@@ -98,10 +142,10 @@ static GstStaticPadTemplate video_src_factory =
 GST_STATIC_PAD_TEMPLATE (VIDEO_SRC_PAD_NAME_COMP,
     GST_PAD_SRC,
     GST_PAD_SOMETIMES,
-    GST_STATIC_CAPS (KMS_AGNOSTIC_RAW_VIDEO_CAPS)
+    GST_STATIC_CAPS (KMS_AGNOSTIC_VIDEO_CAPS)
     );
 
-#define MAX_VIEW_COUNT 4
+#define DEFAULT_VIEW_COUNT 4
 #define MAX_TEXT_LENGTH 128
 typedef struct _KmsConpositeViewPrivate
 {
@@ -116,7 +160,6 @@ struct _KmsStyleCompositeMixerPrivate
 {
   GstElement *videomixer;
   GstElement *audiomixer;
-  GstElement *videotestsrc;
   GHashTable *ports;
   GstElement *mixer_audio_agnostic;
   GstElement *mixer_video_agnostic;
@@ -129,10 +172,25 @@ struct _KmsStyleCompositeMixerPrivate
   gchar *background_image;
   gchar *style;
   gchar font_desc[64];
-  KmsConpositeViewPrivate views[MAX_VIEW_COUNT];
+  GArray *views;
+  guint max_views;
+  KmsStyleLayout *layout;
   GstElement *episodeoverlay;
-  gboolean dir_created;
-  gchar *dir;
+  gboolean detach_hidden;
+  /* single view passthrough */
+  gboolean passthrough_enabled;
+  gboolean passthrough_check_pending;
+  gpointer passthrough_port;
+  gboolean passthrough_active;
+  volatile gint composition_idle;
+  volatile gint keyframe_pending;
+  KmsPortBranchPool *pool;
+  KmsMixerLatency *latency;
+  KmsKeyframeCoalescer *coalescer;
+  volatile gint latency_pending;
+  KmsStyleCompositeMixerSnapshot *snapshot;
+  GstPad *snapshot_pad;
+  gulong snapshot_probe_id;
 };
 
 /* class initialization */
@@ -147,6 +205,7 @@ typedef struct _KmsStyleCompositeMixerData
   KmsRefStruct parent;
   gint id;
   KmsStyleCompositeMixer *mixer;
+  KmsPortBranch *branch;
   GstElement *capsfilter;
   GstElement *tee;
   GstElement *fakesink;
@@ -156,10 +215,23 @@ typedef struct _KmsStyleCompositeMixerData
   gulong probe_id;
   gulong link_probe_id;
   gulong latency_probe_id;
+  gulong idle_probe_id;
+  gulong caps_probe_id;
   GstPad *video_mixer_pad;
   GstPad *tee_sink_pad;
+  GstPad *tee_src_pad;
   GstElement *mixer_end_point;
   gint viewId;
+  gulong view_id_handler;
+  gboolean visible;
+  KmsStyleLayoutRect rect;
+  /* detached from the hub and the compositor while hidden */
+  gboolean parked;
+  gboolean park_pending;
+  /* the input as it comes, while it is forwarded */
+  GstElement *passthrough_agnostic;
+  gulong keyframe_probe_id;
+  volatile gint keyframe_received;
 } KmsStyleCompositeMixerData;
 
 #define KMS_STYLE_COMPOSITE_MIXER_REF(data) \
@@ -185,17 +257,6 @@ kms_create_style_composite_mixer_data ()
   return data;
 }
 
-static gint
-compare_port_data (gconstpointer a, gconstpointer b)
-{
-  KmsStyleCompositeMixerData *port_data_a = (KmsStyleCompositeMixerData *) a;
-  KmsStyleCompositeMixerData *port_data_b = (KmsStyleCompositeMixerData *) b;
-
-  if (port_data_a->viewId != port_data_b->viewId)
-    return port_data_a->viewId - port_data_b->viewId;
-  return port_data_a->id - port_data_b->id;
-}
-
 // resize the source views' resolution to full cover the output resolution and keep the ratio unchanged.
 #define SCALE_TO_JUST_FULL_COVER(sw, sh, ow, oh) \
   if ((sw) * (oh) >= (sh) * (ow)) { \
@@ -206,193 +267,667 @@ compare_port_data (gconstpointer a, gconstpointer b)
     sw = ow; \
   }
 
-#define CLEANUP_ELEMENT_FROM(self, element) \
-    gst_bin_remove (GST_BIN (self), g_object_ref (element)); \
-    gst_element_set_state (element, GST_STATE_NULL); \
-    g_object_unref (element); \
-    element = NULL;
+static gboolean kms_style_composite_mixer_park_port (KmsStyleCompositeMixerData
+    * port_data);
+static gboolean kms_style_composite_mixer_unpark_port (KmsStyleCompositeMixerData
+    * port_data);
+static void kms_style_composite_mixer_unlink_mixer_pad (KmsStyleCompositeMixer *
+    self, KmsStyleCompositeMixerData * data);
 
 static void
-kms_style_composite_mixer_recalculate_sizes (gpointer data)
+kms_style_composite_mixer_schedule_park (KmsStyleCompositeMixerData * port_data)
 {
-  KmsStyleCompositeMixer *self = KMS_STYLE_COMPOSITE_MIXER (data);
+  KmsStyleCompositeMixer *self = port_data->mixer;
 
-  gint n_columns, n_rows;
-  GList *l;
-  GList *values = g_hash_table_get_values (self->priv->ports);
-  gint content_width, content_height;
-  gchar jsonStyle[2048];
-  gchar jsonView[512];
-
-  gint o_width = self->priv->output_width, o_height = self->priv->output_height;
-  gint b_width, b_height = 0;
-  gint v_width, v_height;
-  gint line_weight = self->priv->line_weight;
-  gint pad_left, pad_top;
-  gint port_count = self->priv->n_elems;
-  gint width_reminder;
-  gint i, mappedCount = 0, unmappedCount = 0, curColumn, left, top, occupied;
-  KmsStyleCompositeMixerData *viewMapping[MAX_VIEW_COUNT] =
-      { NULL, NULL, NULL, NULL };
-  KmsStyleCompositeMixerData *viewUnMapping[10] =
-      { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
-
-  if (port_count <= 0) {
-    // set to show background only.
-    g_object_set (G_OBJECT (self->priv->episodeoverlay), "style",
-        "{'enable':2}", NULL);
+  if (!self->priv->detach_hidden || !port_data->input || port_data->parked
+      || port_data->park_pending)
     return;
+
+  /* views are often hidden and shown back while a style is being applied, */
+  /* only inputs that stay hidden are detached */
+  port_data->park_pending = TRUE;
+  kms_loop_timeout_add_full (self->priv->loop, G_PRIORITY_DEFAULT,
+      PARK_DELAY, (GSourceFunc) kms_style_composite_mixer_park_port,
+      KMS_STYLE_COMPOSITE_MIXER_REF (port_data),
+      (GDestroyNotify) kms_ref_struct_unref);
+}
+
+static void
+kms_style_composite_mixer_schedule_unpark (KmsStyleCompositeMixerData *
+    port_data)
+{
+  KmsStyleCompositeMixer *self = port_data->mixer;
+
+  if (!port_data->parked)
+    return;
+
+  kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_DEFAULT,
+      (GSourceFunc) kms_style_composite_mixer_unpark_port,
+      KMS_STYLE_COMPOSITE_MIXER_REF (port_data),
+      (GDestroyNotify) kms_ref_struct_unref);
+}
+
+static void
+kms_style_composite_mixer_apply_view (gpointer item, gint slot,
+    const KmsStyleLayoutRect * rect, gpointer user_data)
+{
+  KmsStyleCompositeMixerData *port_data = item;
+
+  port_data->visible = rect != NULL;
+
+  if (rect == NULL) {
+    kms_style_composite_mixer_schedule_park (port_data);
+  } else {
+    port_data->rect = *rect;
+    kms_style_composite_mixer_schedule_unpark (port_data);
   }
-  values = g_list_sort (values, compare_port_data);
 
-  // map ports to views.
-  mappedCount = 0;
-  for (l = values; l != NULL; l = l->next) {
-    KmsStyleCompositeMixerData *port_data = l->data;
+  if (port_data->video_mixer_pad == NULL)
+    return;
 
-    if (port_data->input == FALSE) {
-      continue;
-    }
-    // make all the view to transparent first.
+  if (rect == NULL) {
     g_object_set (port_data->video_mixer_pad, "xpos", 0, "ypos", 0,
         "alpha", 0.0, NULL);
-    if (mappedCount >= MAX_VIEW_COUNT)
-      continue;
-
-    // use max-output-bitrate as view id to bind mixer_endpoint to specified user.
-    g_object_get (G_OBJECT (port_data->mixer_end_point), "max-output-bitrate",
-        &port_data->viewId, NULL);
-    // find view that match the ID.
-    for (i = 0; i < MAX_VIEW_COUNT; i++) {
-      if (self->priv->views[i].id == port_data->viewId) {
-        if (self->priv->views[i].enable == 0)
-          break;
-        if (viewMapping[i] != NULL)
-          goto unmapped;
-        GST_TRACE ("@rentao mapped id=%d, viewId=%d, i=%d",
-            self->priv->views[i].id, port_data->viewId, i);
-        viewMapping[i] = port_data;
-        mappedCount++;
-        break;
-      }
+    return;
+  }
+
+  g_object_set (port_data->video_mixer_pad, "xpos", rect->x, "ypos",
+      rect->y, "width", rect->width, "height", rect->height, "alpha", 1.0,
+      NULL);
+
+  GST_TRACE_OBJECT (port_data->video_mixer_pad,
+      "@rentao slot=%d left=%d top=%d, v_width=%d v_height=%d", slot,
+      rect->x, rect->y, rect->width, rect->height);
+}
+
+typedef struct _KmsStyleCompositeMixerSceneBuilder
+{
+  KmsStyleCompositeMixer *self;
+  KmsStyleScene *scene;
+  guint n_views;
+} KmsStyleCompositeMixerSceneBuilder;
+
+static void
+kms_style_composite_mixer_append_scene_view (gpointer item, gint slot,
+    const KmsStyleLayoutRect * rect, gpointer user_data)
+{
+  KmsStyleCompositeMixerSceneBuilder *builder = user_data;
+  KmsStyleCompositeMixerData *port_data = item;
+  GArray *views = builder->self->priv->views;
+  KmsConpositeViewPrivate *view = NULL;
+  KmsStyleSceneView *scene_view;
+
+  if (builder->n_views >= builder->scene->n_views)
+    return;
+
+  // current port maybe not match to current view, that means the port can not use the view's style.
+  if ((guint) slot < views->len) {
+    view = &g_array_index (views, KmsConpositeViewPrivate, slot);
+    if (view->id != port_data->viewId)
+      view = NULL;
+  }
+
+  scene_view = &builder->scene->views[builder->n_views++];
+  scene_view->x = rect->x;
+  scene_view->y = rect->y;
+  scene_view->width = rect->width;
+  scene_view->height = rect->height;
+
+  if (view != NULL) {
+    scene_view->text = g_strdup (view->text);
+  } else {
+    scene_view->text = g_strdup_printf ("id:%d", port_data->viewId);
+  }
+}
+
+static void
+free_weak_ref (GWeakRef * ref)
+{
+  g_weak_ref_clear (ref);
+  g_slice_free (GWeakRef, ref);
+}
+
+static gboolean
+kms_style_composite_mixer_recalculate_latency (GWeakRef * ref)
+{
+  KmsStyleCompositeMixer *self = g_weak_ref_get (ref);
+
+  if (self == NULL)
+    return G_SOURCE_REMOVE;
+
+  g_atomic_int_set (&self->priv->latency_pending, FALSE);
+
+  GST_DEBUG_OBJECT (self, "Recalculating latency");
+  gst_bin_recalculate_latency (GST_BIN (self));
+
+  g_object_unref (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* called from a streaming thread when the adaptive latency moves, while */
+/* other threads may hold the mixer lock waiting for it: the new latency */
+/* is applied from the loop */
+static void
+kms_style_composite_mixer_latency_changed (GWeakRef * ref)
+{
+  KmsStyleCompositeMixer *self = g_weak_ref_get (ref);
+  GWeakRef *idle_ref;
+
+  if (self == NULL)
+    return;
+
+  if (self->priv->loop != NULL
+      && g_atomic_int_compare_and_exchange (&self->priv->latency_pending,
+          FALSE, TRUE)) {
+    idle_ref = g_slice_new (GWeakRef);
+    g_weak_ref_init (idle_ref, self);
+    kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_DEFAULT,
+        (GSourceFunc) kms_style_composite_mixer_recalculate_latency,
+        idle_ref, (GDestroyNotify) free_weak_ref);
+  }
+
+  g_object_unref (self);
+}
+
+static void
+kms_style_composite_mixer_find_visible (gpointer item, gint slot,
+    const KmsStyleLayoutRect * rect, gpointer user_data)
+{
+  KmsStyleCompositeMixerData **found = user_data;
+
+  *found = item;
+}
+
+/* must be called with the mixer lock held */
+static KmsStyleCompositeMixerData *
+kms_style_composite_mixer_get_passthrough_port (KmsStyleCompositeMixer * self)
+{
+  KmsStyleCompositeMixerData *port_data = NULL;
+  gboolean match = FALSE;
+  GstVideoInfo info;
+  GstCaps *caps;
+
+  if (!self->priv->passthrough_enabled
+      || self->priv->mixer_video_agnostic == NULL
+      || kms_style_layout_get_n_visible (self->priv->layout) != 1)
+    return NULL;
+
+  kms_style_layout_foreach_visible (self->priv->layout,
+      kms_style_composite_mixer_find_visible, &port_data);
+
+  if (port_data == NULL || port_data->removing || port_data->parked
+      || !port_data->input || port_data->video_mixer_pad == NULL)
+    return NULL;
+
+  if (port_data->rect.x != 0 || port_data->rect.y != 0
+      || port_data->rect.width != self->priv->output_width
+      || port_data->rect.height != self->priv->output_height)
+    return NULL;
+
+  // the compositor would only copy it, the input has the output geometry.
+  caps = gst_pad_get_current_caps (port_data->tee_sink_pad);
+  if (caps != NULL) {
+    match = gst_video_info_from_caps (&info, caps)
+        && GST_VIDEO_INFO_WIDTH (&info) == self->priv->output_width
+        && GST_VIDEO_INFO_HEIGHT (&info) == self->priv->output_height;
+    gst_caps_unref (caps);
+  }
+
+  return match ? port_data : NULL;
+}
+
+/* decoding starts again from scratch, do not wait for the next gop */
+static void
+kms_style_composite_mixer_request_keyframe (KmsStyleCompositeMixer * self,
+    GstElement * element, gint id)
+{
+  GstPad *sink;
+
+  sink = gst_element_get_static_pad (element, "sink");
+  if (!gst_pad_push_event (sink,
+          gst_video_event_new_upstream_force_key_unit (GST_CLOCK_TIME_NONE,
+              TRUE, 0))) {
+    GST_WARNING_OBJECT (self, "Keyframe request for input %d failed", id);
+  }
+  g_object_unref (sink);
+}
+
+/* must be called with the mixer lock held */
+static GstElement *
+kms_style_composite_mixer_get_output (KmsStyleCompositeMixer * self)
+{
+  KmsStyleCompositeMixerData *port_data = self->priv->passthrough_port;
+
+  if (self->priv->passthrough_active)
+    return port_data->passthrough_agnostic;
+
+  return self->priv->mixer_video_agnostic;
+}
+
+/* must be called with the mixer lock held */
+static void
+kms_style_composite_mixer_link_outputs (KmsStyleCompositeMixer * self,
+    GstElement * source)
+{
+  KmsStyleCompositeMixerData *port_data;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_hash_table_iter_init (&iter, self->priv->ports);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    port_data = value;
+
+    if (!port_data->removing) {
+      kms_base_hub_link_video_src (KMS_BASE_HUB (self), port_data->id,
+          source, "src_%u", TRUE);
     }
-    if (i < MAX_VIEW_COUNT)
-      continue;                 // break for find a match view.
-  unmapped:
-    // store the unmapping views.
-    for (i = 0; i < 10; i++) {
-      if (viewUnMapping[i] == NULL) {
-        viewUnMapping[i] = port_data;
-        unmappedCount++;
-        GST_TRACE ("@rentao unmapped viewId=%d, i=%d, unmappedCount=%d",
-            port_data->viewId, i, unmappedCount);
-        break;
-      }
+  }
+}
+
+/* The compositor keeps running while idle, so that the inputs still */
+/* linked to it never see flushing pads, but it gets no frame to scale */
+static void
+kms_style_composite_mixer_set_composition_idle (KmsStyleCompositeMixer *
+    self, gboolean idle)
+{
+  if (g_atomic_int_get (&self->priv->composition_idle) == idle)
+    return;
+
+  GST_DEBUG_OBJECT (self, "%s the compositor inputs",
+      idle ? "Dropping" : "Composing");
+  g_atomic_int_set (&self->priv->composition_idle, idle);
+}
+
+static GstPadProbeReturn
+kms_style_composite_mixer_idle_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsStyleCompositeMixer * self)
+{
+  if (g_atomic_int_get (&self->priv->composition_idle)) {
+    return GST_PAD_PROBE_DROP;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+kms_style_composite_mixer_activate_passthrough (KmsStyleCompositeMixerData *
+    port_data)
+{
+  KmsStyleCompositeMixer *self = port_data->mixer;
+  gboolean activated = FALSE;
+  GstPad *sink;
+
+  KMS_STYLE_COMPOSITE_MIXER_LOCK (self);
+
+  if (self->priv->passthrough_port != port_data
+      || self->priv->passthrough_active) {
+    goto end;
+  }
+
+  GST_DEBUG_OBJECT (self, "Forwarding input %d", port_data->id);
+
+  kms_style_composite_mixer_link_outputs (self,
+      port_data->passthrough_agnostic);
+  self->priv->passthrough_active = TRUE;
+  activated = TRUE;
+
+  /* the outputs start with the keyframe held back by the probe */
+  sink = gst_element_get_static_pad (port_data->passthrough_agnostic, "sink");
+  gst_pad_remove_probe (sink, port_data->keyframe_probe_id);
+  port_data->keyframe_probe_id = 0;
+  g_object_unref (sink);
+
+end:
+  KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
+
+  if (activated) {
+    /* nothing takes the composed video meanwhile */
+    kms_style_composite_mixer_set_composition_idle (self, TRUE);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* what comes before the first keyframe cannot be decoded downstream */
+static GstPadProbeReturn
+kms_style_composite_mixer_keyframe_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer data)
+{
+  KmsStyleCompositeMixerData *port_data = data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    return GST_PAD_PROBE_DROP;
+  }
+
+  if (g_atomic_int_compare_and_exchange (&port_data->keyframe_received, FALSE,
+          TRUE)) {
+    kms_loop_idle_add_full (port_data->mixer->priv->loop, G_PRIORITY_DEFAULT,
+        (GSourceFunc) kms_style_composite_mixer_activate_passthrough,
+        KMS_STYLE_COMPOSITE_MIXER_REF (port_data),
+        (GDestroyNotify) kms_ref_struct_unref);
+  }
+
+  /* blocked until the outputs are linked */
+  return GST_PAD_PROBE_OK;
+}
+
+/* must be called with the mixer lock held */
+static void
+kms_style_composite_mixer_start_passthrough (KmsStyleCompositeMixer * self,
+    KmsStyleCompositeMixerData * port_data)
+{
+  GstElement *agnostic;
+  GstPad *sink;
+
+  GST_DEBUG_OBJECT (self, "Waiting for a keyframe of input %d", port_data->id);
+
+  agnostic = gst_element_factory_make ("agnosticbin", NULL);
+  gst_bin_add (GST_BIN (self), agnostic);
+  gst_element_sync_state_with_parent (agnostic);
+
+  g_atomic_int_set (&port_data->keyframe_received, FALSE);
+  sink = gst_element_get_static_pad (agnostic, "sink");
+  port_data->keyframe_probe_id = gst_pad_add_probe (sink,
+      GST_PAD_PROBE_TYPE_BLOCK | GST_PAD_PROBE_TYPE_BUFFER,
+      kms_style_composite_mixer_keyframe_probe,
+      KMS_STYLE_COMPOSITE_MIXER_REF (port_data),
+      (GDestroyNotify) kms_ref_struct_unref);
+  g_object_unref (sink);
+
+  port_data->passthrough_agnostic = agnostic;
+  self->priv->passthrough_port = KMS_STYLE_COMPOSITE_MIXER_REF (port_data);
+
+  /* the input is not decoded for the mixer anymore, it goes out encoded */
+  kms_base_hub_unlink_video_sink (KMS_BASE_HUB (self), port_data->id);
+  kms_base_hub_link_video_sink (KMS_BASE_HUB (self), port_data->id, agnostic,
+      "sink", FALSE);
+
+  kms_style_composite_mixer_request_keyframe (self, agnostic, port_data->id);
+}
+
+/* must be called with the mixer lock held, the returned agnosticbin has to */
+/* be removed out of it */
+static GstElement *
+kms_style_composite_mixer_stop_passthrough (KmsStyleCompositeMixer * self)
+{
+  KmsStyleCompositeMixerData *port_data = self->priv->passthrough_port;
+  GstElement *agnostic = port_data->passthrough_agnostic;
+  GstPad *sink;
+
+  GST_DEBUG_OBJECT (self, "Leaving passthrough of input %d", port_data->id);
+
+  if (self->priv->passthrough_active) {
+    kms_style_composite_mixer_link_outputs (self,
+        self->priv->mixer_video_agnostic);
+    self->priv->passthrough_active = FALSE;
+
+    /* the encoders start a new gop with the first composed frame */
+    g_atomic_int_set (&self->priv->keyframe_pending, TRUE);
+  }
+
+  if (!port_data->removing) {
+    kms_base_hub_unlink_video_sink (KMS_BASE_HUB (self), port_data->id);
+    kms_base_hub_link_video_sink (KMS_BASE_HUB (self), port_data->id,
+        port_data->capsfilter, "sink", FALSE);
+    kms_style_composite_mixer_request_keyframe (self, port_data->capsfilter,
+        port_data->id);
+
+    /* it was kept attached while forwarded */
+    if (!port_data->visible) {
+      kms_style_composite_mixer_schedule_park (port_data);
     }
   }
 
-  // move the unmapped view to the empty slot.
-  while (mappedCount < MAX_VIEW_COUNT && unmappedCount > 0) {
-    for (i = 0; i < MAX_VIEW_COUNT; i++) {
-      if (viewMapping[i] != NULL)
-        continue;
-      unmappedCount--;
-      viewMapping[i] = viewUnMapping[unmappedCount];
-      viewUnMapping[unmappedCount] = NULL;
-      mappedCount++;
-      break;
+  if (port_data->keyframe_probe_id > 0) {
+    sink = gst_element_get_static_pad (agnostic, "sink");
+    gst_pad_remove_probe (sink, port_data->keyframe_probe_id);
+    port_data->keyframe_probe_id = 0;
+    g_object_unref (sink);
+  }
+
+  port_data->passthrough_agnostic = NULL;
+  self->priv->passthrough_port = NULL;
+  KMS_STYLE_COMPOSITE_MIXER_UNREF (port_data);
+
+  return agnostic;
+}
+
+static gboolean
+kms_style_composite_mixer_update_passthrough (GWeakRef * ref)
+{
+  KmsStyleCompositeMixer *self = g_weak_ref_get (ref);
+  KmsStyleCompositeMixerData *port_data;
+  GstElement *agnostic = NULL;
+
+  if (self == NULL)
+    return G_SOURCE_REMOVE;
+
+  KMS_STYLE_COMPOSITE_MIXER_LOCK (self);
+
+  self->priv->passthrough_check_pending = FALSE;
+  port_data = kms_style_composite_mixer_get_passthrough_port (self);
+
+  if (port_data != self->priv->passthrough_port) {
+    if (self->priv->passthrough_port != NULL) {
+      agnostic = kms_style_composite_mixer_stop_passthrough (self);
+    }
+
+    if (port_data != NULL) {
+      kms_style_composite_mixer_start_passthrough (self, port_data);
     }
   }
-  n_columns = mappedCount;
-  n_rows = 1;
-  GST_TRACE_OBJECT (self,
-      "@rentao columns=%d rows=%d o_width=%d o_height=%d, mappedCount=%d, unmappedCount=%d, port_count=%d",
-      n_columns, n_rows, o_width, o_height, mappedCount, unmappedCount,
-      port_count);
-
-  // no view need to show, quit.
-  if (n_columns == 0) {
-    // set to show background only.
-    g_object_set (G_OBJECT (self->priv->episodeoverlay), "style",
-        "{'enable':2}", NULL);
-    g_list_free (values);
+
+  KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
+
+  /* only changed from the loop, as the compositor state */
+  if (!self->priv->passthrough_active) {
+    kms_style_composite_mixer_set_composition_idle (self, FALSE);
+  }
+
+  if (agnostic != NULL) {
+    gst_element_set_state (agnostic, GST_STATE_NULL);
+    gst_bin_remove (GST_BIN (self), agnostic);
+  }
+
+  g_object_unref (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* must be called with the mixer lock held */
+static void
+kms_style_composite_mixer_check_passthrough (KmsStyleCompositeMixer * self)
+{
+  GWeakRef *ref;
+
+  if (self->priv->passthrough_check_pending || self->priv->loop == NULL)
     return;
+
+  if (kms_style_composite_mixer_get_passthrough_port (self) ==
+      self->priv->passthrough_port)
+    return;
+
+  /* pads are linked and released out of the streaming threads */
+  self->priv->passthrough_check_pending = TRUE;
+  ref = g_slice_new (GWeakRef);
+  g_weak_ref_init (ref, self);
+  kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_DEFAULT,
+      (GSourceFunc) kms_style_composite_mixer_update_passthrough, ref,
+      (GDestroyNotify) free_weak_ref);
+}
+
+static GstPadProbeReturn
+kms_style_composite_mixer_output_probe (GstPad * pad, GstPadProbeInfo * info,
+    gpointer data)
+{
+  KmsStyleCompositeMixer *self = data;
+
+  if (g_atomic_int_compare_and_exchange (&self->priv->keyframe_pending, TRUE,
+          FALSE)) {
+    gst_pad_push_event (pad,
+        gst_video_event_new_downstream_force_key_unit (GST_CLOCK_TIME_NONE,
+            GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, TRUE, 0));
   }
-  //configure the local stream size, left and top according to master output view.
-  content_width = o_width - self->priv->pad_x;
-  content_height = o_height - self->priv->pad_y;
-  b_width = (content_width - line_weight) / n_columns;
-  b_height = content_height + b_height;
-  v_width = b_width - line_weight;
-  v_height = content_height - line_weight * 2;
-  width_reminder = content_width - b_width * n_columns;
-  pad_left = (self->priv->pad_x + width_reminder) / 2 + line_weight;
-  pad_top = self->priv->pad_y / 2 + line_weight;
-
-  g_snprintf (jsonStyle, 2048,
-      "{'width':%d, 'height':%d, 'font-desc':'%s', 'enable':%d, 'views':[",
-      o_width, o_height, self->priv->font_desc, (mappedCount <= 1) ? 0 : 1);
-
-  // draw the views.
-  curColumn = 0;
-  for (i = 0; i < MAX_VIEW_COUNT; i++) {
-    KmsStyleCompositeMixerData *port_data = viewMapping[i];
-
-    if (port_data == NULL)
-      continue;
-    // current port maybe not match to current view, set it to occupied, that means the port can not use the view's style.
-    if (self->priv->views[i].id == port_data->viewId)
-      occupied = 0;
-    else
-      occupied = 1;
-
-    left = pad_left + b_width * curColumn;
-    top = pad_top;
-
-    // only one view, show it full screen.
-    if (mappedCount <= 1) {
-      v_width = o_width - 0;
-      v_height = o_height - 0;
-      left = 0;
-      top = 0;
-    }
-    g_object_set (port_data->video_mixer_pad, "xpos", left, "ypos", top,
-        "width", v_width, "height", v_height, "alpha", 1.0, NULL);
-
-    GST_TRACE_OBJECT (port_data->video_mixer_pad,
-        "@rentao top=%d left=%d, pad_left=%d pad_top=%d, v_width=%d v_height=%d",
-        top, left, pad_left, pad_top, v_width, v_height);
-
-    // build the view style that will send to the episodeoverlay plugin.
-    if (occupied == 0) {
-      g_snprintf (jsonView, 512,
-          "{'width':%d, 'height':%d, 'x':%d, 'y':%d, 'text':'%s'}%s",
-          v_width, v_height, left, top, self->priv->views[i].text,
-          (curColumn >= mappedCount - 1) ? "" : ",");
-    } else {
-      g_snprintf (jsonView, 512,
-          "{'width':%d, 'height':%d, 'x':%d, 'y':%d, 'text':'id:%d'}%s",
-          v_width, v_height, left, top, port_data->viewId,
-          (curColumn >= mappedCount - 1) ? "" : ",");
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+cb_caps_changed (GstPad * pad, GstPadProbeInfo * info, gpointer data)
+{
+  KmsStyleCompositeMixerData *port_data = data;
+  KmsStyleCompositeMixer *self = port_data->mixer;
+
+  if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) != GST_EVENT_CAPS) {
+    return GST_PAD_PROBE_OK;
+  }
+
+  KMS_STYLE_COMPOSITE_MIXER_LOCK (self);
+  kms_style_composite_mixer_check_passthrough (self);
+  KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+kms_style_composite_mixer_recalculate_sizes (gpointer data)
+{
+  KmsStyleCompositeMixer *self = KMS_STYLE_COMPOSITE_MIXER (data);
+  KmsStyleCompositeMixerSceneBuilder builder;
+  guint n_visible;
+  gint enable;
+
+  kms_style_layout_set_area (self->priv->layout, self->priv->output_width,
+      self->priv->output_height, self->priv->pad_x, self->priv->pad_y,
+      self->priv->line_weight);
+
+  /* only the views whose geometry changed are reported, all of them are */
+  /* computed first and then applied to the compositor pads in one pass */
+  kms_style_layout_commit (self->priv->layout,
+      kms_style_composite_mixer_apply_view, self);
+
+  n_visible = kms_style_layout_get_n_visible (self->priv->layout);
+  GST_TRACE_OBJECT (self, "@rentao visible=%u, port_count=%d", n_visible,
+      self->priv->n_elems);
+
+  kms_style_composite_mixer_check_passthrough (self);
+
+  if (self->priv->episodeoverlay == NULL)
+    return;
+
+  if (n_visible == 0) {
+    // no view need to show, set to show background only.
+    enable = KMS_STYLE_SCENE_BACKGROUND_ONLY;
+  } else if (n_visible == 1) {
+    enable = KMS_STYLE_SCENE_DISABLED;
+  } else {
+    enable = KMS_STYLE_SCENE_ENABLED;
+  }
+
+  builder.self = self;
+  builder.n_views = 0;
+  builder.scene = kms_style_scene_new (self->priv->output_width,
+      self->priv->output_height, enable, self->priv->font_desc, n_visible);
+
+  kms_style_layout_foreach_visible (self->priv->layout,
+      kms_style_composite_mixer_append_scene_view, &builder);
+
+  GST_TRACE_OBJECT (self, "@rentao publish scene version=%u views=%u",
+      builder.scene->version, builder.n_views);
+  g_object_set (G_OBJECT (self->priv->episodeoverlay), "scene",
+      builder.scene, NULL);
+
+  kms_style_scene_unref (builder.scene);
+}
+
+static void
+kms_style_composite_mixer_add_views (KmsStyleCompositeMixer * self,
+    guint count)
+{
+  KmsConpositeViewPrivate view;
+
+  memset (&view, 0, sizeof (view));
+  view.id = -1;
+  view.enable = 1;
+  view.width = -1;
+  view.height = -1;
+
+  while (self->priv->views->len < count) {
+    g_array_append_val (self->priv->views, view);
+  }
+}
+
+static void
+kms_style_composite_mixer_update_views (KmsStyleCompositeMixer * self)
+{
+  GArray *views = self->priv->views;
+  KmsStyleLayoutView *layout_views;
+  guint i;
+
+  layout_views = g_new0 (KmsStyleLayoutView, MAX (views->len, 1));
+  for (i = 0; i < views->len; i++) {
+    KmsConpositeViewPrivate *view =
+        &g_array_index (views, KmsConpositeViewPrivate, i);
+
+    layout_views[i].id = view->id;
+    layout_views[i].enabled = view->enable != 0;
+  }
+
+  kms_style_layout_set_views (self->priv->layout, layout_views, views->len,
+      self->priv->max_views);
+  g_free (layout_views);
+}
+
+static void
+kms_style_composite_mixer_view_id_changed (GObject * object,
+    GParamSpec * pspec, KmsStyleCompositeMixerData * port_data)
+{
+  KmsStyleCompositeMixer *self = port_data->mixer;
+  gint view_id;
+
+  // use max-output-bitrate as view id to bind mixer_endpoint to specified user.
+  g_object_get (object, "max-output-bitrate", &view_id, NULL);
+
+  KMS_STYLE_COMPOSITE_MIXER_LOCK (self);
+
+  if (view_id != port_data->viewId) {
+    port_data->viewId = view_id;
+    if (kms_style_layout_update (self->priv->layout, port_data, view_id)) {
+      kms_style_composite_mixer_recalculate_sizes (self);
     }
-    g_strlcat (jsonStyle, jsonView, 2048);
-    GST_TRACE ("@rentao view json: (%s), i=%d, column=%d", jsonView, i,
-        curColumn);
-    curColumn++;
-  }
-  // finishes the view style and set to episodeoverlay plugin.
-  g_strlcat (jsonStyle, "]}", 2048);
-  GST_TRACE ("@rentao style json: %s", jsonStyle);
-  g_object_set (G_OBJECT (self->priv->episodeoverlay), "style", jsonStyle,
-      NULL);
+  }
 
-  g_list_free (values);
+  KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
+}
+
+/* must be called with the mixer lock held */
+static KmsPortBranch *
+kms_style_composite_mixer_take_branch (KmsStyleCompositeMixerData * port_data)
+{
+  KmsPortBranch *branch = port_data->branch;
+
+  /* pooled branches must come back without probes */
+  if (port_data->caps_probe_id > 0) {
+    gst_pad_remove_probe (port_data->tee_sink_pad, port_data->caps_probe_id);
+    port_data->caps_probe_id = 0;
+  }
+
+  port_data->branch = NULL;
+  port_data->tee_sink_pad = NULL;
+  port_data->capsfilter = NULL;
+  port_data->tee = NULL;
+  port_data->fakesink = NULL;
+
+  return branch;
 }
 
 static gboolean
 remove_elements_from_pipeline (KmsStyleCompositeMixerData * port_data)
 {
   KmsStyleCompositeMixer *self = port_data->mixer;
+  KmsPortBranch *branch;
 
   KMS_STYLE_COMPOSITE_MIXER_LOCK (self);
 
@@ -404,6 +939,12 @@ remove_elements_from_pipeline (KmsStyleCompositeMixerData * port_data)
     port_data->latency_probe_id = 0;
   }
 
+  if (port_data->idle_probe_id > 0) {
+    gst_pad_remove_probe (port_data->video_mixer_pad,
+        port_data->idle_probe_id);
+    port_data->idle_probe_id = 0;
+  }
+
   if (port_data->video_mixer_pad != NULL) {
     gst_element_release_request_pad (self->priv->videomixer,
         port_data->video_mixer_pad);
@@ -411,27 +952,17 @@ remove_elements_from_pipeline (KmsStyleCompositeMixerData * port_data)
     port_data->video_mixer_pad = NULL;
   }
 
-  gst_bin_remove_many (GST_BIN (self),
-      g_object_ref (port_data->capsfilter),
-      g_object_ref (port_data->tee), g_object_ref (port_data->fakesink), NULL);
+  g_clear_object (&port_data->tee_src_pad);
 
   kms_base_hub_unlink_video_src (KMS_BASE_HUB (self), port_data->id);
 
-  KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
-
-  gst_element_set_state (port_data->capsfilter, GST_STATE_NULL);
-  gst_element_set_state (port_data->tee, GST_STATE_NULL);
-  gst_element_set_state (port_data->fakesink, GST_STATE_NULL);
+  branch = kms_style_composite_mixer_take_branch (port_data);
 
-  g_object_unref (port_data->capsfilter);
-  g_object_unref (port_data->tee);
-  g_object_unref (port_data->fakesink);
-  g_object_unref (port_data->tee_sink_pad);
+  KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
 
-  port_data->tee_sink_pad = NULL;
-  port_data->capsfilter = NULL;
-  port_data->tee = NULL;
-  port_data->fakesink = NULL;
+  if (branch != NULL) {
+    kms_port_branch_pool_release (self->priv->pool, branch);
+  }
 
   return G_SOURCE_REMOVE;
 }
@@ -473,27 +1004,12 @@ cb_EOS_received (GstPad * pad, GstPadProbeInfo * info, gpointer data)
   return GST_PAD_PROBE_OK;
 }
 
-static GstPadProbeReturn
-cb_latency (GstPad * pad, GstPadProbeInfo * info, gpointer data)
-{
-  if (GST_QUERY_TYPE (GST_PAD_PROBE_INFO_QUERY (info)) != GST_QUERY_LATENCY) {
-    return GST_PAD_PROBE_OK;
-  }
-
-  GST_LOG_OBJECT (pad, "Modifing latency query. New latency %ld",
-      LATENCY * GST_MSECOND);
-
-  gst_query_set_latency (GST_PAD_PROBE_INFO_QUERY (info),
-      TRUE, LATENCY * GST_MSECOND, LATENCY * GST_MSECOND);
-
-  return GST_PAD_PROBE_OK;
-}
-
 static void
 kms_style_composite_mixer_port_data_destroy (gpointer data)
 {
   KmsStyleCompositeMixerData *port_data = (KmsStyleCompositeMixerData *) data;
   KmsStyleCompositeMixer *self = port_data->mixer;
+  KmsPortBranch *branch;
   GstPad *audiosink;
   gchar *padname;
 
@@ -501,10 +1017,30 @@ kms_style_composite_mixer_port_data_destroy (gpointer data)
 
   port_data->removing = TRUE;
 
+  if (self->priv->passthrough_port == port_data && !port_data->parked
+      && port_data->video_mixer_pad != NULL) {
+    /* nothing feeds its compositor pad to drain it, the branch goes back */
+    /* to the pool as a parked one and the outputs are relinked on the loop */
+    kms_style_composite_mixer_unlink_mixer_pad (self, port_data);
+    port_data->parked = TRUE;
+    kms_style_composite_mixer_check_passthrough (self);
+  }
+
+  if (port_data->view_id_handler > 0) {
+    g_signal_handler_disconnect (port_data->mixer_end_point,
+        port_data->view_id_handler);
+    port_data->view_id_handler = 0;
+  }
+
+  if (kms_style_layout_remove (self->priv->layout, port_data)) {
+    self->priv->n_elems--;
+    kms_style_composite_mixer_recalculate_sizes (self);
+  }
+
   kms_base_hub_unlink_video_sink (KMS_BASE_HUB (self), port_data->id);
   kms_base_hub_unlink_audio_sink (KMS_BASE_HUB (self), port_data->id);
 
-  if (port_data->input) {
+  if (port_data->input && !port_data->parked) {
     GstEvent *event;
     gboolean result;
     GstPad *pad;
@@ -530,11 +1066,6 @@ kms_style_composite_mixer_port_data_destroy (gpointer data)
       event = gst_event_new_eos ();
       result = gst_pad_send_event (pad, event);
 
-      if (port_data->input && self->priv->n_elems > 0) {
-        port_data->input = FALSE;
-        self->priv->n_elems--;
-        kms_style_composite_mixer_recalculate_sizes (self);
-      }
       KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
 
       if (!result) {
@@ -543,58 +1074,210 @@ kms_style_composite_mixer_port_data_destroy (gpointer data)
     } else {
       gboolean remove = FALSE;
 
-      /* EOS callback was triggered before we could remove the port data */
-      /* so we have to remove elements to avoid memory leaks. */
-      remove = port_data->eos_managed;
-      KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
+      /* EOS callback was triggered before we could remove the port data */
+      /* so we have to remove elements to avoid memory leaks. */
+      remove = port_data->eos_managed;
+      KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
+
+      if (remove) {
+        /* Remove pipeline without helding the mutex */
+        kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_DEFAULT,
+            (GSourceFunc) remove_elements_from_pipeline,
+            KMS_STYLE_COMPOSITE_MIXER_REF (port_data),
+            (GDestroyNotify) kms_ref_struct_unref);
+      }
+    }
+    /* the branch stays linked, it goes back to the pool once drained */
+    g_object_unref (pad);
+  } else {
+    if (port_data->probe_id > 0) {
+      gst_pad_remove_probe (port_data->video_mixer_pad, port_data->probe_id);
+    }
+
+    if (port_data->latency_probe_id > 0) {
+      gst_pad_remove_probe (port_data->video_mixer_pad,
+          port_data->latency_probe_id);
+    }
+
+    if (port_data->idle_probe_id > 0) {
+      gst_pad_remove_probe (port_data->video_mixer_pad,
+          port_data->idle_probe_id);
+    }
+
+    if (port_data->link_probe_id > 0) {
+      gst_pad_remove_probe (port_data->tee_sink_pad, port_data->link_probe_id);
+      port_data->link_probe_id = 0;
+    }
+
+    g_clear_object (&port_data->tee_src_pad);
+    branch = kms_style_composite_mixer_take_branch (port_data);
+    KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
+
+    /* never used or parked, back to the pool as it is */
+    if (branch != NULL) {
+      kms_port_branch_pool_release (self->priv->pool, branch);
+    }
+  }
+
+  padname = g_strdup_printf (AUDIO_SINK_PAD, port_data->id);
+  audiosink = gst_element_get_static_pad (self->priv->audiomixer, padname);
+  gst_element_release_request_pad (self->priv->audiomixer, audiosink);
+  gst_object_unref (audiosink);
+  g_free (padname);
+}
+
+/* must be called with the mixer lock held */
+static gboolean
+kms_style_composite_mixer_link_mixer_pad (KmsStyleCompositeMixer * self,
+    KmsStyleCompositeMixerData * data)
+{
+  GstPadTemplate *sink_pad_template;
+
+  sink_pad_template =
+      gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS (self->priv->
+          videomixer), "sink_%u");
+
+  if (G_UNLIKELY (sink_pad_template == NULL)) {
+    GST_ERROR_OBJECT (self, "Error taking a new pad from videomixer");
+    return FALSE;
+  }
+
+  /*link tee -> videomixer */
+  data->video_mixer_pad =
+      gst_element_request_pad (self->priv->videomixer,
+      sink_pad_template, NULL, NULL);
+
+  data->tee_src_pad = gst_element_get_request_pad (data->tee, "src_%u");
+
+  gst_element_link_pads (data->tee, GST_OBJECT_NAME (data->tee_src_pad),
+      self->priv->videomixer, GST_OBJECT_NAME (data->video_mixer_pad));
+
+  data->probe_id = gst_pad_add_probe (data->video_mixer_pad,
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      (GstPadProbeCallback) cb_EOS_received,
+      KMS_STYLE_COMPOSITE_MIXER_REF (data),
+      (GDestroyNotify) kms_ref_struct_unref);
+
+  data->latency_probe_id =
+      kms_mixer_latency_add_probe (self->priv->latency,
+      data->video_mixer_pad);
+
+  data->idle_probe_id = gst_pad_add_probe (data->video_mixer_pad,
+      GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) kms_style_composite_mixer_idle_probe, self, NULL);
+
+  return TRUE;
+}
+
+/* must be called with the mixer lock held */
+static void
+kms_style_composite_mixer_unlink_mixer_pad (KmsStyleCompositeMixer * self,
+    KmsStyleCompositeMixerData * data)
+{
+  if (data->probe_id > 0) {
+    gst_pad_remove_probe (data->video_mixer_pad, data->probe_id);
+    data->probe_id = 0;
+  }
+
+  if (data->latency_probe_id > 0) {
+    gst_pad_remove_probe (data->video_mixer_pad, data->latency_probe_id);
+    data->latency_probe_id = 0;
+  }
+
+  if (data->idle_probe_id > 0) {
+    gst_pad_remove_probe (data->video_mixer_pad, data->idle_probe_id);
+    data->idle_probe_id = 0;
+  }
+
+  gst_pad_unlink (data->tee_src_pad, data->video_mixer_pad);
+
+  gst_element_release_request_pad (data->tee, data->tee_src_pad);
+  g_clear_object (&data->tee_src_pad);
+
+  gst_element_release_request_pad (self->priv->videomixer,
+      data->video_mixer_pad);
+  g_clear_object (&data->video_mixer_pad);
+}
+
+static gboolean
+kms_style_composite_mixer_park_port (KmsStyleCompositeMixerData * port_data)
+{
+  KmsStyleCompositeMixer *self = port_data->mixer;
+
+  KMS_STYLE_COMPOSITE_MIXER_LOCK (self);
+
+  port_data->park_pending = FALSE;
+
+  if (port_data->visible || port_data->parked || port_data->removing
+      || !port_data->input || port_data->video_mixer_pad == NULL
+      || !self->priv->detach_hidden
+      || self->priv->passthrough_port == port_data) {
+    goto end;
+  }
+
+  GST_DEBUG_OBJECT (self, "Detaching hidden input %d", port_data->id);
+
+  /* the hub port stops feeding (and decoding) video for this mixer, and */
+  /* the compositor does not wait for nor scale it anymore */
+  kms_base_hub_unlink_video_sink (KMS_BASE_HUB (self), port_data->id);
+  kms_style_composite_mixer_unlink_mixer_pad (self, port_data);
+  port_data->parked = TRUE;
+
+  gst_bin_recalculate_latency (GST_BIN (self));
+
+end:
+  KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+kms_style_composite_mixer_unpark_port (KmsStyleCompositeMixerData * port_data)
+{
+  KmsStyleCompositeMixer *self = port_data->mixer;
+
+  KMS_STYLE_COMPOSITE_MIXER_LOCK (self);
+
+  if (!port_data->parked || port_data->removing || (!port_data->visible
+          && self->priv->detach_hidden)) {
+    goto end;
+  }
+
+  GST_DEBUG_OBJECT (self, "Attaching input %d", port_data->id);
 
-      if (remove) {
-        /* Remove pipeline without helding the mutex */
-        kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_DEFAULT,
-            (GSourceFunc) remove_elements_from_pipeline,
-            KMS_STYLE_COMPOSITE_MIXER_REF (port_data),
-            (GDestroyNotify) kms_ref_struct_unref);
-      }
-    }
-    gst_element_unlink (port_data->capsfilter, port_data->tee);
-    g_object_unref (pad);
+  if (!kms_style_composite_mixer_link_mixer_pad (self, port_data))
+    goto end;
+
+  port_data->parked = FALSE;
+
+  if (port_data->visible) {
+    g_object_set (port_data->video_mixer_pad, "xpos", port_data->rect.x,
+        "ypos", port_data->rect.y, "width", port_data->rect.width, "height",
+        port_data->rect.height, "alpha", 1.0, NULL);
   } else {
-    if (port_data->probe_id > 0) {
-      gst_pad_remove_probe (port_data->video_mixer_pad, port_data->probe_id);
-    }
+    g_object_set (port_data->video_mixer_pad, "xpos", 0, "ypos", 0,
+        "alpha", 0.0, NULL);
+  }
 
-    if (port_data->latency_probe_id > 0) {
-      gst_pad_remove_probe (port_data->video_mixer_pad,
-          port_data->latency_probe_id);
-    }
+  kms_base_hub_link_video_sink (KMS_BASE_HUB (self), port_data->id,
+      port_data->capsfilter, "sink", FALSE);
 
-    if (port_data->link_probe_id > 0) {
-      gst_pad_remove_probe (port_data->tee_sink_pad, port_data->link_probe_id);
-    }
-    KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
+  kms_style_composite_mixer_request_keyframe (self, port_data->capsfilter,
+      port_data->id);
 
-    gst_element_unlink_many (port_data->capsfilter, port_data->tee,
-        port_data->fakesink, NULL);
+  gst_bin_recalculate_latency (GST_BIN (self));
 
-    CLEANUP_ELEMENT_FROM (self, port_data->capsfilter);
-    CLEANUP_ELEMENT_FROM (self, port_data->fakesink);
-    CLEANUP_ELEMENT_FROM (self, port_data->tee);
-  }
+end:
+  KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
 
-  padname = g_strdup_printf (AUDIO_SINK_PAD, port_data->id);
-  audiosink = gst_element_get_static_pad (self->priv->audiomixer, padname);
-  gst_element_release_request_pad (self->priv->audiomixer, audiosink);
-  gst_object_unref (audiosink);
-  g_free (padname);
+  return G_SOURCE_REMOVE;
 }
 
 static GstPadProbeReturn
 link_to_videomixer (GstPad * pad, GstPadProbeInfo * info,
     KmsStyleCompositeMixerData * data)
 {
-  GstPadTemplate *sink_pad_template;
   KmsStyleCompositeMixer *mixer;
-  GstPad *tee_src;
 
   if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) !=
       GST_EVENT_STREAM_START) {
@@ -607,47 +1290,28 @@ link_to_videomixer (GstPad * pad, GstPadProbeInfo * info,
 
   data->link_probe_id = 0;
   data->latency_probe_id = 0;
+  data->idle_probe_id = 0;
 
-  sink_pad_template =
-      gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS (mixer->priv->
-          videomixer), "sink_%u");
-
-  if (G_UNLIKELY (sink_pad_template == NULL)) {
-    GST_ERROR_OBJECT (mixer, "Error taking a new pad from videomixer");
+  if (!kms_style_composite_mixer_link_mixer_pad (mixer, data)) {
     KMS_STYLE_COMPOSITE_MIXER_UNLOCK (mixer);
     return GST_PAD_PROBE_DROP;
   }
 
   data->input = TRUE;
 
-  /*link tee -> videomixer */
-  data->video_mixer_pad =
-      gst_element_request_pad (mixer->priv->videomixer,
-      sink_pad_template, NULL, NULL);
-
-//  g_object_set (data->video_mixer_pad, "width", mixer->priv->output_width, "height",
-//      mixer->priv->output_height, NULL);
-
-  tee_src = gst_element_get_request_pad (data->tee, "src_%u");
-
-  gst_element_link_pads (data->tee, GST_OBJECT_NAME (tee_src),
-      mixer->priv->videomixer, GST_OBJECT_NAME (data->video_mixer_pad));
-  g_object_unref (tee_src);
-
-  data->probe_id = gst_pad_add_probe (data->video_mixer_pad,
-      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
-      (GstPadProbeCallback) cb_EOS_received,
-      KMS_STYLE_COMPOSITE_MIXER_REF (data),
-      (GDestroyNotify) kms_ref_struct_unref);
-
-  data->latency_probe_id = gst_pad_add_probe (data->video_mixer_pad,
-      GST_PAD_PROBE_TYPE_QUERY_UPSTREAM,
-      (GstPadProbeCallback) cb_latency, NULL, NULL);
-
   /*recalculate the output sizes */
   mixer->priv->n_elems++;
+  g_object_get (G_OBJECT (data->mixer_end_point), "max-output-bitrate",
+      &data->viewId, NULL);
+  kms_style_layout_add (mixer->priv->layout, data, data->viewId);
   kms_style_composite_mixer_recalculate_sizes (mixer);
 
+  // a port that is not mapped to any view is not reported by the layout.
+  if (!data->visible) {
+    g_object_set (data->video_mixer_pad, "alpha", 0.0, NULL);
+    kms_style_composite_mixer_schedule_park (data);
+  }
+
   //Recalculate latency to avoid video freezes when an element stops to send media.
   gst_bin_recalculate_latency (GST_BIN (mixer));
 
@@ -694,7 +1358,6 @@ kms_style_composite_mixer_port_data_create (KmsStyleCompositeMixer * mixer,
 {
   KmsStyleCompositeMixerData *data;
   gchar *padname;
-  GstPad *tee_src;
 
   data = kms_create_style_composite_mixer_data ();
   data->mixer = mixer;
@@ -703,40 +1366,34 @@ kms_style_composite_mixer_port_data_create (KmsStyleCompositeMixer * mixer,
   data->removing = FALSE;
   data->eos_managed = FALSE;
 
-  data->tee = gst_element_factory_make ("tee", NULL);
-  data->fakesink = gst_element_factory_make ("fakesink", NULL);
-  data->capsfilter = gst_element_factory_make ("capsfilter", NULL);
-
-  g_object_set (G_OBJECT (data->capsfilter), "caps-change-mode",
-      1 /*delayed */ , NULL);
-
-  g_object_set (G_OBJECT (data->fakesink), "async", FALSE, "sync", FALSE, NULL);
-
-  gst_bin_add_many (GST_BIN (mixer), data->capsfilter, data->tee,
-      data->fakesink, NULL);
-
-  gst_element_sync_state_with_parent (data->capsfilter);
-  gst_element_sync_state_with_parent (data->tee);
-  gst_element_sync_state_with_parent (data->fakesink);
+  /* capsfilter -> tee -> fakesink, already built and running */
+  data->branch = kms_port_branch_pool_acquire (mixer->priv->pool);
+  if (data->branch == NULL) {
+    /* the pool is cleared on dispose */
+    GST_DEBUG_OBJECT (mixer, "No branch pooled for port %d", id);
+    data->branch = kms_port_branch_pool_build (mixer->priv->pool,
+        GST_BIN (mixer));
+  }
+  data->capsfilter = data->branch->capsfilter;
+  data->tee = data->branch->tee;
+  data->fakesink = data->branch->fakesink;
+  data->tee_sink_pad = data->branch->tee_sink_pad;
 
   /*link basemixer -> video_agnostic */
   kms_base_hub_link_video_sink (KMS_BASE_HUB (mixer), data->id,
       data->capsfilter, "sink", FALSE);
 
-  data->tee_sink_pad = gst_element_get_static_pad (data->tee, "sink");
-  gst_element_link_pads (data->capsfilter, NULL, data->tee,
-      GST_OBJECT_NAME (data->tee_sink_pad));
-
-  tee_src = gst_element_get_request_pad (data->tee, "src_%u");
-  gst_element_link_pads (data->tee, GST_OBJECT_NAME (tee_src), data->fakesink,
-      "sink");
-  g_object_unref (tee_src);
-
   padname = g_strdup_printf (AUDIO_SINK_PAD, id);
   kms_base_hub_link_audio_sink (KMS_BASE_HUB (mixer), id,
       mixer->priv->audiomixer, padname, FALSE);
   g_free (padname);
 
+  data->caps_probe_id = gst_pad_add_probe (data->tee_sink_pad,
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      (GstPadProbeCallback) cb_caps_changed,
+      KMS_STYLE_COMPOSITE_MIXER_REF (data),
+      (GDestroyNotify) kms_ref_struct_unref);
+
   data->link_probe_id = gst_pad_add_probe (data->tee_sink_pad,
       GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_BLOCK,
       (GstPadProbeCallback) link_to_videomixer,
@@ -797,90 +1454,81 @@ pad_release_request_cb (GstElement * element, GstPad * pad, gpointer data)
 //  if (pad) GST_TRACE ("@rentao Release request pad %" GST_PTR_FORMAT, pad);
 }
 
-static gboolean
-kms_style_composite_mixer_is_valid_uri (const gchar * url)
+typedef struct _KmsBackgroundRequest
 {
-  gboolean ret;
-  GRegex *regex;
+  GWeakRef ref;
+  gchar *uri;
+} KmsBackgroundRequest;
 
-  regex = g_regex_new ("^(?:((?:https?):)\\/\\/)([^:\\/\\s]+)(?::(\\d*))?(?:\\/"
-      "([^\\s?#]+)?([?][^?#]*)?(#.*)?)?$", 0, 0, NULL);
-  ret = g_regex_match (regex, url, G_REGEX_MATCH_ANCHORED, NULL);
-  g_regex_unref (regex);
-
-  return ret;
+static void
+kms_background_request_free (KmsBackgroundRequest * req)
+{
+  g_weak_ref_clear (&req->ref);
+  g_free (req->uri);
+  g_slice_free (KmsBackgroundRequest, req);
 }
 
-static gboolean
-load_from_url (gchar * file_name, const gchar * url)
+static void
+kms_style_composite_mixer_background_loaded (KmsImage * image,
+    KmsBackgroundRequest * req)
 {
-  SoupSession *session;
-  SoupMessage *msg;
-  FILE *dst;
-  gboolean retOK = FALSE;
+  KmsStyleCompositeMixer *self = g_weak_ref_get (&req->ref);
 
-  session = soup_session_sync_new ();
-  msg = soup_message_new ("GET", url);
-  soup_session_send_message (session, msg);
+  if (self == NULL)
+    return;
 
-  dst = fopen (file_name, "w+");
+  KMS_STYLE_COMPOSITE_MIXER_LOCK (self);
 
-  if (dst == NULL) {
-    GST_ERROR ("It is not possible to create the file");
-    goto end;
+  /* a newer background may have been requested while this one was loading */
+  if (g_strcmp0 (req->uri, self->priv->background_image) != 0) {
+    GST_DEBUG_OBJECT (self, "Discarding outdated background image");
+  } else if (image == NULL) {
+    GST_WARNING_OBJECT (self, "Background image could not be loaded: %s",
+        req->uri);
+    /* forget it so that setting the same URL again retries the load */
+    g_free (self->priv->background_image);
+    self->priv->background_image = NULL;
+  } else if (self->priv->videomixer != NULL) {
+    g_object_set (G_OBJECT (self->priv->videomixer), "background-image",
+        image->path, NULL);
+    GST_INFO ("@rentao set background file %s ok.", image->path);
   }
-  fwrite (msg->response_body->data, 1, msg->response_body->length, dst);
-  fclose (dst);
-  retOK = TRUE;
 
-end:
-  g_object_unref (msg);
-  g_object_unref (session);
-  return retOK;
+  KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
+
+  g_object_unref (self);
 }
 
 static void
 kms_style_composite_mixer_setup_background_image (KmsStyleCompositeMixer * self)
 {
-  gchar *url = self->priv->background_image;
-  gchar *file_name;
+  KmsBackgroundRequest *req;
 
   // check the videomixer plugin created?
-  if (self->priv->videomixer == NULL || url == NULL)
+  if (self->priv->videomixer == NULL || self->priv->background_image == NULL)
     return;
 
-  // load from url.
-  if (kms_style_composite_mixer_is_valid_uri (url)) {
-    if (!self->priv->dir_created) {
-      gchar *d = g_strdup (TEMP_PATH);
-
-      self->priv->dir = g_mkdtemp (d);
-      self->priv->dir_created = TRUE;
-      GST_INFO ("@rentao create tmp folder fot download image. %s", d);
-    }
-    file_name = g_strconcat (self->priv->dir, "/image.png", NULL);
+  /* the image is downloaded and scaled out of the mixer lock, the current */
+  /* background is kept until the new one is ready */
+  req = g_slice_new (KmsBackgroundRequest);
+  g_weak_ref_init (&req->ref, self);
+  req->uri = g_strdup (self->priv->background_image);
+  kms_image_cache_load_async (req->uri,
+      self->priv->output_width, self->priv->output_height,
+      (KmsImageCacheFunc) kms_style_composite_mixer_background_loaded, req,
+      (GDestroyNotify) kms_background_request_free);
+}
 
-    if (load_from_url (file_name, url)) {
-      g_object_set (G_OBJECT (self->priv->videomixer), "background-image",
-          file_name, NULL);
-      GST_INFO ("@rentao set background file %s ok, and delete it.", file_name);
-    }
-    g_remove (file_name);
-    g_free (file_name);
-  }
-//
-//
-//
-//  GST_TRACE ("@rentao");
-//
-//  if (self->priv->episodeoverlay == NULL
-//      || self->priv->background_image == NULL)
-//    return;
-//  g_snprintf (jsonStyle, 512, "{'background_image':'%s'}",
-//      self->priv->background_image);
-//  g_object_set (G_OBJECT (self->priv->episodeoverlay), "style", jsonStyle,
-//      NULL);
-//  GST_TRACE ("@rentao style=%s", jsonStyle);
+static void
+kms_style_composite_mixer_detach_mode_changed (gpointer key,
+    KmsStyleCompositeMixerData * port_data, gpointer user_data)
+{
+  if (port_data->mixer->priv->detach_hidden) {
+    if (!port_data->visible)
+      kms_style_composite_mixer_schedule_park (port_data);
+  } else {
+    kms_style_composite_mixer_schedule_unpark (port_data);
+  }
 }
 
 static gboolean
@@ -890,8 +1538,10 @@ kms_style_composite_mixer_parse_style (KmsStyleCompositeMixer * self)
   GError *error;
   JsonReader *reader;
   gint width = 0, height = 0, frame_rate = 0, pad_x = 0, pad_y = 0, line =
-      0, count, i, id, enable, show_hide_flag = 0;
-  const gchar *background, *text, *fontdesc_str;
+      0, count, i, id, enable, max_views, show_hide_flag = 0;
+  const gchar *background, *text, *fontdesc_str, *layout_str;
+  KmsStyleLayoutTemplate tmpl;
+  KmsConpositeViewPrivate *view;
   gchar **members;
   gint n_members, mi;
 
@@ -978,11 +1628,62 @@ kms_style_composite_mixer_parse_style (KmsStyleCompositeMixer * self)
   }
   json_reader_end_member (reader);
 
+  if (json_reader_read_member (reader, "layout")) {
+    layout_str = json_reader_get_string_value (reader);
+    if (kms_style_layout_template_from_string (layout_str, &tmpl)) {
+      if (tmpl != kms_style_layout_get_template (self->priv->layout)) {
+        kms_style_layout_set_template (self->priv->layout, tmpl);
+        show_hide_flag = 1;
+      }
+      GST_TRACE ("@rentao set layout=%s", layout_str);
+    } else {
+      GST_WARNING_OBJECT (self, "Unknown layout %s", layout_str);
+    }
+  }
+  json_reader_end_member (reader);
+
+  if (json_reader_read_member (reader, "max-views")) {
+    max_views = json_reader_get_int_value (reader);
+    if (max_views > 0 && (guint) max_views != self->priv->max_views) {
+      self->priv->max_views = max_views;
+      show_hide_flag = 1;
+      GST_TRACE ("@rentao set max-views=%d", max_views);
+    }
+  }
+  json_reader_end_member (reader);
+
+  if (json_reader_read_member (reader, "detach-hidden")) {
+    gboolean detach_hidden = json_reader_get_int_value (reader) != 0;
+
+    if (detach_hidden != self->priv->detach_hidden) {
+      self->priv->detach_hidden = detach_hidden;
+      g_hash_table_foreach (self->priv->ports,
+          (GHFunc) kms_style_composite_mixer_detach_mode_changed, NULL);
+      GST_TRACE ("@rentao set detach-hidden=%d", detach_hidden);
+    }
+  }
+  json_reader_end_member (reader);
+
+  if (json_reader_read_member (reader, "passthrough")) {
+    gboolean passthrough = json_reader_get_int_value (reader) != 0;
+
+    if (passthrough != self->priv->passthrough_enabled) {
+      self->priv->passthrough_enabled = passthrough;
+      kms_style_composite_mixer_check_passthrough (self);
+      GST_TRACE ("@rentao set passthrough=%d", passthrough);
+    }
+  }
+  json_reader_end_member (reader);
+
   json_reader_read_member (reader, "views");
   count = json_reader_count_elements (reader);
-  count = (count < MAX_VIEW_COUNT) ? count : MAX_VIEW_COUNT;
+  if (count > 0 && (guint) count > self->priv->views->len) {
+    kms_style_composite_mixer_add_views (self, count);
+    show_hide_flag = 1;
+  }
   for (i = 0; i < count; i++) {
     json_reader_read_element (reader, i);
+    view = &g_array_index (self->priv->views, KmsConpositeViewPrivate, i);
 
     members = json_reader_list_members (reader);
     n_members = g_strv_length (members);
@@ -991,45 +1692,43 @@ kms_style_composite_mixer_parse_style (KmsStyleCompositeMixer * self)
       if (g_strcmp0 (members[mi], "id") == 0) {
         json_reader_read_member (reader, "id");
         id = json_reader_get_int_value (reader);
-        self->priv->views[i].id = id;
-        GST_TRACE ("@rentao set view[%d] id=%d", i, self->priv->views[i].id);
+        if (view->id != id)
+          show_hide_flag = 1;
+        view->id = id;
+        GST_TRACE ("@rentao set view[%d] id=%d", i, view->id);
       } else if (g_strcmp0 (members[mi], "text") == 0) {
         json_reader_read_member (reader, "text");
         text = json_reader_get_string_value (reader);
         if (text != NULL) {
-          g_strlcpy (self->priv->views[i].text, text, MAX_TEXT_LENGTH);
-          GST_TRACE ("@rentao set view[%d] text=%s", i,
-              self->priv->views[i].text);
+          g_strlcpy (view->text, text, MAX_TEXT_LENGTH);
+          GST_TRACE ("@rentao set view[%d] text=%s", i, view->text);
         }
       } else if (g_strcmp0 (members[mi], "width") == 0) {
         json_reader_read_member (reader, "width");
         width = json_reader_get_int_value (reader);
         if (width > 0) {
-          self->priv->views[i].width = width;
-          GST_TRACE ("@rentao set view[%d] width=%d", i,
-              self->priv->views[i].width);
+          view->width = width;
+          GST_TRACE ("@rentao set view[%d] width=%d", i, view->width);
         }
       } else if (g_strcmp0 (members[mi], "height") == 0) {
         json_reader_read_member (reader, "height");
         height = json_reader_get_int_value (reader);
         if (height > 0) {
-          self->priv->views[i].height = height;
-          GST_TRACE ("@rentao set view[%d] height=%d", i,
-              self->priv->views[i].height);
+          view->height = height;
+          GST_TRACE ("@rentao set view[%d] height=%d", i, view->height);
         }
       } else if (g_strcmp0 (members[mi], "enable") == 0) {
         json_reader_read_member (reader, "enable");
         enable = json_reader_get_int_value (reader);
         if (enable == 0) {
-          if (self->priv->views[i].enable != 0)
+          if (view->enable != 0)
             show_hide_flag = 1;
-          self->priv->views[i].enable = 0;
-          GST_TRACE ("@rentao disable view[%d] with id=%d", i,
-              self->priv->views[i].id);
+          view->enable = 0;
+          GST_TRACE ("@rentao disable view[%d] with id=%d", i, view->id);
         } else {
-          if (self->priv->views[i].enable == 0)
+          if (view->enable == 0)
             show_hide_flag = 1;
-          self->priv->views[i].enable = 1;
+          view->enable = 1;
         }
       }
       json_reader_end_member (reader);
@@ -1042,6 +1741,7 @@ kms_style_composite_mixer_parse_style (KmsStyleCompositeMixer * self)
   GST_TRACE ("@rentao set views' count=%d, show_hide_flag=%d", count,
       show_hide_flag);
   if (show_hide_flag != 0) {
+    kms_style_composite_mixer_update_views (self);
     kms_style_composite_mixer_recalculate_sizes (self);
   }
   KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
@@ -1059,6 +1759,7 @@ kms_style_composite_mixer_handle_port (KmsBaseHub * mixer,
   KmsStyleCompositeMixer *self = KMS_STYLE_COMPOSITE_MIXER (mixer);
   KmsStyleCompositeMixerData *port_data;
   gint port_id;
+  GstPad *sink, *src;
 
   port_id = KMS_BASE_HUB_CLASS (G_OBJECT_CLASS
       (kms_style_composite_mixer_parent_class))->handle_port (mixer,
@@ -1072,10 +1773,17 @@ kms_style_composite_mixer_handle_port (KmsBaseHub * mixer,
   KMS_STYLE_COMPOSITE_MIXER_LOCK (self);
 
   if (self->priv->videomixer == NULL) {
-    self->priv->videomixer = gst_element_factory_make ("compositor", NULL);
+    if (self->priv->output_width <= 0) {
+      self->priv->output_width = 1280;
+      self->priv->output_height = 720;
+    }
+
+    // the compositor times the output itself, even before any input arrives.
+    self->priv->videomixer = gst_element_factory_make ("yuvcompositor", NULL);
     g_object_set (G_OBJECT (self->priv->videomixer), "background",
-        1 /*black */ , "start-time-selection", 1 /*first */ , "width",
-        self->priv->output_width, "height", self->priv->output_height, "frame-rate", self->priv->frame_rate, NULL);
+        1 /*black */ , "width", self->priv->output_width, "height",
+        self->priv->output_height, "frame-rate", self->priv->frame_rate,
+        "live", TRUE, NULL);
 
     // try to setup background image here, because the background image could be set before this compositor creates.
     kms_style_composite_mixer_setup_background_image (self);
@@ -1093,60 +1801,16 @@ kms_style_composite_mixer_handle_port (KmsBaseHub * mixer,
     gst_element_sync_state_with_parent (self->priv->episodeoverlay);
     gst_element_sync_state_with_parent (self->priv->mixer_video_agnostic);
 
-    if (self->priv->videotestsrc == NULL && 1) {
-      GstElement *capsfilter;
-      GstCaps *filtercaps;
-      GstPad *pad;
-      GstPadTemplate *sink_pad_template;
-      int pad_x = self->priv->pad_x, pad_y = self->priv->pad_y;
-
-      sink_pad_template =
-          gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS
-          (self->priv->videomixer), "sink_%u");
-
-      if (G_UNLIKELY (sink_pad_template == NULL)) {
-        GST_ERROR_OBJECT (self, "Error taking a new pad from videomixer");
-      }
-
-      self->priv->videotestsrc =
-          gst_element_factory_make ("videotestsrc", NULL);
-      g_object_set (self->priv->videotestsrc, "is-live", TRUE, "pattern",
-          /* black */ 2, NULL);
-
-      capsfilter = gst_element_factory_make ("capsfilter", NULL);
-      g_object_set (G_OBJECT (capsfilter), "caps-change-mode", 1, NULL);
+    /* new outputs ask the mixer, and so every input, for a keyframe */
+    sink = gst_element_get_static_pad (self->priv->mixer_video_agnostic,
+        "sink");
+    kms_keyframe_coalescer_add_probe (self->priv->coalescer, sink);
+    g_object_unref (sink);
 
-      if (self->priv->output_width <= 0) {
-        self->priv->output_width = 1280;
-        self->priv->output_height = 720;
-      }
-      filtercaps =
-          gst_caps_new_simple ("video/x-raw",
-          "width", G_TYPE_INT, 16,
-          "height", G_TYPE_INT, 16,
-          "framerate", GST_TYPE_FRACTION, self->priv->frame_rate, 1, NULL);
-      g_object_set (G_OBJECT (capsfilter), "caps", filtercaps, NULL);
-      gst_caps_unref (filtercaps);
-
-      gst_bin_add_many (GST_BIN (self), self->priv->videotestsrc,
-          capsfilter, NULL);
-      gst_element_link_many (self->priv->videotestsrc, capsfilter, NULL);
-
-      /*link capsfilter -> videomixer */
-      pad = gst_element_request_pad (self->priv->videomixer, sink_pad_template,
-          NULL, NULL);
-      gst_element_link_pads (capsfilter, NULL,
-          self->priv->videomixer, GST_OBJECT_NAME (pad));
-      g_object_set (pad, "xpos", 0, "ypos", 0, "alpha", 1.0, NULL);
-//      g_object_set (pad, "xpos", pad_x / 2, "ypos", pad_y / 2, "alpha", .6,
-//              NULL);
-      g_object_unref (pad);
-      GST_TRACE ("@rentao create videosrc w=%d, h=%d, x=%d, y=%d",
-          self->priv->output_width, self->priv->output_height, pad_x, pad_y);
-
-      gst_element_sync_state_with_parent (capsfilter);
-      gst_element_sync_state_with_parent (self->priv->videotestsrc);
-    }
+    src = gst_element_get_static_pad (self->priv->episodeoverlay, "src");
+    gst_pad_add_probe (src, GST_PAD_PROBE_TYPE_BUFFER,
+        kms_style_composite_mixer_output_probe, self, NULL);
+    g_object_unref (src);
 
     gst_element_link_many (self->priv->videomixer, self->priv->episodeoverlay,
         self->priv->mixer_video_agnostic, NULL);
@@ -1164,12 +1828,18 @@ kms_style_composite_mixer_handle_port (KmsBaseHub * mixer,
         G_CALLBACK (pad_removed_cb), self);
   }
   kms_base_hub_link_video_src (KMS_BASE_HUB (self), port_id,
-      self->priv->mixer_video_agnostic, "src_%u", TRUE);
+      kms_style_composite_mixer_get_output (self), "src_%u", TRUE);
 
   port_data = kms_style_composite_mixer_port_data_create (self, port_id);
   port_data->mixer_end_point = mixer_end_point;
   g_signal_connect (port_data->mixer_end_point, "release-requested-pad",
       G_CALLBACK (pad_release_request_cb), self);
+  port_data->view_id_handler =
+      g_signal_connect_data (port_data->mixer_end_point,
+      "notify::max-output-bitrate",
+      G_CALLBACK (kms_style_composite_mixer_view_id_changed),
+      KMS_STYLE_COMPOSITE_MIXER_REF (port_data),
+      (GClosureNotify) kms_ref_struct_unref, 0);
 
   g_hash_table_insert (self->priv->ports, create_gint (port_id), port_data);
 
@@ -1183,33 +1853,29 @@ static void
 kms_style_composite_mixer_dispose (GObject * object)
 {
   KmsStyleCompositeMixer *self = KMS_STYLE_COMPOSITE_MIXER (object);
+  GstElement *agnostic = NULL;
 
   KMS_STYLE_COMPOSITE_MIXER_LOCK (self);
   g_hash_table_remove_all (self->priv->ports);
+  if (self->priv->passthrough_port != NULL) {
+    agnostic = kms_style_composite_mixer_stop_passthrough (self);
+  }
+  kms_style_composite_mixer_clear_snapshot (self);
   KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
-  g_clear_object (&self->priv->loop);
-
-//  GST_TRACE ("@rentao, dispose, background=%s", self->priv->background_image);
-  G_OBJECT_CLASS (kms_style_composite_mixer_parent_class)->dispose (object);
-}
 
-static int
-delete_file (const char *fpath, const struct stat *sb, int typeflag,
-    struct FTW *ftwbuf)
-{
-  int rv = g_remove (fpath);
+  if (agnostic != NULL) {
+    gst_element_set_state (agnostic, GST_STATE_NULL);
+    gst_bin_remove (GST_BIN (self), agnostic);
+  }
 
-  if (rv) {
-    GST_WARNING ("Error deleting file: %s. %s", fpath, strerror (errno));
+  if (self->priv->pool != NULL) {
+    kms_port_branch_pool_clear (self->priv->pool);
   }
 
-  return rv;
-}
+  g_clear_object (&self->priv->loop);
 
-static void
-remove_recursive (const gchar * path)
-{
-  nftw (path, delete_file, 64, FTW_DEPTH | FTW_PHYS);
+//  GST_TRACE ("@rentao, dispose, background=%s", self->priv->background_image);
+  G_OBJECT_CLASS (kms_style_composite_mixer_parent_class)->dispose (object);
 }
 
 static void
@@ -1230,10 +1896,24 @@ kms_style_composite_mixer_finalize (GObject * object)
   if (self->priv->style != NULL)
     g_free (self->priv->style);
 
-  if (self->priv->dir_created) {
-    remove_recursive (self->priv->dir);
-    g_free (self->priv->dir);
+  if (self->priv->pool != NULL) {
+    kms_port_branch_pool_unref (self->priv->pool);
+    self->priv->pool = NULL;
+  }
+
+  if (self->priv->latency != NULL) {
+    kms_mixer_latency_unref (self->priv->latency);
+    self->priv->latency = NULL;
+  }
+
+  if (self->priv->coalescer != NULL) {
+    kms_keyframe_coalescer_unref (self->priv->coalescer);
+    self->priv->coalescer = NULL;
   }
+
+  g_array_free (self->priv->views, TRUE);
+  kms_style_layout_destroy (self->priv->layout);
+
 //  GST_TRACE ("@rentao, finalize, background=%s", self->priv->background_image);
   G_OBJECT_CLASS (kms_style_composite_mixer_parent_class)->finalize (object);
 }
@@ -1256,25 +1936,93 @@ kms_style_composite_mixer_get_property (GObject * object, guint property_id,
     }
     case PROP_STYLE:
     {
-      gchar style[2048];
+      GString *style;
+      guint i;
 
       // change this style format will affect StyleCompositeImpl.cpp function: bool setViewEnableStatus(int viewId, char enable)
-      g_snprintf (style, 2048,
-          "{'width':%d, 'height':%d, 'frame-rate':%d, 'pad-x':%d, 'pad-y':%d, 'line-weight':%d, 'font-desc':'%s', 'background':'%s', 'views':[{'id':%d, 'enable':%d, 'text':'%s'},{'id':%d, 'enable':%d, 'text':'%s'},{'id':%d, 'enable':%d, 'text':'%s'},{'id':%d, 'enable':%d, 'text':'%s'}]}",
+      style = g_string_sized_new (2048);
+      g_string_append_printf (style,
+          "{'width':%d, 'height':%d, 'frame-rate':%d, 'pad-x':%d, 'pad-y':%d, 'line-weight':%d, 'font-desc':'%s', 'background':'%s', 'layout':'%s', 'max-views':%u, 'detach-hidden':%d, 'passthrough':%d, 'views':[",
           self->priv->output_width, self->priv->output_height,
           self->priv->frame_rate,
           self->priv->pad_x, self->priv->pad_y, self->priv->line_weight,
           self->priv->font_desc, self->priv->background_image,
-          self->priv->views[0].id, self->priv->views[0].enable,
-          self->priv->views[0].text, self->priv->views[1].id,
-          self->priv->views[1].enable, self->priv->views[1].text,
-          self->priv->views[2].id, self->priv->views[2].enable,
-          self->priv->views[2].text, self->priv->views[3].id,
-          self->priv->views[3].enable, self->priv->views[3].text);
-      g_value_set_string (value, style);
-      GST_TRACE ("@rentao getStyle(%s)", style);
+          kms_style_layout_template_to_string (kms_style_layout_get_template
+              (self->priv->layout)), self->priv->max_views,
+          self->priv->detach_hidden, self->priv->passthrough_enabled);
+      for (i = 0; i < self->priv->views->len; i++) {
+        KmsConpositeViewPrivate *view =
+            &g_array_index (self->priv->views, KmsConpositeViewPrivate, i);
+
+        g_string_append_printf (style, "%s{'id':%d, 'enable':%d, 'text':'%s'}",
+            (i == 0) ? "" : ",", view->id, view->enable, view->text);
+      }
+      g_string_append (style, "]}");
+      g_value_take_string (value, g_string_free (style, FALSE));
+      GST_TRACE ("@rentao getStyle(%s)", g_value_get_string (value));
+      break;
+    }
+    case PROP_PORT_POOL_SIZE:
+      g_value_set_uint (value,
+          kms_port_branch_pool_get_size (self->priv->pool));
+      break;
+    case PROP_PORT_POOL_HITS:{
+      guint64 hits;
+
+      kms_port_branch_pool_get_stats (self->priv->pool, &hits, NULL);
+      g_value_set_uint64 (value, hits);
+      break;
+    }
+    case PROP_PORT_POOL_MISSES:{
+      guint64 misses;
+
+      kms_port_branch_pool_get_stats (self->priv->pool, NULL, &misses);
+      g_value_set_uint64 (value, misses);
+      break;
+    }
+    case PROP_ADAPTIVE_LATENCY:
+      g_value_set_boolean (value,
+          kms_mixer_latency_get_adaptive (self->priv->latency));
+      break;
+    case PROP_LATENCY_PERCENTILE:
+      g_value_set_uint (value,
+          kms_mixer_latency_get_percentile (self->priv->latency));
+      break;
+    case PROP_MIN_LATENCY:{
+      GstClockTime min;
+
+      kms_mixer_latency_get_range (self->priv->latency, &min, NULL);
+      g_value_set_uint (value, min / GST_MSECOND);
+      break;
+    }
+    case PROP_MAX_LATENCY:{
+      GstClockTime max;
+
+      kms_mixer_latency_get_range (self->priv->latency, NULL, &max);
+      g_value_set_uint (value, max / GST_MSECOND);
       break;
     }
+    case PROP_LATENCY:
+      g_value_set_uint (value,
+          kms_mixer_latency_get_current (self->priv->latency) / GST_MSECOND);
+      break;
+    case PROP_LATE_FRAMES:
+      g_value_set_uint64 (value,
+          kms_mixer_latency_get_late_frames (self->priv->latency));
+      break;
+    case PROP_KEYFRAME_REQUEST_INTERVAL:
+      g_value_set_uint (value,
+          kms_keyframe_coalescer_get_interval (self->priv->coalescer) /
+          GST_MSECOND);
+      break;
+    case PROP_KEYFRAME_REQUESTS_RECEIVED:
+      g_value_set_uint64 (value,
+          kms_keyframe_coalescer_get_received (self->priv->coalescer));
+      break;
+    case PROP_KEYFRAME_REQUESTS_FORWARDED:
+      g_value_set_uint64 (value,
+          kms_keyframe_coalescer_get_forwarded (self->priv->coalescer));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -1301,6 +2049,38 @@ kms_style_composite_mixer_set_property (GObject * object, guint prop_id,
       GST_TRACE ("@rentao setStyle(%s)", self->priv->style);
       kms_style_composite_mixer_parse_style (self);
       break;
+    case PROP_PORT_POOL_SIZE:
+      kms_port_branch_pool_set_size (self->priv->pool,
+          g_value_get_uint (value));
+      break;
+    case PROP_ADAPTIVE_LATENCY:
+      kms_mixer_latency_set_adaptive (self->priv->latency,
+          g_value_get_boolean (value));
+      break;
+    case PROP_LATENCY_PERCENTILE:
+      kms_mixer_latency_set_percentile (self->priv->latency,
+          g_value_get_uint (value));
+      break;
+    case PROP_MIN_LATENCY:{
+      GstClockTime max;
+
+      kms_mixer_latency_get_range (self->priv->latency, NULL, &max);
+      kms_mixer_latency_set_range (self->priv->latency,
+          g_value_get_uint (value) * GST_MSECOND, max);
+      break;
+    }
+    case PROP_MAX_LATENCY:{
+      GstClockTime min;
+
+      kms_mixer_latency_get_range (self->priv->latency, &min, NULL);
+      kms_mixer_latency_set_range (self->priv->latency, min,
+          g_value_get_uint (value) * GST_MSECOND);
+      break;
+    }
+    case PROP_KEYFRAME_REQUEST_INTERVAL:
+      kms_keyframe_coalescer_set_interval (self->priv->coalescer,
+          g_value_get_uint (value) * GST_MSECOND);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1318,6 +2098,154 @@ kms_style_composite_mixer_release_requested_pad_action (KmsElement * self,
   return TRUE;
 }
 
+static void
+kms_style_composite_mixer_snapshot_destroy (KmsStyleCompositeMixerSnapshot *
+    snapshot)
+{
+  g_weak_ref_clear (&snapshot->mixer);
+  g_free (snapshot->path);
+  g_slice_free (KmsStyleCompositeMixerSnapshot, snapshot);
+}
+
+static KmsStyleCompositeMixerSnapshot *
+kms_style_composite_mixer_snapshot_new (KmsStyleCompositeMixer * self,
+    gchar * path)
+{
+  KmsStyleCompositeMixerSnapshot *snapshot =
+      g_slice_new0 (KmsStyleCompositeMixerSnapshot);
+
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (snapshot),
+      (GDestroyNotify) kms_style_composite_mixer_snapshot_destroy);
+  g_weak_ref_init (&snapshot->mixer, self);
+  snapshot->path = path;
+  snapshot->state = SNAPSHOT_PENDING;
+
+  return snapshot;
+}
+
+static void
+kms_style_composite_mixer_snapshot_done (const gchar * path, gboolean written,
+    KmsStyleCompositeMixerSnapshot * snapshot)
+{
+  KmsStyleCompositeMixer *self = g_weak_ref_get (&snapshot->mixer);
+
+  if (self == NULL)
+    return;
+
+  if (!written) {
+    GST_WARNING_OBJECT (self, "Snapshot %s could not be taken", path);
+  }
+
+  g_signal_emit (self, obj_signals[SIGNAL_SNAPSHOT_DONE], 0, path, written);
+  g_object_unref (self);
+}
+
+/* Runs in the streaming thread, it never takes the mixer lock */
+static GstPadProbeReturn
+kms_style_composite_mixer_snapshot_probe (GstPad * pad, GstPadProbeInfo * info,
+    KmsStyleCompositeMixerSnapshot * snapshot)
+{
+  GstCaps *caps = gst_pad_get_current_caps (pad);
+
+  // not negotiated yet, wait for the next frame.
+  if (caps == NULL)
+    return GST_PAD_PROBE_OK;
+
+  if (!g_atomic_int_compare_and_exchange (&snapshot->state, SNAPSHOT_PENDING,
+          SNAPSHOT_TAKEN)) {
+    gst_caps_unref (caps);
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  if (!kms_snapshot_submit_full (snapshot->path,
+          GST_PAD_PROBE_INFO_BUFFER (info), caps,
+          (KmsSnapshotDoneFunc) kms_style_composite_mixer_snapshot_done,
+          kms_ref_struct_ref (KMS_REF_STRUCT_CAST (snapshot)),
+          (GDestroyNotify) kms_ref_struct_unref)) {
+    kms_style_composite_mixer_snapshot_done (snapshot->path, FALSE, snapshot);
+  }
+
+  gst_caps_unref (caps);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+/* Must be called with the lock held. Forgets the last snapshot, removing */
+/* its probe when no frame was captured yet. */
+static void
+kms_style_composite_mixer_clear_snapshot (KmsStyleCompositeMixer * self)
+{
+  KmsStyleCompositeMixerSnapshot *snapshot = self->priv->snapshot;
+
+  if (snapshot == NULL)
+    return;
+
+  if (g_atomic_int_compare_and_exchange (&snapshot->state, SNAPSHOT_PENDING,
+          SNAPSHOT_CANCELLED)) {
+    GST_DEBUG_OBJECT (self, "Cancelling snapshot %s", snapshot->path);
+    gst_pad_remove_probe (self->priv->snapshot_pad,
+        self->priv->snapshot_probe_id);
+  }
+
+  g_clear_object (&self->priv->snapshot_pad);
+  self->priv->snapshot_probe_id = 0;
+  self->priv->snapshot = NULL;
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (snapshot));
+}
+
+/* Returns the path of the next composed frame, its outcome is reported */
+/* by snapshot-done. Only one snapshot can wait for a frame at a time. */
+static gchar *
+kms_style_composite_mixer_take_snapshot_action (KmsStyleCompositeMixer * self)
+{
+  KmsStyleCompositeMixerSnapshot *snapshot;
+  GstElement *source;
+  gchar *owner, *path = NULL;
+
+  KMS_STYLE_COMPOSITE_MIXER_LOCK (self);
+
+  if (self->priv->snapshot != NULL
+      && g_atomic_int_get (&self->priv->snapshot->state) ==
+      SNAPSHOT_PENDING) {
+    GST_WARNING_OBJECT (self, "Previous snapshot %s still waiting for a frame",
+        self->priv->snapshot->path);
+    goto end;
+  }
+
+  // the composed frame, with its decorations, before being encoded.
+  source = self->priv->episodeoverlay != NULL ?
+      self->priv->episodeoverlay : self->priv->videomixer;
+  if (source == NULL) {
+    GST_WARNING_OBJECT (self, "No video composed yet, cannot take snapshot");
+    goto end;
+  }
+
+  owner = g_strdup_printf ("%s-api", GST_OBJECT_NAME (self));
+  path = kms_snapshot_reserve (owner, KMS_SNAPSHOT_ON_DEMAND_INTERVAL);
+  g_free (owner);
+
+  if (path == NULL) {
+    GST_WARNING_OBJECT (self, "Snapshot rate limited");
+    goto end;
+  }
+
+  kms_style_composite_mixer_clear_snapshot (self);
+
+  snapshot = kms_style_composite_mixer_snapshot_new (self, g_strdup (path));
+  self->priv->snapshot = snapshot;
+  self->priv->snapshot_pad = gst_element_get_static_pad (source, "src");
+  self->priv->snapshot_probe_id =
+      gst_pad_add_probe (self->priv->snapshot_pad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) kms_style_composite_mixer_snapshot_probe,
+      kms_ref_struct_ref (KMS_REF_STRUCT_CAST (snapshot)),
+      (GDestroyNotify) kms_ref_struct_unref);
+
+end:
+  KMS_STYLE_COMPOSITE_MIXER_UNLOCK (self);
+
+  return path;
+}
+
 static void
 kms_style_composite_mixer_class_init (KmsStyleCompositeMixerClass * klass)
 {
@@ -1347,6 +2275,22 @@ kms_style_composite_mixer_class_init (KmsStyleCompositeMixerClass * klass)
       GST_DEBUG_FUNCPTR
       (kms_style_composite_mixer_release_requested_pad_action);
 
+  g_signal_new ("take-snapshot",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_ACTION | G_SIGNAL_RUN_LAST,
+      G_STRUCT_OFFSET (KmsStyleCompositeMixerClass, take_snapshot),
+      NULL, NULL, NULL, G_TYPE_STRING, 0);
+  klass->take_snapshot =
+      GST_DEBUG_FUNCPTR (kms_style_composite_mixer_take_snapshot_action);
+
+  /* Once per path returned by take-snapshot, from a streaming or worker */
+  /* thread, unless the mixer is disposed before a frame is captured */
+  obj_signals[SIGNAL_SNAPSHOT_DONE] =
+      g_signal_new ("snapshot-done",
+      G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL, G_TYPE_NONE, 2, G_TYPE_STRING,
+      G_TYPE_BOOLEAN);
+
   base_hub_class->handle_port =
       GST_DEBUG_FUNCPTR (kms_style_composite_mixer_handle_port);
   base_hub_class->unhandle_port =
@@ -1374,6 +2318,79 @@ kms_style_composite_mixer_class_init (KmsStyleCompositeMixerClass * klass)
           "Style description(schema like ice candidate)",
           DEFAULT_STYLE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_PORT_POOL_SIZE,
+      g_param_spec_uint ("port-pool-size", "Port pool size",
+          "Port video branches kept built and running for new ports",
+          0, G_MAXUINT, DEFAULT_PORT_POOL_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PORT_POOL_HITS,
+      g_param_spec_uint64 ("port-pool-hits", "Port pool hits",
+          "New ports that took a branch from the pool",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PORT_POOL_MISSES,
+      g_param_spec_uint64 ("port-pool-misses", "Port pool misses",
+          "New ports that had to build their branch",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADAPTIVE_LATENCY,
+      g_param_spec_boolean ("adaptive-latency", "Adaptive latency",
+          "Follow the measured skew between inputs instead of a fixed latency",
+          DEFAULT_ADAPTIVE_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY_PERCENTILE,
+      g_param_spec_uint ("latency-percentile", "Latency percentile",
+          "Percentile of the input skews covered by the adaptive latency",
+          1, 100, DEFAULT_LATENCY_PERCENTILE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MIN_LATENCY,
+      g_param_spec_uint ("min-latency", "Minimum latency",
+          "Lower bound of the adaptive latency (ms)",
+          0, G_MAXUINT, DEFAULT_MIN_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_LATENCY,
+      g_param_spec_uint ("max-latency", "Maximum latency",
+          "Upper bound of the adaptive latency (ms)",
+          0, G_MAXUINT, LATENCY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATENCY,
+      g_param_spec_uint ("latency", "Latency",
+          "Latency in use to wait for the inputs (ms)",
+          0, G_MAXUINT, LATENCY, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_LATE_FRAMES,
+      g_param_spec_uint64 ("late-frames", "Late frames",
+          "Input buffers whose skew behind the earliest input exceeded the "
+          "latency in use, not the ones the compositor actually dropped",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_REQUEST_INTERVAL,
+      g_param_spec_uint ("keyframe-request-interval",
+          "Keyframe request interval",
+          "Minimum time (ms) between two keyframe requests sent to the "
+          "inputs, the ones received in between are merged",
+          0, G_MAXUINT, DEFAULT_KEYFRAME_REQUEST_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_REQUESTS_RECEIVED,
+      g_param_spec_uint64 ("keyframe-requests-received",
+          "Keyframe requests received",
+          "Keyframe requests received from the outputs",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class,
+      PROP_KEYFRAME_REQUESTS_FORWARDED,
+      g_param_spec_uint64 ("keyframe-requests-forwarded",
+          "Keyframe requests forwarded",
+          "Keyframe requests sent to the inputs",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
   /* Registers a private structure for the instantiatable type */
   g_type_class_add_private (klass, sizeof (KmsStyleCompositeMixerPrivate));
 }
@@ -1381,7 +2398,8 @@ kms_style_composite_mixer_class_init (KmsStyleCompositeMixerClass * klass)
 static void
 kms_style_composite_mixer_init (KmsStyleCompositeMixer * self)
 {
-  int i;
+  GWeakRef *ref;
+  GstCaps *caps;
 
   self->priv = KMS_STYLE_COMPOSITE_MIXER_GET_PRIVATE (self);
 
@@ -1391,7 +2409,6 @@ kms_style_composite_mixer_init (KmsStyleCompositeMixer * self)
       release_gint, kms_style_composite_mixer_port_data_destroy);
   self->priv->videomixer = NULL;
   self->priv->audiomixer = NULL;
-  self->priv->videotestsrc = NULL;
   self->priv->mixer_audio_agnostic = NULL;
   self->priv->mixer_video_agnostic = NULL;
   self->priv->background_image = NULL;
@@ -1404,17 +2421,32 @@ kms_style_composite_mixer_init (KmsStyleCompositeMixer * self)
   self->priv->pad_y = -1;
   self->priv->line_weight = 2;
   self->priv->n_elems = 0;
-  for (i = 0; i < MAX_VIEW_COUNT; i++) {
-    self->priv->views[i].id = -1;
-    self->priv->views[i].enable = 1;
-    self->priv->views[i].width = -1;
-    self->priv->views[i].height = -1;
-  }
+  self->priv->views =
+      g_array_new (FALSE, TRUE, sizeof (KmsConpositeViewPrivate));
+  kms_style_composite_mixer_add_views (self, DEFAULT_VIEW_COUNT);
+  self->priv->max_views = DEFAULT_VIEW_COUNT;
+  self->priv->layout = kms_style_layout_new ();
+  kms_style_composite_mixer_update_views (self);
   g_strlcpy (self->priv->font_desc, "sans bold 16", 64);
-  self->priv->dir_created = FALSE;
-  self->priv->dir = NULL;
 
   self->priv->loop = kms_loop_new ();
+  /* inputs are decoded for the compositor, the hub takes encoded video too */
+  /* to forward it on passthrough */
+  caps = gst_caps_from_string (KMS_AGNOSTIC_RAW_VIDEO_CAPS);
+  self->priv->pool = kms_port_branch_pool_new (GST_BIN (self),
+      self->priv->loop, caps, DEFAULT_PORT_POOL_SIZE);
+  gst_caps_unref (caps);
+
+  ref = g_slice_new (GWeakRef);
+  g_weak_ref_init (ref, self);
+  self->priv->latency = kms_mixer_latency_new (LATENCY * GST_MSECOND,
+      (KmsMixerLatencyFunc) kms_style_composite_mixer_latency_changed, ref,
+      (GDestroyNotify) free_weak_ref);
+  kms_mixer_latency_set_range (self->priv->latency,
+      DEFAULT_MIN_LATENCY * GST_MSECOND, LATENCY * GST_MSECOND);
+
+  self->priv->coalescer = kms_keyframe_coalescer_new (self->priv->loop,
+      DEFAULT_KEYFRAME_REQUEST_INTERVAL * GST_MSECOND);
 }
 
 gboolean
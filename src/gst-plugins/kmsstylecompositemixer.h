@@ -71,6 +71,7 @@ struct _KmsStyleCompositeMixerClass
 
   /* actions */
   gboolean (*release_requested_pad) (KmsElement *self, const gchar *pad_name);
+  gchar *(*take_snapshot) (KmsStyleCompositeMixer *self);
 };
 
 GType kms_style_composite_mixer_get_type (void);
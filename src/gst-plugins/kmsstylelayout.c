@@ -0,0 +1,516 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsstylelayout.h"
+
+/* height of the bottom strip in spotlight layout, in parts of the content */
+#define SPOTLIGHT_STRIP_PARTS 4
+
+typedef struct _KmsStyleLayoutEntry
+{
+  gpointer item;
+  gint view_id;
+  guint64 seq;
+  gint slot;                    /* -1 while hidden */
+  GList *waiting_link;          /* link in layout->waiting, if any */
+  gboolean visible;             /* visibility at the last commit */
+  gboolean hide_pending;
+  KmsStyleLayoutRect rect;      /* geometry at the last commit */
+} KmsStyleLayoutEntry;
+
+struct _KmsStyleLayout
+{
+  KmsStyleLayoutTemplate tmpl;
+  gint width, height, pad_x, pad_y, line_weight;
+
+  GArray *views;                /* KmsStyleLayoutView, indexed by slot */
+  GHashTable *view_slots;       /* view id -> reserved slot */
+  GPtrArray *slots;             /* slot -> KmsStyleLayoutEntry or NULL */
+  guint n_visible;
+
+  GHashTable *entries;          /* item -> KmsStyleLayoutEntry */
+  GQueue *waiting;              /* entries waiting for a free slot */
+  GPtrArray *hidden;            /* entries hidden since the last commit */
+  GArray *rects;                /* scratch geometry, one per visible slot */
+  guint64 seq;
+};
+
+static const gchar *template_names[] = {
+  "filmstrip",
+  "grid",
+  "spotlight"
+};
+
+gboolean
+kms_style_layout_template_from_string (const gchar * name,
+    KmsStyleLayoutTemplate * tmpl)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (template_names); i++) {
+    if (g_strcmp0 (name, template_names[i]) == 0) {
+      *tmpl = (KmsStyleLayoutTemplate) i;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+const gchar *
+kms_style_layout_template_to_string (KmsStyleLayoutTemplate tmpl)
+{
+  if ((guint) tmpl >= G_N_ELEMENTS (template_names))
+    return NULL;
+
+  return template_names[tmpl];
+}
+
+static void
+kms_style_layout_mark_hidden (KmsStyleLayout * layout,
+    KmsStyleLayoutEntry * entry)
+{
+  if (entry->visible && !entry->hide_pending) {
+    entry->hide_pending = TRUE;
+    g_ptr_array_add (layout->hidden, entry);
+  }
+}
+
+static void
+kms_style_layout_assign (KmsStyleLayout * layout, KmsStyleLayoutEntry * entry,
+    gint slot)
+{
+  g_ptr_array_index (layout->slots, slot) = entry;
+  entry->slot = slot;
+  layout->n_visible++;
+}
+
+static void
+kms_style_layout_unassign (KmsStyleLayout * layout,
+    KmsStyleLayoutEntry * entry)
+{
+  g_ptr_array_index (layout->slots, entry->slot) = NULL;
+  entry->slot = -1;
+  layout->n_visible--;
+  kms_style_layout_mark_hidden (layout, entry);
+}
+
+static void
+kms_style_layout_place_unbound (KmsStyleLayout * layout,
+    KmsStyleLayoutEntry * entry)
+{
+  guint i;
+
+  for (i = 0; i < layout->slots->len; i++) {
+    if (g_ptr_array_index (layout->slots, i) == NULL) {
+      kms_style_layout_assign (layout, entry, i);
+      return;
+    }
+  }
+
+  g_queue_push_tail (layout->waiting, entry);
+  entry->waiting_link = g_queue_peek_tail_link (layout->waiting);
+  kms_style_layout_mark_hidden (layout, entry);
+}
+
+static void
+kms_style_layout_place (KmsStyleLayout * layout, KmsStyleLayoutEntry * entry)
+{
+  KmsStyleLayoutEntry *occupant;
+  gpointer value;
+  gint slot;
+
+  if (!g_hash_table_lookup_extended (layout->view_slots,
+          GINT_TO_POINTER (entry->view_id), NULL, &value)) {
+    kms_style_layout_place_unbound (layout, entry);
+    return;
+  }
+
+  slot = GPOINTER_TO_INT (value);
+
+  if (!g_array_index (layout->views, KmsStyleLayoutView, slot).enabled) {
+    /* items bound to a disabled view stay hidden until it is enabled */
+    kms_style_layout_mark_hidden (layout, entry);
+    return;
+  }
+
+  occupant = g_ptr_array_index (layout->slots, slot);
+
+  if (occupant == NULL) {
+    kms_style_layout_assign (layout, entry, slot);
+  } else if (occupant->view_id != entry->view_id) {
+    /* the slot was lent to an unbound item, take it back */
+    kms_style_layout_unassign (layout, occupant);
+    kms_style_layout_assign (layout, entry, slot);
+    kms_style_layout_place_unbound (layout, occupant);
+  } else {
+    /* another item already owns this view id */
+    kms_style_layout_place_unbound (layout, entry);
+  }
+}
+
+static void
+kms_style_layout_detach (KmsStyleLayout * layout, KmsStyleLayoutEntry * entry)
+{
+  gint slot = entry->slot;
+  KmsStyleLayoutEntry *next;
+
+  if (entry->waiting_link != NULL) {
+    g_queue_delete_link (layout->waiting, entry->waiting_link);
+    entry->waiting_link = NULL;
+  }
+
+  if (slot < 0)
+    return;
+
+  kms_style_layout_unassign (layout, entry);
+
+  /* hand the free slot to the oldest waiting item */
+  next = g_queue_pop_head (layout->waiting);
+  if (next != NULL) {
+    next->waiting_link = NULL;
+    kms_style_layout_assign (layout, next, slot);
+  }
+}
+
+static gint
+compare_entry_seq (gconstpointer a, gconstpointer b)
+{
+  const KmsStyleLayoutEntry *entry_a = *(KmsStyleLayoutEntry **) a;
+  const KmsStyleLayoutEntry *entry_b = *(KmsStyleLayoutEntry **) b;
+
+  return (entry_a->seq > entry_b->seq) - (entry_a->seq < entry_b->seq);
+}
+
+static void
+kms_style_layout_remap (KmsStyleLayout * layout)
+{
+  GHashTableIter iter;
+  GPtrArray *entries;
+  gpointer value;
+  guint i;
+
+  entries = g_ptr_array_sized_new (g_hash_table_size (layout->entries));
+
+  g_hash_table_iter_init (&iter, layout->entries);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    KmsStyleLayoutEntry *entry = value;
+
+    if (entry->slot >= 0) {
+      entry->slot = -1;
+      kms_style_layout_mark_hidden (layout, entry);
+    }
+    entry->waiting_link = NULL;
+    g_ptr_array_add (entries, entry);
+  }
+
+  g_queue_clear (layout->waiting);
+  for (i = 0; i < layout->slots->len; i++) {
+    g_ptr_array_index (layout->slots, i) = NULL;
+  }
+  layout->n_visible = 0;
+
+  /* keep joining order so that a remap is deterministic */
+  g_ptr_array_sort (entries, compare_entry_seq);
+  for (i = 0; i < entries->len; i++) {
+    kms_style_layout_place (layout, g_ptr_array_index (entries, i));
+  }
+
+  g_ptr_array_free (entries, TRUE);
+}
+
+KmsStyleLayout *
+kms_style_layout_new (void)
+{
+  KmsStyleLayout *layout = g_slice_new0 (KmsStyleLayout);
+
+  layout->tmpl = KMS_STYLE_LAYOUT_FILMSTRIP;
+  layout->views = g_array_new (FALSE, TRUE, sizeof (KmsStyleLayoutView));
+  layout->view_slots = g_hash_table_new (g_direct_hash, g_direct_equal);
+  layout->slots = g_ptr_array_new ();
+  layout->entries = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+      NULL, g_free);
+  layout->waiting = g_queue_new ();
+  layout->hidden = g_ptr_array_new ();
+  layout->rects = g_array_new (FALSE, TRUE, sizeof (KmsStyleLayoutRect));
+
+  return layout;
+}
+
+void
+kms_style_layout_destroy (KmsStyleLayout * layout)
+{
+  g_array_free (layout->rects, TRUE);
+  g_ptr_array_free (layout->hidden, TRUE);
+  g_queue_free (layout->waiting);
+  g_hash_table_unref (layout->entries);
+  g_ptr_array_free (layout->slots, TRUE);
+  g_hash_table_unref (layout->view_slots);
+  g_array_free (layout->views, TRUE);
+
+  g_slice_free (KmsStyleLayout, layout);
+}
+
+void
+kms_style_layout_set_template (KmsStyleLayout * layout,
+    KmsStyleLayoutTemplate tmpl)
+{
+  layout->tmpl = tmpl;
+}
+
+KmsStyleLayoutTemplate
+kms_style_layout_get_template (KmsStyleLayout * layout)
+{
+  return layout->tmpl;
+}
+
+void
+kms_style_layout_set_area (KmsStyleLayout * layout, gint width, gint height,
+    gint pad_x, gint pad_y, gint line_weight)
+{
+  layout->width = MAX (width, 1);
+  layout->height = MAX (height, 1);
+  layout->pad_x = CLAMP (pad_x, 0, layout->width - 1);
+  layout->pad_y = CLAMP (pad_y, 0, layout->height - 1);
+  layout->line_weight = MAX (line_weight, 0);
+}
+
+void
+kms_style_layout_set_views (KmsStyleLayout * layout,
+    const KmsStyleLayoutView * views, guint n_views, guint max_views)
+{
+  guint n_slots = MIN (n_views, max_views);
+  guint i;
+
+  g_array_set_size (layout->views, 0);
+  g_array_append_vals (layout->views, views, n_views);
+
+  g_hash_table_remove_all (layout->view_slots);
+  for (i = 0; i < n_slots; i++) {
+    /* first view wins when several share the same id */
+    if (views[i].id >= 0 && !g_hash_table_contains (layout->view_slots,
+            GINT_TO_POINTER (views[i].id))) {
+      g_hash_table_insert (layout->view_slots, GINT_TO_POINTER (views[i].id),
+          GINT_TO_POINTER (i));
+    }
+  }
+
+  g_ptr_array_set_size (layout->slots, n_slots);
+
+  kms_style_layout_remap (layout);
+}
+
+void
+kms_style_layout_add (KmsStyleLayout * layout, gpointer item, gint view_id)
+{
+  KmsStyleLayoutEntry *entry;
+
+  if (g_hash_table_contains (layout->entries, item)) {
+    kms_style_layout_update (layout, item, view_id);
+    return;
+  }
+
+  entry = g_new0 (KmsStyleLayoutEntry, 1);
+  entry->item = item;
+  entry->view_id = view_id;
+  entry->seq = layout->seq++;
+  entry->slot = -1;
+
+  g_hash_table_insert (layout->entries, item, entry);
+  kms_style_layout_place (layout, entry);
+}
+
+gboolean
+kms_style_layout_update (KmsStyleLayout * layout, gpointer item, gint view_id)
+{
+  KmsStyleLayoutEntry *entry;
+
+  entry = g_hash_table_lookup (layout->entries, item);
+  if (entry == NULL || entry->view_id == view_id)
+    return FALSE;
+
+  kms_style_layout_detach (layout, entry);
+  entry->view_id = view_id;
+  kms_style_layout_place (layout, entry);
+
+  return TRUE;
+}
+
+gboolean
+kms_style_layout_remove (KmsStyleLayout * layout, gpointer item)
+{
+  KmsStyleLayoutEntry *entry;
+
+  entry = g_hash_table_lookup (layout->entries, item);
+  if (entry == NULL)
+    return FALSE;
+
+  kms_style_layout_detach (layout, entry);
+
+  if (entry->hide_pending)
+    g_ptr_array_remove_fast (layout->hidden, entry);
+
+  g_hash_table_remove (layout->entries, item);
+
+  return TRUE;
+}
+
+guint
+kms_style_layout_get_n_visible (KmsStyleLayout * layout)
+{
+  return layout->n_visible;
+}
+
+static void
+kms_style_layout_tile (KmsStyleLayout * layout,
+    const KmsStyleLayoutRect * area, guint cols, guint rows, guint count,
+    KmsStyleLayoutRect * rects)
+{
+  gint line_weight = layout->line_weight;
+  gint b_width, b_height, left, top, shift = 0;
+  guint i, last_row_count;
+
+  b_width = MAX ((area->width - line_weight) / (gint) cols, line_weight + 1);
+  b_height = MAX ((area->height - line_weight) / (gint) rows, line_weight + 1);
+
+  /* center the tiles, the remainder includes the trailing line */
+  left = area->x + (area->width - b_width * (gint) cols + line_weight) / 2;
+  top = area->y + (area->height - b_height * (gint) rows + line_weight) / 2;
+
+  last_row_count = count - cols * (rows - 1);
+
+  for (i = 0; i < count; i++) {
+    guint row = i / cols, col = i % cols;
+
+    if (row == rows - 1)
+      shift = (cols - last_row_count) * b_width / 2;
+
+    rects[i].x = left + shift + b_width * col;
+    rects[i].y = top + b_height * row;
+    rects[i].width = b_width - line_weight;
+    rects[i].height = b_height - line_weight;
+  }
+}
+
+static void
+kms_style_layout_compute (KmsStyleLayout * layout, KmsStyleLayoutRect * rects)
+{
+  KmsStyleLayoutRect area;
+  guint n = layout->n_visible, cols;
+
+  if (n == 0)
+    return;
+
+  if (n == 1) {
+    /* only one view, show it full screen */
+    rects[0].x = 0;
+    rects[0].y = 0;
+    rects[0].width = layout->width;
+    rects[0].height = layout->height;
+    return;
+  }
+
+  area.x = layout->pad_x / 2;
+  area.y = layout->pad_y / 2;
+  area.width = layout->width - layout->pad_x;
+  area.height = layout->height - layout->pad_y;
+
+  switch (layout->tmpl) {
+    case KMS_STYLE_LAYOUT_GRID:
+      cols = 1;
+      while (cols * cols < n)
+        cols++;
+      kms_style_layout_tile (layout, &area, cols, (n + cols - 1) / cols, n,
+          rects);
+      break;
+    case KMS_STYLE_LAYOUT_SPOTLIGHT:{
+      KmsStyleLayoutRect strip = area;
+
+      strip.height = area.height / SPOTLIGHT_STRIP_PARTS;
+      strip.y = area.y + area.height - strip.height;
+      area.height -= strip.height;
+
+      kms_style_layout_tile (layout, &area, 1, 1, 1, rects);
+      kms_style_layout_tile (layout, &strip, n - 1, 1, n - 1, rects + 1);
+      break;
+    }
+    case KMS_STYLE_LAYOUT_FILMSTRIP:
+    default:
+      kms_style_layout_tile (layout, &area, n, 1, n, rects);
+      break;
+  }
+}
+
+static gboolean
+rect_equal (const KmsStyleLayoutRect * a, const KmsStyleLayoutRect * b)
+{
+  return a->x == b->x && a->y == b->y && a->width == b->width &&
+      a->height == b->height;
+}
+
+void
+kms_style_layout_commit (KmsStyleLayout * layout, KmsStyleLayoutFunc func,
+    gpointer user_data)
+{
+  KmsStyleLayoutRect *rects;
+  guint i, n = 0;
+
+  for (i = 0; i < layout->hidden->len; i++) {
+    KmsStyleLayoutEntry *entry = g_ptr_array_index (layout->hidden, i);
+
+    entry->hide_pending = FALSE;
+    if (entry->slot < 0 && entry->visible) {
+      entry->visible = FALSE;
+      func (entry->item, -1, NULL, user_data);
+    }
+  }
+  g_ptr_array_set_size (layout->hidden, 0);
+
+  g_array_set_size (layout->rects, layout->n_visible);
+  rects = (KmsStyleLayoutRect *) layout->rects->data;
+  kms_style_layout_compute (layout, rects);
+
+  /* only the visible slots are visited, hidden items are not touched */
+  for (i = 0; i < layout->slots->len; i++) {
+    KmsStyleLayoutEntry *entry = g_ptr_array_index (layout->slots, i);
+
+    if (entry == NULL)
+      continue;
+
+    if (!entry->visible || !rect_equal (&entry->rect, &rects[n])) {
+      entry->visible = TRUE;
+      entry->rect = rects[n];
+      func (entry->item, i, &entry->rect, user_data);
+    }
+    n++;
+  }
+}
+
+void
+kms_style_layout_foreach_visible (KmsStyleLayout * layout,
+    KmsStyleLayoutFunc func, gpointer user_data)
+{
+  guint i;
+
+  for (i = 0; i < layout->slots->len; i++) {
+    KmsStyleLayoutEntry *entry = g_ptr_array_index (layout->slots, i);
+
+    if (entry != NULL && entry->visible)
+      func (entry->item, i, &entry->rect, user_data);
+  }
+}
@@ -0,0 +1,87 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_STYLE_LAYOUT_H_
+#define _KMS_STYLE_LAYOUT_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  KMS_STYLE_LAYOUT_FILMSTRIP,
+  KMS_STYLE_LAYOUT_GRID,
+  KMS_STYLE_LAYOUT_SPOTLIGHT
+} KmsStyleLayoutTemplate;
+
+typedef struct _KmsStyleLayoutRect
+{
+  gint x;
+  gint y;
+  gint width;
+  gint height;
+} KmsStyleLayoutRect;
+
+typedef struct _KmsStyleLayoutView
+{
+  gint id;
+  gboolean enabled;
+} KmsStyleLayoutView;
+
+typedef struct _KmsStyleLayout KmsStyleLayout;
+
+/* rect is NULL when the item has just been hidden */
+typedef void (*KmsStyleLayoutFunc) (gpointer item, gint slot,
+    const KmsStyleLayoutRect * rect, gpointer user_data);
+
+KmsStyleLayout *kms_style_layout_new (void);
+void kms_style_layout_destroy (KmsStyleLayout * layout);
+
+gboolean kms_style_layout_template_from_string (const gchar * name,
+    KmsStyleLayoutTemplate * tmpl);
+const gchar *kms_style_layout_template_to_string (KmsStyleLayoutTemplate tmpl);
+
+void kms_style_layout_set_template (KmsStyleLayout * layout,
+    KmsStyleLayoutTemplate tmpl);
+KmsStyleLayoutTemplate kms_style_layout_get_template (KmsStyleLayout * layout);
+
+void kms_style_layout_set_area (KmsStyleLayout * layout, gint width,
+    gint height, gint pad_x, gint pad_y, gint line_weight);
+
+/* Replaces the configured views and remaps every item. Slot i is reserved
+ * for views[i]; max_views bounds the number of visible items, views past it
+ * get no slot and their items are placed as unbound ones. */
+void kms_style_layout_set_views (KmsStyleLayout * layout,
+    const KmsStyleLayoutView * views, guint n_views, guint max_views);
+
+void kms_style_layout_add (KmsStyleLayout * layout, gpointer item,
+    gint view_id);
+gboolean kms_style_layout_update (KmsStyleLayout * layout, gpointer item,
+    gint view_id);
+gboolean kms_style_layout_remove (KmsStyleLayout * layout, gpointer item);
+
+guint kms_style_layout_get_n_visible (KmsStyleLayout * layout);
+
+/* Calls func once per item whose geometry or visibility changed since the
+ * previous commit. Hidden items are reported before the visible ones. */
+void kms_style_layout_commit (KmsStyleLayout * layout, KmsStyleLayoutFunc func,
+    gpointer user_data);
+
+/* Iterates the visible items in slot order with their committed geometry */
+void kms_style_layout_foreach_visible (KmsStyleLayout * layout,
+    KmsStyleLayoutFunc func, gpointer user_data);
+
+G_END_DECLS
+#endif /* _KMS_STYLE_LAYOUT_H_ */
@@ -0,0 +1,72 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmsstylescene.h"
+
+static volatile gint last_version = 0;
+
+static gpointer
+kms_style_scene_copy (gpointer scene)
+{
+  return kms_style_scene_ref (scene);
+}
+
+static void
+kms_style_scene_free (gpointer scene)
+{
+  kms_style_scene_unref (scene);
+}
+
+G_DEFINE_BOXED_TYPE (KmsStyleScene, kms_style_scene, kms_style_scene_copy,
+    kms_style_scene_free);
+
+static void
+kms_style_scene_destroy (KmsStyleScene * scene)
+{
+  guint i;
+
+  for (i = 0; i < scene->n_views; i++) {
+    g_free (scene->views[i].text);
+  }
+
+  g_free (scene->views);
+  g_free (scene->font_desc);
+
+  g_slice_free (KmsStyleScene, scene);
+}
+
+KmsStyleScene *
+kms_style_scene_new (gint width, gint height, gint enable,
+    const gchar * font_desc, guint n_views)
+{
+  KmsStyleScene *scene;
+
+  scene = g_slice_new0 (KmsStyleScene);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (scene),
+      (GDestroyNotify) kms_style_scene_destroy);
+
+  scene->version = (guint) g_atomic_int_add (&last_version, 1) + 1;
+  scene->width = width;
+  scene->height = height;
+  scene->enable = enable;
+  scene->font_desc = g_strdup (font_desc);
+  scene->n_views = n_views;
+  scene->views = g_new0 (KmsStyleSceneView, n_views);
+
+  return scene;
+}
@@ -0,0 +1,68 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_STYLE_SCENE_H_
+#define _KMS_STYLE_SCENE_H_
+
+#include <glib-object.h>
+#include <commons/kmsrefstruct.h>
+
+G_BEGIN_DECLS
+
+#define KMS_TYPE_STYLE_SCENE (kms_style_scene_get_type ())
+
+/* overlay enable modes */
+#define KMS_STYLE_SCENE_DISABLED 0
+#define KMS_STYLE_SCENE_ENABLED 1
+#define KMS_STYLE_SCENE_BACKGROUND_ONLY 2
+
+typedef struct _KmsStyleSceneView
+{
+  gint x;
+  gint y;
+  gint width;
+  gint height;
+  gchar *text;
+} KmsStyleSceneView;
+
+/* Immutable snapshot of the composite layout shared between */
+/* stylecompositemixer and episodeoverlay. A newer scene always has a */
+/* greater version. */
+typedef struct _KmsStyleScene
+{
+  KmsRefStruct ref;
+
+  guint version;
+  gint width;
+  gint height;
+  gint enable;
+  gchar *font_desc;
+  guint n_views;
+  KmsStyleSceneView *views;
+} KmsStyleScene;
+
+GType kms_style_scene_get_type (void);
+
+/* views are zeroed, the caller fills them (text is g_strdup'ed) before */
+/* publishing the scene */
+KmsStyleScene *kms_style_scene_new (gint width, gint height, gint enable,
+    const gchar * font_desc, guint n_views);
+
+#define kms_style_scene_ref(scene) \
+  ((KmsStyleScene *) kms_ref_struct_ref (KMS_REF_STRUCT_CAST (scene)))
+#define kms_style_scene_unref(scene) \
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (scene))
+
+G_END_DECLS
+#endif /* _KMS_STYLE_SCENE_H_ */
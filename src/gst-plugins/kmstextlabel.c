@@ -0,0 +1,172 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "kmstextlabel.h"
+
+#include <gst/gst.h>
+#include <pango/pangocairo.h>
+
+#define GST_CAT_DEFAULT kms_text_label_debug_category
+GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
+#define GST_DEFAULT_NAME "kmstextlabel"
+
+typedef struct _KmsTextLabelRenderer
+{
+  GThreadPool *pool;            /* a single thread, owns context and layout */
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *layout;
+  gchar *font_desc;
+  gdouble shadow_offset;
+} KmsTextLabelRenderer;
+
+static KmsTextLabelRenderer *renderer = NULL;
+
+static void
+kms_text_label_destroy (KmsTextLabel * label)
+{
+  if (label->surface != NULL)
+    cairo_surface_destroy (label->surface);
+
+  g_free (label->font_desc);
+  g_free (label->markup);
+
+  g_slice_free (KmsTextLabel, label);
+}
+
+/* only called from the renderer thread */
+static void
+kms_text_label_renderer_set_font (const gchar * font_desc)
+{
+  PangoFontDescription *desc;
+  gint font_size;
+
+  if (g_strcmp0 (font_desc, renderer->font_desc) == 0)
+    return;
+
+  desc = pango_font_description_from_string (font_desc);
+  if (desc == NULL) {
+    GST_WARNING ("font description parse failed: %s", font_desc);
+    return;
+  }
+
+  GST_LOG ("font description set: %s", font_desc);
+  pango_layout_set_font_description (renderer->layout, desc);
+
+  font_size = pango_font_description_get_size (desc) / PANGO_SCALE;
+  renderer->shadow_offset = (double) (font_size) / 13.0;
+
+  pango_font_description_free (desc);
+
+  g_free (renderer->font_desc);
+  renderer->font_desc = g_strdup (font_desc);
+}
+
+static void
+kms_text_label_render (KmsTextLabel * label, gpointer unused)
+{
+  PangoRectangle ink_rect, logical_rect;
+  cairo_surface_t *surface = NULL;
+  gint width, height;
+  cairo_t *cr;
+
+  if (label->markup == NULL || label->markup[0] == '\0')
+    goto end;
+
+  kms_text_label_renderer_set_font (label->font_desc);
+
+  // draw text on pango layout.
+  pango_layout_set_markup (renderer->layout, label->markup, -1);
+  // calculate the size of text.
+  pango_layout_get_pixel_extents (renderer->layout, &ink_rect, &logical_rect);
+  width = logical_rect.width + renderer->shadow_offset;
+  height = logical_rect.height + logical_rect.y + renderer->shadow_offset;
+  GST_DEBUG ("text=%s width=%d height=%d", label->markup, width, height);
+
+  if (width <= 0 || height <= 0)
+    goto end;
+
+  // draw on the cairo surface.
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+  cr = cairo_create (surface);
+  cairo_set_source_rgb (cr, 1.0, 1.0, 1.0);     // white color to draw text.
+  cairo_move_to (cr, 0.0, 0.0);
+  pango_cairo_show_layout (cr, renderer->layout);
+  cairo_destroy (cr);
+  cairo_surface_flush (surface);
+
+end:
+  /* readers check ready before touching the surface */
+  label->surface = surface;
+  g_atomic_int_set (&label->ready, TRUE);
+
+  kms_text_label_unref (label);
+}
+
+static gpointer
+kms_text_label_init_renderer (gpointer data)
+{
+  GST_DEBUG_CATEGORY_INIT (GST_CAT_DEFAULT, GST_DEFAULT_NAME, 0,
+      GST_DEFAULT_NAME);
+
+  renderer = g_slice_new0 (KmsTextLabelRenderer);
+  renderer->fontmap = pango_cairo_font_map_new ();
+  renderer->context = pango_font_map_create_context (renderer->fontmap);
+  pango_context_set_base_gravity (renderer->context, PANGO_GRAVITY_SOUTH);
+  renderer->layout = pango_layout_new (renderer->context);
+
+  /* pango objects are not thread safe, so there is only one thread */
+  renderer->pool = g_thread_pool_new ((GFunc) kms_text_label_render, NULL, 1,
+      FALSE, NULL);
+
+  return NULL;
+}
+
+KmsTextLabel *
+kms_text_label_new (const gchar * font_desc, const gchar * markup)
+{
+  static GOnce once = G_ONCE_INIT;
+  KmsTextLabel *label;
+
+  g_once (&once, kms_text_label_init_renderer, NULL);
+
+  label = g_slice_new0 (KmsTextLabel);
+  kms_ref_struct_init (KMS_REF_STRUCT_CAST (label),
+      (GDestroyNotify) kms_text_label_destroy);
+  label->font_desc = g_strdup (font_desc);
+  label->markup = g_strdup (markup);
+
+  g_thread_pool_push (renderer->pool, kms_text_label_ref (label), NULL);
+
+  return label;
+}
+
+gboolean
+kms_text_label_is_ready (KmsTextLabel * label)
+{
+  return g_atomic_int_get (&label->ready);
+}
+
+cairo_surface_t *
+kms_text_label_get_surface (KmsTextLabel * label)
+{
+  if (!kms_text_label_is_ready (label))
+    return NULL;
+
+  return label->surface;
+}
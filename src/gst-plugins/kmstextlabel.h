@@ -0,0 +1,53 @@
+/*
+ * (C) Copyright 2013 Kurento (http://kurento.org/)
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the GNU Lesser General Public License
+ * (LGPL) version 2.1 which accompanies this distribution, and is available at
+ * http://www.gnu.org/licenses/lgpl-2.1.html
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ */
+#ifndef _KMS_TEXT_LABEL_H_
+#define _KMS_TEXT_LABEL_H_
+
+#include <glib.h>
+#include <cairo.h>
+#include <commons/kmsrefstruct.h>
+
+G_BEGIN_DECLS
+
+/* Pango markup rendered white on transparent by a process wide worker, */
+/* which shares one font map and its glyph cache between all the users */
+typedef struct _KmsTextLabel
+{
+  KmsRefStruct ref;
+
+  gchar *font_desc;
+  gchar *markup;
+
+  /*< private > */
+  cairo_surface_t *surface;
+  volatile gint ready;
+} KmsTextLabel;
+
+/* Returns right away, the label is rendered later on the worker */
+KmsTextLabel *kms_text_label_new (const gchar * font_desc,
+    const gchar * markup);
+
+#define kms_text_label_ref(label) \
+  ((KmsTextLabel *) kms_ref_struct_ref (KMS_REF_STRUCT_CAST (label)))
+#define kms_text_label_unref(label) \
+  kms_ref_struct_unref (KMS_REF_STRUCT_CAST (label))
+
+gboolean kms_text_label_is_ready (KmsTextLabel * label);
+
+/* NULL until the label is ready or when there is nothing to draw */
+cairo_surface_t *kms_text_label_get_surface (KmsTextLabel * label);
+
+G_END_DECLS
+#endif /* _KMS_TEXT_LABEL_H_ */
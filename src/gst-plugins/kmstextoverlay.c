@@ -22,7 +22,11 @@
 #include <glib-object.h>
 #include <json-glib/json-glib.h>
 #include <gst/gst.h>
+#include <gst/video/video.h>
+#include <cairo.h>
 #include "kmstextoverlay.h"
+#include "kmstextlabel.h"
+#include "kmsoverlaysprite.h"
 
 #define PLUGIN_NAME "kmstextoverlay"
 
@@ -46,6 +50,17 @@ GST_DEBUG_CATEGORY_STATIC (kms_text_overlay_debug_category);
 )
 
 #define DEFAULT_STYLE NULL
+#define DEFAULT_FONT_DESC "sans bold 12"
+
+/* where textoverlay used to draw: bottom left, with its default padding */
+#define TEXT_PAD_X 25
+#define TEXT_PAD_Y 25
+/* shaded background behind the text */
+#define SHADING_ALPHA (80.0 / 255.0)
+#define SHADING_MARGIN 4
+
+/* formats text can be drawn on, anything else is decoded upstream */
+#define DRAWABLE_VIDEO_CAPS "video/x-raw, format=(string){ I420, NV12, BGR }"
 
 enum
 {
@@ -57,8 +72,29 @@ enum
 struct _KmsTextOverlayPrivate
 {
   GRecMutex mutex;
-  GstElement *textoverlay;
   gchar *style;
+  gchar *text;
+  gchar *font_desc;
+  gint deltay;
+
+  /* drawable formats filter, only linked between the video sink pad and */
+  /* the agnosticbin while there is text */
+  GstElement *capsfilter;
+  GstPad *video_sink;
+  GstPad *agnosticbin_sink;
+  gboolean filtered;
+
+  /* text is drawn on the buffers going through this pad, in place */
+  GstPad *video_pad;
+  gulong draw_probe_id;
+  GstVideoInfo info;
+  gboolean info_valid;
+  gboolean drawable;
+
+  KmsTextLabel *label;          /* rendered by the label worker */
+  KmsTextLabel *sprite_label;   /* label drawn in sprite */
+  KmsOverlaySprite *sprite;
+  gint sprite_frame_height;
 };
 
 /* class initialization */
@@ -68,6 +104,281 @@ G_DEFINE_TYPE_WITH_CODE (KmsTextOverlay, kms_text_overlay,
     GST_DEBUG_CATEGORY_INIT (kms_text_overlay_debug_category, PLUGIN_NAME,
         0, "debug category for textoverlay element"));
 
+static KmsOverlaySprite *
+kms_text_overlay_build_sprite (KmsTextOverlay * self, cairo_surface_t * text)
+{
+  KmsOverlaySprite *sprite;
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  gint text_width, text_height, width, height, x, y;
+
+  text_width = cairo_image_surface_get_width (text);
+  text_height = cairo_image_surface_get_height (text);
+  width = text_width + 2 * SHADING_MARGIN;
+  height = text_height + 2 * SHADING_MARGIN;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+  cr = cairo_create (surface);
+  cairo_set_source_rgba (cr, 0, 0, 0, SHADING_ALPHA);
+  cairo_paint (cr);
+  cairo_set_source_surface (cr, text, SHADING_MARGIN, SHADING_MARGIN);
+  cairo_paint (cr);
+  cairo_destroy (cr);
+  cairo_surface_flush (surface);
+
+  x = TEXT_PAD_X - SHADING_MARGIN;
+  y = GST_VIDEO_INFO_HEIGHT (&self->priv->info) - TEXT_PAD_Y - text_height -
+      SHADING_MARGIN + self->priv->deltay;
+
+  sprite = kms_overlay_sprite_new_from_argb32 (cairo_image_surface_get_data
+      (surface), width, height, cairo_image_surface_get_stride (surface), x, y);
+  cairo_surface_destroy (surface);
+
+  GST_DEBUG_OBJECT (self, "@rentao built text sprite %dx%d at %d,%d", width,
+      height, x, y);
+
+  return sprite;
+}
+
+/* Must be called with the lock held. Returns TRUE when there is a sprite */
+/* to blend on frames of the current caps. The sprite is only built again */
+/* for a new label or frame height, while a label is being rendered the */
+/* previous one is kept. */
+static gboolean
+kms_text_overlay_update_sprite (KmsTextOverlay * self, GstPad * pad)
+{
+  KmsTextLabel *label = self->priv->sprite_label;
+  cairo_surface_t *surface;
+
+  if (!self->priv->info_valid) {
+    GstCaps *caps = gst_pad_get_current_caps (pad);
+
+    if (caps == NULL)
+      return FALSE;
+
+    /* checked once for each caps */
+    self->priv->info_valid = TRUE;
+    self->priv->drawable =
+        gst_video_info_from_caps (&self->priv->info, caps) &&
+        kms_overlay_sprite_supports_format (GST_VIDEO_INFO_FORMAT
+        (&self->priv->info));
+
+    if (!self->priv->drawable) {
+      GST_WARNING_OBJECT (self, "Text cannot be drawn on %" GST_PTR_FORMAT,
+          caps);
+    }
+
+    gst_caps_unref (caps);
+  }
+
+  if (!self->priv->drawable)
+    return FALSE;
+
+  if (self->priv->label != NULL && kms_text_label_is_ready (self->priv->label))
+    label = self->priv->label;
+
+  if (self->priv->sprite != NULL && label == self->priv->sprite_label
+      && self->priv->sprite_frame_height ==
+      GST_VIDEO_INFO_HEIGHT (&self->priv->info))
+    return TRUE;
+
+  if (label != self->priv->sprite_label) {
+    if (self->priv->sprite_label != NULL)
+      kms_text_label_unref (self->priv->sprite_label);
+    self->priv->sprite_label = label != NULL ? kms_text_label_ref (label) :
+        NULL;
+  }
+
+  g_clear_pointer (&self->priv->sprite, kms_overlay_sprite_free);
+
+  surface = label != NULL ? kms_text_label_get_surface (label) : NULL;
+  if (surface == NULL)
+    return FALSE;
+
+  self->priv->sprite = kms_text_overlay_build_sprite (self, surface);
+  self->priv->sprite_frame_height = GST_VIDEO_INFO_HEIGHT (&self->priv->info);
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+kms_text_overlay_draw (GstPad * pad, GstPadProbeInfo * info,
+    KmsTextOverlay * self)
+{
+  GstVideoFrame frame;
+  GstBuffer *buffer;
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) == GST_EVENT_CAPS) {
+      KMS_TEXT_OVERLAY_LOCK (self);
+      self->priv->info_valid = FALSE;
+      KMS_TEXT_OVERLAY_UNLOCK (self);
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  KMS_TEXT_OVERLAY_LOCK (self);
+
+  if (!kms_text_overlay_update_sprite (self, pad)) {
+    KMS_TEXT_OVERLAY_UNLOCK (self);
+    return GST_PAD_PROBE_OK;
+  }
+
+  /* drawn in the negotiated format, it is only copied when shared */
+  buffer = gst_buffer_make_writable (GST_PAD_PROBE_INFO_BUFFER (info));
+  GST_PAD_PROBE_INFO_DATA (info) = buffer;
+
+  if (gst_video_frame_map (&frame, &self->priv->info, buffer,
+          GST_MAP_READWRITE)) {
+    kms_overlay_sprite_blend (self->priv->sprite, &frame);
+    gst_video_frame_unmap (&frame);
+  }
+
+  KMS_TEXT_OVERLAY_UNLOCK (self);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+kms_text_overlay_has_text (KmsTextOverlay * self)
+{
+  return self->priv->text != NULL && self->priv->text[0] != '\0';
+}
+
+/* Runs while no data goes through the video sink pad. Links the filter */
+/* in or out of the path as the text there is by then asks for. */
+static GstPadProbeReturn
+kms_text_overlay_switch_path (GstPad * pad, GstPadProbeInfo * info,
+    KmsTextOverlay * self)
+{
+  GstPad *filter_sink, *filter_src;
+  gboolean filter;
+
+  KMS_TEXT_OVERLAY_LOCK (self);
+
+  filter = kms_text_overlay_has_text (self);
+  if (filter == self->priv->filtered) {
+    KMS_TEXT_OVERLAY_UNLOCK (self);
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  filter_sink = gst_element_get_static_pad (self->priv->capsfilter, "sink");
+  filter_src = gst_element_get_static_pad (self->priv->capsfilter, "src");
+
+  if (filter) {
+    gst_ghost_pad_set_target (GST_GHOST_PAD (self->priv->video_sink),
+        filter_sink);
+    if (gst_pad_link (filter_src, self->priv->agnosticbin_sink) !=
+        GST_PAD_LINK_OK) {
+      GST_WARNING_OBJECT (self, "Cannot link the drawable formats filter");
+    }
+  } else {
+    gst_pad_unlink (filter_src, self->priv->agnosticbin_sink);
+    gst_ghost_pad_set_target (GST_GHOST_PAD (self->priv->video_sink),
+        self->priv->agnosticbin_sink);
+  }
+
+  self->priv->filtered = filter;
+
+  GST_DEBUG_OBJECT (self, "Drawable formats filter %s",
+      filter ? "linked" : "unlinked");
+
+  g_object_unref (filter_sink);
+  g_object_unref (filter_src);
+
+  KMS_TEXT_OVERLAY_UNLOCK (self);
+
+  /* encoded media has to be decoded upstream for the filter, and raw */
+  /* video does not have to be anymore without it */
+  gst_pad_push_event (self->priv->video_sink, gst_event_new_reconfigure ());
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+/* Must be called with the lock held */
+static void
+kms_text_overlay_update_path (KmsTextOverlay * self)
+{
+  GstPad *internal;
+
+  if (self->priv->video_sink == NULL ||
+      kms_text_overlay_has_text (self) == self->priv->filtered)
+    return;
+
+  /* relinked right away when no buffer is going through, otherwise by */
+  /* the streaming thread once it is pushed. The pad does not outlive us. */
+  internal = GST_PAD (gst_proxy_pad_get_internal (GST_PROXY_PAD
+          (self->priv->video_sink)));
+  gst_pad_add_probe (internal, GST_PAD_PROBE_TYPE_IDLE,
+      (GstPadProbeCallback) kms_text_overlay_switch_path, self, NULL);
+  g_object_unref (internal);
+}
+
+/* Must be called with the lock held. Frames go through untouched while */
+/* there is no text. */
+static void
+kms_text_overlay_update_probe (KmsTextOverlay * self)
+{
+  gboolean draw = kms_text_overlay_has_text (self);
+
+  kms_text_overlay_update_path (self);
+
+  if (self->priv->video_pad == NULL)
+    return;
+
+  if (draw && self->priv->draw_probe_id == 0) {
+    self->priv->info_valid = FALSE;
+    self->priv->draw_probe_id = gst_pad_add_probe (self->priv->video_pad,
+        GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+        (GstPadProbeCallback) kms_text_overlay_draw, self, NULL);
+  } else if (!draw && self->priv->draw_probe_id != 0) {
+    gst_pad_remove_probe (self->priv->video_pad, self->priv->draw_probe_id);
+    self->priv->draw_probe_id = 0;
+  }
+
+  if (!draw) {
+    g_clear_pointer (&self->priv->sprite, kms_overlay_sprite_free);
+    g_clear_pointer (&self->priv->sprite_label, kms_ref_struct_unref);
+    g_clear_pointer (&self->priv->label, kms_ref_struct_unref);
+  }
+}
+
+/* Must be called with the lock held. Only a new text or font is rendered */
+/* again, the same one keeps its cached bitmap. */
+static void
+kms_text_overlay_set_text (KmsTextOverlay * self, const gchar * text,
+    const gchar * font_desc, gint deltay)
+{
+  gboolean render = FALSE;
+
+  if (text != NULL && g_strcmp0 (text, self->priv->text) != 0) {
+    g_free (self->priv->text);
+    self->priv->text = g_strdup (text);
+    render = TRUE;
+  }
+
+  if (font_desc != NULL && g_strcmp0 (font_desc, self->priv->font_desc) != 0) {
+    g_free (self->priv->font_desc);
+    self->priv->font_desc = g_strdup (font_desc);
+    render = TRUE;
+  }
+
+  if (deltay != self->priv->deltay) {
+    self->priv->deltay = deltay;
+    /* placed again with the label it has */
+    g_clear_pointer (&self->priv->sprite, kms_overlay_sprite_free);
+  }
+
+  kms_text_overlay_update_probe (self);
+
+  if (render && self->priv->draw_probe_id != 0) {
+    if (self->priv->label != NULL)
+      kms_text_label_unref (self->priv->label);
+    self->priv->label = kms_text_label_new (self->priv->font_desc,
+        self->priv->text);
+  }
+}
+
 static gboolean
 kms_text_overlay_parse_style (KmsTextOverlay * self)
 {
@@ -94,24 +405,18 @@ kms_text_overlay_parse_style (KmsTextOverlay * self)
 
   json_reader_read_member (reader, "text");
   text = json_reader_get_string_value (reader);
-  if (text != NULL) {
-    g_object_set (G_OBJECT (self->priv->textoverlay), "text", text, NULL);
-  }
   json_reader_end_member (reader);
 
   json_reader_read_member (reader, "font-desc");
   font_desc = json_reader_get_string_value (reader);
-  if (font_desc != NULL) {
-    g_object_set (G_OBJECT (self->priv->textoverlay), "font-desc", font_desc,
-        NULL);
-  }
   json_reader_end_member (reader);
 
   json_reader_read_member (reader, "deltay");
   deltay = json_reader_get_int_value (reader);
-  g_object_set (G_OBJECT (self->priv->textoverlay), "deltay", deltay, NULL);
   json_reader_end_member (reader);
 
+  kms_text_overlay_set_text (self, text, font_desc, deltay);
+
   GST_INFO ("@rentao text=%s, font=%s, deltay=%d", text, font_desc, deltay);
   g_object_unref (reader);
   g_object_unref (parser);
@@ -123,76 +428,46 @@ static void
 kms_text_overlay_connect_textoverlay (KmsTextOverlay * self,
     KmsElementPadType type, GstElement * agnosticbin)
 {
-  GstPad *target, *sink = NULL;
-  GstElement *textoverlay, *videoconvert, *decodebin2, *capsfilter, *videorate,
-      *videoscale;
-  GstCaps *filtercaps;
-  gchar *textMsg = "";
+  GstElement *capsfilter;
+  GstCaps *caps;
+  GstPad *target;
 
   GST_INFO ("@rentao type = %d.", type);
-  if (self->priv->style != NULL) {
-    textMsg = self->priv->style;
-  }
-  GST_INFO ("@rentao textMsg = %s.", textMsg);
-  if (type == KMS_ELEMENT_PAD_TYPE_VIDEO) {
-    // textoverlay source code:
-    //   https://code.google.com/p/ossbuild/source/browse/trunk/Main/GStreamer/Source/gst-plugins-base/ext/pango/gsttextoverlay.c?spec=svn1012&r=1007
-    textoverlay = gst_element_factory_make ("textoverlay", NULL);
-    if (textoverlay == NULL) {
-      GST_INFO ("@rentao textoverlay cannot be created.");
-      return;
-    }
-    videoconvert = gst_element_factory_make ("videoconvert", NULL);
-    decodebin2 = gst_element_factory_make ("decodebin", NULL);
-    capsfilter = gst_element_factory_make ("capsfilter", NULL);
-    filtercaps =
-        gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "AYUV",
-//                "width", G_TYPE_INT, 300,
-//                "height", G_TYPE_INT, 300,
-//        "framerate", GST_TYPE_FRACTION, 15, 1, NULL);
-        NULL);
-    g_object_set (G_OBJECT (capsfilter), "caps", filtercaps, NULL);
-    gst_caps_unref (filtercaps);
-
-    videorate = gst_element_factory_make ("videorate", NULL);
-    videoscale = gst_element_factory_make ("videoscale", NULL);
-
-    g_object_set (G_OBJECT (textoverlay), "text", textMsg, NULL);
-    g_object_set (G_OBJECT (textoverlay), "valignment", 1, "halignment", "left",
-        "shaded-background", 1, "auto-resize", 0, "font-desc", "sans bold 12",
-        "wrap-mode", 0, NULL);
-    sink = gst_element_get_static_pad (videoscale, "sink");
-    if (sink == NULL) {
-      GST_INFO ("@rentao videoconvert sink cannot be created.");
+
+  if (type != KMS_ELEMENT_PAD_TYPE_VIDEO) {
+    target = gst_element_get_static_pad (agnosticbin, "sink");
+    if (target == NULL) {
+      GST_INFO ("@rentao agnosticbin sink cannot be created.");
       return;
     }
 
-    GST_INFO ("@rentao linking elements.");
-    gst_bin_add_many (GST_BIN (self), videoscale, videoconvert, textoverlay,
-        capsfilter, NULL);
-    gst_element_link_many (videoscale, videoconvert, capsfilter, textoverlay,
-        agnosticbin, NULL);
-    gst_element_sync_state_with_parent (textoverlay);
-    gst_element_sync_state_with_parent (videoconvert);
-    gst_element_sync_state_with_parent (capsfilter);
-    gst_element_sync_state_with_parent (decodebin2);
-    gst_element_sync_state_with_parent (videoscale);
-    gst_element_sync_state_with_parent (videorate);
-    self->priv->textoverlay = textoverlay;
-  }
-
-  target = gst_element_get_static_pad (agnosticbin, "sink");
-  if (target == NULL) {
-    GST_INFO ("@rentao agnosticbin sink cannot be created.");
+    kms_element_connect_sink_target (KMS_ELEMENT (self), target, type);
+    g_object_unref (target);
     return;
   }
 
-  GST_INFO ("@rentao sink = %" GST_PTR_FORMAT, sink);
-  if (sink == NULL)
-    kms_element_connect_sink_target (KMS_ELEMENT (self), target, type);
-  else
-    kms_element_connect_sink_target (KMS_ELEMENT (self), sink, type);
-  g_object_unref (target);
+  /* only accepting drawable raw video makes upstream decode encoded */
+  /* media. While there is text the filter is linked in front of the */
+  /* agnosticbin and text is drawn by a probe after it, otherwise video */
+  /* goes straight to the agnosticbin. */
+  capsfilter = gst_element_factory_make ("capsfilter", NULL);
+  caps = gst_caps_from_string (DRAWABLE_VIDEO_CAPS);
+  g_object_set (G_OBJECT (capsfilter), "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  gst_bin_add (GST_BIN (self), capsfilter);
+  gst_element_sync_state_with_parent (capsfilter);
+
+  self->priv->capsfilter = capsfilter;
+  self->priv->video_pad = gst_element_get_static_pad (capsfilter, "src");
+  self->priv->agnosticbin_sink = gst_element_get_static_pad (agnosticbin,
+      "sink");
+
+  self->priv->video_sink = kms_element_connect_sink_target_full (KMS_ELEMENT
+      (self), self->priv->agnosticbin_sink, type, NULL, NULL, NULL);
+  if (self->priv->video_sink != NULL) {
+    g_object_ref (self->priv->video_sink);
+  }
 }
 
 static void
@@ -262,6 +537,26 @@ kms_text_overlay_finalize (GObject * object)
   KmsTextOverlay *self = KMS_TEXT_OVERLAY (object);
 
   GST_INFO ("@rentao, finalize, style=%s", self->priv->style);
+
+  if (self->priv->video_pad != NULL) {
+    if (self->priv->draw_probe_id != 0)
+      gst_pad_remove_probe (self->priv->video_pad, self->priv->draw_probe_id);
+    g_object_unref (self->priv->video_pad);
+  }
+
+  g_clear_object (&self->priv->video_sink);
+  g_clear_object (&self->priv->agnosticbin_sink);
+
+  kms_overlay_sprite_free (self->priv->sprite);
+  if (self->priv->sprite_label != NULL)
+    kms_text_label_unref (self->priv->sprite_label);
+  if (self->priv->label != NULL)
+    kms_text_label_unref (self->priv->label);
+
+  g_free (self->priv->text);
+  g_free (self->priv->font_desc);
+  g_rec_mutex_clear (&self->priv->mutex);
+
   G_OBJECT_CLASS (kms_text_overlay_parent_class)->finalize (object);
 }
 
@@ -294,6 +589,9 @@ kms_text_overlay_init (KmsTextOverlay * self)
 {
   self->priv = KMS_TEXT_OVERLAY_GET_PRIVATE (self);
 
+  g_rec_mutex_init (&self->priv->mutex);
+  self->priv->font_desc = g_strdup (DEFAULT_FONT_DESC);
+
   GST_INFO ("@rentao kms_text_overlay started");
   kms_text_overlay_connect_textoverlay (self, KMS_ELEMENT_PAD_TYPE_VIDEO,
       kms_element_get_video_agnosticbin (KMS_ELEMENT (self)));
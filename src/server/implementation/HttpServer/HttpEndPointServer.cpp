@@ -118,12 +118,22 @@ HttpEndPointServer::stop ()
   kms_http_ep_server_stop (server, http_server_handler_cb, &logHandler , NULL);
 }
 
-void
+std::string
 HttpEndPointServer::registerEndPoint (GstElement *endpoint, guint timeout,
                                       KmsHttpEPRegisterCallback cb, gpointer user_data, GDestroyNotify notify)
 {
-  kms_http_ep_server_register_end_point (server, endpoint, timeout, cb, user_data,
-                                         notify);
+  std::string uri;
+  gchar *uri_c;
+
+  uri_c = kms_http_ep_server_register_end_point (server, endpoint, timeout, cb,
+          user_data, notify);
+
+  if (uri_c != NULL) {
+    uri = uri_c;
+    g_free (uri_c);
+  }
+
+  return uri;
 }
 
 void
@@ -147,6 +157,15 @@ HttpEndPointServer::disconnectSignal (gulong id)
   g_signal_handler_disconnect (server, id);
 }
 
+void
+HttpEndPointServer::setCallbacks (const std::string &uri,
+                                  const KmsHttpEPCallbacks *callbacks, gpointer user_data,
+                                  GDestroyNotify notify)
+{
+  kms_http_ep_server_set_callbacks (server, uri.c_str(), callbacks, user_data,
+                                    notify);
+}
+
 uint
 HttpEndPointServer::getPort ()
 {
@@ -35,13 +35,16 @@ public:
     const uint port, const std::string &iface, const std::string &addr);
   void start ();
   void stop ();
-  void registerEndPoint (GstElement *endpoint, guint timeout,
-                         KmsHttpEPRegisterCallback cb, gpointer user_data, GDestroyNotify notify);
+  std::string registerEndPoint (GstElement *endpoint, guint timeout,
+                                KmsHttpEPRegisterCallback cb, gpointer user_data,
+                                GDestroyNotify notify);
   void unregisterEndPoint (std::string uri, KmsHttpEPServerNotifyCallback cb,
                            gpointer user_data, GDestroyNotify notify);
   gulong connectSignal (std::string name, GCallback c_handler,
                         gpointer user_data);
   void disconnectSignal (gulong id);
+  void setCallbacks (const std::string &uri, const KmsHttpEPCallbacks *callbacks,
+                     gpointer user_data, GDestroyNotify notify);
   uint getPort ();
   std::string getInterface();
   std::string getAnnouncedAddress();
@@ -62,14 +62,46 @@ G_DEFINE_QUARK (KEY_PARAM_POST_CONTROLLER, key_param_post_controller)
 #define KEY_PARAM_TIMEOUT "kms-param-timeout"
 G_DEFINE_QUARK (KEY_PARAM_TIMEOUT, key_param_timeout)
 
+#define KEY_POST_BATCH "kms-post-batch"
+G_DEFINE_QUARK (KEY_POST_BATCH, key_post_batch)
+
+#define KEY_THROTTLE_HANDLER_ID "kms-throttle-handler-id"
+G_DEFINE_QUARK (KEY_THROTTLE_HANDLER_ID, key_throttle_handler_id)
+
+#define KEY_PAUSED "kms-paused"
+G_DEFINE_QUARK (KEY_PAUSED, key_paused)
+
 #define GST_CAT_DEFAULT kms_http_ep_server_debug_category
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 
 #define RESOLV_TIMEOUT 5000 /* 5 seconds */
 
+/* POST data is pushed when the loop is idle or when this much is waiting */
+#define POST_BATCH_MAX_SIZE (64 * 1024)
+
 #define KMS_HTTP_EP_SERVER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), KMS_TYPE_HTTP_EP_SERVER, KmsHttpEPServerPrivate))
+typedef struct _KmsPostBatch {
+  GstBufferList *list;
+  gsize size;
+  gboolean flush_pending;
+} KmsPostBatch;
+
+/* Register operations queued until the server loop runs them */
+typedef struct _KmsHttpEPOp {
+  GSourceFunc func;
+  gpointer data;
+  GDestroyNotify notify;
+} KmsHttpEPOp;
+
+typedef struct _KmsHttpEPUriCallbacks {
+  KmsHttpEPCallbacks callbacks;
+  gpointer user_data;
+  GDestroyNotify notify;
+} KmsHttpEPUriCallbacks;
+
 struct _KmsHttpEPServerPrivate {
   GHashTable *handlers;
+  GHashTable *callbacks;
   SoupServer *server;
   gchar *announced_addr;
   gchar *got_addr;
@@ -77,6 +109,10 @@ struct _KmsHttpEPServerPrivate {
   gint port;
   GRand *rand;
   KmsLoop *loop;
+
+  GMutex ops_mutex;
+  GQueue ops;
+  gboolean ops_scheduled;
 };
 
 static GType http_t = G_TYPE_INVALID;
@@ -133,6 +169,7 @@ struct tmp_register_data {
   GDestroyNotify notify;
   GstElement *endpoint;
   guint timeout;
+  gchar *uri;
   KmsHttpEPServer *server;
 };
 
@@ -144,6 +181,12 @@ struct tmp_unregister_data {
   KmsHttpEPServer *server;
 };
 
+struct tmp_callbacks_data {
+  gchar *uri;
+  KmsHttpEPUriCallbacks *cbs;
+  KmsHttpEPServer *server;
+};
+
 struct sample_data {
   GstElement *httpep;
   GstSample *sample;
@@ -232,6 +275,27 @@ kms_http_ep_server_get_ep_from_msg (KmsHttpEPServer *self, SoupMessage *msg)
   return (GstElement *) g_hash_table_lookup (self->priv->handlers, uri);
 }
 
+static void
+destroy_uri_callbacks (KmsHttpEPUriCallbacks *cbs)
+{
+  if (cbs->notify != NULL) {
+    cbs->notify (cbs->user_data);
+  }
+
+  g_slice_free (KmsHttpEPUriCallbacks, cbs);
+}
+
+static KmsHttpEPUriCallbacks *
+kms_http_ep_server_get_uri_callbacks (KmsHttpEPServer *self, const gchar *uri)
+{
+  if (self->priv->callbacks == NULL) {
+    return NULL;
+  }
+
+  return (KmsHttpEPUriCallbacks *) g_hash_table_lookup (self->priv->callbacks,
+         uri);
+}
+
 static gboolean
 emit_expiration_signal_cb (gpointer user_data)
 {
@@ -240,11 +304,19 @@ emit_expiration_signal_cb (gpointer user_data)
                           key_http_ep_server_quark () );
   SoupURI *uri = soup_message_get_uri (msg);
   const char *path = soup_uri_get_path (uri);
+  KmsHttpEPUriCallbacks *cbs;
   GstElement *httpep;
 
   GST_DEBUG ("Cookie expired for %s", path);
   g_signal_emit (G_OBJECT (serv), obj_signals[URL_EXPIRED], 0, path);
 
+  /* It may unregister the uri and free cbs */
+  cbs = kms_http_ep_server_get_uri_callbacks (serv, path);
+
+  if (cbs != NULL && cbs->callbacks.url_expired != NULL) {
+    cbs->callbacks.url_expired (serv, path, cbs->user_data);
+  }
+
   httpep = (GstElement *) g_hash_table_lookup (serv->priv->handlers, path);
 
   if (httpep != NULL) {
@@ -297,31 +369,129 @@ destroy_ulong (gulong *handlerid)
 }
 
 static void
-got_post_data_cb (KmsHttpPost *post_obj, SoupBuffer *buffer, gpointer data)
+destroy_post_batch (KmsPostBatch *batch)
 {
-  GstElement *httpep = GST_ELEMENT (data);
-  GstFlowReturn ret;
+  gst_buffer_list_unref (batch->list);
+  g_slice_free (KmsPostBatch, batch);
+}
+
+static GstBuffer *
+wrap_soup_buffer (SoupBuffer *buffer)
+{
+  /* Just a new reference unless the chunk memory is temporary */
+  SoupBuffer *ref = soup_buffer_copy (buffer);
   GstBuffer *new_buffer;
-  GstMemory *memory;
-  GstMapInfo info;
 
   new_buffer = gst_buffer_new ();
-  memory = gst_allocator_alloc (NULL, buffer->length, NULL);
-  gst_buffer_append_memory (new_buffer, memory);
+  gst_buffer_append_memory (new_buffer,
+                            gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY,
+                                (gpointer) ref->data, ref->length, 0, ref->length, ref,
+                                (GDestroyNotify) soup_buffer_free) );
+
+  return new_buffer;
+}
 
-  gst_buffer_map (new_buffer, &info, GST_MAP_WRITE);
-  memcpy (info.data, buffer->data, info.size);
-  gst_buffer_unmap (new_buffer, &info);
+static void
+flush_post_batch (GstElement *httpep)
+{
+  KmsPostBatch *batch;
+  GstBufferList *list;
+  GstFlowReturn ret;
+
+  batch = (KmsPostBatch *) g_object_get_qdata (G_OBJECT (httpep),
+          key_post_batch_quark () );
+
+  if (batch == NULL || gst_buffer_list_length (batch->list) == 0) {
+    return;
+  }
 
-  g_signal_emit_by_name (httpep, "push-buffer", new_buffer, &ret);
+  list = batch->list;
+  batch->list = gst_buffer_list_new ();
+  batch->size = 0;
+
+  g_signal_emit_by_name (httpep, "push-buffer-list", list, &ret);
 
   if (ret != GST_FLOW_OK) {
     /* something wrong */
-    GST_ERROR ("Could not send buffer to httpep %s. Ret code %d",
+    GST_ERROR ("Could not send buffers to httpep %s. Ret code %d",
                GST_ELEMENT_NAME (httpep), ret);
   }
 
-  gst_buffer_unref (new_buffer);
+  gst_buffer_list_unref (list);
+}
+
+static gboolean
+flush_post_batch_cb (gpointer data)
+{
+  GstElement *httpep = GST_ELEMENT (data);
+  KmsPostBatch *batch;
+
+  batch = (KmsPostBatch *) g_object_get_qdata (G_OBJECT (httpep),
+          key_post_batch_quark () );
+
+  if (batch != NULL) {
+    batch->flush_pending = FALSE;
+    flush_post_batch (httpep);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+static KmsHttpEPServer *
+get_http_ep_server (GstElement *httpep)
+{
+  gpointer msg;
+
+  msg = g_object_get_qdata (G_OBJECT (httpep), key_message_quark () );
+
+  if (msg == NULL) {
+    return NULL;
+  }
+
+  return (KmsHttpEPServer *) g_object_get_qdata (G_OBJECT (msg),
+         key_http_ep_server_quark () );
+}
+
+static void
+got_post_data_cb (KmsHttpPost *post_obj, SoupBuffer *buffer, gpointer data)
+{
+  GstElement *httpep = GST_ELEMENT (data);
+  KmsHttpEPServer *serv;
+  KmsPostBatch *batch;
+
+  batch = (KmsPostBatch *) g_object_get_qdata (G_OBJECT (httpep),
+          key_post_batch_quark () );
+
+  if (batch == NULL) {
+    batch = g_slice_new0 (KmsPostBatch);
+    batch->list = gst_buffer_list_new ();
+    g_object_set_qdata_full (G_OBJECT (httpep), key_post_batch_quark (), batch,
+                             (GDestroyNotify) destroy_post_batch);
+  }
+
+  /* Chunks read in the same loop iteration are pushed together */
+  gst_buffer_list_add (batch->list, wrap_soup_buffer (buffer) );
+  batch->size += buffer->length;
+
+  if (batch->size >= POST_BATCH_MAX_SIZE) {
+    flush_post_batch (httpep);
+    return;
+  }
+
+  if (batch->flush_pending) {
+    return;
+  }
+
+  serv = get_http_ep_server (httpep);
+
+  if (serv == NULL) {
+    flush_post_batch (httpep);
+    return;
+  }
+
+  batch->flush_pending = TRUE;
+  kms_loop_idle_add_full (serv->priv->loop, G_PRIORITY_DEFAULT_IDLE,
+                          flush_post_batch_cb, g_object_ref (httpep), g_object_unref);
 }
 
 static void
@@ -333,6 +503,8 @@ finished_post_cb (KmsHttpPost *post_obj, gpointer data)
 
   GST_DEBUG ("POST finished");
 
+  flush_post_batch (httpep);
+
   g_signal_emit_by_name (httpep, "end-of-stream", &ret);
 
   if (ret != GST_FLOW_OK) {
@@ -349,8 +521,63 @@ finished_post_cb (KmsHttpPost *post_obj, gpointer data)
   }
 }
 
+static gboolean
+update_post_throttle_cb (gpointer data)
+{
+  GstElement *httpep = GST_ELEMENT (data);
+  KmsHttpEPServer *serv;
+  gboolean throttled, paused;
+  SoupMessage *msg;
+
+  msg = (SoupMessage *) g_object_get_qdata (G_OBJECT (httpep),
+        key_message_quark () );
+
+  if (msg == NULL) {
+    return G_SOURCE_REMOVE;
+  }
+
+  serv = (KmsHttpEPServer *) g_object_get_qdata (G_OBJECT (msg),
+         key_http_ep_server_quark () );
+
+  if (serv == NULL) {
+    return G_SOURCE_REMOVE;
+  }
+
+  /* Several changes may be queued, only the current state matters */
+  g_object_get (G_OBJECT (httpep), "throttled", &throttled, NULL);
+  paused = GPOINTER_TO_INT (g_object_get_qdata (G_OBJECT (msg),
+                            key_paused_quark () ) );
+
+  if (throttled == paused) {
+    return G_SOURCE_REMOVE;
+  }
+
+  if (throttled) {
+    GST_DEBUG ("Pausing upload to %s", GST_ELEMENT_NAME (httpep) );
+    soup_server_pause_message (serv->priv->server, msg);
+  } else {
+    GST_DEBUG ("Resuming upload to %s", GST_ELEMENT_NAME (httpep) );
+    soup_server_unpause_message (serv->priv->server, msg);
+  }
+
+  g_object_set_qdata (G_OBJECT (msg), key_paused_quark (),
+                      GINT_TO_POINTER (throttled) );
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+post_throttle_cb (GstElement *httpep, gboolean throttled, gpointer data)
+{
+  KmsHttpEPServer *self = KMS_HTTP_EP_SERVER (data);
+
+  /* Emitted from streaming threads, soup is only used from the loop */
+  kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_DEFAULT,
+                          update_post_throttle_cb, g_object_ref (httpep), g_object_unref);
+}
+
 static void
-install_http_post_signals (GstElement *httpep)
+install_http_post_signals (KmsHttpEPServer *self, GstElement *httpep)
 {
   KmsHttpPost *post_obj;
   gulong *handlerid;
@@ -387,6 +614,19 @@ install_http_post_signals (GstElement *httpep)
     g_object_set_qdata_full (G_OBJECT (httpep), key_finished_handler_id_quark (),
                              handlerid, (GDestroyNotify) destroy_ulong);
   }
+
+  handlerid = (gulong *) g_object_get_qdata (G_OBJECT (httpep),
+              key_throttle_handler_id_quark () );
+
+  if (handlerid == NULL) {
+    handlerid = g_slice_new (gulong);
+    *handlerid = g_signal_connect_object (httpep, "throttle",
+                                          G_CALLBACK (post_throttle_cb), self, (GConnectFlags) 0);
+    GST_DEBUG ("Installing throttle signal with id %lu from %p ",
+               *handlerid, (gpointer) httpep);
+    g_object_set_qdata_full (G_OBJECT (httpep), key_throttle_handler_id_quark (),
+                             handlerid, (GDestroyNotify) destroy_ulong);
+  }
 }
 
 static void
@@ -413,6 +653,10 @@ uninstall_http_post_signals (GstElement *httpep)
                              NULL, NULL);
   }
 
+  /* Data already received still goes to the endpoint */
+  flush_post_batch (httpep);
+  g_object_set_qdata (G_OBJECT (httpep), key_post_batch_quark (), NULL);
+
   handlerid = (gulong *) g_object_get_qdata (G_OBJECT (httpep),
               key_finished_handler_id_quark () );
 
@@ -423,6 +667,17 @@ uninstall_http_post_signals (GstElement *httpep)
     g_object_set_qdata_full (G_OBJECT (httpep), key_finished_handler_id_quark (),
                              NULL, NULL);
   }
+
+  handlerid = (gulong *) g_object_get_qdata (G_OBJECT (httpep),
+              key_throttle_handler_id_quark () );
+
+  if (handlerid != NULL) {
+    GST_DEBUG ("Disconnecting throttle signal with id %lu from %p ",
+               *handlerid, (gpointer) httpep);
+    g_signal_handler_disconnect (httpep, *handlerid);
+    g_object_set_qdata_full (G_OBJECT (httpep), key_throttle_handler_id_quark (),
+                             NULL, NULL);
+  }
 }
 
 static void
@@ -455,7 +710,7 @@ kms_http_ep_server_post_handler (KmsHttpEPServer *self, SoupMessage *msg,
                              post_obj, g_object_unref);
   }
 
-  install_http_post_signals (httpep);
+  install_http_post_signals (self, httpep);
   g_object_set (G_OBJECT (post_obj), "soup-message", msg, NULL);
 }
 
@@ -479,24 +734,47 @@ kms_http_ep_server_clean_http_end_point (KmsHttpEPServer *self,
 }
 
 static void
-remove_http_end_point_cb (gpointer key, gpointer value, gpointer user_data)
+remove_http_end_point (KmsHttpEPServer *self, gchar *uri)
 {
-  KmsHttpEPServer *self = KMS_HTTP_EP_SERVER (user_data);
-  GstElement *httpep = GST_ELEMENT (value);
+  KmsHttpEPUriCallbacks *cbs;
+  GstElement *httpep;
+
+  httpep = (GstElement *) g_hash_table_lookup (self->priv->handlers, uri);
+
+  if (httpep == NULL) {
+    /* Already unregistered from a callback */
+    return;
+  }
 
   kms_http_ep_server_clean_http_end_point (self, httpep);
 
   /* Emit removed url signal for each key */
-  emit_removed_url_signal (self, (gchar *) key);
+  emit_removed_url_signal (self, uri);
+
+  cbs = kms_http_ep_server_get_uri_callbacks (self, uri);
+
+  if (cbs != NULL && cbs->callbacks.url_removed != NULL) {
+    cbs->callbacks.url_removed (self, uri, cbs->user_data);
+  }
+
+  g_hash_table_remove (self->priv->handlers, uri);
+  g_hash_table_remove (self->priv->callbacks, uri);
 }
 
 static void
 kms_http_ep_server_remove_handlers (KmsHttpEPServer *self)
 {
-  g_hash_table_foreach (self->priv->handlers, remove_http_end_point_cb, self);
+  GList *uris, *l;
+
+  /* Callbacks may unregister uris, so do not iterate over the table */
+  uris = g_hash_table_get_keys (self->priv->handlers);
+  uris = g_list_copy_deep (uris, (GCopyFunc) g_strdup, NULL);
 
-  /* Remove handlers */
-  g_hash_table_remove_all (self->priv->handlers);
+  for (l = uris; l != NULL; l = l->next) {
+    remove_http_end_point (self, (gchar *) l->data);
+  }
+
+  g_list_free_full (uris, g_free);
 }
 
 static void
@@ -522,6 +800,8 @@ destroy_tmp_register_data (struct tmp_register_data *tdata)
     tdata->notify (tdata->data);
   }
 
+  g_free (tdata->uri);
+
   if (tdata->endpoint != NULL) {
     gst_object_unref (tdata->endpoint);
   }
@@ -635,6 +915,13 @@ destroy_pending_message (SoupMessage *msg)
     if (post_obj != NULL) {
       g_object_set (G_OBJECT (post_obj), "soup-message", NULL, NULL);
     }
+
+    if (GPOINTER_TO_INT (g_object_get_qdata (G_OBJECT (msg),
+                         key_paused_quark () ) ) ) {
+      /* Let soup read and discard the rest of the upload */
+      g_object_set_qdata (G_OBJECT (msg), key_paused_quark (), NULL);
+      soup_server_unpause_message (serv->priv->server, msg);
+    }
   }
 
   /* Force to remove http server reference */
@@ -646,7 +933,7 @@ destroy_pending_message (SoupMessage *msg)
 }
 
 static gboolean
-kms_http_ep_server_register_handler (KmsHttpEPServer *self, gchar *uri,
+kms_http_ep_server_register_handler (KmsHttpEPServer *self, const gchar *uri,
                                      GstElement *endpoint)
 {
   GstElement *element;
@@ -659,7 +946,8 @@ kms_http_ep_server_register_handler (KmsHttpEPServer *self, gchar *uri,
     return FALSE;
   }
 
-  g_hash_table_insert (self->priv->handlers, uri, g_object_ref (endpoint) );
+  g_hash_table_insert (self->priv->handlers, g_strdup (uri),
+                       g_object_ref (endpoint) );
 
   return TRUE;
 }
@@ -781,6 +1069,7 @@ got_headers_handler (SoupMessage *msg, gpointer data)
   KmsHttpEPServer *self = KMS_HTTP_EP_SERVER (data);
   SoupURI *uri = soup_message_get_uri (msg);
   const char *path = soup_uri_get_path (uri);
+  KmsHttpEPUriCallbacks *cbs;
   GstElement *httpep;
 
   httpep = (GstElement *) g_hash_table_lookup (self->priv->handlers, path);
@@ -825,6 +1114,12 @@ got_headers_handler (SoupMessage *msg, gpointer data)
 
   g_signal_emit (G_OBJECT (self), obj_signals[ACTION_REQUESTED], 0, path,
                  action);
+
+  cbs = kms_http_ep_server_get_uri_callbacks (self, path);
+
+  if (cbs != NULL && cbs->callbacks.action_requested != NULL) {
+    cbs->callbacks.action_requested (self, path, action, cbs->user_data);
+  }
 }
 
 static void
@@ -965,6 +1260,65 @@ kms_http_ep_server_start_impl (KmsHttpEPServer *self,
                               tdata);
 }
 
+static void
+kms_http_ep_server_run_ops (KmsHttpEPServer *self)
+{
+  KmsHttpEPOp *op;
+
+  g_mutex_lock (&self->priv->ops_mutex);
+
+  /* Operations may queue new ones, which still run in order */
+  while ( (op = (KmsHttpEPOp *) g_queue_pop_head (&self->priv->ops) ) != NULL) {
+    g_mutex_unlock (&self->priv->ops_mutex);
+
+    op->func (op->data);
+    op->notify (op->data);
+    g_slice_free (KmsHttpEPOp, op);
+
+    g_mutex_lock (&self->priv->ops_mutex);
+  }
+
+  self->priv->ops_scheduled = FALSE;
+  g_mutex_unlock (&self->priv->ops_mutex);
+}
+
+static gboolean
+run_ops_cb (gpointer data)
+{
+  kms_http_ep_server_run_ops (KMS_HTTP_EP_SERVER (data) );
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Operations from other threads are batched, one loop wake-up runs all */
+/* of them in order */
+static void
+kms_http_ep_server_queue_op (KmsHttpEPServer *self, GSourceFunc func,
+                             gpointer data, GDestroyNotify notify)
+{
+  gboolean schedule;
+  KmsHttpEPOp *op;
+
+  op = g_slice_new (KmsHttpEPOp);
+  op->func = func;
+  op->data = data;
+  op->notify = notify;
+
+  g_mutex_lock (&self->priv->ops_mutex);
+  g_queue_push_tail (&self->priv->ops, op);
+  schedule = !self->priv->ops_scheduled;
+  self->priv->ops_scheduled = TRUE;
+  g_mutex_unlock (&self->priv->ops_mutex);
+
+  if (KMS_LOOP_IS_CURRENT_THREAD (self->priv->loop) ) {
+    /* Done before returning, after the operations queued before it */
+    kms_http_ep_server_run_ops (self);
+  } else if (schedule) {
+    kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_HIGH_IDLE, run_ops_cb,
+                            g_object_ref (self), g_object_unref);
+  }
+}
+
 static void
 add_guint_param (GstElement *httpep, GQuark quark, guint val)
 {
@@ -976,25 +1330,27 @@ add_guint_param (GstElement *httpep, GQuark quark, guint val)
                            (GDestroyNotify) destroy_guint);
 }
 
-static gboolean
-register_end_point_cb (struct tmp_register_data *tdata)
+static gchar *
+create_uri ()
 {
-  GError *gerr = NULL;
-  gchar *uuid_str;
-  gchar *uri;
+  gchar uuid_str[UUID_STR_SIZE];
   uuid_t uuid;
 
-  uuid_str = (gchar *) g_malloc (UUID_STR_SIZE);
   uuid_generate (uuid);
   uuid_unparse (uuid, uuid_str);
 
-  /* Create URI from uuid string and add it to list of handlers */
-  uri = g_strdup_printf ("/%s", uuid_str);
-  g_free (uuid_str);
+  return g_strdup_printf ("/%s", uuid_str);
+}
 
+static gboolean
+register_end_point_cb (struct tmp_register_data *tdata)
+{
+  GError *gerr = NULL;
+  const gchar *uri = tdata->uri;
+
+  /* Add the URI chosen by the caller to the list of handlers */
   if (!kms_http_ep_server_register_handler (tdata->server, uri,
       tdata->endpoint) ) {
-    g_free (uri);
     uri = NULL;
     g_set_error (&gerr, KMS_HTTP_EP_SERVER_ERROR,
                  HTTPEPSERVER_UNEXPECTED_ERROR,
@@ -1012,13 +1368,14 @@ register_end_point_cb (struct tmp_register_data *tdata)
   return G_SOURCE_REMOVE;
 }
 
-static void
+static gchar *
 kms_http_ep_server_register_end_point_impl (KmsHttpEPServer *self,
     GstElement *endpoint, guint timeout, KmsHttpEPRegisterCallback cb,
     gpointer user_data, GDestroyNotify notify)
 {
   struct tmp_register_data *tdata;
   GError *gerr = NULL;
+  gchar *uri;
 
   /* Check whether this is really an httpendpoint element */
   if (http_t == G_TYPE_INVALID) {
@@ -1044,23 +1401,22 @@ kms_http_ep_server_register_end_point_impl (KmsHttpEPServer *self,
     goto error;
   }
 
+  /* The URI is known before the loop registers it */
+  uri = create_uri ();
+
   tdata = g_slice_new (struct tmp_register_data);
   tdata->endpoint = GST_ELEMENT ( gst_object_ref (endpoint) );
   tdata->timeout = timeout;
+  tdata->uri = g_strdup (uri);
   tdata->function = cb;
   tdata->data = user_data;
   tdata->notify = notify;
   tdata->server = KMS_HTTP_EP_SERVER ( g_object_ref (self) );
 
-  if (KMS_LOOP_IS_CURRENT_THREAD (self->priv->loop) ) {
-    register_end_point_cb (tdata);
-    destroy_tmp_register_data (tdata);
-  } else
-    kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_HIGH_IDLE,
-                            (GSourceFunc) register_end_point_cb, tdata,
-                            (GDestroyNotify) destroy_tmp_register_data);
+  kms_http_ep_server_queue_op (self, (GSourceFunc) register_end_point_cb, tdata,
+                               (GDestroyNotify) destroy_tmp_register_data);
 
-  return;
+  return uri;
 
 error:
 
@@ -1073,6 +1429,8 @@ error:
   }
 
   g_clear_error (&gerr);
+
+  return NULL;
 }
 
 static gboolean
@@ -1106,6 +1464,9 @@ unregister_end_point_cb (struct tmp_unregister_data *tdata)
 
   g_hash_table_remove (tdata->server->priv->handlers, tdata->uri);
 
+  /* The owner asked for it, do not call it back anymore */
+  g_hash_table_remove (tdata->server->priv->callbacks, tdata->uri);
+
   if (tdata->cb != NULL) {
     tdata->cb (tdata->server, gerr, tdata->data);
   }
@@ -1139,14 +1500,41 @@ kms_http_ep_server_unregister_end_point_impl (KmsHttpEPServer *self,
   tdata->uri = g_strdup (uri);
   tdata->server = KMS_HTTP_EP_SERVER ( g_object_ref (self) );
 
-  if (KMS_LOOP_IS_CURRENT_THREAD (self->priv->loop) ) {
-    unregister_end_point_cb (tdata);
-    destroy_tmp_unregister_data (tdata);
-  } else {
-    kms_loop_idle_add_full (self->priv->loop, G_PRIORITY_HIGH_IDLE,
-                            (GSourceFunc) unregister_end_point_cb, tdata,
-                            (GDestroyNotify) destroy_tmp_unregister_data);
+  kms_http_ep_server_queue_op (self, (GSourceFunc) unregister_end_point_cb,
+                               tdata, (GDestroyNotify) destroy_tmp_unregister_data);
+}
+
+static gboolean
+set_callbacks_cb (struct tmp_callbacks_data *tdata)
+{
+  if (tdata->cbs == NULL) {
+    g_hash_table_remove (tdata->server->priv->callbacks, tdata->uri);
+    return G_SOURCE_REMOVE;
+  }
+
+  if (!g_hash_table_contains (tdata->server->priv->handlers, tdata->uri) ) {
+    GST_WARNING ("Can not set callbacks, uri %s is not registered", tdata->uri);
+    return G_SOURCE_REMOVE;
   }
+
+  g_hash_table_replace (tdata->server->priv->callbacks, g_strdup (tdata->uri),
+                        tdata->cbs);
+  tdata->cbs = NULL;
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+destroy_tmp_callbacks_data (struct tmp_callbacks_data *tdata)
+{
+  if (tdata->cbs != NULL) {
+    destroy_uri_callbacks (tdata->cbs);
+  }
+
+  g_free (tdata->uri);
+  g_object_unref (tdata->server);
+
+  g_slice_free (struct tmp_callbacks_data, tdata);
 }
 
 static void
@@ -1169,6 +1557,8 @@ kms_http_ep_server_finalize (GObject *obj)
 
   GST_DEBUG_OBJECT (self, "finalize");
 
+  g_mutex_clear (&self->priv->ops_mutex);
+
   g_free (self->priv->iface);
 
   g_free (self->priv->announced_addr);
@@ -1183,6 +1573,11 @@ kms_http_ep_server_finalize (GObject *obj)
     self->priv->handlers = NULL;
   }
 
+  if (self->priv->callbacks != NULL) {
+    g_hash_table_unref (self->priv->callbacks);
+    self->priv->callbacks = NULL;
+  }
+
   if (self->priv->server != NULL) {
     soup_server_disconnect (self->priv->server);
     g_clear_object (&self->priv->server);
@@ -1355,9 +1750,14 @@ kms_http_ep_server_init (KmsHttpEPServer *self)
   self->priv->got_addr = NULL;
   self->priv->handlers = g_hash_table_new_full (g_str_hash, equal_str_key,
                          g_free, g_object_unref);
+  self->priv->callbacks = g_hash_table_new_full (g_str_hash, equal_str_key,
+                          g_free, (GDestroyNotify) destroy_uri_callbacks);
 
   self->priv->rand = g_rand_new();
   self->priv->loop = kms_loop_new ();
+
+  g_mutex_init (&self->priv->ops_mutex);
+  g_queue_init (&self->priv->ops);
 }
 
 /* Virtual public methods */
@@ -1396,14 +1796,14 @@ kms_http_ep_server_stop (KmsHttpEPServer *self,
   KMS_HTTP_EP_SERVER_GET_CLASS (self)->stop (self, stop_cb, user_data, notify);
 }
 
-void
+gchar *
 kms_http_ep_server_register_end_point (KmsHttpEPServer *self,
                                        GstElement *endpoint, guint timeout,
                                        KmsHttpEPRegisterCallback cb,
                                        gpointer user_data,
                                        GDestroyNotify notify)
 {
-  g_return_if_fail (KMS_IS_HTTP_EP_SERVER (self) );
+  g_return_val_if_fail (KMS_IS_HTTP_EP_SERVER (self), NULL);
 
   return KMS_HTTP_EP_SERVER_GET_CLASS (self)->register_end_point (self,
          endpoint, timeout, cb, user_data, notify);
@@ -1419,3 +1819,27 @@ kms_http_ep_server_unregister_end_point (KmsHttpEPServer *self,
   return KMS_HTTP_EP_SERVER_GET_CLASS (self)->unregister_end_point (self, uri,
          cb, user_data, notify);
 }
+
+void
+kms_http_ep_server_set_callbacks (KmsHttpEPServer *self, const gchar *uri,
+                                  const KmsHttpEPCallbacks *callbacks, gpointer user_data,
+                                  GDestroyNotify notify)
+{
+  struct tmp_callbacks_data *tdata;
+
+  g_return_if_fail (KMS_IS_HTTP_EP_SERVER (self) );
+
+  tdata = g_slice_new0 (struct tmp_callbacks_data);
+  tdata->uri = g_strdup (uri);
+  tdata->server = KMS_HTTP_EP_SERVER (g_object_ref (self) );
+
+  if (callbacks != NULL) {
+    tdata->cbs = g_slice_new (KmsHttpEPUriCallbacks);
+    tdata->cbs->callbacks = *callbacks;
+    tdata->cbs->user_data = user_data;
+    tdata->cbs->notify = notify;
+  }
+
+  kms_http_ep_server_queue_op (self, (GSourceFunc) set_callbacks_cb, tdata,
+                               (GDestroyNotify) destroy_tmp_callbacks_data);
+}
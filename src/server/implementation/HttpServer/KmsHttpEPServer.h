@@ -87,6 +87,16 @@ typedef void (*KmsHttpEPServerNotifyCallback) (KmsHttpEPServer * self,
 typedef void (*KmsHttpEPRegisterCallback) (KmsHttpEPServer * self,
     const gchar *uri, GstElement *e, GError * err, gpointer data);
 
+typedef struct _KmsHttpEPCallbacks
+{
+  void (*action_requested) (KmsHttpEPServer * self, const gchar * uri,
+      KmsHttpEndPointAction action, gpointer user_data);
+  void (*url_removed) (KmsHttpEPServer * self, const gchar * uri,
+      gpointer user_data);
+  void (*url_expired) (KmsHttpEPServer * self, const gchar * uri,
+      gpointer user_data);
+} KmsHttpEPCallbacks;
+
 struct _KmsHttpEPServer
 {
   GObject parent_instance;
@@ -106,7 +116,7 @@ struct _KmsHttpEPServerClass
     gpointer user_data, GDestroyNotify notify);
   void (*stop) (KmsHttpEPServer * self, KmsHttpEPServerNotifyCallback cb,
     gpointer user_data, GDestroyNotify notify);
-  void (*register_end_point) (KmsHttpEPServer * self,
+  gchar *(*register_end_point) (KmsHttpEPServer * self,
     GstElement * endpoint, guint timeout, KmsHttpEPRegisterCallback cb,
     gpointer user_data, GDestroyNotify notify);
   void (*unregister_end_point) (KmsHttpEPServer * self, const gchar *,
@@ -130,13 +140,22 @@ void kms_http_ep_server_start (KmsHttpEPServer * self,
 void kms_http_ep_server_stop (KmsHttpEPServer * self,
     KmsHttpEPServerNotifyCallback stop_cb, gpointer user_data,
     GDestroyNotify notify);
-void kms_http_ep_server_register_end_point (KmsHttpEPServer * self,
+/* Returns the URI the endpoint will have, @cb is called from the server */
+/* loop once it is registered. Free it with g_free. */
+gchar *kms_http_ep_server_register_end_point (KmsHttpEPServer * self,
     GstElement * endpoint, guint timeout, KmsHttpEPRegisterCallback cb,
     gpointer user_data, GDestroyNotify notify);
 void kms_http_ep_server_unregister_end_point (KmsHttpEPServer * self,
     const gchar * uri, KmsHttpEPServerNotifyCallback cb, gpointer user_data,
     GDestroyNotify notify);
 
+/* Callbacks are only called for events on @uri, unlike the signals. They */
+/* take effect in order with register and unregister requests and are */
+/* dropped when @uri is unregistered. */
+void kms_http_ep_server_set_callbacks (KmsHttpEPServer * self,
+    const gchar * uri, const KmsHttpEPCallbacks * callbacks,
+    gpointer user_data, GDestroyNotify notify);
+
 #define KMS_HTTP_EP_SERVER_PORT "port"
 #define KMS_HTTP_EP_SERVER_INTERFACE "interface"
 #define KMS_HTTP_EP_SERVER_ANNOUNCED_IP "announced-address"
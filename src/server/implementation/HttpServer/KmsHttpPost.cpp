@@ -27,11 +27,11 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define KMS_HTTP_POST_GET_PRIVATE(obj) \
   (G_TYPE_INSTANCE_GET_PRIVATE ((obj), KMS_TYPE_HTTP_POST, KmsHttpPostPrivate))
 
+#define MAX_BOUNDARY_LENGTH 70 /* RFC 2046 */
+#define MAX_HEADER_LINE_LENGTH 4096
+
 typedef enum {
-  MULTIPART_INITIAL_STAGE,
-  MULTIPART_SKIP_PREAMBLE,
   MULTIPART_READ_HEADERS,
-  MULTIPART_CHECK_HEADERS,
   MULTIPART_READ_CONTENT,
   MULTIPART_IGNORE_CONTENT,
   MULTIPART_FINISHED
@@ -41,8 +41,20 @@ typedef struct _KmsHttpPostMultipart {
   SoupMessageHeaders *headers;
   gchar *boundary;
   ParseState state;
-  gchar *tmp_buff;
-  guint len;
+
+  /* "\r\n--boundary", searched with a Horspool skip table */
+  gchar *delimiter;
+  gsize delimiter_len;
+  gsize skip[256];
+
+  /* End of the last chunk that may begin a delimiter. It is completed */
+  /* with the two bytes that follow the delimiter, so it is never longer */
+  /* than delimiter_len + 2 */
+  gchar *carry;
+  gsize carry_len;
+
+  /* header line split between chunks */
+  GString *line;
 } KmsHttpPostMultipart;
 
 struct _KmsHttpPostPrivate {
@@ -80,204 +92,257 @@ enum {
 static guint obj_signals[LAST_SIGNAL] = { 0 };
 
 static void
-kms_http_post_concat_previous_buffer (KmsHttpPost *self, const char **start,
-                                      const char **end)
+kms_http_post_notify_buffer (KmsHttpPost *self, SoupBuffer *buffer)
 {
-  if (self->priv->multipart->tmp_buff == NULL) {
-    return;
-  }
+  g_signal_emit (G_OBJECT (self), obj_signals[GOT_DATA], 0, buffer);
+}
 
-  if (self->priv->multipart->tmp_buff <= *start &&
-      *start <= self->priv->multipart->tmp_buff + self->priv->multipart->len) {
-    /* Memory overlap => Do not reallocate more memory in this case */
+static void
+kms_notify_buffer_data (KmsHttpPost *self, SoupBuffer *chunk,
+                        const char *start, const char *end)
+{
+  SoupBuffer *buffer;
+
+  if (start >= end) {
     return;
   }
 
-  self->priv->multipart->tmp_buff = (char *) g_realloc (
-                                      self->priv->multipart->tmp_buff,
-                                      self->priv->multipart->len + (*end - *start) );
-  memmove (self->priv->multipart->tmp_buff + self->priv->multipart->len,
-           *start, *end - *start);
-  self->priv->multipart->len += (*end - *start);
-
-  *start = self->priv->multipart->tmp_buff;
-  *end = self->priv->multipart->tmp_buff + self->priv->multipart->len;
+  /* A view into the chunk, no data is copied */
+  buffer = soup_buffer_new_subbuffer (chunk, start - chunk->data, end - start);
+  kms_http_post_notify_buffer (self, buffer);
+  soup_buffer_free (buffer);
 }
 
 static void
-kms_notify_buffer_data (KmsHttpPost *self, const char *start, const char *end)
+kms_notify_carry_data (KmsHttpPost *self, gsize len)
 {
   SoupBuffer *buffer;
 
-  buffer = soup_buffer_new (SOUP_MEMORY_STATIC, start, end - start);
-
-  g_signal_emit (G_OBJECT (self), obj_signals[GOT_DATA], 0, buffer);
+  if (len == 0) {
+    return;
+  }
 
+  /* Data that looked like the beginning of a delimiter at the end of */
+  /* the previous chunk. This is the only copied data. */
+  buffer = soup_buffer_new (SOUP_MEMORY_TEMPORARY,
+                            self->priv->multipart->carry, len);
+  kms_http_post_notify_buffer (self, buffer);
   soup_buffer_free (buffer);
 }
 
-static void
-kms_http_post_skip_preamble (KmsHttpPost *self, const char **start,
-                             const char **end)
+static gboolean
+kms_http_post_set_boundary (KmsHttpPost *self, const gchar *boundary)
 {
-  const char *boundary = self->priv->multipart->boundary;
-  int boundary_len = strlen (boundary);
-  const char *b;
+  KmsHttpPostMultipart *multipart = self->priv->multipart;
+  gsize i, len;
 
-  if (self->priv->multipart->tmp_buff != NULL) {
-    kms_http_post_concat_previous_buffer (self, start, end);
+  if (boundary == NULL) {
+    return FALSE;
   }
 
-  b = (const char *) memchr (*start, '-', *end - *start);
+  len = strlen (boundary);
 
-  if (b == NULL || b != *start) {
-    /*first line of the body is not the boundary tag */
-    self->priv->multipart->state = MULTIPART_IGNORE_CONTENT;
-    return;
+  /* The search relies on '\r' being only at the start of the delimiter */
+  if (len == 0 || len > MAX_BOUNDARY_LENGTH || strpbrk (boundary, "\r\n") ) {
+    return FALSE;
   }
 
-  if (b + boundary_len + 4 > *end) {
-    /* boundary does not fit in this buffer */
-    gchar *mem = NULL;
+  multipart->boundary = g_strdup (boundary);
+  multipart->delimiter = g_strconcat ("\r\n--", boundary, NULL);
+  multipart->delimiter_len = len + 4;
+  multipart->carry = (gchar *) g_malloc (multipart->delimiter_len + 2);
 
-    if (self->priv->multipart->tmp_buff != NULL) {
-      mem = self->priv->multipart->tmp_buff;
-    }
+  for (i = 0; i < G_N_ELEMENTS (multipart->skip); i++) {
+    multipart->skip[i] = multipart->delimiter_len;
+  }
 
-    self->priv->multipart->tmp_buff = (gchar *) g_memdup (b, *end - b);
-    self->priv->multipart->len = *end - b;
+  for (i = 0; i < multipart->delimiter_len - 1; i++) {
+    multipart->skip[ (guchar) multipart->delimiter[i]] =
+      multipart->delimiter_len - 1 - i;
+  }
 
-    if (mem != NULL) {
-      g_free (mem);
-    }
+  /* RFC 2046 5.1.1: the CRLF before the first boundary may be missing. */
+  /* Starting as if it was received also skips any preamble. */
+  multipart->state = MULTIPART_IGNORE_CONTENT;
+  memcpy (multipart->carry, "\r\n", 2);
+  multipart->carry_len = 2;
 
-    /* Move start pointer up to the end */
-    *start = *end;
-    return;
-  }
+  return TRUE;
+}
 
-  /* Check for "--boundary" */
-  if (b[1] != '-' ||
-      memcmp (b + 2, boundary, boundary_len) != 0) {
-    /*first line of the body is not the boundary tag */
-    self->priv->multipart->state = MULTIPART_IGNORE_CONTENT;
-    return;
-  }
+static const char *
+kms_http_post_find_delimiter (KmsHttpPostMultipart *multipart,
+                              const char *start, const char *end)
+{
+  const char *delimiter = multipart->delimiter;
+  gsize len = multipart->delimiter_len;
+  const char *p = start;
 
-  /* Check for "--" or "\r\n" after boundary */
-  if ( (b[boundary_len + 2] == '-' && b[boundary_len + 3] == '-') ||
-       (b[boundary_len + 2] == '\r' && b[boundary_len + 3] == '\n') ) {
+  while ( (gsize) (end - p) >= len) {
+    guchar c = (guchar) p[len - 1];
 
-    if (b[boundary_len + 2] == '\r' && b[boundary_len + 3] == '\n') {
-      /* End of this body part */
-      self->priv->multipart->state = MULTIPART_READ_HEADERS;
-    } else {
-      /* Double hyphens at the end of the boundary marks the end */
-      /* of the multipart post requets */
-      self->priv->multipart->state = MULTIPART_FINISHED;
+    if (c == (guchar) delimiter[len - 1] && memcmp (p, delimiter, len - 1) == 0) {
+      return p;
     }
-  }
 
-  if (*end > b + boundary_len + 4) {
-    *start = b + boundary_len + 4;
-    return;
+    p += multipart->skip[c];
   }
 
-  if (self->priv->multipart->tmp_buff != NULL) {
-    g_free (self->priv->multipart->tmp_buff);
-    self->priv->multipart->tmp_buff = NULL;
-  }
+  return NULL;
+}
 
-  /* Move start pointer up to the end */
-  *start = *end;
+static void
+kms_http_post_keep_candidate (KmsHttpPostMultipart *multipart,
+                              const char *start, const char *end)
+{
+  memcpy (multipart->carry, start, end - start);
+  multipart->carry_len = end - start;
 }
 
 static void
-kms_http_post_read_until_boundary (KmsHttpPost *self, const char **start,
-                                   const char **end, gboolean ignore)
+kms_http_post_check_headers (KmsHttpPost *self);
+
+/* Moves to the next state if p points to "\r\n" or "--" */
+static gboolean
+kms_http_post_delimiter_end (KmsHttpPost *self, const char *p)
 {
-  const char *boundary = self->priv->multipart->boundary;
-  int boundary_len = strlen (boundary);
-  const char *b;
+  KmsHttpPostMultipart *multipart = self->priv->multipart;
+  ParseState next;
+
+  if (p[0] == '\r' && p[1] == '\n') {
+    /* End of this body part */
+    next = MULTIPART_READ_HEADERS;
+  } else if (p[0] == '-' && p[1] == '-') {
+    /* Double hyphens at the end of the boundary marks the end */
+    /* of the multipart post requets */
+    next = MULTIPART_FINISHED;
+  } else {
+    return FALSE;
+  }
 
-  if (self->priv->multipart->tmp_buff != NULL) {
-    kms_http_post_concat_previous_buffer (self, start, end);
+  if (multipart->state == MULTIPART_READ_CONTENT) {
+    /* Do not process anything else */
+    next = MULTIPART_FINISHED;
+  } else {
+    soup_message_headers_clear (multipart->headers);
   }
 
-  for (b = (const char *) memchr (*start, '\r', *end - *start); b != NULL;
-       b = (const char *) memchr (b + 1, '\r', *end - (b + 1) ) ) {
+  multipart->state = next;
 
-    if (b + boundary_len + 6 > *end) {
-      /* boundary does not fit in this buffer */
-      gchar *mem = NULL;
+  return TRUE;
+}
 
-      if (self->priv->multipart->tmp_buff != NULL) {
-        mem = self->priv->multipart->tmp_buff;
-      }
+/* Completes the delimiter candidate kept from the previous chunk. */
+/* Returns how many bytes of the chunk were consumed. */
+static gsize
+kms_http_post_resolve_carry (KmsHttpPost *self, const char *start,
+                             const char *end)
+{
+  KmsHttpPostMultipart *multipart = self->priv->multipart;
+  gboolean ignore = multipart->state != MULTIPART_READ_CONTENT;
+  gsize total = multipart->delimiter_len + 2;
 
-      self->priv->multipart->tmp_buff = (gchar *) g_memdup (b, *end - b);
-      self->priv->multipart->len = *end - b;
+  while (multipart->carry_len > 0) {
+    gsize k = multipart->carry_len, j = 0, r;
 
-      /* Notify data read so far */
-      if (!ignore && *start < b) {
-        kms_notify_buffer_data (self, *start, b );
+    while (k < total && start + j < end) {
+      if (k < multipart->delimiter_len &&
+          start[j] != multipart->delimiter[k]) {
+        break;
       }
 
-      if (mem != NULL) {
-        g_free (mem);
-      }
+      multipart->carry[k++] = start[j++];
+    }
 
-      /* Move start pointer up to the end */
-      *start = *end;
-      return;
+    if (k < total && start + j == end) {
+      /* Still a candidate, wait for the next chunk */
+      multipart->carry_len = k;
+      return j;
     }
 
-    /* Check for "\r\n--boundary" */
-    if (b[1] != '\n' || b[2] != '-' || b[3] != '-' ||
-        memcmp (b + 4, boundary, boundary_len) != 0) {
-      continue;
+    if (k == total &&
+        kms_http_post_delimiter_end (self,
+                                     multipart->carry + multipart->delimiter_len) ) {
+      multipart->carry_len = 0;
+      return j;
     }
 
-    /* Check for "--" or "\r\n" after boundary */
-    if ( (b[boundary_len + 4] == '-' && b[boundary_len + 5] == '-') ||
-         (b[boundary_len + 4] == '\r' && b[boundary_len + 5] == '\n') ) {
-
-      if (b[boundary_len + 4] == '\r' && b[boundary_len + 5] == '\n') {
-        /* End of this body part */
-        self->priv->multipart->state = MULTIPART_READ_HEADERS;
-      } else {
-        /* Double hyphens at the end of the boundary marks the end */
-        /* of the multipart post requets */
-        self->priv->multipart->state = MULTIPART_FINISHED;
+    /* Not a delimiter, only the bytes after it may begin another one */
+    for (r = 1; r < multipart->carry_len; r++) {
+      if (multipart->carry[r] == '\r') {
+        break;
       }
+    }
 
-      /* Notify data read so far */
-      if (!ignore && *start < b) {
-        kms_notify_buffer_data (self, *start, b);
+    if (!ignore) {
+      kms_notify_carry_data (self, r);
+    }
+
+    memmove (multipart->carry, multipart->carry + r, multipart->carry_len - r);
+    multipart->carry_len -= r;
+  }
+
+  return 0;
+}
+
+/* Returns where the data following the body part begins */
+static const char *
+kms_http_post_read_until_boundary (KmsHttpPost *self, SoupBuffer *chunk,
+                                   const char *start, const char *end)
+{
+  KmsHttpPostMultipart *multipart = self->priv->multipart;
+  gboolean ignore = multipart->state != MULTIPART_READ_CONTENT;
+  gsize len = multipart->delimiter_len;
+  const char *b;
+  gsize tail, i;
+
+  for (b = kms_http_post_find_delimiter (multipart, start, end); b != NULL;
+       b = kms_http_post_find_delimiter (multipart, b + 1, end) ) {
+
+    if (b + len + 2 > end) {
+      /* What follows the boundary is in the next chunk */
+      if (!ignore) {
+        kms_notify_buffer_data (self, chunk, start, b);
       }
 
-      if (*end <= b + boundary_len + 6) {
-        /* Free temporal buffer */
-        break;
+      kms_http_post_keep_candidate (multipart, b, end);
+      return end;
+    }
+
+    if (kms_http_post_delimiter_end (self, b + len) ) {
+      /* Notify data read so far */
+      if (!ignore) {
+        kms_notify_buffer_data (self, chunk, start, b);
       }
 
-      *start = b + boundary_len + 6;
-      return;
+      return b + len + 2;
     }
   }
 
-  /* Notify data */
-  if (!ignore && b == NULL) {
-    kms_notify_buffer_data (self, *start, *end);
+  /* The last bytes may be the beginning of a delimiter */
+  tail = MIN ( (gsize) (end - start), len - 1);
+
+  for (i = 1; i <= tail; i++) {
+    if (end[-i] == '\r') {
+      break;
+    }
   }
 
-  if (self->priv->multipart->tmp_buff != NULL) {
-    g_free (self->priv->multipart->tmp_buff);
-    self->priv->multipart->tmp_buff = NULL;
+  if (i <= tail && memcmp (end - i, multipart->delimiter, i) == 0) {
+    if (!ignore) {
+      kms_notify_buffer_data (self, chunk, start, end - i);
+    }
+
+    kms_http_post_keep_candidate (multipart, end - i, end);
+    return end;
   }
 
-  /* Move start pointer up to the end */
-  *start = *end;
+  /* Notify data */
+  if (!ignore) {
+    kms_notify_buffer_data (self, chunk, start, end);
+  }
+
+  return end;
 }
 
 static void
@@ -334,67 +399,44 @@ kms_http_post_parse_header (KmsHttpPost *self, const char *start,
   g_free (value);
 }
 
-static void
-kms_http_post_read_headers (KmsHttpPost *self, const char **start,
-                            const char **end)
+static const char *
+kms_http_post_read_headers (KmsHttpPost *self, const char *start,
+                            const char *end)
 {
-  const char *b;
-
-  if (self->priv->multipart->tmp_buff != NULL) {
-    kms_http_post_concat_previous_buffer (self, start, end);
-  }
+  GString *line = self->priv->multipart->line;
+  const char *b = start;
 
-  b = *start;
-
-  while (b <= *end) {
-    const char *newline = (const char *) memchr (b, '\n', *end - b);
+  while (b < end) {
+    const char *newline = (const char *) memchr (b, '\n', end - b);
 
     if (newline == NULL) {
       /* header does not fit in this buffer */
-      gchar *mem = NULL;
-
-      if (self->priv->multipart->tmp_buff != NULL) {
-        mem = self->priv->multipart->tmp_buff;
-      }
-
-      self->priv->multipart->tmp_buff = (gchar *) g_memdup (b, *end - b);
-      self->priv->multipart->len = *end - b;
-
-      if (mem != NULL) {
-        g_free (mem);
-      }
-
-      /* Move start pointer up to the end */
-      *start = *end;
-      return;
+      g_string_append_len (line, b, end - b);
+      break;
     }
 
-    /* Check if this is a blank line */
-    if (newline - b == 1 && b[0] == '\r' && b[1] == '\n') {
-      self->priv->multipart->state = MULTIPART_CHECK_HEADERS;
-
-      if (*end <= newline + 1) {
-        /* Free temporal buffer */
-        break;
-      }
+    g_string_append_len (line, b, newline + 1 - b);
+    b = newline + 1;
 
-      *start = newline + 1;
-      return;
+    /* Check if this is a blank line */
+    if (line->len == 2 && line->str[0] == '\r') {
+      g_string_truncate (line, 0);
+      kms_http_post_check_headers (self);
+      return b;
     }
 
-    kms_http_post_parse_header (self, b, newline);
-
-    /* Search next header starting from the next character following '\n' */
-    b = newline + 1;
+    kms_http_post_parse_header (self, line->str, line->str + line->len);
+    g_string_truncate (line, 0);
   }
 
-  if (self->priv->multipart->tmp_buff != NULL) {
-    g_free (self->priv->multipart->tmp_buff);
-    self->priv->multipart->tmp_buff = NULL;
+  if (line->len > MAX_HEADER_LINE_LENGTH) {
+    GST_WARNING ("Header line too long, ignoring body part");
+    g_string_truncate (line, 0);
+    soup_message_headers_clear (self->priv->multipart->headers);
+    self->priv->multipart->state = MULTIPART_IGNORE_CONTENT;
   }
 
-  /* Move start pointer up to the end */
-  *start = *end;
+  return end;
 }
 
 static void
@@ -403,9 +445,7 @@ kms_http_post_check_headers (KmsHttpPost *self)
   GHashTable *params = NULL;
   gchar *disposition = NULL;
 
-  if (self->priv->multipart->headers == NULL) {
-    return;
-  }
+  self->priv->multipart->state = MULTIPART_IGNORE_CONTENT;
 
   if (!soup_message_headers_get_content_disposition (
         self->priv->multipart->headers, &disposition, &params) ) {
@@ -415,8 +455,6 @@ kms_http_post_check_headers (KmsHttpPost *self)
   /* We are only interested in filename param */
   if (g_hash_table_contains (params, "filename") ) {
     self->priv->multipart->state = MULTIPART_READ_CONTENT;
-  } else {
-    self->priv->multipart->state = MULTIPART_IGNORE_CONTENT;
   }
 
 end:
@@ -431,75 +469,24 @@ end:
 }
 
 static void
-kms_http_post_check_preamble (KmsHttpPost *self, const char **start,
-                              const char **end)
+kms_http_post_parse_multipart_data (KmsHttpPost *self, SoupBuffer *chunk)
 {
-  if (*end - *start < 1) {
-    return;
-  }
+  const char *start = chunk->data;
+  const char *end = chunk->data + chunk->length;
 
-  if (*start[0] == '\r') {
-    /* Multipart without preamble */
-    self->priv->multipart->state = MULTIPART_IGNORE_CONTENT;
-    return;
+  if (self->priv->multipart->carry_len > 0) {
+    start += kms_http_post_resolve_carry (self, start, end);
   }
 
-  /* RFC 1341 7.2.1 Multipart: The common syntax */
-
-  /* Note that the encapsulation boundary must occur at the beginning of a line,
-   * i.e., following a CRLF, and that initial CRLF is considered to be part of
-   * the encapsulation boundary rather than part of the preceding part.
-   * The requirement that the encapsulation boundary begins with a CRLF implies
-   * that the body of a multipart entity must itself begin with a CRLF before
-   * the first encapsulation line -- that is, if the "preamble" area is not
-   * used, the entity headers must be followed by TWO CRLFs. This is indeed how
-   * such entities should be composed. A tolerant mail reading program, however,
-   * may interpret a body of type multipart that begins with an encapsulation
-   * line NOT initiated by a CRLF as also being an encapsulation boundary
-   */
-
-  self->priv->multipart->state = MULTIPART_SKIP_PREAMBLE;
-}
-
-static void
-kms_http_post_parse_multipart_data (KmsHttpPost *self, const char *start,
-                                    const char *end)
-{
   while (start != end) {
     switch (self->priv->multipart->state) {
-    case MULTIPART_INITIAL_STAGE:
-      kms_http_post_check_preamble (self, &start, &end);
-      break;
-
-    case MULTIPART_SKIP_PREAMBLE:
-      kms_http_post_skip_preamble (self, &start, &end);
-      break;
-
     case MULTIPART_READ_HEADERS:
-      kms_http_post_read_headers (self, &start, &end);
-      break;
-
-    case MULTIPART_CHECK_HEADERS:
-      kms_http_post_check_headers (self);
+      start = kms_http_post_read_headers (self, start, end);
       break;
 
     case MULTIPART_IGNORE_CONTENT:
-      kms_http_post_read_until_boundary (self, &start, &end, TRUE);
-
-      if (self->priv->multipart->state != MULTIPART_IGNORE_CONTENT) {
-        soup_message_headers_clear (self->priv->multipart->headers);
-      }
-
-      break;
-
     case MULTIPART_READ_CONTENT:
-      kms_http_post_read_until_boundary (self, &start, &end, FALSE);
-
-      if (self->priv->multipart->state != MULTIPART_READ_CONTENT) {
-        /* Do not process anything else */
-        self->priv->multipart->state = MULTIPART_FINISHED;
-      }
-
+      start = kms_http_post_read_until_boundary (self, chunk, start, end);
       break;
 
     case MULTIPART_FINISHED:
@@ -516,12 +503,11 @@ got_chunk_cb (SoupMessage *msg, SoupBuffer *chunk, gpointer data)
 
   if (self->priv->multipart != NULL) {
     /* Extract data from body parts */
-    kms_http_post_parse_multipart_data (self, chunk->data,
-                                        chunk->data + chunk->length);
+    kms_http_post_parse_multipart_data (self, chunk);
   } else {
     /* Data received in a non multipart POST request is */
     /* provided as it is without any further processing */
-    kms_notify_buffer_data (self, chunk->data, chunk->data + chunk->length);
+    kms_http_post_notify_buffer (self, chunk);
   }
 }
 
@@ -538,7 +524,9 @@ kms_http_post_destroy_multipart (KmsHttpPost *self)
     soup_message_headers_free (self->priv->multipart->headers);
   }
 
-  g_free (self->priv->multipart->tmp_buff);
+  g_free (self->priv->multipart->delimiter);
+  g_free (self->priv->multipart->carry);
+  g_string_free (self->priv->multipart->line, TRUE);
 
   g_slice_free (KmsHttpPostMultipart, self->priv->multipart);
   self->priv->multipart = NULL;
@@ -555,6 +543,7 @@ kms_http_post_init_multipart (KmsHttpPost *self)
   self->priv->multipart = g_slice_new0 (KmsHttpPostMultipart);
   self->priv->multipart->headers =
     soup_message_headers_new (SOUP_MESSAGE_HEADERS_MULTIPART);
+  self->priv->multipart->line = g_string_new (NULL);
 }
 
 static void
@@ -609,10 +598,8 @@ kms_http_post_configure_msg (KmsHttpPost *self)
         strncmp (content_type + 11, "form-data", 9) ) {
       /* Content-Type: multipart/form-data */
       kms_http_post_init_multipart (self);
-      self->priv->multipart->boundary =
-        g_strdup ( (gchar *) g_hash_table_lookup (params, "boundary") );
-
-      if (self->priv->multipart->boundary == NULL) {
+      if (!kms_http_post_set_boundary (self,
+                                       (gchar *) g_hash_table_lookup (params, "boundary") ) ) {
         GST_WARNING ("Malformed multipart POST request");
         kms_http_post_destroy_multipart (self);
         soup_message_set_status (self->priv->msg, SOUP_STATUS_NOT_ACCEPTABLE);
@@ -0,0 +1,58 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "MixerStatsReport.hpp"
+#include "ElementStats.hpp"
+#include "MediaLatencyStat.hpp"
+#include "StatsType.hpp"
+#include "MixerStats.hpp"
+
+namespace kurento
+{
+
+void
+MixerStatsReport::fill (std::map <std::string, std::shared_ptr<Stats>> &report,
+                        const std::string &id, GstElement *mixer, double timestamp)
+{
+  std::shared_ptr<ElementStats> eStats;
+  std::vector<std::shared_ptr<MediaLatencyStat>> inputStats;
+  double inputAudioLatency = 0.0, inputVideoLatency = 0.0;
+  guint latency = 0;
+  guint64 lateFrames = 0;
+
+  auto it = report.find (id);
+
+  if (it != report.end () ) {
+    eStats = std::dynamic_pointer_cast <ElementStats> (it->second);
+  }
+
+  if (eStats) {
+    inputAudioLatency = eStats->getInputAudioLatency ();
+    inputVideoLatency = eStats->getInputVideoLatency ();
+    inputStats = eStats->getInputLatency ();
+  }
+
+  g_object_get (G_OBJECT (mixer), "latency", &latency, "late-frames",
+                &lateFrames, NULL);
+
+  report[id] = std::make_shared <MixerStats> (id,
+               std::make_shared <StatsType> (StatsType::element), timestamp,
+               inputAudioLatency, inputVideoLatency, inputStats, latency,
+               lateFrames);
+}
+
+} /* kurento */
@@ -22,6 +22,8 @@
 #include <KurentoException.hpp>
 #include <gst/gst.h>
 
+#include "MixerStatsReport.hpp"
+
 #define GST_CAT_DEFAULT kurento_composite_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 #define GST_DEFAULT_NAME "KurentoCompositeImpl"
@@ -37,6 +39,14 @@ CompositeImpl::CompositeImpl (const boost::property_tree::ptree &conf,
 {
 }
 
+void
+CompositeImpl::fillStatsReport (std::map <std::string, std::shared_ptr<Stats>>
+    &report, const GstStructure *stats, double timestamp)
+{
+  HubImpl::fillStatsReport (report, stats, timestamp);
+  MixerStatsReport::fill (report, getId (), element, timestamp);
+}
+
 MediaObjectImpl *
 CompositeImplFactory::createObject (const boost::property_tree::ptree &conf,
                                     std::shared_ptr<MediaPipeline> mediaPipeline) const
@@ -20,7 +20,6 @@
 #include <KurentoException.hpp>
 #include <gst/gst.h>
 #include "HttpServer/HttpEndPointServer.hpp"
-#include <condition_variable>
 
 #define GST_CAT_DEFAULT kurento_http_endpoint_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -33,18 +32,6 @@ static const std::string HTTP_SERVICE_ANNOUNCED_ADDRESS = "announcedAddress";
 namespace kurento
 {
 
-static void
-action_requested_adaptor_function (KmsHttpEPServer *server, const gchar *uri,
-                                   KmsHttpEndPointAction action, gpointer data)
-{
-  auto handler =
-    reinterpret_cast < std::function < void (const gchar *uri,
-        KmsHttpEndPointAction action) > * >
-    (data);
-
-  (*handler) (uri, action);
-}
-
 static std::string
 getUriFromUrl (std::string url)
 {
@@ -85,132 +72,163 @@ getUriFromUrl (std::string url)
 }
 
 static void
-session_terminated_adaptor_function (KmsHttpEPServer *server, const gchar *uri,
-                                     gpointer data)
+destroy_weak_ptr (gpointer data)
+{
+  delete reinterpret_cast<std::weak_ptr<HttpEndpointImpl> *> (data);
+}
+
+void
+HttpEndpointImpl::actionRequestedAdaptor (KmsHttpEPServer *server,
+    const gchar *uri, KmsHttpEndPointAction action, gpointer data)
+{
+  auto weak = reinterpret_cast<std::weak_ptr<HttpEndpointImpl> *> (data);
+  std::shared_ptr<HttpEndpointImpl> self = weak->lock ();
+
+  /* Released, its unregistration is on the way */
+  if (!self) {
+    return;
+  }
+
+  self->actionRequestedLambda (uri, action);
+}
+
+void
+HttpEndpointImpl::sessionTerminatedAdaptor (KmsHttpEPServer *server,
+    const gchar *uri, gpointer data)
 {
-  auto handler = reinterpret_cast<std::function<void (const gchar *uri) >*>
-                 (data);
+  auto weak = reinterpret_cast<std::weak_ptr<HttpEndpointImpl> *> (data);
+  std::shared_ptr<HttpEndpointImpl> self = weak->lock ();
+
+  /* Released, its unregistration is on the way */
+  if (!self) {
+    return;
+  }
 
-  (*handler) (uri);
+  self->sessionTerminatedLambda (uri);
 }
 
-static void
-register_end_point_adaptor_function (KmsHttpEPServer *self, const gchar *uri,
-                                     GstElement *e, GError *err, gpointer data)
+void
+HttpEndpointImpl::registerEndPointAdaptor (KmsHttpEPServer *server,
+    const gchar *uri, GstElement *e, GError *err, gpointer data)
 {
-  auto handler =
-    reinterpret_cast<std::function<void (const gchar *uri, GError *err) >*>
-    (data);
+  auto weak = reinterpret_cast<std::weak_ptr<HttpEndpointImpl> *> (data);
+  std::shared_ptr<HttpEndpointImpl> self;
+
+  if (err == NULL) {
+    return;
+  }
+
+  GST_ERROR ("Can not register end point %s: %s", GST_ELEMENT_NAME (e),
+             err->message);
+
+  self = weak->lock ();
+
+  /* Released, nothing to report */
+  if (!self) {
+    return;
+  }
 
-  (*handler) (uri, err);
+  self->registerFailedLambda (err->message);
 }
 
 static void
 unregister_end_point_adaptor_function (KmsHttpEPServer *self, GError *err,
                                        gpointer data)
 {
-  auto handler = reinterpret_cast<std::function<void (GError *err) >*> (data);
-  (*handler) (err);
+  if (err != NULL) {
+    GST_ERROR ("Could not unregister uri %s: %s", (const gchar *) data,
+               err->message);
+  }
 }
 
 void
 HttpEndpointImpl::unregister_end_point ()
 {
+  std::unique_lock<std::mutex> lock (mutex);
   std::string uri = getUriFromUrl (url);
-  std::condition_variable cond;
-  std::mutex mutex;
-  bool finish = FALSE;
 
   if (!urlSet) {
     return;
   }
 
-  std::function <void (GError *err) > aux = [&] (GError * err) {
-    if (err != NULL) {
-      GST_ERROR ("Could not unregister uri %s: %s", uri.c_str(), err->message);
-    }
+  url = "";
+  urlSet = false;
+  lock.unlock ();
 
-    url = "";
-    urlSet = false;
+  /* Callbacks are dropped in order with this request, no need to wait */
+  server->unregisterEndPoint (uri, unregister_end_point_adaptor_function,
+                              g_strdup (uri.c_str () ), g_free);
+}
 
-    std::unique_lock<std::mutex> lock (mutex);
+void
+HttpEndpointImpl::register_end_point ()
+{
+  std::weak_ptr<HttpEndpointImpl> *weak;
+  std::string uri;
+  gchar *url_tmp;
 
-    finish = TRUE;
-    cond.notify_all ();
-  };
+  weak = new std::weak_ptr<HttpEndpointImpl> (
+    std::dynamic_pointer_cast<HttpEndpointImpl> (shared_from_this () ) );
 
-  server->unregisterEndPoint (uri, unregister_end_point_adaptor_function,
-                              &aux, NULL);
+  /* The uri is known now, the server loop adds it later and reports */
+  /* a failure to do so through registerFailedLambda */
+  uri = server->registerEndPoint (element, disconnectionTimeout,
+                                  registerEndPointAdaptor, weak, destroy_weak_ptr);
+
+  if (uri.empty () ) {
+    return;
+  }
+
+  url_tmp = g_strdup_printf ("http://%s:%d%s",
+                             server->getAnnouncedAddress().c_str (), server->getPort(), uri.c_str () );
 
   std::unique_lock<std::mutex> lock (mutex);
 
-  while (!finish) {
-    cond.wait (lock);
+  /* The loop may have failed it already, postConstructor checks that */
+  if (!registerFailed) {
+    url = std::string (url_tmp);
+    urlSet = true;
   }
+
+  g_free (url_tmp);
 }
 
 void
-HttpEndpointImpl::register_end_point ()
+HttpEndpointImpl::postConstructor ()
 {
-  std::condition_variable cond;
-  std::mutex mutex;
-  bool done = FALSE;
-
-  std::function <void (const gchar *, GError *err) > aux = [&] (const gchar * uri,
-  GError * err) {
-    std::string addr;
-    guint port;
-    gchar *url_tmp;
-
-    if (err != NULL) {
-      GST_ERROR ("Can not register end point: %s", err->message);
-      goto do_signal;
-    }
-
-    actionRequestedHandlerId =
-      server->connectSignal ("action-requested",
-                             G_CALLBACK (action_requested_adaptor_function),
-                             &actionRequestedLambda);
-    urlRemovedHandlerId =
-      server->connectSignal ("url-removed",
-                             G_CALLBACK (session_terminated_adaptor_function),
-                             &sessionTerminatedLambda);
-    urlExpiredHandlerId =
-      server->connectSignal ("url-expired",
-                             G_CALLBACK (session_terminated_adaptor_function),
-                             &sessionTerminatedLambda);
-
-    addr = server->getAnnouncedAddress();
-    port = server->getPort();
-
-    url_tmp = g_strdup_printf ("http://%s:%d%s", addr.c_str (), port, uri);
-    url = std::string (url_tmp);
-    g_free (url_tmp);
-    urlSet = true;
+  KmsHttpEPCallbacks callbacks;
+  std::weak_ptr<HttpEndpointImpl> *weak;
+  std::string uri;
 
-do_signal:
+  SessionEndpointImpl::postConstructor ();
 
-    std::unique_lock<std::mutex> lock (mutex);
+  register_end_point ();
 
-    done = TRUE;
-    cond.notify_all ();
+  std::unique_lock<std::mutex> lock (mutex);
 
-  };
+  if (!urlSet) {
+    throw KurentoException (HTTP_END_POINT_REGISTRATION_ERROR,
+                            "Cannot register HttpEndPoint");
+  }
 
-  server->registerEndPoint (element,
-                            disconnectionTimeout, register_end_point_adaptor_function,
-                            &aux, NULL);
+  uri = getUriFromUrl (url);
+  lock.unlock ();
 
-  std::unique_lock<std::mutex> lock (mutex);
+  /* Only events on this uri reach the endpoint, until it is unregistered */
+  callbacks.action_requested = actionRequestedAdaptor;
+  callbacks.url_removed = sessionTerminatedAdaptor;
+  callbacks.url_expired = sessionTerminatedAdaptor;
 
-  while (!done) {
-    cond.wait (lock);
-  }
+  weak = new std::weak_ptr<HttpEndpointImpl> (
+    std::dynamic_pointer_cast<HttpEndpointImpl> (shared_from_this () ) );
+  server->setCallbacks (uri, &callbacks, weak, destroy_weak_ptr);
 }
 
 bool
 HttpEndpointImpl::is_registered()
 {
+  std::unique_lock<std::mutex> lock (mutex);
+
   return urlSet;
 }
 
@@ -223,21 +241,7 @@ HttpEndpointImpl::HttpEndpointImpl (const boost::property_tree::ptree &conf,
   this->disconnectionTimeout = disconnectionTimeout;
   actionRequestedLambda = [&] (const gchar * uri,
   KmsHttpEndPointAction action) {
-    std::string uriStr = uri;
-
-    GST_DEBUG ("Action requested URI %s", uriStr.c_str() );
-
-    if (url.size() <= uriStr.size() ) {
-      return;
-    }
-
-    /* Remove the initial "http://host:port" to compare the uri */
-    std::string substr = url.substr (url.size() - uriStr.size(),
-                                     std::string::npos);
-
-    if (substr.compare (uriStr) != 0) {
-      return;
-    }
+    GST_DEBUG ("Action requested URI %s", uri);
 
     /* Send event */
     if (!g_atomic_int_compare_and_exchange (& (sessionStarted), 0, 1) ) {
@@ -266,40 +270,31 @@ HttpEndpointImpl::HttpEndpointImpl (const boost::property_tree::ptree &conf,
     }
   };
 
-  sessionTerminatedLambda = [&] (const gchar * uri) {
-    std::string uriStr = uri;
-
-    if (url.size() <= uriStr.size() ) {
-      return;
-    }
+  registerFailedLambda = [&] (const gchar * message) {
+    std::unique_lock<std::mutex> lock (mutex);
+    bool wasSet = urlSet;
 
-    /* Remove the initial "http://host:port" to compare the uri */
-    std::string substr = url.substr (url.size() - uriStr.size(),
-                                     std::string::npos);
+    registerFailed = true;
+    url = "";
+    urlSet = false;
+    lock.unlock ();
 
-    if (substr.compare (uriStr) != 0) {
+    /* Failed before the url was given, postConstructor throws */
+    if (!wasSet) {
       return;
     }
 
-    GST_DEBUG ("Session terminated URI %s", uriStr.c_str() );
-
-    if (actionRequestedHandlerId > 0) {
-      server->disconnectSignal (
-        actionRequestedHandlerId);
-      actionRequestedHandlerId = 0;
-    }
+    try {
+      Error error (shared_from_this(), std::string ("Cannot register url: ") +
+                   message, 0, "HTTP_END_POINT_REGISTRATION_ERROR");
 
-    if (urlExpiredHandlerId > 0) {
-      server->disconnectSignal (
-        urlExpiredHandlerId);
-      urlExpiredHandlerId = 0;
+      signalError (error);
+    } catch (std::bad_weak_ptr &e) {
     }
+  };
 
-    if (urlRemovedHandlerId > 0) {
-      server->disconnectSignal (
-        urlRemovedHandlerId);
-      urlRemovedHandlerId = 0;
-    }
+  sessionTerminatedLambda = [&] (const gchar * uri) {
+    GST_DEBUG ("Session terminated URI %s", uri);
 
     unregister_end_point ();
 
@@ -331,26 +326,13 @@ HttpEndpointImpl::HttpEndpointImpl (const boost::property_tree::ptree &conf,
 
 HttpEndpointImpl::~HttpEndpointImpl()
 {
-  if (actionRequestedHandlerId > 0) {
-    server->disconnectSignal (
-      actionRequestedHandlerId);
-  }
-
-  if (urlExpiredHandlerId > 0) {
-    server->disconnectSignal (
-      urlExpiredHandlerId);
-  }
-
-  if (urlRemovedHandlerId > 0) {
-    server->disconnectSignal (
-      urlRemovedHandlerId);
-  }
-
   unregister_end_point ();
 }
 
 std::string HttpEndpointImpl::getUrl ()
 {
+  std::unique_lock<std::mutex> lock (mutex);
+
   return url;
 }
 
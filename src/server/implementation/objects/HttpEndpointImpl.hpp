@@ -21,6 +21,7 @@
 #include "HttpEndpoint.hpp"
 #include <EventHandler.hpp>
 #include "HttpServer/HttpEndPointServer.hpp"
+#include <mutex>
 
 namespace kurento
 {
@@ -55,6 +56,8 @@ public:
   virtual void Serialize (JsonSerializer &serializer) override;
 
 protected:
+  virtual void postConstructor () override;
+
   void unregister_end_point ();
   void register_end_point ();
   bool is_registered();
@@ -62,8 +65,11 @@ protected:
 private:
   std::shared_ptr<HttpEndPointServer> server;
 
+  /* Written from the server loop too, guarded by mutex */
+  std::mutex mutex;
   std::string url;
   bool urlSet = false;
+  bool registerFailed = false;
   guint disconnectionTimeout;
 
   class StaticConstructor
@@ -74,14 +80,19 @@ private:
 
   static StaticConstructor staticConstructor;
 
-  gulong actionRequestedHandlerId;
-  gulong urlRemovedHandlerId;
-  gulong urlExpiredHandlerId;
+  static void actionRequestedAdaptor (KmsHttpEPServer *server, const gchar *uri,
+                                      KmsHttpEndPointAction action, gpointer data);
+  static void sessionTerminatedAdaptor (KmsHttpEPServer *server,
+                                        const gchar *uri, gpointer data);
+  static void registerEndPointAdaptor (KmsHttpEPServer *server,
+                                       const gchar *uri, GstElement *e, GError *err, gpointer data);
+
   gint sessionStarted = 0;
 
   std::function<void (const gchar *uri, KmsHttpEndPointAction action) >
   actionRequestedLambda;
   std::function<void (const gchar *uri) > sessionTerminatedLambda;
+  std::function<void (const gchar *message) > registerFailedLambda;
 
 };
 
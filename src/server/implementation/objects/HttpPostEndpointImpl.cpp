@@ -23,7 +23,18 @@
 #include <gst/gst.h>
 #include <SignalHandler.hpp>
 
+#include "StatsType.hpp"
+#include "HttpPostEndpointStats.hpp"
+
 #define USE_ENCODED_MEDIA "use-encoded-media"
+#define HIGH_WATER_MARK "high-water-mark"
+#define LOW_WATER_MARK "low-water-mark"
+#define THROTTLED_TIME "throttled-time"
+
+#define DEFAULT_POST_HIGH_WATER_MARK (2 * 1024 * 1024)
+#define DEFAULT_POST_LOW_WATER_MARK (512 * 1024)
+
+#define NS_TO_MS 1000000
 
 #define GST_CAT_DEFAULT kurento_http_post_endpoint_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -34,6 +45,9 @@ GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
 namespace kurento
 {
 
+static const std::string POST_HIGH_WATER_MARK = "postHighWaterMark";
+static const std::string POST_LOW_WATER_MARK = "postLowWaterMark";
+
 void HttpPostEndpointImpl::eosLambda ()
 {
   try {
@@ -62,17 +76,29 @@ HttpPostEndpointImpl::HttpPostEndpointImpl (const boost::property_tree::ptree
           std::dynamic_pointer_cast< MediaObjectImpl > (mediaPipeline),
           disconnectionTimeout, FACTORY_NAME)
 {
+  int highWaterMark, lowWaterMark;
+
   g_object_set (G_OBJECT (element), USE_ENCODED_MEDIA, useEncodedMedia, NULL);
 
   /* Do not accept EOS */
   g_object_set ( G_OBJECT (element), "accept-eos", false, NULL);
 
-  register_end_point();
-
-  if (!is_registered() ) {
-    throw KurentoException (HTTP_END_POINT_REGISTRATION_ERROR,
-                            "Cannot register HttpPostEndPoint");
+  /* Pause uploads faster than the pipeline */
+  highWaterMark = getConfigValue<int, HttpEndpoint> (POST_HIGH_WATER_MARK,
+                  DEFAULT_POST_HIGH_WATER_MARK);
+  lowWaterMark = getConfigValue<int, HttpEndpoint> (POST_LOW_WATER_MARK,
+                 DEFAULT_POST_LOW_WATER_MARK);
+
+  if (highWaterMark < 0 || lowWaterMark < 0 ||
+      (highWaterMark > 0 && lowWaterMark > highWaterMark) ) {
+    GST_WARNING ("Invalid upload water marks (%d, %d), using defaults",
+                 highWaterMark, lowWaterMark);
+    highWaterMark = DEFAULT_POST_HIGH_WATER_MARK;
+    lowWaterMark = DEFAULT_POST_LOW_WATER_MARK;
   }
+
+  g_object_set (G_OBJECT (element), HIGH_WATER_MARK, (guint64) highWaterMark,
+                LOW_WATER_MARK, (guint64) lowWaterMark, NULL);
 }
 
 HttpPostEndpointImpl::~HttpPostEndpointImpl ()
@@ -82,6 +108,39 @@ HttpPostEndpointImpl::~HttpPostEndpointImpl ()
   }
 }
 
+void
+HttpPostEndpointImpl::fillStatsReport (std::map <std::string,
+                                       std::shared_ptr<Stats>> &report, const GstStructure *stats,
+                                       double timestamp)
+{
+  std::shared_ptr<ElementStats> eStats;
+  std::vector<std::shared_ptr<MediaLatencyStat>> inputStats;
+  double inputAudioLatency = 0.0, inputVideoLatency = 0.0;
+  guint64 throttledTime = 0;
+
+  HttpEndpointImpl::fillStatsReport (report, stats, timestamp);
+
+  /* the element stats collected above, with the upload ones added */
+  auto it = report.find (getId () );
+
+  if (it != report.end () ) {
+    eStats = std::dynamic_pointer_cast <ElementStats> (it->second);
+  }
+
+  if (eStats) {
+    inputAudioLatency = eStats->getInputAudioLatency ();
+    inputVideoLatency = eStats->getInputVideoLatency ();
+    inputStats = eStats->getInputLatency ();
+  }
+
+  g_object_get (G_OBJECT (element), THROTTLED_TIME, &throttledTime, NULL);
+
+  report[getId ()] = std::make_shared <HttpPostEndpointStats> (getId (),
+                     std::make_shared <StatsType> (StatsType::element), timestamp,
+                     inputAudioLatency, inputVideoLatency, inputStats,
+                     throttledTime / NS_TO_MS);
+}
+
 MediaObjectImpl *
 HttpPostEndpointImplFactory::createObject (const boost::property_tree::ptree
     &conf, std::shared_ptr<MediaPipeline>
@@ -59,6 +59,10 @@ public:
 protected:
   virtual void postConstructor () override;
 
+  virtual void fillStatsReport (std::map <std::string, std::shared_ptr<Stats>>
+                                &report, const GstStructure *stats,
+                                double timestamp) override;
+
 private:
   void eosLambda ();
 
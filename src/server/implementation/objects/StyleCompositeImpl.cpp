@@ -6,6 +6,10 @@
 #include "StyleCompositeImpl.hpp"
 #include <jsonrpc/JsonSerializer.hpp>
 #include <KurentoException.hpp>
+#include <SignalHandler.hpp>
+#include <functional>
+
+#include "MixerStatsReport.hpp"
 
 #define GST_CAT_DEFAULT kurento_style_composite_impl
 GST_DEBUG_CATEGORY_STATIC (GST_CAT_DEFAULT);
@@ -21,6 +25,50 @@ StyleCompositeImpl::StyleCompositeImpl (const boost::property_tree::ptree
                                               std::dynamic_pointer_cast<MediaObjectImpl> (mediaPipeline), FACTORY_NAME)
 {}
 
+StyleCompositeImpl::~StyleCompositeImpl ()
+{
+  if (handlerSnapshotDone > 0) {
+    unregister_signal_handler (element, handlerSnapshotDone);
+  }
+}
+
+void StyleCompositeImpl::postConstructor ()
+{
+  HubImpl::postConstructor ();
+
+  handlerSnapshotDone = register_signal_handler (G_OBJECT (element),
+                        "snapshot-done",
+                        std::function <void (GstElement *, gchar *, gboolean) >
+                        (std::bind (&StyleCompositeImpl::onSnapshotDone, this,
+                                    std::placeholders::_2, std::placeholders::_3) ),
+                        std::dynamic_pointer_cast<StyleCompositeImpl>
+                        (shared_from_this() ) );
+}
+
+void StyleCompositeImpl::onSnapshotDone (gchar *path, gboolean written)
+{
+  if (written) {
+    GST_DEBUG_OBJECT (element, "Snapshot written to %s", path);
+    return;
+  }
+
+  try {
+    Error error (shared_from_this(), "Snapshot " + std::string (path) +
+                 " could not be taken", 0, "SNAPSHOT_FAILED");
+
+    signalError (error);
+  } catch (std::bad_weak_ptr &e) {
+  }
+}
+
+void
+StyleCompositeImpl::fillStatsReport (std::map <std::string, std::shared_ptr<Stats>>
+    &report, const GstStructure *stats, double timestamp)
+{
+  HubImpl::fillStatsReport (report, stats, timestamp);
+  MixerStatsReport::fill (report, getId (), element, timestamp);
+}
+
 void StyleCompositeImpl::setStyle (const std::string &style)
 {
   g_object_set ( G_OBJECT (element), "style", style.c_str(), NULL);
@@ -83,6 +131,21 @@ void StyleCompositeImpl::hideView (int viewId)
   setViewEnableStatus (viewId, '0');
 }
 
+std::string StyleCompositeImpl::takeSnapshot ()
+{
+  std::string path;
+  gchar *ret = NULL;
+
+  g_signal_emit_by_name (element, "take-snapshot", &ret);
+
+  if (ret != NULL) {
+    path = std::string (ret);
+    g_free (ret);
+  }
+
+  return path;
+}
+
 MediaObjectImpl *
 StyleCompositeImplFactory::createObject (const boost::property_tree::ptree
     &config, std::shared_ptr<MediaPipeline> mediaPipeline) const
@@ -35,12 +35,13 @@ public:
   StyleCompositeImpl (const boost::property_tree::ptree &config,
                       std::shared_ptr<MediaPipeline> mediaPipeline);
 
-  virtual ~StyleCompositeImpl () {};
+  virtual ~StyleCompositeImpl ();
 
   void setStyle (const std::string &style);
   std::string getStyle ();
   void showView (int viewId);
   void hideView (int viewId);
+  std::string takeSnapshot ();
 
   /* Next methods are automatically implemented by code generator */
   virtual bool connect (const std::string &eventType,
@@ -51,9 +52,19 @@ public:
 
   virtual void Serialize (JsonSerializer &serializer);
 
+protected:
+  virtual void fillStatsReport (std::map <std::string, std::shared_ptr<Stats>>
+                                &report, const GstStructure *stats,
+                                double timestamp) override;
+
+  virtual void postConstructor () override;
+
 private:
 
+  gulong handlerSnapshotDone = 0;
+
   bool setViewEnableStatus (int viewId, char enable);
+  void onSnapshotDone (gchar *path, gboolean written);
   class StaticConstructor
   {
   public:
@@ -0,0 +1,240 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/video/video.h>
+
+#include "kmskeyframecoalescer.h"
+
+#define INTERVAL 200            /* ms */
+
+/* The coalescer probe sits on sink, the requests that get through reach */
+/* the source pad that stands for the publisher */
+typedef struct _CheckSource
+{
+  KmsLoop *loop;
+  KmsKeyframeCoalescer *coalescer;
+  GstPad *src;
+  GstPad *sink;
+  gint requests;
+  gint all_headers;
+} CheckSource;
+
+static gboolean
+src_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  CheckSource *source = g_object_get_data (G_OBJECT (pad), "source");
+  gboolean all_headers = FALSE;
+
+  if (gst_video_event_is_force_key_unit (event)) {
+    gst_video_event_parse_upstream_force_key_unit (event, NULL, &all_headers,
+        NULL);
+    g_atomic_int_inc (&source->requests);
+    if (all_headers) {
+      g_atomic_int_inc (&source->all_headers);
+    }
+  }
+
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+static gboolean
+sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+static GstFlowReturn
+sink_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  gst_buffer_unref (buffer);
+
+  return GST_FLOW_OK;
+}
+
+static void
+check_source_init (CheckSource * source, const gchar * caps_str)
+{
+  GstSegment segment;
+  GstCaps *caps;
+
+  source->loop = kms_loop_new ();
+  source->coalescer = kms_keyframe_coalescer_new (source->loop,
+      INTERVAL * GST_MSECOND);
+  source->requests = 0;
+  source->all_headers = 0;
+
+  source->src = gst_pad_new ("src", GST_PAD_SRC);
+  g_object_set_data (G_OBJECT (source->src), "source", source);
+  gst_pad_set_event_function (source->src, src_event);
+  source->sink = gst_pad_new ("sink", GST_PAD_SINK);
+  gst_pad_set_event_function (source->sink, sink_event);
+  gst_pad_set_chain_function (source->sink, sink_chain);
+
+  fail_unless (gst_pad_link (source->src, source->sink) == GST_PAD_LINK_OK);
+  gst_pad_set_active (source->sink, TRUE);
+  gst_pad_set_active (source->src, TRUE);
+
+  fail_unless (kms_keyframe_coalescer_add_probe (source->coalescer,
+          source->sink) != 0);
+
+  gst_pad_push_event (source->src, gst_event_new_stream_start ("test"));
+  caps = gst_caps_from_string (caps_str);
+  gst_pad_push_event (source->src, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (source->src, gst_event_new_segment (&segment));
+}
+
+static void
+check_source_clear (CheckSource * source)
+{
+  gst_pad_set_active (source->src, FALSE);
+  gst_pad_set_active (source->sink, FALSE);
+  gst_object_unref (source->src);
+  gst_object_unref (source->sink);
+  kms_keyframe_coalescer_unref (source->coalescer);
+  g_object_unref (source->loop);
+}
+
+static void
+request_keyframe (CheckSource * source, gboolean all_headers)
+{
+  gst_pad_push_event (source->sink,
+      gst_video_event_new_upstream_force_key_unit (GST_CLOCK_TIME_NONE,
+          all_headers, 0));
+}
+
+static void
+push_keyframe (CheckSource * source)
+{
+  fail_unless (gst_pad_push (source->src, gst_buffer_new ()) == GST_FLOW_OK);
+}
+
+/* past the interval, with some room for the loop to send the request */
+static void
+wait_interval (void)
+{
+  g_usleep (2 * INTERVAL * G_TIME_SPAN_MILLISECOND);
+}
+
+/* The first request goes through, the next ones wait for the interval */
+GST_START_TEST (rate_limit)
+{
+  CheckSource source;
+  guint i;
+
+  check_source_init (&source, "video/x-vp8");
+
+  request_keyframe (&source, FALSE);
+  fail_unless_equals_int (g_atomic_int_get (&source.requests), 1);
+
+  for (i = 0; i < 5; i++) {
+    request_keyframe (&source, FALSE);
+  }
+  fail_unless_equals_int (g_atomic_int_get (&source.requests), 1);
+
+  wait_interval ();
+  fail_unless_equals_int (g_atomic_int_get (&source.requests), 2);
+
+  fail_unless_equals_uint64 (kms_keyframe_coalescer_get_received
+      (source.coalescer), 6);
+  fail_unless_equals_uint64 (kms_keyframe_coalescer_get_forwarded
+      (source.coalescer), 2);
+
+  /* a whole interval after the merged one, it goes through at once */
+  wait_interval ();
+  request_keyframe (&source, FALSE);
+  fail_unless_equals_int (g_atomic_int_get (&source.requests), 3);
+
+  check_source_clear (&source);
+}
+
+GST_END_TEST;
+
+/* The merged request asks for the headers if any of its requests did */
+GST_START_TEST (merge_all_headers)
+{
+  CheckSource source;
+
+  check_source_init (&source, "video/x-vp8");
+
+  request_keyframe (&source, FALSE);
+  request_keyframe (&source, FALSE);
+  request_keyframe (&source, TRUE);
+  request_keyframe (&source, FALSE);
+
+  wait_interval ();
+  fail_unless_equals_int (g_atomic_int_get (&source.requests), 2);
+  fail_unless_equals_int (g_atomic_int_get (&source.all_headers), 1);
+
+  check_source_clear (&source);
+}
+
+GST_END_TEST;
+
+/* A keyframe serves the pending requests, raw frames do not */
+GST_START_TEST (keyframe_clears_pending)
+{
+  CheckSource encoded, raw;
+
+  check_source_init (&encoded, "video/x-vp8");
+  check_source_init (&raw, "video/x-raw");
+
+  request_keyframe (&encoded, FALSE);
+  request_keyframe (&encoded, FALSE);
+  request_keyframe (&raw, FALSE);
+  request_keyframe (&raw, FALSE);
+
+  push_keyframe (&encoded);
+  push_keyframe (&raw);
+
+  wait_interval ();
+  fail_unless_equals_int (g_atomic_int_get (&encoded.requests), 1);
+  fail_unless_equals_int (g_atomic_int_get (&raw.requests), 2);
+
+  check_source_clear (&encoded);
+  check_source_clear (&raw);
+}
+
+GST_END_TEST;
+
+/*
+ * End of test cases
+ */
+static Suite *
+keyframe_coalescer_suite (void)
+{
+  Suite *s = suite_create ("keyframecoalescer");
+  TCase *tc_chain = tcase_create ("coalescer");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, rate_limit);
+  tcase_add_test (tc_chain, merge_all_headers);
+  tcase_add_test (tc_chain, keyframe_clears_pending);
+
+  return s;
+}
+
+GST_CHECK_MAIN (keyframe_coalescer);
@@ -0,0 +1,211 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "kmsblend.h"
+
+#define BENCH_ITERATIONS 50
+
+/* Text copy loop EpisodeOverlay used before the blend kernels */
+static void
+legacy_or_copy (const guint8 * argb, guint8 * bgr, gint width, gint height)
+{
+  gint i, j;
+
+  for (i = 0; i < height; i++) {
+    const guint8 *bitp = argb + i * width * 4;
+    guint8 *p = bgr + i * width * 3;
+
+    for (j = 0; j < width; j++) {
+      p[0] |= bitp[0];
+      p[1] |= bitp[1];
+      p[2] |= bitp[2];
+
+      bitp += 4;
+      p += 3;
+    }
+  }
+}
+
+static void
+fill_random_premultiplied (GRand * rand, guint8 * bgra, gsize n_pixels)
+{
+  gsize i;
+
+  for (i = 0; i < n_pixels; i++) {
+    guint a = g_rand_int_range (rand, 0, 256);
+
+    bgra[0] = g_rand_int_range (rand, 0, 256) * a / 255;
+    bgra[1] = g_rand_int_range (rand, 0, 256) * a / 255;
+    bgra[2] = g_rand_int_range (rand, 0, 256) * a / 255;
+    bgra[3] = a;
+    bgra += 4;
+  }
+}
+
+static void
+fill_random (GRand * rand, guint8 * data, gsize n)
+{
+  gsize i;
+
+  for (i = 0; i < n; i++) {
+    data[i] = g_rand_int_range (rand, 0, 256);
+  }
+}
+
+GST_START_TEST (implementations_match)
+{
+  /* odd size so every vector loop also runs its scalar tail */
+  gsize n_pixels = 4099, n = n_pixels * 3;
+  guint8 *bgra = g_malloc (n_pixels * 4);
+  guint8 *color = g_malloc (n), *alpha = g_malloc (n);
+  guint8 *frame = g_malloc (n), *expected = g_malloc (n), *dst = g_malloc (n);
+  GRand *rand = g_rand_new_with_seed (42);
+  KmsBlendImpl impl;
+  gsize i;
+
+  fill_random_premultiplied (rand, bgra, n_pixels);
+  fill_random (rand, frame, n);
+  kms_blend_prepare_bgr (bgra, color, alpha, n_pixels);
+
+  memcpy (expected, frame, n);
+  kms_blend_get_func (KMS_BLEND_IMPL_SCALAR) (expected, color, alpha, n);
+
+  /* fully opaque pixels replace the frame, transparent ones keep it */
+  for (i = 0; i < n; i++) {
+    if (alpha[i] == 255)
+      fail_unless (expected[i] == color[i]);
+    else if (alpha[i] == 0)
+      fail_unless (expected[i] == frame[i]);
+  }
+
+  for (impl = KMS_BLEND_IMPL_SSE2; impl <= KMS_BLEND_IMPL_AVX2; impl++) {
+    KmsBlendFunc func = kms_blend_get_func (impl);
+
+    if (func == NULL) {
+      GST_INFO ("%s not supported", kms_blend_impl_to_string (impl));
+      continue;
+    }
+
+    memcpy (dst, frame, n);
+    func (dst, color, alpha, n);
+    fail_unless (memcmp (dst, expected, n) == 0, "%s differs from scalar",
+        kms_blend_impl_to_string (impl));
+  }
+
+  g_rand_free (rand);
+  g_free (bgra);
+  g_free (color);
+  g_free (alpha);
+  g_free (frame);
+  g_free (expected);
+  g_free (dst);
+}
+
+GST_END_TEST;
+
+static void
+run_benchmark (gint width, gint height)
+{
+  gsize n_pixels = width * height, n = n_pixels * 3;
+  guint8 *bgra = g_malloc (n_pixels * 4);
+  guint8 *color = g_malloc (n), *alpha = g_malloc (n);
+  guint8 *frame = g_malloc (n);
+  GRand *rand = g_rand_new_with_seed (7);
+  KmsBlendImpl impl;
+  gint64 start;
+  gint i;
+
+  fill_random_premultiplied (rand, bgra, n_pixels);
+  fill_random (rand, frame, n);
+  kms_blend_prepare_bgr (bgra, color, alpha, n_pixels);
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < BENCH_ITERATIONS; i++) {
+    legacy_or_copy (bgra, frame, width, height);
+  }
+  g_print ("%dx%d legacy |= loop: %.3f ms/frame\n", width, height,
+      (g_get_monotonic_time () - start) / 1000.0 / BENCH_ITERATIONS);
+
+  for (impl = KMS_BLEND_IMPL_SCALAR; impl <= KMS_BLEND_IMPL_AVX2; impl++) {
+    KmsBlendFunc func = kms_blend_get_func (impl);
+
+    if (func == NULL)
+      continue;
+
+    start = g_get_monotonic_time ();
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+      func (frame, color, alpha, n);
+    }
+    g_print ("%dx%d %s blend: %.3f ms/frame\n", width, height,
+        kms_blend_impl_to_string (impl),
+        (g_get_monotonic_time () - start) / 1000.0 / BENCH_ITERATIONS);
+  }
+
+  g_rand_free (rand);
+  g_free (bgra);
+  g_free (color);
+  g_free (alpha);
+  g_free (frame);
+}
+
+GST_START_TEST (benchmark_720p)
+{
+  run_benchmark (1280, 720);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (benchmark_1080p)
+{
+  run_benchmark (1920, 1080);
+}
+
+GST_END_TEST;
+
+/*
+ * End of test cases
+ */
+static Suite *
+overlay_blend_suite (void)
+{
+  Suite *s = suite_create ("overlayblend");
+  TCase *tc_chain = tcase_create ("kernels");
+  TCase *tc_bench;
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, implementations_match);
+
+  /* timings only, run them on demand */
+  if (getenv ("BENCHMARK") != NULL) {
+    tc_bench = tcase_create ("benchmark");
+    suite_add_tcase (s, tc_bench);
+    tcase_add_test (tc_bench, benchmark_720p);
+    tcase_add_test (tc_bench, benchmark_1080p);
+  }
+
+  return s;
+}
+
+GST_CHECK_MAIN (overlay_blend);
@@ -0,0 +1,189 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+
+#include "kmsstylelayout.h"
+
+#define N_ITEMS 8
+/* slot of an item that was never reported by a commit */
+#define NOT_REPORTED -2
+
+#define ITEM(n) GINT_TO_POINTER (n)
+
+static void
+record_slot_cb (gpointer item, gint slot, const KmsStyleLayoutRect * rect,
+    gint * slots)
+{
+  gint n = GPOINTER_TO_INT (item);
+
+  fail_unless (n > 0 && n < N_ITEMS);
+  fail_unless ((slot < 0) == (rect == NULL));
+  slots[n] = slot;
+}
+
+static void
+commit (KmsStyleLayout * layout, gint * slots)
+{
+  guint i;
+
+  for (i = 0; i < N_ITEMS; i++) {
+    slots[i] = NOT_REPORTED;
+  }
+
+  kms_style_layout_commit (layout, (KmsStyleLayoutFunc) record_slot_cb,
+      slots);
+}
+
+static KmsStyleLayout *
+create_layout (const KmsStyleLayoutView * views, guint n_views,
+    guint max_views)
+{
+  KmsStyleLayout *layout = kms_style_layout_new ();
+
+  kms_style_layout_set_area (layout, 640, 480, 0, 0, 0);
+  kms_style_layout_set_views (layout, views, n_views, max_views);
+
+  return layout;
+}
+
+/* Bound items get the slot of their view, unbound ones borrow free slots */
+GST_START_TEST (slot_assignment)
+{
+  KmsStyleLayoutView views[] = { {10, TRUE}, {20, TRUE}, {30, TRUE} };
+  KmsStyleLayout *layout = create_layout (views, G_N_ELEMENTS (views), 3);
+  gint slots[N_ITEMS];
+
+  kms_style_layout_add (layout, ITEM (1), 20);
+  kms_style_layout_add (layout, ITEM (2), -1);
+  /* takes its slot back from item 2, which moves to the free one */
+  kms_style_layout_add (layout, ITEM (3), 10);
+
+  commit (layout, slots);
+  fail_unless_equals_int (kms_style_layout_get_n_visible (layout), 3);
+  fail_unless_equals_int (slots[1], 1);
+  fail_unless_equals_int (slots[2], 2);
+  fail_unless_equals_int (slots[3], 0);
+
+  /* no free slot is left for item 2 now */
+  kms_style_layout_add (layout, ITEM (4), 30);
+
+  commit (layout, slots);
+  fail_unless_equals_int (kms_style_layout_get_n_visible (layout), 3);
+  fail_unless_equals_int (slots[2], -1);
+  fail_unless_equals_int (slots[4], 2);
+  /* unchanged geometry is not reported again */
+  fail_unless_equals_int (slots[1], NOT_REPORTED);
+  fail_unless_equals_int (slots[3], NOT_REPORTED);
+
+  kms_style_layout_destroy (layout);
+}
+
+GST_END_TEST;
+
+/* Views past max_views reserve no slot, their items wait like unbound */
+GST_START_TEST (max_views_bound)
+{
+  KmsStyleLayoutView views[] =
+      { {1, TRUE}, {2, TRUE}, {3, TRUE}, {4, TRUE} };
+  KmsStyleLayout *layout = create_layout (views, G_N_ELEMENTS (views), 2);
+  gint slots[N_ITEMS];
+
+  kms_style_layout_add (layout, ITEM (1), 1);
+  kms_style_layout_add (layout, ITEM (2), 2);
+  kms_style_layout_add (layout, ITEM (3), 3);
+  kms_style_layout_add (layout, ITEM (4), 4);
+
+  commit (layout, slots);
+  fail_unless_equals_int (kms_style_layout_get_n_visible (layout), 2);
+  fail_unless_equals_int (slots[1], 0);
+  fail_unless_equals_int (slots[2], 1);
+  fail_unless_equals_int (slots[3], NOT_REPORTED);
+  fail_unless_equals_int (slots[4], NOT_REPORTED);
+
+  /* the oldest waiting item gets the freed slot */
+  fail_unless (kms_style_layout_remove (layout, ITEM (1)));
+
+  commit (layout, slots);
+  fail_unless_equals_int (kms_style_layout_get_n_visible (layout), 2);
+  fail_unless_equals_int (slots[3], 0);
+  fail_unless_equals_int (slots[4], NOT_REPORTED);
+
+  kms_style_layout_destroy (layout);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (unbound_items)
+{
+  KmsStyleLayoutView views[] = { {1, FALSE}, {2, TRUE} };
+  KmsStyleLayout *layout = create_layout (views, G_N_ELEMENTS (views), 2);
+  gint slots[N_ITEMS];
+
+  /* hidden while its view is disabled, the slot can be lent meanwhile */
+  kms_style_layout_add (layout, ITEM (1), 1);
+  kms_style_layout_add (layout, ITEM (2), -1);
+  kms_style_layout_add (layout, ITEM (3), -1);
+  kms_style_layout_add (layout, ITEM (4), -1);
+
+  commit (layout, slots);
+  fail_unless_equals_int (kms_style_layout_get_n_visible (layout), 2);
+  fail_unless_equals_int (slots[1], NOT_REPORTED);
+  fail_unless_equals_int (slots[2], 0);
+  fail_unless_equals_int (slots[3], 1);
+  fail_unless_equals_int (slots[4], NOT_REPORTED);
+
+  /* binding a waiting item reclaims its view slot from an unbound one */
+  fail_unless (kms_style_layout_update (layout, ITEM (4), 2));
+
+  commit (layout, slots);
+  fail_unless_equals_int (slots[3], -1);
+  fail_unless_equals_int (slots[4], 1);
+
+  fail_unless (kms_style_layout_remove (layout, ITEM (2)));
+
+  commit (layout, slots);
+  fail_unless_equals_int (kms_style_layout_get_n_visible (layout), 2);
+  fail_unless_equals_int (slots[3], 0);
+  fail_unless_equals_int (slots[1], NOT_REPORTED);
+
+  kms_style_layout_destroy (layout);
+}
+
+GST_END_TEST;
+
+/*
+ * End of test cases
+ */
+static Suite *
+style_layout_suite (void)
+{
+  Suite *s = suite_create ("stylelayout");
+  TCase *tc_chain = tcase_create ("layout");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, slot_assignment);
+  tcase_add_test (tc_chain, max_views_bound);
+  tcase_add_test (tc_chain, unbound_items);
+
+  return s;
+}
+
+GST_CHECK_MAIN (style_layout);
@@ -0,0 +1,190 @@
+/*
+ * (C) Copyright 2016 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#define SINK_VIDEO_STREAM "sink_video_default"
+#define TEXT_STYLE "{\"text\": \"KURENTO\", \"font-desc\": \"sans bold 24\", " \
+  "\"deltay\": 0}"
+#define FRAME_WIDTH 320
+#define FRAME_HEIGHT 240
+/* the input is black, the text is drawn white on the bottom left */
+#define TEXT_AREA_WIDTH 160
+#define TEXT_AREA_HEIGHT 80
+#define LUMA_TEXT 200
+
+typedef struct _CheckData
+{
+  GMainLoop *loop;
+  gboolean text_found;
+} CheckData;
+
+static gboolean
+quit_main_loop (gpointer loop)
+{
+  g_main_loop_quit (loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+frame_has_text (GstVideoFrame * frame)
+{
+  guint8 *data = GST_VIDEO_FRAME_COMP_DATA (frame, 0);
+  gint stride = GST_VIDEO_FRAME_COMP_STRIDE (frame, 0);
+  gint height = GST_VIDEO_FRAME_COMP_HEIGHT (frame, 0);
+  gint x, y;
+
+  for (y = MAX (height - TEXT_AREA_HEIGHT, 0); y < height; y++) {
+    for (x = 0; x < TEXT_AREA_WIDTH; x++) {
+      if (data[y * stride + x] > LUMA_TEXT) {
+        return TRUE;
+      }
+    }
+  }
+
+  return FALSE;
+}
+
+static void
+check_output_cb (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    CheckData * data)
+{
+  GstVideoFrame frame;
+  GstVideoInfo info;
+  GstCaps *caps;
+
+  if (data->text_found) {
+    return;
+  }
+
+  caps = gst_pad_get_current_caps (pad);
+  fail_unless (caps != NULL);
+  fail_unless (gst_video_info_from_caps (&info, caps));
+  gst_caps_unref (caps);
+
+  fail_unless (gst_video_frame_map (&frame, &info, buffer, GST_MAP_READ));
+
+  /* the label is rendered in the background, first frames have no text */
+  if (frame_has_text (&frame)) {
+    GST_INFO ("Text drawn on %" GST_PTR_FORMAT, buffer);
+    data->text_found = TRUE;
+    g_idle_add (quit_main_loop, data->loop);
+  }
+
+  gst_video_frame_unmap (&frame);
+}
+
+static void
+bus_msg (GstBus * bus, GstMessage * msg, gpointer loop)
+{
+  switch (GST_MESSAGE_TYPE (msg)) {
+    case GST_MESSAGE_ERROR:
+      fail ("Error received on bus");
+      break;
+    case GST_MESSAGE_EOS:
+      g_main_loop_quit (loop);
+      break;
+    default:
+      break;
+  }
+}
+
+/* Encoded input has to be decoded for the text to be drawn */
+GST_START_TEST (text_on_encoded_input)
+{
+  CheckData data = { g_main_loop_new (NULL, FALSE), FALSE };
+  GstElement *pipeline = gst_pipeline_new (NULL);
+  GstElement *src, *filter, *encoder, *agnosticbin, *textoverlay, *outfilter,
+      *sink;
+  GstCaps *caps;
+  GstBus *bus;
+
+  src = gst_element_factory_make ("videotestsrc", NULL);
+  filter = gst_element_factory_make ("capsfilter", NULL);
+  encoder = gst_element_factory_make ("vp8enc", NULL);
+  agnosticbin = gst_element_factory_make ("agnosticbin", NULL);
+  textoverlay = gst_element_factory_make ("kmstextoverlay", NULL);
+  outfilter = gst_element_factory_make ("capsfilter", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+
+  caps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "I420",
+      "width", G_TYPE_INT, FRAME_WIDTH, "height", G_TYPE_INT, FRAME_HEIGHT,
+      "framerate", GST_TYPE_FRACTION, 30, 1, NULL);
+  g_object_set (filter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  caps = gst_caps_from_string ("video/x-raw, format=(string)I420");
+  g_object_set (outfilter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+
+  g_object_set (src, "num-buffers", 150, NULL);
+  gst_util_set_object_arg (G_OBJECT (src), "pattern", "black");
+  g_object_set (textoverlay, "style", TEXT_STYLE, NULL);
+  g_object_set (sink, "sync", FALSE, "async", FALSE, "signal-handoffs", TRUE,
+      NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (check_output_cb), &data);
+
+  gst_bin_add_many (GST_BIN (pipeline), src, filter, encoder, agnosticbin,
+      textoverlay, outfilter, sink, NULL);
+  fail_unless (gst_element_link_many (src, filter, encoder, agnosticbin,
+          NULL));
+  fail_unless (gst_element_link_pads (agnosticbin, "src_%u", textoverlay,
+          SINK_VIDEO_STREAM));
+  fail_unless (gst_element_link_pads (textoverlay, "video_src_%u", outfilter,
+          "sink"));
+  fail_unless (gst_element_link (outfilter, sink));
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), data.loop);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  g_main_loop_run (data.loop);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  fail_unless (data.text_found, "No text drawn on the decoded frames");
+
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (data.loop);
+}
+
+GST_END_TEST;
+
+/*
+ * End of test cases
+ */
+static Suite *
+textoverlay_suite (void)
+{
+  Suite *s = suite_create ("textoverlay");
+  TCase *tc_chain = tcase_create ("element");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, text_on_encoded_input);
+
+  return s;
+}
+
+GST_CHECK_MAIN (textoverlay);
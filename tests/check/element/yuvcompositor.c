@@ -0,0 +1,620 @@
+/*
+ * (C) Copyright 2015 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "kmscompositorblit.h"
+
+#define BENCH_BUFFERS 100
+#define INPUT_WIDTH 640
+#define INPUT_HEIGHT 480
+#define CHECK_WIDTH 1920
+#define CHECK_HEIGHT 1080
+#define LUMA_WHITE 235
+#define LUMA_BLACK 16
+
+static void
+fill_random (GRand * rand, guint8 * data, gsize n)
+{
+  gsize i;
+
+  for (i = 0; i < n; i++) {
+    data[i] = g_rand_int_range (rand, 0, 256);
+  }
+}
+
+/* Blits src, scaled and partly out of the frame, in every row band */
+static void
+blit_bands (KmsCompositorPlane * dst, const KmsCompositorComponent * src,
+    const KmsCompositorComponent * src_alpha, guint8 alpha,
+    KmsCompositorScratch * scratch)
+{
+  gint row;
+
+  for (row = 0; row < dst->height; row += 6) {
+    kms_compositor_blit (dst, src, src_alpha, -7, 5, dst->width * 3 / 4,
+        dst->height - 2, alpha, row, MIN (row + 6, dst->height), scratch);
+  }
+}
+
+static void
+check_implementations (gboolean interleaved, gboolean per_pixel_alpha,
+    guint8 alpha)
+{
+  gint width = 173, height = 97, dst_width = 211, dst_height = 120;
+  guint n_channels = interleaved ? 2 : 1;
+  gsize src_size = width * height * 4, dst_size;
+  guint8 *src_data = g_malloc (src_size);
+  guint8 *frame, *expected, *dst_data;
+  KmsCompositorScratch *scratch = kms_compositor_scratch_new ();
+  KmsCompositorComponent src[2], src_alpha;
+  KmsCompositorPlane dst;
+  GRand *rand = g_rand_new_with_seed (42);
+  KmsBlendImpl impl;
+  guint c;
+
+  dst_size = dst_width * n_channels * dst_height;
+  frame = g_malloc (dst_size);
+  expected = g_malloc (dst_size);
+  dst_data = g_malloc (dst_size);
+
+  fill_random (rand, src_data, src_size);
+  fill_random (rand, frame, dst_size);
+
+  /* AYUV like source, components interleaved every 4 bytes */
+  for (c = 0; c < n_channels; c++) {
+    src[c].data = src_data + 1 + c;
+    src[c].stride = width * 4;
+    src[c].pixel_stride = 4;
+    src[c].width = width;
+    src[c].height = height;
+  }
+  src_alpha = src[0];
+  src_alpha.data = src_data;
+
+  dst.stride = dst_width * n_channels;
+  dst.width = dst_width;
+  dst.height = dst_height;
+  dst.n_channels = n_channels;
+
+  kms_compositor_blit_set_impl (KMS_BLEND_IMPL_SCALAR);
+  memcpy (expected, frame, dst_size);
+  dst.data = expected;
+  blit_bands (&dst, src, per_pixel_alpha ? &src_alpha : NULL, alpha, scratch);
+
+  for (impl = KMS_BLEND_IMPL_SSE2; impl <= KMS_BLEND_IMPL_AVX2; impl++) {
+    if (!kms_compositor_blit_set_impl (impl)) {
+      GST_INFO ("%s not supported", kms_blend_impl_to_string (impl));
+      continue;
+    }
+
+    memcpy (dst_data, frame, dst_size);
+    dst.data = dst_data;
+    blit_bands (&dst, src, per_pixel_alpha ? &src_alpha : NULL, alpha,
+        scratch);
+    fail_unless (memcmp (dst_data, expected, dst_size) == 0,
+        "%s differs from scalar", kms_blend_impl_to_string (impl));
+  }
+
+  kms_compositor_blit_set_impl (kms_blend_get_impl ());
+  kms_compositor_scratch_free (scratch);
+  g_rand_free (rand);
+  g_free (src_data);
+  g_free (frame);
+  g_free (expected);
+  g_free (dst_data);
+}
+
+GST_START_TEST (implementations_match)
+{
+  check_implementations (FALSE, FALSE, 255);
+  check_implementations (FALSE, FALSE, 100);
+  check_implementations (TRUE, FALSE, 255);
+  check_implementations (TRUE, FALSE, 77);
+  check_implementations (FALSE, TRUE, 255);
+  check_implementations (TRUE, TRUE, 180);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (identity_copy)
+{
+  gint width = 64, height = 48;
+  guint8 *src_data = g_malloc (width * height);
+  guint8 *dst_data = g_malloc0 (width * height);
+  KmsCompositorScratch *scratch = kms_compositor_scratch_new ();
+  KmsCompositorComponent src = { src_data, width, 1, width, height };
+  KmsCompositorPlane dst = { dst_data, width, width, height, 1 };
+  GRand *rand = g_rand_new_with_seed (3);
+
+  fill_random (rand, src_data, width * height);
+  kms_compositor_blit (&dst, &src, NULL, 0, 0, width, height, 255, 0, height,
+      scratch);
+  fail_unless (memcmp (src_data, dst_data, width * height) == 0);
+
+  kms_compositor_scratch_free (scratch);
+  g_rand_free (rand);
+  g_free (src_data);
+  g_free (dst_data);
+}
+
+GST_END_TEST;
+
+static void
+bus_msg (GstBus * bus, GstMessage * msg, gpointer loop)
+{
+  switch (GST_MESSAGE_TYPE (msg)) {
+    case GST_MESSAGE_ERROR:{
+      GST_ERROR ("Error: %" GST_PTR_FORMAT, msg);
+      fail ("Error received on bus");
+      break;
+    }
+    case GST_MESSAGE_EOS:
+      g_main_loop_quit (loop);
+      break;
+    default:
+      break;
+  }
+}
+
+typedef struct _CheckInput
+{
+  const gchar *pattern;
+  gint x, y, width, height;
+} CheckInput;
+
+/* Large enough to be rendered in row bands: one input crosses the first */
+/* band boundary, another one is partly out of the frame and crosses the */
+/* second one, the red ones are out of the frame and must not show up */
+static const CheckInput check_inputs[] = {
+  {"white", 101, 251, 131, 41},
+  {"white", -40, 521, 81, 50},
+  {"red", CHECK_WIDTH + 10, 0, 64, 48},
+  {"red", 0, -100, 64, 64},
+};
+
+typedef struct _CheckResult
+{
+  guint n_frames;
+  guint n_wrong;
+} CheckResult;
+
+static guint8
+expected_luma (gint x, gint y)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (check_inputs); i++) {
+    const CheckInput *input = &check_inputs[i];
+
+    if (x >= input->x && x < input->x + input->width && y >= input->y
+        && y < input->y + input->height) {
+      return LUMA_WHITE;
+    }
+  }
+
+  return LUMA_BLACK;
+}
+
+static void
+check_output_cb (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    CheckResult * result)
+{
+  GstVideoFrame frame;
+  GstVideoInfo info;
+  GstCaps *caps;
+  guint8 *luma;
+  gint x, y, stride;
+
+  caps = gst_pad_get_current_caps (pad);
+  if (caps == NULL || !gst_video_info_from_caps (&info, caps)
+      || !gst_video_frame_map (&frame, &info, buffer, GST_MAP_READ)) {
+    GST_ERROR ("Cannot map output %" GST_PTR_FORMAT, buffer);
+    result->n_wrong++;
+    if (caps != NULL)
+      gst_caps_unref (caps);
+    return;
+  }
+  gst_caps_unref (caps);
+
+  luma = GST_VIDEO_FRAME_COMP_DATA (&frame, 0);
+  stride = GST_VIDEO_FRAME_COMP_STRIDE (&frame, 0);
+
+  for (y = 0; y < GST_VIDEO_FRAME_HEIGHT (&frame); y++) {
+    for (x = 0; x < GST_VIDEO_FRAME_WIDTH (&frame); x++) {
+      if (luma[y * stride + x] != expected_luma (x, y)) {
+        GST_ERROR ("Luma %u at %d,%d, %u expected", luma[y * stride + x], x,
+            y, expected_luma (x, y));
+        result->n_wrong++;
+        goto end;
+      }
+    }
+  }
+
+end:
+  result->n_frames++;
+  gst_video_frame_unmap (&frame);
+}
+
+GST_START_TEST (output_geometry)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+  GstElement *pipeline = gst_pipeline_new (NULL);
+  GstElement *mixer, *capsfilter, *sink;
+  CheckResult result = { 0, 0 };
+  GstCaps *caps;
+  GstBus *bus;
+  guint i;
+
+  mixer = gst_element_factory_make ("yuvcompositor", NULL);
+  capsfilter = gst_element_factory_make ("capsfilter", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  caps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "I420",
+      "width", G_TYPE_INT, CHECK_WIDTH, "height", G_TYPE_INT, CHECK_HEIGHT,
+      NULL);
+  g_object_set (capsfilter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  g_object_set (sink, "sync", FALSE, "async", FALSE, "signal-handoffs", TRUE,
+      NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (check_output_cb), &result);
+  g_object_set (mixer, "background", 1, NULL);
+
+  gst_bin_add_many (GST_BIN (pipeline), mixer, capsfilter, sink, NULL);
+  gst_element_link_many (mixer, capsfilter, sink, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (check_inputs); i++) {
+    GstElement *src = gst_element_factory_make ("videotestsrc", NULL);
+    GstElement *filter = gst_element_factory_make ("capsfilter", NULL);
+    GstPad *srcpad, *sinkpad;
+
+    caps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING,
+        "I420", "width", G_TYPE_INT, 64, "height", G_TYPE_INT, 48,
+        "framerate", GST_TYPE_FRACTION, 30, 1, NULL);
+    g_object_set (filter, "caps", caps, NULL);
+    gst_caps_unref (caps);
+    g_object_set (src, "num-buffers", 3, NULL);
+    gst_util_set_object_arg (G_OBJECT (src), "pattern",
+        check_inputs[i].pattern);
+
+    gst_bin_add_many (GST_BIN (pipeline), src, filter, NULL);
+    gst_element_link (src, filter);
+
+    sinkpad = gst_element_get_request_pad (mixer, "sink_%u");
+    g_object_set (sinkpad, "xpos", check_inputs[i].x, "ypos",
+        check_inputs[i].y, "width", check_inputs[i].width, "height",
+        check_inputs[i].height, NULL);
+    srcpad = gst_element_get_static_pad (filter, "src");
+    fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK);
+    g_object_unref (srcpad);
+    g_object_unref (sinkpad);
+  }
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), loop);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  g_main_loop_run (loop);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  fail_unless (result.n_frames > 0, "No frame composed");
+  fail_unless (result.n_wrong == 0, "%u of %u frames wrong", result.n_wrong,
+      result.n_frames);
+
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
+
+static void
+count_buffer_cb (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    guint * n_buffers)
+{
+  g_atomic_int_inc (n_buffers);
+}
+
+static gboolean
+quit_main_loop (gpointer loop)
+{
+  g_main_loop_quit (loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* As the mixers create it, before any of their ports brings video */
+GST_START_TEST (live_without_inputs)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+  GstElement *pipeline = gst_pipeline_new (NULL);
+  GstElement *mixer, *sink;
+  guint n_buffers = 0;
+  GstBus *bus;
+
+  mixer = gst_element_factory_make ("yuvcompositor", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (mixer, "background", 1, "start-time-selection", 0, "width",
+      320, "height", 240, "frame-rate", 30, "live", TRUE, NULL);
+  g_object_set (sink, "async", FALSE, "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (count_buffer_cb),
+      &n_buffers);
+
+  gst_bin_add_many (GST_BIN (pipeline), mixer, sink, NULL);
+  gst_element_link (mixer, sink);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), loop);
+
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  g_timeout_add (500, quit_main_loop, loop);
+  g_main_loop_run (loop);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+
+  fail_unless (g_atomic_int_get (&n_buffers) > 0, "No frame without inputs");
+
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+}
+
+GST_END_TEST;
+
+#define LATE_ADD_DELAY 1000     /* ms */
+
+typedef struct _LateAddData
+{
+  GMainLoop *loop;
+  GstElement *pipeline;
+  GstClockTime added_at;        /* running time */
+  GstClockTime first_pts;
+} LateAddData;
+
+static void
+first_pts_cb (GstElement * sink, GstBuffer * buffer, GstPad * pad,
+    LateAddData * data)
+{
+  if (GST_CLOCK_TIME_IS_VALID (data->first_pts)) {
+    return;
+  }
+
+  data->first_pts = GST_BUFFER_PTS (buffer);
+  g_idle_add (quit_main_loop, data->loop);
+}
+
+static gboolean
+add_mixer (LateAddData * data)
+{
+  GstElement *mixer, *src, *sink;
+  GstClock *clock;
+
+  mixer = gst_element_factory_make ("yuvcompositor", NULL);
+  src = gst_element_factory_make ("videotestsrc", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (mixer, "background", 1, "width", 320, "height", 240,
+      "frame-rate", 30, "live", TRUE, NULL);
+  g_object_set (src, "is-live", TRUE, NULL);
+  g_object_set (sink, "async", FALSE, "signal-handoffs", TRUE, NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (first_pts_cb), data);
+
+  clock = gst_element_get_clock (data->pipeline);
+  data->added_at = gst_clock_get_time (clock) -
+      gst_element_get_base_time (data->pipeline);
+  gst_object_unref (clock);
+
+  gst_bin_add_many (GST_BIN (data->pipeline), src, mixer, sink, NULL);
+  fail_unless (gst_element_link_many (src, mixer, sink, NULL));
+
+  gst_element_sync_state_with_parent (sink);
+  gst_element_sync_state_with_parent (mixer);
+  gst_element_sync_state_with_parent (src);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* As the mixers create it, when the first port joins a running pipeline */
+GST_START_TEST (live_added_to_running_pipeline)
+{
+  LateAddData data;
+  GstElement *src, *sink;
+  GstBus *bus;
+
+  data.loop = g_main_loop_new (NULL, FALSE);
+  data.pipeline = gst_pipeline_new (NULL);
+  data.added_at = GST_CLOCK_TIME_NONE;
+  data.first_pts = GST_CLOCK_TIME_NONE;
+
+  /* keeps the pipeline running until the mixer is added */
+  src = gst_element_factory_make ("videotestsrc", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (src, "is-live", TRUE, NULL);
+  gst_bin_add_many (GST_BIN (data.pipeline), src, sink, NULL);
+  gst_element_link (src, sink);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (data.pipeline));
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), data.loop);
+
+  gst_element_set_state (data.pipeline, GST_STATE_PLAYING);
+  g_timeout_add (LATE_ADD_DELAY, (GSourceFunc) add_mixer, &data);
+  g_main_loop_run (data.loop);
+  gst_element_set_state (data.pipeline, GST_STATE_NULL);
+
+  fail_unless (GST_CLOCK_TIME_IS_VALID (data.first_pts), "No output");
+  GST_DEBUG ("Added at %" GST_TIME_FORMAT ", first output at %"
+      GST_TIME_FORMAT, GST_TIME_ARGS (data.added_at),
+      GST_TIME_ARGS (data.first_pts));
+
+  /* within one output frame before it, and not a second of late frames */
+  fail_unless (data.first_pts + GST_SECOND / 30 >= data.added_at);
+  fail_unless (data.first_pts < data.added_at + 200 * GST_MSECOND);
+
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (data.pipeline);
+  g_main_loop_unref (data.loop);
+}
+
+GST_END_TEST;
+
+/* Composes n_inputs 640x480 I420 sources on a grid, returns ms per frame */
+static gdouble
+run_pipeline (const gchar * factory, guint n_inputs, gint width, gint height)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+  GstElement *pipeline = gst_pipeline_new (NULL);
+  GstElement *mixer, *capsfilter, *sink;
+  GstCaps *caps;
+  GstBus *bus;
+  gint64 start;
+  guint cols, i;
+
+  mixer = gst_element_factory_make (factory, NULL);
+  if (mixer == NULL) {
+    GST_WARNING ("%s not available", factory);
+    gst_object_unref (pipeline);
+    g_main_loop_unref (loop);
+    return -1;
+  }
+
+  capsfilter = gst_element_factory_make ("capsfilter", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  caps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING, "I420",
+      "width", G_TYPE_INT, width, "height", G_TYPE_INT, height, NULL);
+  g_object_set (capsfilter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  g_object_set (sink, "sync", FALSE, "async", FALSE, NULL);
+  g_object_set (mixer, "background", 1, NULL);
+
+  gst_bin_add_many (GST_BIN (pipeline), mixer, capsfilter, sink, NULL);
+  gst_element_link_many (mixer, capsfilter, sink, NULL);
+
+  for (cols = 1; cols * cols < n_inputs; cols++);
+
+  for (i = 0; i < n_inputs; i++) {
+    GstElement *src = gst_element_factory_make ("videotestsrc", NULL);
+    GstElement *filter = gst_element_factory_make ("capsfilter", NULL);
+    GstPad *srcpad, *sinkpad;
+
+    caps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING,
+        "I420", "width", G_TYPE_INT, INPUT_WIDTH, "height", G_TYPE_INT,
+        INPUT_HEIGHT, "framerate", GST_TYPE_FRACTION, 30, 1, NULL);
+    g_object_set (filter, "caps", caps, NULL);
+    gst_caps_unref (caps);
+    g_object_set (src, "num-buffers", BENCH_BUFFERS, NULL);
+
+    gst_bin_add_many (GST_BIN (pipeline), src, filter, NULL);
+    gst_element_link (src, filter);
+
+    sinkpad = gst_element_get_request_pad (mixer, "sink_%u");
+    g_object_set (sinkpad, "xpos", (gint) ((i % cols) * width / cols),
+        "ypos", (gint) ((i / cols) * height / cols), "width",
+        (gint) (width / cols), "height", (gint) (height / cols), NULL);
+    srcpad = gst_element_get_static_pad (filter, "src");
+    fail_unless (gst_pad_link (srcpad, sinkpad) == GST_PAD_LINK_OK);
+    g_object_unref (srcpad);
+    g_object_unref (sinkpad);
+  }
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE (pipeline));
+  gst_bus_add_signal_watch (bus);
+  g_signal_connect (bus, "message", G_CALLBACK (bus_msg), loop);
+
+  start = g_get_monotonic_time ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  g_main_loop_run (loop);
+  start = g_get_monotonic_time () - start;
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_bus_remove_signal_watch (bus);
+  g_object_unref (bus);
+  g_object_unref (pipeline);
+  g_main_loop_unref (loop);
+
+  return start / 1000.0 / BENCH_BUFFERS;
+}
+
+static void
+run_benchmark (gint width, gint height)
+{
+  static const guint inputs[] = { 1, 4, 9, 16 };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (inputs); i++) {
+    gdouble current = run_pipeline ("compositor", inputs[i], width, height);
+    gdouble yuv = run_pipeline ("yuvcompositor", inputs[i], width, height);
+
+    g_print ("%dx%d %2u inputs: compositor %.3f ms/frame, "
+        "yuvcompositor %.3f ms/frame\n", width, height, inputs[i], current,
+        yuv);
+  }
+}
+
+GST_START_TEST (benchmark_720p)
+{
+  run_benchmark (1280, 720);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (benchmark_1080p)
+{
+  run_benchmark (1920, 1080);
+}
+
+GST_END_TEST;
+
+/*
+ * End of test cases
+ */
+static Suite *
+yuv_compositor_suite (void)
+{
+  Suite *s = suite_create ("yuvcompositor");
+  TCase *tc_chain = tcase_create ("kernels");
+  TCase *tc_bench;
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, implementations_match);
+  tcase_add_test (tc_chain, identity_copy);
+  tcase_add_test (tc_chain, output_geometry);
+  tcase_add_test (tc_chain, live_without_inputs);
+  tcase_add_test (tc_chain, live_added_to_running_pipeline);
+
+  /* timings only, run them on demand */
+  if (getenv ("BENCHMARK") != NULL) {
+    tc_bench = tcase_create ("benchmark");
+    suite_add_tcase (s, tc_bench);
+    tcase_set_timeout (tc_bench, 300);
+    tcase_add_test (tc_bench, benchmark_720p);
+    tcase_add_test (tc_bench, benchmark_1080p);
+  }
+
+  return s;
+}
+
+GST_CHECK_MAIN (yuv_compositor);
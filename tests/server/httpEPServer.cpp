@@ -0,0 +1,281 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_STATIC_LINK
+#define BOOST_TEST_PROTECTED_VIRTUAL
+
+#include <boost/test/included/unit_test.hpp>
+#include <gst/gst.h>
+#include <libsoup/soup.h>
+#include <KmsHttpEPServer.h>
+
+#include <vector>
+#include <iostream>
+
+using namespace boost::unit_test;
+
+#define N_ENDPOINTS 16
+#define N_BENCHMARK_ENDPOINTS 10000
+
+struct Waiter {
+  GMutex mutex;
+  GCond cond;
+  guint pending;
+  guint errors;
+};
+
+struct EndpointData {
+  gchar *uri;
+  guint removed;
+  guint expired;
+  guint actions;
+  guint wrong_uri;
+};
+
+static void
+waiter_init (Waiter *waiter, guint pending)
+{
+  g_mutex_init (&waiter->mutex);
+  g_cond_init (&waiter->cond);
+  waiter->pending = pending;
+  waiter->errors = 0;
+}
+
+/* Callbacks run in the server loop, checks are done by the test thread */
+static void
+waiter_done (Waiter *waiter, GError *err)
+{
+  g_mutex_lock (&waiter->mutex);
+
+  if (err != NULL) {
+    waiter->errors++;
+  }
+
+  if (--waiter->pending == 0) {
+    g_cond_signal (&waiter->cond);
+  }
+
+  g_mutex_unlock (&waiter->mutex);
+}
+
+static void
+waiter_wait (Waiter *waiter)
+{
+  g_mutex_lock (&waiter->mutex);
+
+  while (waiter->pending > 0) {
+    g_cond_wait (&waiter->cond, &waiter->mutex);
+  }
+
+  g_mutex_unlock (&waiter->mutex);
+  g_mutex_clear (&waiter->mutex);
+  g_cond_clear (&waiter->cond);
+}
+
+static void
+action_requested_cb (KmsHttpEPServer *server, const gchar *uri,
+                     KmsHttpEndPointAction action, gpointer data)
+{
+  ( (EndpointData *) data)->actions++;
+}
+
+static void
+url_removed_cb (KmsHttpEPServer *server, const gchar *uri, gpointer data)
+{
+  EndpointData *ep = (EndpointData *) data;
+
+  if (g_strcmp0 (uri, ep->uri) != 0) {
+    ep->wrong_uri++;
+  }
+
+  ep->removed++;
+}
+
+static void
+url_expired_cb (KmsHttpEPServer *server, const gchar *uri, gpointer data)
+{
+  ( (EndpointData *) data)->expired++;
+}
+
+static const KmsHttpEPCallbacks callbacks = {
+  action_requested_cb, url_removed_cb, url_expired_cb
+};
+
+static void
+notify_cb (KmsHttpEPServer *server, GError *err, gpointer data)
+{
+  waiter_done ( (Waiter *) data, err);
+}
+
+static void
+register_cb (KmsHttpEPServer *server, const gchar *uri, GstElement *e,
+             GError *err, gpointer data)
+{
+  waiter_done ( (Waiter *) data, err);
+}
+
+static void
+url_removed_signal_cb (KmsHttpEPServer *server, const gchar *uri, gpointer data)
+{
+  (*(guint *) data)++;
+}
+
+static void
+print_time (gboolean benchmark, const gchar *what, guint n, gint64 start)
+{
+  if (benchmark) {
+    std::cout << what << " " << n << " endpoints in " <<
+              (g_get_monotonic_time () - start) / 1000 << " ms" << std::endl;
+  }
+}
+
+/* Blocks the test thread, the request is served by the server loop */
+static void
+post_request (KmsHttpEPServer *server, const gchar *uri)
+{
+  SoupSession *session = soup_session_sync_new ();
+  SoupMessage *msg;
+  gchar *url;
+  gint port;
+
+  g_object_get (server, KMS_HTTP_EP_SERVER_PORT, &port, NULL);
+  url = g_strdup_printf ("http://localhost:%d%s", port, uri);
+  msg = soup_message_new ("POST", url);
+  BOOST_REQUIRE (msg != NULL);
+  soup_message_set_request (msg, "application/octet-stream",
+                            SOUP_MEMORY_STATIC, "data", 4);
+  soup_session_send_message (session, msg);
+
+  g_object_unref (msg);
+  g_object_unref (session);
+  g_free (url);
+}
+
+static void
+dispatch_endpoints (guint n_endpoints, gboolean benchmark)
+{
+  std::vector<EndpointData> eps (n_endpoints);
+  std::vector<GstElement *> elements;
+  KmsHttpEPServer *server;
+  guint signals = 0;
+  guint requested;
+  Waiter waiter;
+  gint64 start;
+
+  server = kms_http_ep_server_new (KMS_HTTP_EP_SERVER_PORT, 0,
+                                   KMS_HTTP_EP_SERVER_INTERFACE, "localhost", NULL);
+  g_signal_connect (server, "url-removed", G_CALLBACK (url_removed_signal_cb),
+                    &signals);
+
+  waiter_init (&waiter, 1);
+  kms_http_ep_server_start (server, notify_cb, &waiter, NULL);
+  waiter_wait (&waiter);
+  BOOST_REQUIRE_EQUAL (waiter.errors, 0u);
+
+  for (guint i = 0; i < n_endpoints; i++) {
+    GstElement *httpep = gst_element_factory_make ("httppostendpoint", NULL);
+
+    BOOST_REQUIRE (httpep != NULL);
+    elements.push_back (httpep);
+  }
+
+  waiter_init (&waiter, n_endpoints);
+  start = g_get_monotonic_time ();
+
+  /* Requests are batched, callbacks can be set before the loop runs them */
+  for (guint i = 0; i < n_endpoints; i++) {
+    eps[i].uri = kms_http_ep_server_register_end_point (server, elements[i], 2,
+                 register_cb, &waiter, NULL);
+    BOOST_REQUIRE (eps[i].uri != NULL);
+    kms_http_ep_server_set_callbacks (server, eps[i].uri, &callbacks, &eps[i],
+                                      NULL);
+  }
+
+  print_time (benchmark, "Queued registrations of", n_endpoints, start);
+  waiter_wait (&waiter);
+  BOOST_REQUIRE_EQUAL (waiter.errors, 0u);
+  print_time (benchmark, "Registered", n_endpoints, start);
+
+  /* A request reaches the callbacks of its own endpoint only */
+  requested = n_endpoints - 1;
+  post_request (server, eps[requested].uri);
+
+  /* Endpoints unregistered by their owner are not called back */
+  waiter_init (&waiter, n_endpoints / 2);
+  start = g_get_monotonic_time ();
+
+  for (guint i = 0; i < n_endpoints / 2; i++) {
+    kms_http_ep_server_unregister_end_point (server, eps[i].uri, notify_cb,
+        &waiter, NULL);
+  }
+
+  waiter_wait (&waiter);
+  BOOST_REQUIRE_EQUAL (waiter.errors, 0u);
+  print_time (benchmark, "Unregistered", n_endpoints / 2, start);
+
+  /* Stopping removes the rest, each removal must reach one endpoint */
+  waiter_init (&waiter, 1);
+  start = g_get_monotonic_time ();
+  kms_http_ep_server_stop (server, notify_cb, &waiter, NULL);
+  waiter_wait (&waiter);
+  BOOST_CHECK_EQUAL (waiter.errors, 0u);
+  print_time (benchmark, "Dispatched url removals of", n_endpoints / 2,
+              start);
+
+  BOOST_CHECK_EQUAL (signals, n_endpoints);
+
+  for (guint i = 0; i < n_endpoints; i++) {
+    BOOST_CHECK_EQUAL (eps[i].removed, i < n_endpoints / 2 ? 0u : 1u);
+    BOOST_CHECK_EQUAL (eps[i].wrong_uri, 0u);
+    BOOST_CHECK_EQUAL (eps[i].expired, 0u);
+    BOOST_CHECK_EQUAL (eps[i].actions, i == requested ? 1u : 0u);
+    g_free (eps[i].uri);
+    gst_object_unref (elements[i]);
+  }
+
+  g_object_unref (server);
+}
+
+static void
+dispatch_few_endpoints ()
+{
+  dispatch_endpoints (N_ENDPOINTS, FALSE);
+}
+
+static void
+dispatch_10k_endpoints ()
+{
+  dispatch_endpoints (N_BENCHMARK_ENDPOINTS, TRUE);
+}
+
+test_suite *
+init_unit_test_suite ( int argc, char *argv[] )
+{
+  test_suite *test = BOOST_TEST_SUITE ( "HttpEPServer" );
+
+  gst_init (&argc, &argv);
+
+  test->add (BOOST_TEST_CASE ( &dispatch_few_endpoints ), 0, /* timeout */ 20);
+
+  /* Timing run, too slow to be part of the regular checks */
+  if (g_getenv ("BENCHMARK") != NULL) {
+    test->add (BOOST_TEST_CASE ( &dispatch_10k_endpoints ), 0,
+               /* timeout */ 120);
+  }
+
+  return test;
+}
@@ -0,0 +1,184 @@
+/*
+ * (C) Copyright 2014 Kurento (http://kurento.org/)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#define BOOST_TEST_STATIC_LINK
+#define BOOST_TEST_PROTECTED_VIRTUAL
+
+#include <boost/test/included/unit_test.hpp>
+#include <libsoup/soup.h>
+#include <KmsHttpPost.h>
+
+#include <string>
+#include <iostream>
+
+using namespace boost::unit_test;
+
+#define BOUNDARY "----KurentoBoundary7MA4YWxkTrZu0gW"
+#define BENCH_CONTENT_SIZE (64 * 1024 * 1024)
+
+static void
+got_data_cb (KmsHttpPost *post, SoupBuffer *buffer, gpointer data)
+{
+  std::string *received = (std::string *) data;
+
+  received->append (buffer->data, buffer->length);
+}
+
+static SoupMessage *
+create_message ()
+{
+  SoupMessage *msg = soup_message_new ("POST", "http://localhost/");
+  GHashTable *params = g_hash_table_new (g_str_hash, g_str_equal);
+
+  g_hash_table_insert (params, (gpointer) "boundary", (gpointer) BOUNDARY);
+  soup_message_headers_set_content_type (msg->request_headers,
+                                         "multipart/form-data", params);
+  g_hash_table_destroy (params);
+
+  return msg;
+}
+
+static std::string
+create_body (const std::string &content)
+{
+  return "preamble\r\n--" BOUNDARY "\r\n"
+         "Content-Disposition: form-data; name=\"field\"\r\n\r\n"
+         "value\r\n--" BOUNDARY "\r\n"
+         "Content-Disposition: form-data; name=\"file\"; filename=\"f.bin\"\r\n"
+         "Content-Type: application/octet-stream\r\n\r\n" + content +
+         "\r\n--" BOUNDARY "--\r\n";
+}
+
+/* Content full of carriage returns and partial delimiters */
+static std::string
+create_content (gsize size, guint32 seed)
+{
+  static const std::string partial = "\r\n--" BOUNDARY;
+  GRand *rand = g_rand_new_with_seed (seed);
+  std::string content;
+
+  content.reserve (size + partial.size () );
+
+  while (content.size () < size) {
+    switch (g_rand_int_range (rand, 0, 16) ) {
+    case 0:
+      content += '\r';
+      break;
+
+    case 1:
+      content += partial.substr (0, g_rand_int_range (rand, 1,
+                                 partial.size () ) );
+      break;
+
+    case 2:
+      content += partial + "x";
+      break;
+
+    default:
+      content += (char) g_rand_int_range (rand, 0, 256);
+      break;
+    }
+  }
+
+  g_rand_free (rand);
+  content.resize (size);
+
+  return content;
+}
+
+static gint64
+parse (const std::string &body, gsize chunk_size, std::string &received)
+{
+  KmsHttpPost *post = kms_http_post_new ();
+  SoupMessage *msg = create_message ();
+  gint64 start;
+  gsize offset;
+
+  g_signal_connect (post, "got-data", G_CALLBACK (got_data_cb), &received);
+  g_object_set (post, "soup-message", msg, NULL);
+
+  start = g_get_monotonic_time ();
+
+  for (offset = 0; offset < body.size (); offset += chunk_size) {
+    SoupBuffer *chunk = soup_buffer_new (SOUP_MEMORY_STATIC,
+                                         body.data () + offset,
+                                         MIN (chunk_size, body.size () - offset) );
+
+    soup_message_got_chunk (msg, chunk);
+    soup_buffer_free (chunk);
+  }
+
+  soup_message_finished (msg);
+
+  start = g_get_monotonic_time () - start;
+
+  g_object_unref (msg);
+  g_object_unref (post);
+
+  return start;
+}
+
+static void
+content_extracted ()
+{
+  std::string content = create_content (256 * 1024, 1);
+  std::string body = create_body (content);
+  gsize sizes[] = { 1, 2, 3, 7, 40, 41, 42, 1024, 65536, body.size () };
+
+  for (guint i = 0; i < G_N_ELEMENTS (sizes); i++) {
+    std::string received;
+
+    parse (body, sizes[i], received);
+    BOOST_CHECK_MESSAGE (received == content,
+                         "Wrong content with chunks of " << sizes[i]);
+  }
+}
+
+static void
+throughput ()
+{
+  std::string content = create_content (BENCH_CONTENT_SIZE, 2);
+  std::string body = create_body (content);
+
+  for (gsize size = 1024; size <= 1024 * 1024; size *= 4) {
+    std::string received;
+    gint64 elapsed;
+
+    received.reserve (content.size () );
+    elapsed = parse (body, size, received);
+
+    BOOST_CHECK (received == content);
+    std::cout << "chunk " << size / 1024 << " KB: " <<
+              (body.size () / 1048576.0) / (MAX (elapsed, 1) / 1000000.0) <<
+              " MB/s" << std::endl;
+  }
+}
+
+test_suite *
+init_unit_test_suite ( int , char *[] )
+{
+  test_suite *test = BOOST_TEST_SUITE ( "HttpPost" );
+
+  test->add (BOOST_TEST_CASE ( &content_extracted ), 0, /* timeout */ 20);
+
+  /* timings only, run on demand */
+  if (g_getenv ("BENCHMARK") != NULL) {
+    test->add (BOOST_TEST_CASE ( &throughput ), 0, /* timeout */ 120);
+  }
+
+  return test;
+}